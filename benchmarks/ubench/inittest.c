@@ -0,0 +1,88 @@
+/*
+    Copyright (C) 2008-2009 Computer Sciences Department, 
+    University of Wisconsin -- Madison
+
+    ----------------------------------------------------------------------
+
+    This file is part of the xCalls transactional API, originally 
+    developed at the University of Wisconsin -- Madison.
+
+    xCalls was originally developed primarily by Haris Volos and 
+    Neelam Goyal with contributions from Andres Jaan Tack.
+
+    ----------------------------------------------------------------------
+
+    xCalls is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as 
+    published by the Free Software Foundation, either version 3 of 
+    the License, or (at your option) any later version.
+
+    xCalls is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public 
+    License along with xCalls.  If not, see <http://www.gnu.org/licenses/>.
+
+### END HEADER ###
+*/
+
+/*
+ * Measures the time _TXC_global_init takes and the resident set size 
+ * of the process right after it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <txc/txc.h>
+
+
+static
+long
+rss_kb(void)
+{
+	FILE *fp;
+	char line[256];
+	long rss = -1;
+
+	if ((fp = fopen("/proc/self/status", "r")) == NULL) {
+		return -1;
+	}
+	while (fgets(line, sizeof(line), fp)) {
+		if (strncmp(line, "VmRSS:", 6) == 0) {
+			rss = atol(&line[6]);
+			break;
+		}
+	}
+	fclose(fp);
+	return rss;
+}
+
+
+int
+main(int argc, char *argv[])
+{
+	struct timeval     begin_time;
+	struct timeval     end_time;
+	unsigned long long init_duration;
+	long               rss_before;
+	long               rss_after;
+
+	rss_before = rss_kb();
+	gettimeofday(&begin_time, NULL);
+	_TXC_global_init();
+	_TXC_thread_init();
+	gettimeofday(&end_time, NULL);
+	rss_after = rss_kb();
+
+	init_duration = 1000000 * (end_time.tv_sec - begin_time.tv_sec) +
+	                end_time.tv_usec - begin_time.tv_usec;
+	printf("init duration   : %llu us\n", init_duration);
+	printf("rss before init : %ld KB\n", rss_before);
+	printf("rss after init  : %ld KB\n", rss_after);
+
+	return 0;
+}
@@ -0,0 +1,153 @@
+/*
+    Copyright (C) 2008-2009 Computer Sciences Department, 
+    University of Wisconsin -- Madison
+
+    ----------------------------------------------------------------------
+
+    This file is part of the xCalls transactional API, originally 
+    developed at the University of Wisconsin -- Madison.
+
+    xCalls was originally developed primarily by Haris Volos and 
+    Neelam Goyal with contributions from Andres Jaan Tack.
+
+    ----------------------------------------------------------------------
+
+    xCalls is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as 
+    published by the Free Software Foundation, either version 3 of 
+    the License, or (at your option) any later version.
+
+    xCalls is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public 
+    License along with xCalls.  If not, see <http://www.gnu.org/licenses/>.
+
+### END HEADER ###
+*/
+
+/*
+ * Measures pool allocation and free throughput with 1 to MAX_THREADS 
+ * threads. Each thread repeatedly allocates a small batch of objects and
+ * frees them back.
+ *
+ * Usage: pooltest [-t max_threads] [-n iterations] [-b batch] [-m magazine_size]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <misc/result.h>
+#include <misc/pool.h>
+#include <core/config.h>
+
+#define MAX_THREADS  TXC_MAX_NUM_THREADS
+#define MAX_BATCH    64
+#define OBJ_SIZE     64
+#define OBJ_NUM      (64*1024)
+
+txc_pool_t        *pool;
+pthread_barrier_t barrier;
+int               iterations = 100000;
+int               batch = 8;
+
+
+static
+void *
+worker(void *arg)
+{
+	void *objs[MAX_BATCH];
+	int  i;
+	int  j;
+
+	pthread_barrier_wait(&barrier);
+	for (i=0; i<iterations; i++) {
+		for (j=0; j<batch; j++) {
+			if (txc_pool_object_alloc(pool, &objs[j], 1) != TXC_R_SUCCESS) {
+				fprintf(stderr, "pool exhausted\n");
+				exit(1);
+			}
+		}
+		for (j=batch-1; j>=0; j--) {
+			txc_pool_object_free(pool, &objs[j], 1);
+		}
+	}
+	pthread_barrier_wait(&barrier);
+	return NULL;
+}
+
+
+int
+main(int argc, char *argv[])
+{
+	pthread_t          threads[MAX_THREADS];
+	struct timeval     begin_time;
+	struct timeval     end_time;
+	unsigned long long duration;
+	int                max_threads = MAX_THREADS;
+	int                nthreads;
+	int                i;
+	int                c;
+
+	txc_config_init();
+	while ((c = getopt(argc, argv, "t:n:b:m:")) != -1) {
+		switch (c) {
+			case 't':
+				max_threads = atoi(optarg);
+				break;
+			case 'n':
+				iterations = atoi(optarg);
+				break;
+			case 'b':
+				batch = atoi(optarg);
+				break;
+			case 'm':
+				txc_config_set_option("pool_magazine_size", optarg);
+				break;
+			default:
+				fprintf(stderr, "Usage: %s [-t max_threads] [-n iterations] [-b batch] [-m magazine_size]\n", argv[0]);
+				return 1;
+		}
+	}
+	if (max_threads < 1 || max_threads > MAX_THREADS || 
+	    batch < 1 || batch > MAX_BATCH) 
+	{
+		fprintf(stderr, "threads must be in [1, %d] and batch in [1, %d]\n",
+		        MAX_THREADS, MAX_BATCH);
+		return 1;
+	}
+
+	printf("magazine size: %d\n", txc_runtime_settings.pool_magazine_size);
+	printf("%8s %12s %14s\n", "threads", "time (us)", "ops/sec");
+	for (nthreads = 1; nthreads <= max_threads; nthreads *= 2) {
+		if (txc_pool_create(&pool, OBJ_SIZE, OBJ_NUM, NULL) != TXC_R_SUCCESS) {
+			fprintf(stderr, "cannot create pool\n");
+			return 1;
+		}
+		pthread_barrier_init(&barrier, NULL, nthreads + 1);
+		for (i=0; i<nthreads; i++) {
+			pthread_create(&threads[i], NULL, worker, NULL);
+		}
+		pthread_barrier_wait(&barrier);
+		gettimeofday(&begin_time, NULL);
+		pthread_barrier_wait(&barrier);
+		gettimeofday(&end_time, NULL);
+		for (i=0; i<nthreads; i++) {
+			pthread_join(threads[i], NULL);
+		}
+		pthread_barrier_destroy(&barrier);
+		txc_pool_destroy(&pool);
+
+		duration = 1000000 * (end_time.tv_sec - begin_time.tv_sec) +
+		           end_time.tv_usec - begin_time.tv_usec;
+		printf("%8d %12llu %14.0f\n", nthreads, duration, 
+		       2.0 * nthreads * iterations * batch * 1000000 / 
+		       (duration ? duration : 1));
+	}
+
+	return 0;
+}
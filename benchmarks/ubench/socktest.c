@@ -0,0 +1,407 @@
+/*
+    Copyright (C) 2008-2009 Computer Sciences Department, 
+    University of Wisconsin -- Madison
+
+    ----------------------------------------------------------------------
+
+    This file is part of the xCalls transactional API, originally 
+    developed at the University of Wisconsin -- Madison.
+
+    xCalls was originally developed primarily by Haris Volos and 
+    Neelam Goyal with contributions from Andres Jaan Tack.
+
+    ----------------------------------------------------------------------
+
+    xCalls is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as 
+    published by the Free Software Foundation, either version 3 of 
+    the License, or (at your option) any later version.
+
+    xCalls is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public 
+    License along with xCalls.  If not, see <http://www.gnu.org/licenses/>.
+
+### END HEADER ###
+*/
+
+/*
+ * Loopback stream socket throughput. Every thread owns a TCP connection 
+ * over the loopback interface; each operation sends MSGS_PER_CHUNK 
+ * messages over the connection and receives them back on the other end.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <string.h>
+#include <getopt.h>
+#include <util/ut_barrier.h>
+#include <txc/txc.h>
+
+static const char __whitespaces[] = "                                                              ";
+#define WHITESPACE(len) &__whitespaces[sizeof(__whitespaces) - (len) -1]
+
+#define MAX_NUM_THREADS 16
+#define MSGS_PER_CHUNK  4
+#define MAX_MSG_SIZE    16*1024
+
+typedef enum {
+	SYSTEM_UNKNOWN = -1,
+	SYSTEM_NATIVE = 0,
+	SYSTEM_STM,
+	SYSTEM_XCALLS,
+	num_of_systems
+} system_t;	
+
+char                  *progname = "socktest";
+int                   num_threads = 1;
+int                   msg_size = 1024;
+system_t              system_to_use;
+unsigned long long    duration;
+struct timeval        global_begin_time;
+ut_barrier_t          start_timer_barrier;
+ut_barrier_t          start_ubench_barrier;
+volatile unsigned int short_circuit_terminate;
+unsigned long long    thread_total_ops[MAX_NUM_THREADS];
+unsigned long long    thread_actual_duration[MAX_NUM_THREADS];
+
+typedef struct {
+	unsigned int tid;
+	unsigned int chunks;
+} ubench_args_t;
+
+struct {
+	char     *str;
+	system_t val;
+} systems[] = { 
+	{ "native", SYSTEM_NATIVE},
+	{ "stm", SYSTEM_STM},
+	{ "xcalls", SYSTEM_XCALLS}
+};
+
+struct {
+	int  send_fd;
+	int  recv_fd;
+	char buf[MAX_MSG_SIZE];
+} prepared_state_ubench_sock[MAX_NUM_THREADS];
+
+static void run(void* arg);
+void ubench_native_sock(void *);
+void ubench_stm_sock(void *);
+void ubench_xcalls_sock(void *);
+void prepare_ubench_sock(void *arg);
+
+void (*ubenchf_array[3])(void *) = {
+	ubench_native_sock, ubench_stm_sock, ubench_xcalls_sock
+};	
+
+
+static
+void usage(char *name) 
+{
+	printf("Usage: %s   %s\n", name                    , "--system=SYSTEM_TO_USE");
+	printf("       %s   %s\n", WHITESPACE(strlen(name)), "--duration=DURATION_OF_EXPERIMENT_IN_SECONDS");
+	printf("       %s   %s\n", WHITESPACE(strlen(name)), "--numthreads=NUMBER_OF_THREADS");
+	printf("       %s   %s\n", WHITESPACE(strlen(name)), "--msgsize=MESSAGE_SIZE_IN_BYTES");
+	printf("\nValid arguments:\n");
+	printf("  --system     [native|stm|xcalls]\n");
+	printf("  --numthreads [1-%d]\n", MAX_NUM_THREADS);
+	printf("  --msgsize    [1-%d]\n", MAX_MSG_SIZE);
+	exit(1);
+}
+
+
+int
+main(int argc, char *argv[])
+{
+	extern char        *optarg;
+	pthread_t          threads[MAX_NUM_THREADS];
+	int                c;
+	int                i;
+	unsigned long long total_ops;
+	unsigned long long avg_duration;
+	double             throughput;
+
+	/* Default values */
+	system_to_use = SYSTEM_NATIVE;
+	duration = 30 * 1000 * 1000;
+
+	while (1) {
+		static struct option long_options[] = {
+			{"duration",  required_argument, 0, 'd'},
+			{"system",  required_argument, 0, 's'},
+			{"numthreads", required_argument, 0, 'n'},
+			{"msgsize", required_argument, 0, 'm'},
+			{0, 0, 0, 0}
+		};
+		int option_index = 0;
+     
+		c = getopt_long (argc, argv, "d:s:n:m:",
+		                 long_options, &option_index);
+     
+		/* Detect the end of the options. */
+		if (c == -1)
+			break;
+     
+		switch (c) {
+			case 's':
+				system_to_use = SYSTEM_UNKNOWN;
+				for (i=0; i<num_of_systems; i++) {
+					if (strcmp(systems[i].str, optarg) == 0) {
+						system_to_use = (system_t) i;
+						break;
+					}
+				}
+				if (system_to_use == SYSTEM_UNKNOWN) {
+					usage(progname);
+				}
+				break;
+
+			case 'n':
+				num_threads = atoi(optarg);
+				break;
+
+			case 'm':
+				msg_size = atoi(optarg);
+				break;
+
+			case 'd':
+				duration = atoi(optarg) * 1000 * 1000; 
+				break;
+
+			case '?':
+				/* getopt_long already printed an error message. */
+				usage(progname);
+				break;
+     
+			default:
+				abort ();
+		}
+	}
+
+	if (num_threads < 1 || num_threads > MAX_NUM_THREADS ||
+	    msg_size < 1 || msg_size > MAX_MSG_SIZE) 
+	{
+		usage(progname);
+	}
+
+	ut_barrier_init(&start_timer_barrier, num_threads+1);
+	ut_barrier_init(&start_ubench_barrier, num_threads+1);
+	short_circuit_terminate = 0;
+
+	if (system_to_use == SYSTEM_XCALLS) {
+		_TXC_global_init();
+	}
+
+	for (i=0; i<num_threads; i++) {
+		pthread_create(&threads[i], NULL, (void *(*)(void *)) run, (void *) i);
+	}
+
+	ut_barrier_wait(&start_timer_barrier);
+	gettimeofday(&global_begin_time, NULL);
+	ut_barrier_wait(&start_ubench_barrier);
+
+	total_ops = 0;
+	avg_duration = 0;
+	for (i=0; i<num_threads; i++) {
+		pthread_join(threads[i], NULL);
+		total_ops += thread_total_ops[i];
+		avg_duration += thread_actual_duration[i];
+	}
+	avg_duration = avg_duration/num_threads;
+	throughput = ((double) total_ops) / ((double) avg_duration);
+
+	printf("total operations: %llu\n", total_ops);
+	printf("avg duration    : %llu ms\n", avg_duration/1000);
+	printf("throughput      : %f (ops/s) \n", throughput * 1000 * 1000);
+	printf("throughput      : %f (MB/s) \n", 
+	       throughput * MSGS_PER_CHUNK * msg_size * 1000 * 1000 / (1024 * 1024));
+
+	return 0;
+}
+
+
+static
+void run(void* arg)
+{
+ 	unsigned int       tid = (unsigned int) arg;
+	ubench_args_t      args;
+	void               (*ubenchf)(void *);
+	struct timeval     current_time;
+	unsigned long long experiment_time_duration;
+	unsigned long long n;
+
+	args.tid = tid;
+	args.chunks = 1024;
+
+	if (system_to_use == SYSTEM_XCALLS) {
+		_TXC_thread_init();
+	}	
+
+	ubenchf = ubenchf_array[system_to_use];
+	prepare_ubench_sock(&args);
+
+	ut_barrier_wait(&start_timer_barrier);
+	ut_barrier_wait(&start_ubench_barrier);
+
+	n = 0;
+	do {
+		ubenchf(&args);
+		n++;
+		gettimeofday(&current_time, NULL);
+		experiment_time_duration = 1000000 * (current_time.tv_sec - global_begin_time.tv_sec) +
+		                           current_time.tv_usec - global_begin_time.tv_usec;
+	} while (experiment_time_duration < duration && short_circuit_terminate == 0);
+	
+	short_circuit_terminate = 1;
+	thread_actual_duration[tid] = experiment_time_duration;
+	thread_total_ops[tid] = n * args.chunks;
+}
+
+
+/* 
+ * Creates a connected pair of TCP sockets over the loopback interface.
+ * The sockets are created with the plain system calls; xCalls adopt them
+ * the first time they are used.
+ */
+void prepare_ubench_sock(void *arg)
+{
+ 	unsigned int       tid = ((ubench_args_t *) arg)->tid;
+	struct sockaddr_in addr;
+	socklen_t          addrlen = sizeof(addr);
+	int                listen_fd;
+	int                one = 1;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = 0;
+
+	listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (listen_fd < 0 ||
+	    bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+	    listen(listen_fd, 1) < 0 ||
+	    getsockname(listen_fd, (struct sockaddr *) &addr, &addrlen) < 0)
+	{
+		perror("socktest: listen");
+		exit(1);
+	}
+	prepared_state_ubench_sock[tid].send_fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (connect(prepared_state_ubench_sock[tid].send_fd, 
+	            (struct sockaddr *) &addr, sizeof(addr)) < 0) 
+	{
+		perror("socktest: connect");
+		exit(1);
+	}
+	if ((prepared_state_ubench_sock[tid].recv_fd = accept(listen_fd, NULL, NULL)) < 0) {
+		perror("socktest: accept");
+		exit(1);
+	}
+	setsockopt(prepared_state_ubench_sock[tid].send_fd, IPPROTO_TCP, TCP_NODELAY, 
+	           &one, sizeof(one));
+	close(listen_fd);
+	memset(prepared_state_ubench_sock[tid].buf, 'x', MAX_MSG_SIZE);
+}
+
+
+/* 
+ * NATIVE 
+ */
+
+void ubench_native_sock(void *arg)
+{
+ 	unsigned int   tid = ((ubench_args_t *) arg)->tid;
+ 	unsigned int   chunks = ((ubench_args_t *) arg)->chunks;
+	int            send_fd = prepared_state_ubench_sock[tid].send_fd;
+	int            recv_fd = prepared_state_ubench_sock[tid].recv_fd;
+	char           *buf = prepared_state_ubench_sock[tid].buf;
+	char           rbuf[MAX_MSG_SIZE];
+	int            i;
+	int            j;
+	int            n;
+	
+	for (i=0; i<chunks; i++) {
+		for (j=0; j<MSGS_PER_CHUNK; j++) {
+			send(send_fd, buf, msg_size, 0);
+		}
+		for (n=0; n<MSGS_PER_CHUNK*msg_size; ) {
+			n += recv(recv_fd, rbuf, MAX_MSG_SIZE, 0);
+		}
+	}	
+}
+
+
+/* 
+ * STM 
+ */
+
+void ubench_stm_sock(void *arg)
+{
+ 	unsigned int   tid = ((ubench_args_t *) arg)->tid;
+ 	unsigned int   chunks = ((ubench_args_t *) arg)->chunks;
+	int            send_fd = prepared_state_ubench_sock[tid].send_fd;
+	int            recv_fd = prepared_state_ubench_sock[tid].recv_fd;
+	char           *buf = prepared_state_ubench_sock[tid].buf;
+	char           rbuf[MAX_MSG_SIZE];
+	int            i;
+	int            j;
+	int            n;
+
+	for (i=0; i<chunks; i++) {
+		__tm_atomic {
+			for (j=0; j<MSGS_PER_CHUNK; j++) {
+				send(send_fd, buf, msg_size, 0);
+			}
+		}	
+		__tm_atomic {
+			for (n=0; n<MSGS_PER_CHUNK*msg_size; ) {
+				n += recv(recv_fd, rbuf, MAX_MSG_SIZE, 0);
+			}
+		}	
+	}	
+}
+
+
+/* 
+ * XCALLS 
+ */
+
+void ubench_xcalls_sock(void *arg)
+{
+ 	unsigned int   tid = ((ubench_args_t *) arg)->tid;
+ 	unsigned int   chunks = ((ubench_args_t *) arg)->chunks;
+	int            send_fd = prepared_state_ubench_sock[tid].send_fd;
+	int            recv_fd = prepared_state_ubench_sock[tid].recv_fd;
+	char           *buf = prepared_state_ubench_sock[tid].buf;
+	char           rbuf[MAX_MSG_SIZE];
+	int            i;
+	int            j;
+	int            n;
+
+	for (i=0; i<chunks; i++) {
+		/* Sends are coalesced and issued at commit */
+		XACT_BEGIN(xact_send)
+			for (j=0; j<MSGS_PER_CHUNK; j++) {
+				_XCALL(x_send)(send_fd, buf, msg_size, 0, NULL);
+			}
+		XACT_END(xact_send)	
+		XACT_BEGIN(xact_recv)
+			for (n=0; n<MSGS_PER_CHUNK*msg_size; ) {
+				n += _XCALL(x_recv)(recv_fd, rbuf, MAX_MSG_SIZE, 0, NULL);
+			}
+		XACT_END(xact_recv)	
+	}	
+}
@@ -0,0 +1,437 @@
+/*
+    Copyright (C) 2008-2009 Computer Sciences Department, 
+    University of Wisconsin -- Madison
+
+    ----------------------------------------------------------------------
+
+    This file is part of the xCalls transactional API, originally 
+    developed at the University of Wisconsin -- Madison.
+
+    xCalls was originally developed primarily by Haris Volos and 
+    Neelam Goyal with contributions from Andres Jaan Tack.
+
+    ----------------------------------------------------------------------
+
+    xCalls is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as 
+    published by the Free Software Foundation, either version 3 of 
+    the License, or (at your option) any later version.
+
+    xCalls is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public 
+    License along with xCalls.  If not, see <http://www.gnu.org/licenses/>.
+
+### END HEADER ###
+*/
+
+/*
+ * Loopback datagram receive rate. Every thread owns a pair of UDP sockets
+ * over the loopback interface; each operation sends a burst of datagrams
+ * with plain system calls and receives them back one at a time, so that
+ * varying the burst size shows how receives are batched.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <string.h>
+#include <getopt.h>
+#include <util/ut_barrier.h>
+#include <txc/txc.h>
+
+static const char __whitespaces[] = "                                                              ";
+#define WHITESPACE(len) &__whitespaces[sizeof(__whitespaces) - (len) -1]
+
+#define MAX_NUM_THREADS 16
+#define MAX_BURST       64
+#define MAX_MSG_SIZE    8*1024
+
+typedef enum {
+	SYSTEM_UNKNOWN = -1,
+	SYSTEM_NATIVE = 0,
+	SYSTEM_STM,
+	SYSTEM_XCALLS,
+	num_of_systems
+} system_t;	
+
+char                  *progname = "udptest";
+int                   num_threads = 1;
+int                   msg_size = 64;
+int                   burst = 16;
+system_t              system_to_use;
+unsigned long long    duration;
+struct timeval        global_begin_time;
+ut_barrier_t          start_timer_barrier;
+ut_barrier_t          start_ubench_barrier;
+volatile unsigned int short_circuit_terminate;
+unsigned long long    thread_total_ops[MAX_NUM_THREADS];
+unsigned long long    thread_actual_duration[MAX_NUM_THREADS];
+
+typedef struct {
+	unsigned int tid;
+	unsigned int chunks;
+} ubench_args_t;
+
+struct {
+	char     *str;
+	system_t val;
+} systems[] = { 
+	{ "native", SYSTEM_NATIVE},
+	{ "stm", SYSTEM_STM},
+	{ "xcalls", SYSTEM_XCALLS}
+};
+
+struct {
+	int  send_fd;
+	int  recv_fd;
+	char buf[MAX_MSG_SIZE];
+} prepared_state_ubench_udp[MAX_NUM_THREADS];
+
+static void run(void* arg);
+void ubench_native_udp(void *);
+void ubench_stm_udp(void *);
+void ubench_xcalls_udp(void *);
+void prepare_ubench_udp(void *arg);
+
+void (*ubenchf_array[3])(void *) = {
+	ubench_native_udp, ubench_stm_udp, ubench_xcalls_udp
+};	
+
+
+static
+void usage(char *name) 
+{
+	printf("Usage: %s   %s\n", name                    , "--system=SYSTEM_TO_USE");
+	printf("       %s   %s\n", WHITESPACE(strlen(name)), "--duration=DURATION_OF_EXPERIMENT_IN_SECONDS");
+	printf("       %s   %s\n", WHITESPACE(strlen(name)), "--numthreads=NUMBER_OF_THREADS");
+	printf("       %s   %s\n", WHITESPACE(strlen(name)), "--msgsize=MESSAGE_SIZE_IN_BYTES");
+	printf("       %s   %s\n", WHITESPACE(strlen(name)), "--burst=DATAGRAMS_PER_BURST");
+	printf("\nValid arguments:\n");
+	printf("  --system     [native|stm|xcalls]\n");
+	printf("  --numthreads [1-%d]\n", MAX_NUM_THREADS);
+	printf("  --msgsize    [1-%d]\n", MAX_MSG_SIZE);
+	printf("  --burst      [1-%d]\n", MAX_BURST);
+	exit(1);
+}
+
+
+int
+main(int argc, char *argv[])
+{
+	extern char        *optarg;
+	pthread_t          threads[MAX_NUM_THREADS];
+	int                c;
+	int                i;
+	unsigned long long total_ops;
+	unsigned long long avg_duration;
+	double             throughput;
+
+	/* Default values */
+	system_to_use = SYSTEM_NATIVE;
+	duration = 30 * 1000 * 1000;
+
+	while (1) {
+		static struct option long_options[] = {
+			{"duration",  required_argument, 0, 'd'},
+			{"system",  required_argument, 0, 's'},
+			{"numthreads", required_argument, 0, 'n'},
+			{"msgsize", required_argument, 0, 'm'},
+			{"burst", required_argument, 0, 'b'},
+			{0, 0, 0, 0}
+		};
+		int option_index = 0;
+     
+		c = getopt_long (argc, argv, "d:s:n:m:b:",
+		                 long_options, &option_index);
+     
+		/* Detect the end of the options. */
+		if (c == -1)
+			break;
+     
+		switch (c) {
+			case 's':
+				system_to_use = SYSTEM_UNKNOWN;
+				for (i=0; i<num_of_systems; i++) {
+					if (strcmp(systems[i].str, optarg) == 0) {
+						system_to_use = (system_t) i;
+						break;
+					}
+				}
+				if (system_to_use == SYSTEM_UNKNOWN) {
+					usage(progname);
+				}
+				break;
+
+			case 'n':
+				num_threads = atoi(optarg);
+				break;
+
+			case 'm':
+				msg_size = atoi(optarg);
+				break;
+
+			case 'b':
+				burst = atoi(optarg);
+				break;
+
+			case 'd':
+				duration = atoi(optarg) * 1000 * 1000; 
+				break;
+
+			case '?':
+				/* getopt_long already printed an error message. */
+				usage(progname);
+				break;
+     
+			default:
+				abort ();
+		}
+	}
+
+	if (num_threads < 1 || num_threads > MAX_NUM_THREADS ||
+	    msg_size < 1 || msg_size > MAX_MSG_SIZE ||
+	    burst < 1 || burst > MAX_BURST) 
+	{
+		usage(progname);
+	}
+
+	ut_barrier_init(&start_timer_barrier, num_threads+1);
+	ut_barrier_init(&start_ubench_barrier, num_threads+1);
+	short_circuit_terminate = 0;
+
+	if (system_to_use == SYSTEM_XCALLS) {
+		_TXC_global_init();
+	}
+
+	for (i=0; i<num_threads; i++) {
+		pthread_create(&threads[i], NULL, (void *(*)(void *)) run, (void *) i);
+	}
+
+	ut_barrier_wait(&start_timer_barrier);
+	gettimeofday(&global_begin_time, NULL);
+	ut_barrier_wait(&start_ubench_barrier);
+
+	total_ops = 0;
+	avg_duration = 0;
+	for (i=0; i<num_threads; i++) {
+		pthread_join(threads[i], NULL);
+		total_ops += thread_total_ops[i];
+		avg_duration += thread_actual_duration[i];
+	}
+	avg_duration = avg_duration/num_threads;
+	throughput = ((double) total_ops) / ((double) avg_duration);
+
+	printf("total operations: %llu\n", total_ops);
+	printf("avg duration    : %llu ms\n", avg_duration/1000);
+	printf("throughput      : %f (ops/s) \n", throughput * 1000 * 1000);
+	printf("throughput      : %f (packets/s) \n", throughput * burst * 1000 * 1000);
+
+	return 0;
+}
+
+
+static
+void run(void* arg)
+{
+ 	unsigned int       tid = (unsigned int) arg;
+	ubench_args_t      args;
+	void               (*ubenchf)(void *);
+	struct timeval     current_time;
+	unsigned long long experiment_time_duration;
+	unsigned long long n;
+
+	args.tid = tid;
+	args.chunks = 1024;
+
+	if (system_to_use == SYSTEM_XCALLS) {
+		_TXC_thread_init();
+	}	
+
+	ubenchf = ubenchf_array[system_to_use];
+	prepare_ubench_udp(&args);
+
+	ut_barrier_wait(&start_timer_barrier);
+	ut_barrier_wait(&start_ubench_barrier);
+
+	n = 0;
+	do {
+		ubenchf(&args);
+		n++;
+		gettimeofday(&current_time, NULL);
+		experiment_time_duration = 1000000 * (current_time.tv_sec - global_begin_time.tv_sec) +
+		                           current_time.tv_usec - global_begin_time.tv_usec;
+	} while (experiment_time_duration < duration && short_circuit_terminate == 0);
+	
+	short_circuit_terminate = 1;
+	thread_actual_duration[tid] = experiment_time_duration;
+	thread_total_ops[tid] = n * args.chunks;
+}
+
+
+/* 
+ * Creates a connected pair of UDP sockets over the loopback interface.
+ * The sockets are created with the plain system calls; xCalls adopt them
+ * the first time they are used.
+ */
+void prepare_ubench_udp(void *arg)
+{
+ 	unsigned int       tid = ((ubench_args_t *) arg)->tid;
+	struct sockaddr_in addr;
+	socklen_t          addrlen = sizeof(addr);
+	int                recv_fd;
+	int                send_fd;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = 0;
+
+	recv_fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (recv_fd < 0 ||
+	    bind(recv_fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+	    getsockname(recv_fd, (struct sockaddr *) &addr, &addrlen) < 0)
+	{
+		perror("udptest: bind");
+		exit(1);
+	}
+	send_fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (send_fd < 0 ||
+	    connect(send_fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) 
+	{
+		perror("udptest: connect");
+		exit(1);
+	}
+	prepared_state_ubench_udp[tid].send_fd = send_fd;
+	prepared_state_ubench_udp[tid].recv_fd = recv_fd;
+	memset(prepared_state_ubench_udp[tid].buf, 'x', MAX_MSG_SIZE);
+}
+
+
+static inline
+void send_burst(int send_fd, char *buf)
+{
+	int j;
+
+	for (j=0; j<burst; j++) {
+		send(send_fd, buf, msg_size, 0);
+	}
+}
+
+
+/* 
+ * NATIVE 
+ */
+
+void ubench_native_udp(void *arg)
+{
+ 	unsigned int       tid = ((ubench_args_t *) arg)->tid;
+ 	unsigned int       chunks = ((ubench_args_t *) arg)->chunks;
+	int                send_fd = prepared_state_ubench_udp[tid].send_fd;
+	int                recv_fd = prepared_state_ubench_udp[tid].recv_fd;
+	char               *buf = prepared_state_ubench_udp[tid].buf;
+	char               rbuf[MAX_MSG_SIZE];
+	struct sockaddr_in from;
+	struct iovec       iov;
+	struct msghdr      msg;
+	int                i;
+	int                j;
+	
+	for (i=0; i<chunks; i++) {
+		send_burst(send_fd, buf);
+		for (j=0; j<burst; j++) {
+			iov.iov_base = rbuf;
+			iov.iov_len = MAX_MSG_SIZE;
+			memset(&msg, 0, sizeof(msg));
+			msg.msg_name = &from;
+			msg.msg_namelen = sizeof(from);
+			msg.msg_iov = &iov;
+			msg.msg_iovlen = 1;
+			recvmsg(recv_fd, &msg, 0);
+		}
+	}	
+}
+
+
+/* 
+ * STM 
+ */
+
+void ubench_stm_udp(void *arg)
+{
+ 	unsigned int       tid = ((ubench_args_t *) arg)->tid;
+ 	unsigned int       chunks = ((ubench_args_t *) arg)->chunks;
+	int                send_fd = prepared_state_ubench_udp[tid].send_fd;
+	int                recv_fd = prepared_state_ubench_udp[tid].recv_fd;
+	char               *buf = prepared_state_ubench_udp[tid].buf;
+	char               rbuf[MAX_MSG_SIZE];
+	struct sockaddr_in from;
+	struct iovec       iov;
+	struct msghdr      msg;
+	int                i;
+	int                j;
+
+	for (i=0; i<chunks; i++) {
+		send_burst(send_fd, buf);
+		__tm_atomic {
+			for (j=0; j<burst; j++) {
+				iov.iov_base = rbuf;
+				iov.iov_len = MAX_MSG_SIZE;
+				memset(&msg, 0, sizeof(msg));
+				msg.msg_name = &from;
+				msg.msg_namelen = sizeof(from);
+				msg.msg_iov = &iov;
+				msg.msg_iovlen = 1;
+				recvmsg(recv_fd, &msg, 0);
+			}
+		}	
+	}	
+}
+
+
+/* 
+ * XCALLS 
+ */
+
+void ubench_xcalls_udp(void *arg)
+{
+ 	unsigned int       tid = ((ubench_args_t *) arg)->tid;
+ 	unsigned int       chunks = ((ubench_args_t *) arg)->chunks;
+	int                send_fd = prepared_state_ubench_udp[tid].send_fd;
+	int                recv_fd = prepared_state_ubench_udp[tid].recv_fd;
+	char               *buf = prepared_state_ubench_udp[tid].buf;
+	char               rbuf[MAX_MSG_SIZE];
+	struct sockaddr_in from;
+	struct iovec       iov;
+	struct msghdr      msg;
+	int                i;
+	int                j;
+
+	for (i=0; i<chunks; i++) {
+		send_burst(send_fd, buf);
+		/* The first receive brings in the whole burst */
+		XACT_BEGIN(xact_recv)
+			for (j=0; j<burst; j++) {
+				iov.iov_base = rbuf;
+				iov.iov_len = MAX_MSG_SIZE;
+				memset(&msg, 0, sizeof(msg));
+				msg.msg_name = &from;
+				msg.msg_namelen = sizeof(from);
+				msg.msg_iov = &iov;
+				msg.msg_iovlen = 1;
+				_XCALL(x_recvmsg)(recv_fd, &msg, 0, NULL);
+			}
+		XACT_END(xact_recv)	
+	}	
+}
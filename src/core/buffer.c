@@ -45,22 +45,66 @@
  * they are organized as a per-thread log (<tt>txc_buffer_linear_t</tt>)
  * to reduce fragmentation and bookkeeping overheads.
  *
- * \todo Move circular buffer management code from 
- * <tt>src/xcalls/x_read_pipe.c</tt> and <tt>src/xcalls/x_sendmsg.c</tt> 
- * into this file. 
- * 
+ * Buffers are carved out of address space reservations (regions) made 
+ * with mmap(MAP_NORESERVE), one region for each size class. Nothing 
+ * is committed or zeroed when the manager is created; a page is backed by
+ * memory the first time a buffer touches it. Deployments that cannot 
+ * afford page faults on the first use of a buffer may prefault the 
+ * regions and ask for transparent huge pages through txc.ini 
+ * (buffer_prefault, buffer_hugepages). The sizes of the ring buffers
+ * of pipes, datagram sockets and stream sockets and the size of the 
+ * per-thread linear buffers are configurable there too. Ring buffers 
+ * are mapped when a KOA that needs one is created (see 
+ * <tt>txc_buffer_ring_s</tt>).
  */
 
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
 #include <misc/result.h>
 #include <misc/malloc.h>
-#include <misc/pool.h>
+#include <misc/mutex.h>
 #include <misc/debug.h>
+#include <core/config.h>
 #include <core/buffer.h>
+#include <libc/syscalls.h>
+#include <stdlib.h>
+
+
+typedef void (*txc_buffer_bind_t)(void *header, char *buf, unsigned int size, 
+                                  txc_buffer_region_t *region);
+
+/** 
+ * A region of reserved address space carved into equally sized buffers.
+ * Each buffer is described by a header kept outside the region so that 
+ * allocating a buffer does not touch its pages.
+ */
+struct txc_buffer_region_s {
+	txc_mutex_t  mutex;
+	char         *base;        /**< Start of the reservation. */
+	size_t       length;       /**< Length of the reservation. */
+	unsigned int buffer_size;  /**< Size of each buffer in bytes. */
+	unsigned int num;          /**< Number of buffers. */
+	char         *headers;     /**< Array of buffer headers. */
+	void         **free;       /**< Stack of free buffer headers. */
+	unsigned int free_num;     /**< Number of free buffer headers. */
+};
+
 
 /** Buffer manager */
 struct txc_buffermgr_s {
-	txc_pool_t *pool_buffer_circular; /**< Pool of circular buffers. */
-	txc_pool_t *pool_buffer_linear;   /**< Pool of linear buffers. */
+	unsigned int                ring_size[txc_buffer_num_of_classes]; /**< Size of the ring buffers of each size class. */
+	txc_buffer_region_t         *region_linear;                        /**< Linear buffers. */
+	txc_mutex_t                 segment_mutex;
+	size_t                      segment_size;                          /**< Size of the extra segments of linear buffers. */
+	txc_buffer_linear_segment_t *segment_cache;                        /**< Extra segments kept for reuse. */
+	unsigned int                segment_cache_num;
 };
 
 
@@ -69,32 +113,176 @@ txc_buffermgr_t *txc_g_buffermgr;
 
 static
 void
-circular_buffer_constructor(void *obj)
+linear_buffer_bind(void *header, char *buf, unsigned int size, 
+                   txc_buffer_region_t *region)
 {
-	txc_buffer_circular_t *buffer;
-	buffer  = (txc_buffer_circular_t *) obj;
-	buffer->size_max = TXC_BUFFER_CIRCULAR_SIZE;
-	buffer->buf = (char *) (((char *) obj) + sizeof (txc_buffer_circular_t));
+	txc_buffer_linear_t *buffer = (txc_buffer_linear_t *) header;
+
+	buffer->first.size_max = size;
+	buffer->first.buf = buf;
+	buffer->first.map_len = 0;
+	buffer->first.prev = buffer->first.next = NULL;
+	buffer->region = region;
+	buffer->spill_fd = -1;
+	buffer->clone_fd = -1;
 }
 
 
 static
-void
-linear_buffer_constructor(void *obj)
+void 
+region_destroy(txc_buffer_region_t **regionp)
 {
-	txc_buffer_linear_t *buffer;
+	txc_buffer_region_t *region = *regionp;
 
-	buffer  = (txc_buffer_linear_t *) obj;
-	buffer->size_max = TXC_BUFFER_LINEAR_SIZE;
-	buffer->buf = (char *) (((char *) obj) + sizeof (txc_buffer_linear_t));
+	if (region == NULL) {
+		return;
+	}
+	if (region->base) {
+		munmap(region->base, region->length);
+	}
+	FREE(region->headers);
+	FREE(region->free);
+	FREE(region);
+	*regionp = NULL;
+}
+
+
+/**
+ * \brief Reserves address space for num buffers of buffer_size bytes.
+ *
+ * Only the headers are allocated from the heap. The buffers themselves 
+ * are backed by memory as they get used, unless prefaulting is enabled.
+ */
+static
+txc_result_t
+region_create(txc_buffer_region_t **regionp, 
+              unsigned int buffer_size, 
+              unsigned int num,
+              unsigned int header_size,
+              txc_buffer_bind_t bind)
+{
+	txc_buffer_region_t *region;
+	size_t              page_size = (size_t) sysconf(_SC_PAGESIZE);
+	int                 flags;
+	void                *addr;
+	unsigned int        i;
+
+	/* Keep every buffer page aligned so that buffers don't share pages. */
+	buffer_size = (buffer_size + page_size - 1) & ~(page_size - 1);
+
+	if ((region = (txc_buffer_region_t *) CALLOC(TXC_MALLOC_BUFFER, 1, sizeof(txc_buffer_region_t))) 
+	    == NULL) 
+	{
+		return TXC_R_NOMEMORY;
+	}
+	region->buffer_size = buffer_size;
+	region->num = num;
+	region->length = (size_t) buffer_size * num;
+	/* 
+	 * Headers of buffers owned by different threads must not share a 
+	 * cache line.
+	 */
+	header_size = (header_size + TXC_CACHELINE_SIZE - 1) & 
+	              ~(TXC_CACHELINE_SIZE - 1);
+	if (MEMALIGN(TXC_MALLOC_BUFFER, (void **) &region->headers, TXC_CACHELINE_SIZE, 
+	             (size_t) num * header_size) != 0) 
+	{
+		region->headers = NULL;
+		region_destroy(&region);
+		return TXC_R_NOMEMORY;
+	}
+	memset(region->headers, 0, (size_t) num * header_size);
+	region->free = (void **) CALLOC(TXC_MALLOC_BUFFER, num, sizeof(void *));
+	if (region->free == NULL) {
+		region_destroy(&region);
+		return TXC_R_NOMEMORY;
+	}
+
+	flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+#ifdef MAP_POPULATE
+	if (txc_runtime_settings.buffer_prefault == TXC_BOOL_TRUE) {
+		flags |= MAP_POPULATE;
+	}
+#endif
+	addr = MAP_FAILED;
+#ifdef MAP_HUGETLB
+	/* 
+	 * Prefer reserved huge pages when the region spans whole huge pages 
+	 * and fall back to regular pages if none are available. The huge
+	 * page mapping must not use MAP_NORESERVE: without a reservation the
+	 * mmap would succeed and the first touch would raise SIGBUS instead
+	 * of the mmap failing with ENOMEM.
+	 */
+	if (txc_runtime_settings.buffer_hugepages == TXC_BOOL_TRUE &&
+	    region->length % TXC_HUGEPAGE_SIZE == 0) 
+	{
+		addr = mmap(NULL, region->length, PROT_READ | PROT_WRITE, 
+		            (flags & ~MAP_NORESERVE) | MAP_HUGETLB, -1, 0);
+	}
+#endif
+	if (addr == MAP_FAILED) {
+		addr = mmap(NULL, region->length, PROT_READ | PROT_WRITE, flags, -1, 0);
+		if (addr == MAP_FAILED) {
+			region_destroy(&region);
+			return TXC_R_NOMEMORY;
+		}
+#ifdef MADV_HUGEPAGE
+		if (txc_runtime_settings.buffer_hugepages == TXC_BOOL_TRUE) {
+			/* Only a hint; the kernel may not support transparent huge pages. */
+			madvise(addr, region->length, MADV_HUGEPAGE);
+		}
+#endif
+	}
+	region->base = (char *) addr;
+
+	for (i=0; i<num; i++) {
+		bind(&region->headers[i*header_size], 
+		     &region->base[(size_t) i*buffer_size], 
+		     buffer_size, region);
+		region->free[num-1-i] = &region->headers[i*header_size];
+	}
+	region->free_num = num;
+	if (TXC_MUTEX_INIT(&region->mutex, NULL) != 0) {
+		region_destroy(&region);
+		return TXC_R_NOTINITLOCK;
+	}
+	*regionp = region;
+	return TXC_R_SUCCESS;
+}
+
+
+static inline
+void *
+region_alloc(txc_buffer_region_t *region)
+{
+	void *header = NULL;
+
+	TXC_MUTEX_LOCK(&region->mutex);
+	if (region->free_num > 0) {
+		header = region->free[--region->free_num];
+	}
+	TXC_MUTEX_UNLOCK(&region->mutex);
+	return header;
+}
+
+
+static inline
+void 
+region_free(txc_buffer_region_t *region, void *header)
+{
+	TXC_MUTEX_LOCK(&region->mutex);
+	TXC_ASSERT(region->free_num < region->num);
+	region->free[region->free_num++] = header;
+	TXC_MUTEX_UNLOCK(&region->mutex);
 }
 
 
 /**
  * \brief Creates a buffer manager 
  *
- * It preallocates a pool of circular and linear buffers to make allocation 
- * fast.
+ * It reserves address space for the linear buffers and computes the size 
+ * of the ring buffers of each size class. Buffer sizes come from the 
+ * runtime configuration (in KB).
  *
  * \param[out] buffermgrp The created buffer manager.
  * \return Code indicating success or failure (reason) of the operation.
@@ -103,32 +291,38 @@ txc_result_t
 txc_buffermgr_create(txc_buffermgr_t **buffermgrp) 
 {
 	txc_result_t result;
+	unsigned int size_kb[txc_buffer_num_of_classes];
+	unsigned int page_size = (unsigned int) sysconf(_SC_PAGESIZE);
+	int          i;
 
-	*buffermgrp = (txc_buffermgr_t *) MALLOC(sizeof(txc_buffermgr_t));
+	*buffermgrp = (txc_buffermgr_t *) CALLOC(TXC_MALLOC_BUFFER, 1, sizeof(txc_buffermgr_t));
 	if (*buffermgrp == NULL) {
 		return TXC_R_NOMEMORY;
 	}
 
-	if ((result = txc_pool_create(&((*buffermgrp)->pool_buffer_circular), 
-	                              TXC_BUFFER_CIRCULAR_SIZE +
-                                    sizeof(txc_buffer_circular_t),
-	                              TXC_BUFFER_CIRCULAR_NUM, 
-                                  circular_buffer_constructor)) != TXC_R_SUCCESS) 
-	{
+	size_kb[TXC_BUFFER_CLASS_PIPE] = txc_runtime_settings.buffer_pipe_size;
+	size_kb[TXC_BUFFER_CLASS_SOCK_DGRAM] = txc_runtime_settings.buffer_sock_dgram_size;
+	size_kb[TXC_BUFFER_CLASS_SOCK_STREAM] = txc_runtime_settings.buffer_sock_stream_size;
+	for (i=0; i<txc_buffer_num_of_classes; i++) {
+		/* A ring is mapped twice so its size must be a multiple of a page. */
+		(*buffermgrp)->ring_size[i] = (size_kb[i] * 1024 + page_size - 1) & 
+		                              ~(page_size - 1);
+	}
+	(*buffermgrp)->segment_size = ((size_t) txc_runtime_settings.buffer_linear_size * 1024 + 
+	                               page_size - 1) & ~((size_t) page_size - 1);
+	if (TXC_MUTEX_INIT(&(*buffermgrp)->segment_mutex, NULL) != 0) {
 		FREE(*buffermgrp);
-		return result;
-	}	
-
-	if ((result = txc_pool_create(&((*buffermgrp)->pool_buffer_linear), 
-	                              TXC_BUFFER_LINEAR_SIZE + 
-                                    sizeof(txc_buffer_linear_t),
-	                              TXC_BUFFER_LINEAR_NUM, 
-                                  linear_buffer_constructor)) != TXC_R_SUCCESS) 
+		return TXC_R_NOTINITLOCK;
+	}
+	if ((result = region_create(&((*buffermgrp)->region_linear),
+	                            txc_runtime_settings.buffer_linear_size * 1024,
+	                            TXC_BUFFER_LINEAR_NUM,
+	                            sizeof(txc_buffer_linear_t),
+	                            linear_buffer_bind)) != TXC_R_SUCCESS)
 	{
-		txc_pool_destroy(&((*buffermgrp)->pool_buffer_circular));
-		FREE(*buffermgrp);
+		txc_buffermgr_destroy(buffermgrp);
 		return result;
-	}	
+	}
 
 	return TXC_R_SUCCESS;
 }
@@ -144,8 +338,13 @@ txc_buffermgr_create(txc_buffermgr_t **buffermgrp)
 void
 txc_buffermgr_destroy(txc_buffermgr_t **buffermgrp)
 {
-	txc_pool_destroy(&((*buffermgrp)->pool_buffer_circular));
-	txc_pool_destroy(&((*buffermgrp)->pool_buffer_linear));
+	txc_buffer_linear_segment_t *segment;
+
+	while ((segment = (*buffermgrp)->segment_cache) != NULL) {
+		(*buffermgrp)->segment_cache = segment->next;
+		munmap((void *) segment, segment->map_len);
+	}
+	region_destroy(&((*buffermgrp)->region_linear));
 	FREE(*buffermgrp);
 	*buffermgrp = NULL;
 }
@@ -153,82 +352,144 @@ txc_buffermgr_destroy(txc_buffermgr_t **buffermgrp)
 
 /*
  *****************************************************************************
- ***                    CIRCULAR BUFFER IMPLEMENTATION                     ***  
+ ***                      RING BUFFER IMPLEMENTATION                       ***  
  *****************************************************************************
  */
 
 /**
- * \struct txc_buffer_circular_s
+ * \struct txc_buffer_ring_s
  *
- * \brief A structure to represent a circular buffer.
+ * \brief A structure to represent a ring buffer.
  *
- * The circular buffer is implemented using two queues: a
- * primary queue <primary_head, primary_tail> and a secondary queue
- * <secondary_head, secondary_tail>. 
- * The two queues use a contiguous region of the same buffer (buf) and
- * they never overlap. 
- * Data are copied to the primary queue, and when there is no space, data
- * are copied to the secondary queue. There is no space in a queue if the
- * tail would have to extend beyond the end of the buffer or extend into
- * the buffer region of the other queue.
+ * The ring's storage is a memory file mapped twice, back to back, so that 
+ * buf[i] and buf[i + size_max] are the same byte. Any region of up to 
+ * size_max bytes starting anywhere in the ring is therefore contiguous in 
+ * the virtual address space, even when it wraps around the end of the 
+ * ring. Data are brought in from the kernel with a single system call 
+ * directly at the tail, and handed to the application with a single copy 
+ * from the head, without the internal fragmentation of a scheme that 
+ * keeps regions contiguous by never wrapping.
  *
- * When a primary queue is emptied, the secondary queue becomes the new primary
- * queue and the old primary the new secondary.
- *
- * We chose to implement a circular buffer this way instead of simply using
- * a single pair <head, tail> to avoid wrapping the head and tail pointers 
- * around to the beginning of the buffer region. The wrap around would result
- * in a non-contiguous queue region. When reading data from the kernel (using 
- * a system call) would require either to bring the data into the two separate 
- * regions by doing two system calls or bring the data into an intermediate 
- * contiguous buffer to avoid crossing the kernel-user interface two times. 
- * The downside of using two queues is internal fragmentation.
+ * Head and tail are byte counters that only grow; the position in the 
+ * ring is the counter modulo size_max. The bytes between head and tail 
+ * are buffered. A transaction consumes bytes by advancing 
+ * speculative_head; commit moves head to speculative_head and so frees 
+ * the consumed space, while abort leaves head where it was so that the 
+ * bytes are returned again to the next reader. Data read from the kernel 
+ * advance the tail right away even when the reader aborts later, because 
+ * the kernel cannot take them back.
  */ 
 
 
+/**
+ * \brief Creates the doubly mapped memory file backing a ring.
+ *
+ * \param[in] size The size of the ring. Must be a multiple of the page size.
+ * \param[out] bufp The start of the mapping of 2*size bytes.
+ * \return Code indicating success or failure (reason) of the operation.
+ */
+static
+txc_result_t
+ring_map(unsigned int size, char **bufp)
+{
+	char   path[] = "/dev/shm/txc.ring.XXXXXX";
+	int    fd;
+	int    flags;
+	char   *addr;
+	void   *first;
+	void   *second;
+
+	if ((fd = txc_libc_memfd_create("txc.ring", 0)) < 0) {
+		/* No memfd support; use an unlinked file in shared memory. */
+		if ((fd = mkstemp(path)) < 0) {
+			return TXC_R_NOMEMORY;
+		}
+		unlink(path);
+	}
+	if (ftruncate(fd, size) < 0) {
+		txc_libc_close(fd);
+		return TXC_R_NOMEMORY;
+	}
+
+	/* Reserve both halves and then map the file over each half. */
+	addr = (char *) mmap(NULL, 2 * (size_t) size, PROT_NONE, 
+	                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (addr == MAP_FAILED) {
+		txc_libc_close(fd);
+		return TXC_R_NOMEMORY;
+	}
+	flags = MAP_SHARED | MAP_FIXED;
+#ifdef MAP_POPULATE
+	if (txc_runtime_settings.buffer_prefault == TXC_BOOL_TRUE) {
+		flags |= MAP_POPULATE;
+	}
+#endif
+	first = mmap(addr, size, PROT_READ | PROT_WRITE, flags, fd, 0);
+	second = mmap(addr + size, size, PROT_READ | PROT_WRITE, flags, fd, 0);
+	/* The mappings keep the file alive. */
+	txc_libc_close(fd);
+	if (first == MAP_FAILED || second == MAP_FAILED) {
+		munmap(addr, 2 * (size_t) size);
+		return TXC_R_NOMEMORY;
+	}
+#ifdef MADV_HUGEPAGE
+	if (txc_runtime_settings.buffer_hugepages == TXC_BOOL_TRUE) {
+		madvise(addr, 2 * (size_t) size, MADV_HUGEPAGE);
+	}
+#endif
+	*bufp = addr;
+	return TXC_R_SUCCESS;
+}
+
+
 /** 
- * \brief Initializes an existing circular buffer.
+ * \brief Initializes an existing ring buffer.
  *
  * \param[in] buffer The buffer to be initialized.
  * \return Code indicating success or failure (reason) of the operation.
  */
 txc_result_t 
-txc_buffer_circular_init(txc_buffer_circular_t *buffer)
+txc_buffer_ring_init(txc_buffer_ring_t *buffer)
 {
-
-	buffer->primary_head = 0;
-	buffer->primary_tail = 0;
-	buffer->secondary_head = 0;
-	buffer->secondary_tail = 0;
+	buffer->head = 0;
+	buffer->tail = 0;
+	buffer->speculative_head = 0;
 	buffer->state = TXC_BUFFER_STATE_NON_SPECULATIVE;
 
 	return TXC_R_SUCCESS;
 }
 
+
 /** 
- * \brief Creates and initializes a new circular buffer.
+ * \brief Creates and initializes a new ring buffer.
+ *
+ * The memory of the ring is committed as it gets used.
  *
  * \param[in] buffermgr The buffer manager responsible for the buffer.
+ * \param[in] buffer_class The size class of the buffer.
  * \param[out] bufferp The newly created buffer.
  * \return Code indicating success or failure (reason) of the operation.
  */
 txc_result_t 
-txc_buffer_circular_create(txc_buffermgr_t *buffermgr, 
-                           txc_buffer_circular_t **bufferp)
+txc_buffer_ring_create(txc_buffermgr_t *buffermgr, 
+                       txc_buffer_class_t buffer_class,
+                       txc_buffer_ring_t **bufferp)
 {
-	txc_result_t result;
-	txc_buffer_circular_t *buffer;
+	txc_result_t      result;
+	txc_buffer_ring_t *buffer;
 
-	if ((result = txc_pool_object_alloc(buffermgr->pool_buffer_circular,
-	                                    (void **) &(buffer), 1)) 
-	    != TXC_R_SUCCESS) 
+	if ((buffer = (txc_buffer_ring_t *) MALLOC(TXC_MALLOC_BUFFER, sizeof(txc_buffer_ring_t))) 
+	    == NULL) 
 	{
-		TXC_INTERNALERROR("Could not create buffer object\n");
+		return TXC_R_NOMEMORY;
+	}
+	buffer->size_max = buffermgr->ring_size[buffer_class];
+	if ((result = ring_map(buffer->size_max, &buffer->buf)) != TXC_R_SUCCESS) {
+		FREE(buffer);
 		return result;
 	}
-
 	buffer->manager = buffermgr;
-	txc_buffer_circular_init(buffer);
+	txc_buffer_ring_init(buffer);
 	*bufferp = buffer;
 
 	return TXC_R_SUCCESS;
@@ -236,16 +497,15 @@ txc_buffer_circular_create(txc_buffermgr_t *buffermgr,
 
 
 /** 
- * \brief Destroys a circular buffer.
+ * \brief Destroys a ring buffer.
  *
  * \param[in, out] bufferp The buffer to be destroyed.
  */
 void 
-txc_buffer_circular_destroy(txc_buffer_circular_t **bufferp)
+txc_buffer_ring_destroy(txc_buffer_ring_t **bufferp)
 {
-	txc_buffermgr_t *buffermgr = (*bufferp)->manager;
-
-	txc_pool_object_free(buffermgr->pool_buffer_circular, (void **) bufferp, 1); 
+	munmap((*bufferp)->buf, 2 * (size_t) (*bufferp)->size_max);
+	FREE(*bufferp);
 	*bufferp = NULL;
 }
 
@@ -256,10 +516,116 @@ txc_buffer_circular_destroy(txc_buffer_circular_t **bufferp)
  *****************************************************************************
  */
 
+/**
+ * \struct txc_buffer_linear_s
+ *
+ * \brief A structure to represent a linear buffer.
+ *
+ * A linear buffer is the per-thread log of a transaction. It starts out 
+ * with a single segment of buffer_linear_size KB. A transaction that 
+ * outgrows it chains extra segments, taken from a cache kept by the 
+ * buffer manager, or mapped just for an allocation that doesn't fit in a 
+ * regular segment. Segments are handed back when the buffer is 
+ * reinitialized at the start of the next transaction, so a thread keeps 
+ * only its first segment after a transaction that spiked.
+ *
+ * Data too large to be worth keeping in memory, such as the old contents 
+ * of a large overwrite, can instead be spilled to an unlinked temporary 
+ * file, which is only read back if the transaction aborts. Very large data
+ * are instead cloned to an unlinked file on the filesystem they are on, 
+ * which shares their extents where the filesystem supports reflinks and 
+ * otherwise is copied to within the kernel, so that they never pass 
+ * through memory.
+ */
+
+/** Size of the chunks used to copy data to and from the spill file. */
+#define TXC_BUFFER_LINEAR_SPILL_CHUNK (64*1024)
+
+/** Room at the start of an extra segment taken by its descriptor. */
+#define SEGMENT_HEADER_SIZE ((sizeof(txc_buffer_linear_segment_t) + 15) & ~((size_t) 15))
+
+
+static
+txc_buffer_linear_segment_t *
+segment_get(txc_buffermgr_t *buffermgr, unsigned int size)
+{
+	txc_buffer_linear_segment_t *segment = NULL;
+	size_t                      page_size = (size_t) sysconf(_SC_PAGESIZE);
+	size_t                      map_len;
+	void                        *addr;
+
+	map_len = buffermgr->segment_size;
+	if (size + SEGMENT_HEADER_SIZE > map_len) {
+		/* A segment just for this allocation. */
+		map_len = (size + SEGMENT_HEADER_SIZE + page_size - 1) & ~(page_size - 1);
+	} else {
+		TXC_MUTEX_LOCK(&buffermgr->segment_mutex);
+		if ((segment = buffermgr->segment_cache) != NULL) {
+			buffermgr->segment_cache = segment->next;
+			buffermgr->segment_cache_num--;
+		}
+		TXC_MUTEX_UNLOCK(&buffermgr->segment_mutex);
+	}
+	if (segment == NULL) {
+		addr = mmap(NULL, map_len, PROT_READ | PROT_WRITE, 
+		            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if (addr == MAP_FAILED) {
+			return NULL;
+		}
+		segment = (txc_buffer_linear_segment_t *) addr;
+		segment->buf = (char *) addr + SEGMENT_HEADER_SIZE;
+		segment->size_max = map_len - SEGMENT_HEADER_SIZE;
+		segment->map_len = map_len;
+	}
+	segment->cur_len = 0;
+	segment->prev = segment->next = NULL;
+	return segment;
+}
+
+
+static
+void
+segment_put(txc_buffermgr_t *buffermgr, txc_buffer_linear_segment_t *segment)
+{
+	if (segment->map_len == buffermgr->segment_size) {
+		TXC_MUTEX_LOCK(&buffermgr->segment_mutex);
+		if (buffermgr->segment_cache_num < 
+		    (unsigned int) txc_runtime_settings.buffer_linear_cache) 
+		{
+			segment->next = buffermgr->segment_cache;
+			buffermgr->segment_cache = segment;
+			buffermgr->segment_cache_num++;
+			segment = NULL;
+		}
+		TXC_MUTEX_UNLOCK(&buffermgr->segment_mutex);
+	}
+	if (segment) {
+		munmap((void *) segment, segment->map_len);
+	}
+}
+
+
+/** Gives back all segments following segment. */
+static
+void
+segment_put_chain(txc_buffermgr_t *buffermgr, 
+                  txc_buffer_linear_segment_t *segment)
+{
+	txc_buffer_linear_segment_t *next;
+
+	for (segment = segment->next; segment != NULL; segment = next) {
+		next = segment->next;
+		segment_put(buffermgr, segment);
+	}
+}
+
 
 /** 
  * \brief Initializes an existing linear buffer.
  *
+ * Any extra segments and spilled data of the previous transaction are 
+ * released.
+ *
  * \param[in] buffer The buffer to be initialized.
  * \return Code indicating success or failure (reason) of the operation.
  */
@@ -268,7 +634,21 @@ txc_result_t
 txc_buffer_linear_init(txc_buffer_linear_t *buffer)
 {
 	buffer->state = TXC_BUFFER_STATE_NON_SPECULATIVE;
-	buffer->cur_len = 0;
+	if (buffer->first.next) {
+		segment_put_chain(buffer->manager, &buffer->first);
+		buffer->first.next = NULL;
+	}
+	buffer->first.cur_len = 0;
+	buffer->cur = &buffer->first;
+	if (buffer->spill_len > 0) {
+		/* Give the disk space back. */
+		txc_libc_ftruncate(buffer->spill_fd, 0);
+		buffer->spill_len = 0;
+	}
+	if (buffer->clone_len > 0) {
+		txc_libc_ftruncate(buffer->clone_fd, 0);
+		buffer->clone_len = 0;
+	}
 
 	return TXC_R_SUCCESS;
 }
@@ -285,18 +665,19 @@ txc_result_t
 txc_buffer_linear_create(txc_buffermgr_t *buffermgr, 
                          txc_buffer_linear_t **bufferp)
 {
-	txc_result_t result;
 	txc_buffer_linear_t *buffer;
 
-	if ((result = txc_pool_object_alloc(buffermgr->pool_buffer_linear,
-	                                    (void **) &(buffer), 1)) 
-	    != TXC_R_SUCCESS) 
+	if ((buffer = (txc_buffer_linear_t *) region_alloc(buffermgr->region_linear))
+	    == NULL) 
 	{
 		TXC_INTERNALERROR("Could not create buffer object\n");
-		return result;
+		return TXC_R_NOMEMORY;
 	}
 
 	buffer->manager = buffermgr;
+	buffer->first.next = NULL;
+	buffer->spill_len = 0;
+	buffer->clone_len = 0;
 	txc_buffer_linear_init(buffer);
 	*bufferp = buffer;
 
@@ -312,9 +693,19 @@ txc_buffer_linear_create(txc_buffermgr_t *buffermgr,
 void 
 txc_buffer_linear_destroy(txc_buffer_linear_t **bufferp)
 {
-	txc_buffermgr_t *buffermgr = (*bufferp)->manager;
+	txc_buffer_linear_t *buffer = *bufferp;
 
-	txc_pool_object_free(buffermgr->pool_buffer_linear, (void **) bufferp, 1); 
+	segment_put_chain(buffer->manager, &buffer->first);
+	buffer->first.next = NULL;
+	if (buffer->spill_fd >= 0) {
+		txc_libc_close(buffer->spill_fd);
+		buffer->spill_fd = -1;
+	}
+	if (buffer->clone_fd >= 0) {
+		txc_libc_close(buffer->clone_fd);
+		buffer->clone_fd = -1;
+	}
+	region_free(buffer->region, (void *) buffer); 
 	*bufferp = NULL;
 }
 
@@ -322,6 +713,8 @@ txc_buffer_linear_destroy(txc_buffer_linear_t **bufferp)
 /**
  * \brief Allocates a linear region from a linear buffer.
  *
+ * The buffer grows by another segment when the current one is full.
+ *
  * \param[in] buffer The buffer from which the region is allocated.
  * \param[in] size The size of the region to be allocated.
  * \return A pointer to the allocated region or NULL if allocated failed.
@@ -329,14 +722,31 @@ txc_buffer_linear_destroy(txc_buffer_linear_t **bufferp)
 void *
 txc_buffer_linear_malloc(txc_buffer_linear_t *buffer, unsigned int size)
 {
-	void *ptr;
+	txc_buffer_linear_segment_t *segment = buffer->cur;
+	txc_buffer_linear_segment_t *next;
+	void                        *ptr;
 
-	if (buffer->cur_len + size > buffer->size_max) {
-		ptr = NULL;	
-	} else {
-		ptr = (void *) &buffer->buf[buffer->cur_len];
-		buffer->cur_len += size;
+	if (segment->cur_len + size > segment->size_max) {
+		/* 
+		 * Move on to the next segment. Segments following the current 
+		 * one are empty since regions are freed in reverse order.
+		 */
+		if ((next = segment->next) == NULL || size > next->size_max) {
+			if (next) {
+				segment_put_chain(buffer->manager, segment);
+				segment->next = NULL;
+			}
+			if ((next = segment_get(buffer->manager, size)) == NULL) {
+				return NULL;
+			}
+			next->prev = segment;
+			segment->next = next;
+		}
+		next->cur_len = 0;
+		buffer->cur = segment = next;
 	}
+	ptr = (void *) &segment->buf[segment->cur_len];
+	segment->cur_len += size;
 	return ptr;
 }
 
@@ -354,5 +764,338 @@ txc_buffer_linear_malloc(txc_buffer_linear_t *buffer, unsigned int size)
 void
 txc_buffer_linear_free(txc_buffer_linear_t *buffer, unsigned int size)
 {
-	buffer->cur_len -= size;
+	txc_buffer_linear_segment_t *segment = buffer->cur;
+
+	while (segment->cur_len == 0 && segment->prev) {
+		segment = segment->prev;
+	}
+	segment->cur_len -= size;
+	buffer->cur = segment;
+}
+
+
+static
+txc_result_t
+spill_open(txc_buffer_linear_t *buffer)
+{
+	char       path[256];
+	const char *dir;
+
+	if (buffer->spill_fd >= 0) {
+		return TXC_R_SUCCESS;
+	}
+	if ((dir = getenv("TMPDIR")) == NULL || 
+	    snprintf(path, sizeof(path), "%s/txc.spill.XXXXXX", dir) >= 
+	    (int) sizeof(path)) 
+	{
+		strcpy(path, "/tmp/txc.spill.XXXXXX");
+	}
+	if ((buffer->spill_fd = mkstemp(path)) < 0) {
+		return TXC_R_FAILURE;
+	}
+	unlink(path);
+	return TXC_R_SUCCESS;
+}
+
+
+/**
+ * \brief Saves data of a file in the spill file of a linear buffer.
+ *
+ * \param[in] buffer The buffer whose spill file keeps the data.
+ * \param[in] fd The file to read the data from.
+ * \param[in] nbyte The number of bytes to save.
+ * \param[in] offset Where in fd to start reading from.
+ * \param[out] spill_offsetp Where the data are kept in the spill file.
+ * \return The number of bytes saved, which is less than nbyte if the end 
+ * of fd was reached, or -1 if a failure occurred (in which case, errno is
+ * set appropriately).
+ */
+ssize_t
+txc_buffer_linear_spill(txc_buffer_linear_t *buffer, int fd, size_t nbyte, 
+                        off_t offset, off_t *spill_offsetp)
+{
+	char    *chunk;
+	size_t  len;
+	size_t  done;
+	ssize_t ret;
+
+	if (spill_open(buffer) != TXC_R_SUCCESS) {
+		return -1;
+	}
+	if ((chunk = (char *) txc_buffer_linear_malloc(buffer, 
+	                                               TXC_BUFFER_LINEAR_SPILL_CHUNK))
+	    == NULL)
+	{
+		errno = ENOMEM;
+		return -1;
+	}
+	*spill_offsetp = buffer->spill_len;
+	for (done = 0; done < nbyte; done += ret) {
+		len = nbyte - done;
+		if (len > TXC_BUFFER_LINEAR_SPILL_CHUNK) {
+			len = TXC_BUFFER_LINEAR_SPILL_CHUNK;
+		}
+		if ((ret = txc_libc_pread(fd, chunk, len, offset + done)) < 0) {
+			if (errno == EINTR) {
+				ret = 0;
+				continue;
+			}
+			goto error;
+		}
+		if (ret == 0) {
+			/* End of file */
+			break;
+		}
+		if (txc_libc_pwrite(buffer->spill_fd, chunk, ret, 
+		                    buffer->spill_len + done) != ret) 
+		{
+			goto error;
+		}
+	}
+	buffer->spill_len += done;
+	txc_buffer_linear_free(buffer, TXC_BUFFER_LINEAR_SPILL_CHUNK);
+	return done;
+
+error:
+	txc_buffer_linear_free(buffer, TXC_BUFFER_LINEAR_SPILL_CHUNK);
+	return -1;
+}
+
+
+static
+ssize_t
+copy_chunked(txc_buffer_linear_t *buffer, int fd_in, off_t offset_in, 
+             int fd_out, size_t nbyte, off_t offset_out)
+{
+	char    *chunk;
+	size_t  len;
+	size_t  done;
+	ssize_t ret;
+
+	if ((chunk = (char *) txc_buffer_linear_malloc(buffer, 
+	                                               TXC_BUFFER_LINEAR_SPILL_CHUNK))
+	    == NULL)
+	{
+		errno = ENOMEM;
+		return -1;
+	}
+	for (done = 0; done < nbyte; done += ret) {
+		len = nbyte - done;
+		if (len > TXC_BUFFER_LINEAR_SPILL_CHUNK) {
+			len = TXC_BUFFER_LINEAR_SPILL_CHUNK;
+		}
+		if ((ret = txc_libc_pread(fd_in, chunk, len, offset_in + done)) <= 0) {
+			if (ret == 0) {
+				errno = EIO;
+			}
+			goto error;
+		}
+		if (txc_libc_pwrite(fd_out, chunk, ret, offset_out + done) != ret) {
+			goto error;
+		}
+	}
+	txc_buffer_linear_free(buffer, TXC_BUFFER_LINEAR_SPILL_CHUNK);
+	return done;
+
+error:
+	txc_buffer_linear_free(buffer, TXC_BUFFER_LINEAR_SPILL_CHUNK);
+	return -1;
+}
+
+
+/**
+ * Copies [offset_in, offset_in+nbyte) of fd_in to offset_out of fd_out 
+ * without going through user memory, sharing the extents if possible. 
+ * Copies less than nbyte only if the end of fd_in is reached.
+ */
+static
+ssize_t
+copy_range(int fd_in, off_t offset_in, int fd_out, size_t nbyte, 
+           off_t offset_out)
+{
+	size_t  done;
+	ssize_t ret;
+
+	if (txc_libc_clone_range(fd_out, offset_out, fd_in, offset_in, nbyte) 
+	    == 0) 
+	{
+		return nbyte;
+	}
+	for (done = 0; done < nbyte; done += ret) {
+		if ((ret = txc_libc_copy_file_range(fd_in, &offset_in, fd_out, 
+		                                    &offset_out, nbyte - done, 0)) 
+		    < 0)
+		{
+			if (errno == EINTR) {
+				ret = 0;
+				continue;
+			}
+			return -1;
+		}
+		if (ret == 0) {
+			/* End of file */
+			break;
+		}
+	}
+	return done;
+}
+
+
+static
+txc_result_t
+clone_open(txc_buffer_linear_t *buffer, int fd, dev_t dev)
+{
+	char path[64];
+	char dir[PATH_MAX];
+	char *slash;
+	int  len;
+
+	if (buffer->clone_fd >= 0) {
+		if (buffer->clone_dev == dev) {
+			return TXC_R_SUCCESS;
+		}
+		if (buffer->clone_len > 0) {
+			/* Already keeps data of a file on another filesystem. */
+			return TXC_R_FAILURE;
+		}
+		txc_libc_close(buffer->clone_fd);
+		buffer->clone_fd = -1;
+	}
+	/* The clone file goes next to the file, so that they share a filesystem. */
+	snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+	if ((len = readlink(path, dir, sizeof(dir) - 1)) <= 0) {
+		return TXC_R_FAILURE;
+	}
+	dir[len] = '\0';
+	if ((slash = strrchr(dir, '/')) == NULL) {
+		return TXC_R_FAILURE;
+	}
+	*(slash == dir ? slash + 1 : slash) = '\0';
+#ifdef O_TMPFILE
+	buffer->clone_fd = open(dir, O_TMPFILE | O_RDWR, S_IRUSR | S_IWUSR);
+#endif
+	if (buffer->clone_fd < 0) {
+		if (strlen(dir) + sizeof("/.txc.clone.XXXXXX") > sizeof(dir)) {
+			return TXC_R_FAILURE;
+		}
+		strcat(dir, "/.txc.clone.XXXXXX");
+		if ((buffer->clone_fd = mkstemp(dir)) < 0) {
+			return TXC_R_FAILURE;
+		}
+		unlink(dir);
+	}
+	buffer->clone_dev = dev;
+	return TXC_R_SUCCESS;
+}
+
+
+/**
+ * \brief Saves data of a file in the clone file of a linear buffer.
+ *
+ * The data are cloned if the filesystem of fd supports reflinks and 
+ * otherwise copied within the kernel. 
+ *
+ * \param[in] buffer The buffer whose clone file keeps the data.
+ * \param[in] fd The file to save the data of.
+ * \param[in] nbyte The number of bytes to save.
+ * \param[in] offset Where in fd the data start.
+ * \param[out] clone_offsetp Where the data are kept in the clone file.
+ * \return The number of bytes saved, which is less than nbyte if the end 
+ * of fd was reached, or -1 if the data could not be saved this way (in 
+ * which case, errno is set appropriately).
+ */
+ssize_t
+txc_buffer_linear_clone(txc_buffer_linear_t *buffer, int fd, size_t nbyte, 
+                        off_t offset, off_t *clone_offsetp)
+{
+	struct stat stat_buf;
+	off_t       clone_offset;
+	ssize_t     ret;
+
+	if (txc_libc_fstat(fd, &stat_buf) < 0) {
+		return -1;
+	}
+	if (offset >= stat_buf.st_size) {
+		*clone_offsetp = buffer->clone_len;
+		return 0;
+	}
+	if (nbyte > (size_t) (stat_buf.st_size - offset)) {
+		nbyte = stat_buf.st_size - offset;
+	}
+	if (clone_open(buffer, fd, stat_buf.st_dev) != TXC_R_SUCCESS) {
+		errno = EXDEV;
+		return -1;
+	}
+	/* Extents can be shared only at block boundaries. */
+	clone_offset = buffer->clone_len;
+	if (stat_buf.st_blksize > 0) {
+		clone_offset = (clone_offset + stat_buf.st_blksize - 1) / 
+		               stat_buf.st_blksize * stat_buf.st_blksize;
+	}
+	if ((ret = copy_range(fd, offset, buffer->clone_fd, nbyte, 
+	                      clone_offset)) 
+	    < 0)
+	{
+		return -1;
+	}
+	buffer->clone_len = clone_offset + ret;
+	*clone_offsetp = clone_offset;
+	return ret;
+}
+
+
+/**
+ * \brief Writes data saved by txc_buffer_linear_clone back to a file.
+ *
+ * \param[in] buffer The buffer whose clone file keeps the data.
+ * \param[in] clone_offset Where the data are kept in the clone file.
+ * \param[in] fd The file to write the data to.
+ * \param[in] nbyte The number of bytes to write.
+ * \param[in] offset Where in fd to write the data.
+ * \return The number of bytes written, or -1 if a failure occurred (in 
+ * which case, errno is set appropriately).
+ */
+ssize_t
+txc_buffer_linear_unclone(txc_buffer_linear_t *buffer, off_t clone_offset, 
+                          int fd, size_t nbyte, off_t offset)
+{
+	ssize_t ret;
+
+	if ((ret = copy_range(buffer->clone_fd, clone_offset, fd, nbyte, offset))
+	    == (ssize_t) nbyte) 
+	{
+		return ret;
+	}
+	if (ret > 0) {
+		clone_offset += ret;
+		offset += ret;
+		nbyte -= ret;
+	}
+	/* The kernel would not copy between the files; copy through memory. */
+	if (copy_chunked(buffer, buffer->clone_fd, clone_offset, fd, nbyte, 
+	                 offset) < 0)
+	{
+		return -1;
+	}
+	return nbyte + (ret > 0 ? ret : 0);
+}
+
+
+/**
+ * \brief Writes data saved by txc_buffer_linear_spill back to a file.
+ *
+ * \param[in] buffer The buffer whose spill file keeps the data.
+ * \param[in] spill_offset Where the data are kept in the spill file.
+ * \param[in] fd The file to write the data to.
+ * \param[in] nbyte The number of bytes to write.
+ * \param[in] offset Where in fd to write the data.
+ * \return The number of bytes written, or -1 if a failure occurred (in 
+ * which case, errno is set appropriately).
+ */
+ssize_t
+txc_buffer_linear_unspill(txc_buffer_linear_t *buffer, off_t spill_offset, 
+                          int fd, size_t nbyte, off_t offset)
+{
+	return copy_chunked(buffer, buffer->spill_fd, spill_offset, fd, nbyte, 
+	                    offset);
 }
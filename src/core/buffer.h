@@ -37,23 +37,31 @@
 #ifndef _TXC_BUFFER_H
 #define _TXC_BUFFER_H
 
+#include <sys/types.h>
 #include <misc/result.h>
+#include <core/config.h>
 
-#define TXC_BUFFER_CIRCULAR_SIZE        1024*(64*2)*64
-#define TXC_BUFFER_CIRCULAR_NUM         32
-#define TXC_BUFFER_LINEAR_SIZE          1024*256
-#define TXC_BUFFER_LINEAR_NUM           32
+#define TXC_BUFFER_LINEAR_NUM           TXC_MAX_NUM_THREADS
 
 typedef enum {
 	TXC_BUFFER_STATE_NON_SPECULATIVE = 0,
 	TXC_BUFFER_STATE_SPECULATIVE = 1
 } txc_buffer_state_t;
 
+/** Size classes of ring buffers; one for each KOA type that buffers input. */
+typedef enum {
+	TXC_BUFFER_CLASS_PIPE = 0,
+	TXC_BUFFER_CLASS_SOCK_DGRAM = 1,
+	TXC_BUFFER_CLASS_SOCK_STREAM = 2,
+	txc_buffer_num_of_classes
+} txc_buffer_class_t;
+
 typedef struct txc_buffermgr_s txc_buffermgr_t;
-typedef struct txc_buffer_circular_s txc_buffer_circular_t;
+typedef struct txc_buffer_ring_s txc_buffer_ring_t;
 typedef struct txc_buffer_linear_s txc_buffer_linear_t;
-typedef struct txc_buffer_circular_memento_s txc_buffer_circular_memento_t;
+typedef struct txc_buffer_linear_segment_s txc_buffer_linear_segment_t;
 typedef struct txc_buffer_linear_memento_s txc_buffer_linear_memento_t;
+typedef struct txc_buffer_region_s txc_buffer_region_t;
 
 extern txc_buffermgr_t *txc_g_buffermgr;
 
@@ -62,31 +70,44 @@ extern txc_buffermgr_t *txc_g_buffermgr;
  * for better performance.
  */
 
-struct txc_buffer_circular_s {
+struct txc_buffer_ring_s {
 	txc_buffermgr_t    *manager;
-	char               *buf;
+	char               *buf;              /**< 2*size_max bytes; the second half mirrors the first */
 	unsigned int       size_max;
-	unsigned int       primary_head;
-	unsigned int       primary_tail;
-	unsigned int       secondary_head;
-	unsigned int       secondary_tail;
-	unsigned int       speculative_primary_head;
-	unsigned int       speculative_primary_tail;
-	unsigned int       speculative_secondary_head;
-	unsigned int       speculative_secondary_tail;
+	unsigned long long head;              /**< Committed read position */
+	unsigned long long tail;              /**< Write position */
+	unsigned long long speculative_head;  /**< Read position of the transaction consuming the ring */
 	txc_buffer_state_t state;
 };
 
 
+/**
+ * A piece of contiguous memory of a linear buffer.
+ */
+struct txc_buffer_linear_segment_s {
+	char                        *buf;
+	unsigned int                size_max;
+	unsigned int                cur_len;
+	txc_buffer_linear_segment_t *prev;      /**< Previous segment of the buffer */
+	txc_buffer_linear_segment_t *next;      /**< Next segment of the buffer, or of the manager's cache */
+	size_t                      map_len;    /**< Length of the mapping holding the segment; 0 for the first segment */
+};
+
+
 /**
  * A structure to represent a linear buffer. 
  */
 struct txc_buffer_linear_s {
-	txc_buffermgr_t    *manager;
-	char               *buf;
-	unsigned int       size_max;
-	unsigned int       cur_len;
-	txc_buffer_state_t state;
+	txc_buffermgr_t             *manager;
+	txc_buffer_linear_segment_t *cur;       /**< Segment allocations are served from */
+	txc_buffer_linear_segment_t first;      /**< Segment always owned by the buffer */
+	txc_buffer_state_t          state;
+	txc_buffer_region_t         *region;
+	int                         spill_fd;   /**< Unlinked file keeping spilled data; -1 if none */
+	off_t                       spill_len;
+	int                         clone_fd;   /**< Unlinked file keeping cloned data; -1 if none */
+	dev_t                       clone_dev;  /**< Filesystem of the clone file */
+	off_t                       clone_len;
 };
 
 
@@ -94,14 +115,150 @@ struct txc_buffer_linear_s {
 txc_result_t txc_buffermgr_create(txc_buffermgr_t **);
 void txc_buffermgr_destroy(txc_buffermgr_t **);
 
-txc_result_t txc_buffer_circular_create(txc_buffermgr_t *buffermgr, txc_buffer_circular_t **bufferp);
-void txc_buffer_circular_destroy(txc_buffer_circular_t **bufferp);
-txc_result_t txc_buffer_circular_init(txc_buffer_circular_t *buffer);
+txc_result_t txc_buffer_ring_create(txc_buffermgr_t *buffermgr, txc_buffer_class_t buffer_class, txc_buffer_ring_t **bufferp);
+void txc_buffer_ring_destroy(txc_buffer_ring_t **bufferp);
+txc_result_t txc_buffer_ring_init(txc_buffer_ring_t *buffer);
 
 txc_result_t txc_buffer_linear_create(txc_buffermgr_t *buffermgr, txc_buffer_linear_t **bufferp);
 void txc_buffer_linear_destroy(txc_buffer_linear_t **bufferp);
 txc_result_t txc_buffer_linear_init(txc_buffer_linear_t *buffer);
 void *txc_buffer_linear_malloc(txc_buffer_linear_t *buffer, unsigned int size);
 void txc_buffer_linear_free(txc_buffer_linear_t *buffer, unsigned int size);
+ssize_t txc_buffer_linear_spill(txc_buffer_linear_t *buffer, int fd, size_t nbyte, off_t offset, off_t *spill_offsetp);
+ssize_t txc_buffer_linear_unspill(txc_buffer_linear_t *buffer, off_t spill_offset, int fd, size_t nbyte, off_t offset);
+ssize_t txc_buffer_linear_clone(txc_buffer_linear_t *buffer, int fd, size_t nbyte, off_t offset, off_t *clone_offsetp);
+ssize_t txc_buffer_linear_unclone(txc_buffer_linear_t *buffer, off_t clone_offset, int fd, size_t nbyte, off_t offset);
+
+
+/** 
+ * Whether data of size bytes should be spilled to a file instead of being 
+ * kept in the linear buffer.
+ */
+static inline
+int
+txc_buffer_linear_spillable(size_t size)
+{
+	return (txc_runtime_settings.buffer_linear_spill_size > 0 &&
+	        size > (size_t) txc_runtime_settings.buffer_linear_spill_size * 1024);
+}
+
+
+/** 
+ * Whether data of size bytes should be cloned to a file on the filesystem 
+ * they are on instead of being copied.
+ */
+static inline
+int
+txc_buffer_linear_clonable(size_t size)
+{
+	return (txc_runtime_settings.buffer_linear_clone_size > 0 &&
+	        size > (size_t) txc_runtime_settings.buffer_linear_clone_size * 1024);
+}
+
+
+/** Number of bytes buffered, or not yet consumed by the speculative reader. */
+static inline
+unsigned int
+txc_buffer_ring_used(txc_buffer_ring_t *buffer, int speculative)
+{
+	if (speculative) {
+		return (unsigned int) (buffer->tail - buffer->speculative_head);
+	}
+	return (unsigned int) (buffer->tail - buffer->head);
+}
+
+
+/** Number of bytes that can be written at the tail. */
+static inline
+unsigned int
+txc_buffer_ring_space(txc_buffer_ring_t *buffer)
+{
+	return buffer->size_max - (unsigned int) (buffer->tail - buffer->head);
+}
+
+
+/** 
+ * Start of the buffered data. Up to txc_buffer_ring_used bytes are 
+ * contiguous from there.
+ */
+static inline
+char *
+txc_buffer_ring_head_ptr(txc_buffer_ring_t *buffer, int speculative)
+{
+	if (speculative) {
+		return &buffer->buf[buffer->speculative_head % buffer->size_max];
+	}
+	return &buffer->buf[buffer->head % buffer->size_max];
+}
+
+
+/** 
+ * Where to write new data. Up to txc_buffer_ring_space bytes are 
+ * contiguous from there.
+ */
+static inline
+char *
+txc_buffer_ring_tail_ptr(txc_buffer_ring_t *buffer)
+{
+	return &buffer->buf[buffer->tail % buffer->size_max];
+}
+
+
+/** Appends len bytes written at the tail. */
+static inline
+void
+txc_buffer_ring_produce(txc_buffer_ring_t *buffer, unsigned int len)
+{
+	buffer->tail += len;
+}
+
+
+/** Consumes len bytes from the head. */
+static inline
+void
+txc_buffer_ring_consume(txc_buffer_ring_t *buffer, unsigned int len, 
+                        int speculative)
+{
+	if (speculative) {
+		buffer->speculative_head += len;
+	} else {
+		buffer->head += len;
+		if (buffer->head == buffer->tail) {
+			/* Start over at the beginning of the ring to stay warm. */
+			buffer->head = buffer->tail = 0;
+		}
+	}
+}
+
+
+/** Starts consumption of the ring by a transaction. */
+static inline
+void
+txc_buffer_ring_speculate(txc_buffer_ring_t *buffer)
+{
+	buffer->speculative_head = buffer->head;
+	buffer->state = TXC_BUFFER_STATE_SPECULATIVE;
+}
+
+
+/** Makes the speculative consumption of the ring permanent. */
+static inline
+void
+txc_buffer_ring_commit(txc_buffer_ring_t *buffer)
+{
+	txc_buffer_ring_consume(buffer, 
+	                        (unsigned int) (buffer->speculative_head - buffer->head), 
+	                        0);
+	buffer->state = TXC_BUFFER_STATE_NON_SPECULATIVE;
+}
+
+
+/** Drops the speculative consumption of the ring. */
+static inline
+void
+txc_buffer_ring_abort(txc_buffer_ring_t *buffer)
+{
+	buffer->state = TXC_BUFFER_STATE_NON_SPECULATIVE;
+}
 
 #endif
@@ -77,7 +77,43 @@
   ACTION(sentinel_max_spin_retries, integer, int, int, 0,                    \
          VALIDVAL2(0, 1000), 2)                                              \
   ACTION(sentinel_max_backoff_time, integer, int, int, 0,                    \
-         VALIDVAL2(0, 1000), 2)                                              
+         VALIDVAL2(0, 1000), 2)                                              \
+  ACTION(koa_fdcache_size, integer, int, int, 0,                             \
+         VALIDVAL2(0, TXC_KOA_FDCACHE_MAX_SIZE), 2)                          \
+  ACTION(buffer_pipe_size, integer, int, int, 8192,                          \
+         VALIDVAL2(4, TXC_BUFFER_MAX_SIZE_KB), 2)                            \
+  ACTION(buffer_sock_dgram_size, integer, int, int, 8192,                    \
+         VALIDVAL2(64, TXC_BUFFER_MAX_SIZE_KB), 2)                           \
+  ACTION(buffer_sock_stream_size, integer, int, int, 8192,                   \
+         VALIDVAL2(4, TXC_BUFFER_MAX_SIZE_KB), 2)                            \
+  ACTION(buffer_linear_size, integer, int, int, 256,                         \
+         VALIDVAL2(4, TXC_BUFFER_MAX_SIZE_KB), 2)                            \
+  ACTION(buffer_linear_cache, integer, int, int, 16,                         \
+         VALIDVAL2(0, 1024), 2)                                              \
+  ACTION(buffer_linear_spill_size, integer, int, int, 1024,                  \
+         VALIDVAL2(0, TXC_BUFFER_MAX_SIZE_KB), 2)                            \
+  ACTION(buffer_linear_clone_size, integer, int, int, 4096,                  \
+         VALIDVAL2(0, TXC_BUFFER_MAX_SIZE_KB), 2)                            \
+  ACTION(journal, string, char *, char *, "",                                \
+         VALIDVAL0, 0)                                                       \
+  ACTION(journal_checkpoint_size, integer, int, int, 65536,                  \
+         VALIDVAL2(0, 1048576), 2)                                           \
+  ACTION(io_uring, boolean, txc_bool_t, char *, TXC_BOOL_FALSE,              \
+         VALIDVAL2("enable", "disable"), 2)                                  \
+  ACTION(commit_helper_threads, integer, int, int, 0,                        \
+         VALIDVAL2(0, TXC_COMMIT_HELPER_THREADS_MAX), 2)                     \
+  ACTION(sock_recv_batch, integer, int, int, 16,                             \
+         VALIDVAL2(1, TXC_SOCK_RECV_BATCH_MAX), 2)                           \
+  ACTION(buffer_prefault, boolean, txc_bool_t, char *, TXC_BOOL_FALSE,       \
+         VALIDVAL2("enable", "disable"), 2)                                  \
+  ACTION(buffer_hugepages, boolean, txc_bool_t, char *, TXC_BOOL_FALSE,      \
+         VALIDVAL2("enable", "disable"), 2)                                  \
+  ACTION(pool_magazine_size, integer, int, int, 32,                          \
+         VALIDVAL2(0, TXC_POOL_MAGAZINE_MAX_SIZE), 2)                        \
+  ACTION(pool_hugepages, boolean, txc_bool_t, char *, TXC_BOOL_FALSE,        \
+         VALIDVAL2("enable", "disable"), 2)                                  \
+  ACTION(allocator, string, char *, char *, "libc",                          \
+         VALIDVAL2("libc", "arena"), 2)                                      
 
 
 #define CONFIG_OPTION_ENTRY(name,                                            \
@@ -115,12 +151,39 @@ txc_result_t txc_config_set_option(char *option, char *value);
 
 /** Initial sizes of the per descriptor commit and undo action lists. */
 #define TXC_ACTION_LIST_SIZE 32
+#define TXC_MERGE_TABLE_SIZE 64 /* Must be a power of 2 */
 
-/** Number of sentinels */
-#define TXC_SENTINEL_NUM                    512	
+/** 
+ * Maximum number of threads helping transactions run the commit actions 
+ * of different file descriptors concurrently, and number of partitions 
+ * such actions are split into.
+ */
+#define TXC_COMMIT_HELPER_THREADS_MAX       16
+#define TXC_COMMIT_PARTITIONS_MAX           16
 
-/** Number of KOA objects */
-#define TXC_KOA_NUM                         512
+/** 
+ * Number of sentinels. Pool magazines are capped so that all threads 
+ * together cache at most half of a pool (see pool.c); this is large enough
+ * for the default pool_magazine_size.
+ */
+#define TXC_SENTINEL_NUM                    (4*TXC_MAX_NUM_THREADS*32)
+
+/** 
+ * Number of KOA objects of each type. File KOAs are sized as sentinels; 
+ * each other type gets as many as all types used to share. xCalls that 
+ * need a KOA fail with ENOMEM once its pool is exhausted.
+ */
+#define TXC_KOA_FILE_NUM                    (4*TXC_MAX_NUM_THREADS*32)
+#define TXC_KOA_PIPE_READ_END_NUM           512
+#define TXC_KOA_PIPE_WRITE_END_NUM          512
+#define TXC_KOA_SOCK_DGRAM_NUM              512
+#define TXC_KOA_SOCK_STREAM_NUM             512
+
+/** Size of a cache line. Hot objects are aligned to it. */
+#define TXC_CACHELINE_SIZE                  64
+
+/** Size of a huge page. */
+#define TXC_HUGEPAGE_SIZE                   (2*1024*1024)
 
 /** Size of the per thread stat hash table */
 #define TXC_STATS_THREADSTAT_HASHTABLE_SIZE 512
@@ -128,6 +191,15 @@ txc_result_t txc_config_set_option(char *option, char *value);
 /** Initial size of the per descriptor sentinel list. */
 #define TXC_SENTINEL_LIST_SIZE              32
 
+/** Maximum size of a buffer in KB (buffer offsets are unsigned int). */
+#define TXC_BUFFER_MAX_SIZE_KB              (1024*1024)
+
+/** Maximum number of datagrams received with a single system call */
+#define TXC_SOCK_RECV_BATCH_MAX             64
+
+/** Maximum number of objects in a per thread pool magazine */
+#define TXC_POOL_MAGAZINE_MAX_SIZE          1024
+
 /** Maximum number of mapped file descriptors to KOA objects. */
 #define TXC_KOA_MAP_SIZE                    1024
 
@@ -137,6 +209,12 @@ txc_result_t txc_config_set_option(char *option, char *value);
 /** Maximum number of file descriptors referencing a KOA */
 #define TXC_MAX_NUM_FDREFS_PER_KOA          8
 
+/** Maximum number of closed file descriptors kept open for reuse */
+#define TXC_KOA_FDCACHE_MAX_SIZE            256
+
+/** Status flags that must match for a cached file descriptor to be reused */
+#define TXC_KOA_FDCACHE_FLAGS_MASK          (O_ACCMODE | O_APPEND | O_NONBLOCK | O_SYNC)
+
 /** Maximum length of pathname */
 #define TXC_MAX_LEN_PATHNAME                128
 
@@ -152,5 +230,6 @@ txc_result_t txc_config_set_option(char *option, char *value);
 #define TXC_SENTINELMGR_UNDO_ACTION_ORDER   2
 #define TXC_STATSMGR_COMMIT_ACTION_ORDER    3
 #define TXC_STATSMGR_UNDO_ACTION_ORDER      3
+#define TXC_GROUP_SYNC_COMMIT_ACTION_ORDER  4
 
 #endif /* _TXC_CONFIG_H */
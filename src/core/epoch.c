@@ -0,0 +1,307 @@
+/*
+    Copyright (C) 2008-2009 Computer Sciences Department, 
+    University of Wisconsin -- Madison
+
+    ----------------------------------------------------------------------
+
+    This file is part of the xCalls transactional API, originally 
+    developed at the University of Wisconsin -- Madison.
+
+    xCalls was originally developed primarily by Haris Volos and 
+    Neelam Goyal with contributions from Andres Jaan Tack.
+
+    ----------------------------------------------------------------------
+
+    xCalls is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as 
+    published by the Free Software Foundation, either version 3 of 
+    the License, or (at your option) any later version.
+
+    xCalls is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public 
+    License along with xCalls.  If not, see <http://www.gnu.org/licenses/>.
+
+### END HEADER ###
+*/
+
+/**
+ * \file epoch.c
+ *
+ * \brief Epoch based reclamation implementation.
+ *
+ * KOAs and sentinels are reached through plain pointers (file descriptor 
+ * map, alias cache, sentinel lists). Instead of guarding every such 
+ * reference with a lock, an object whose last logical reference goes away
+ * is retired rather than freed, and it is reclaimed only after every thread
+ * that could have followed a pointer to it has left the transaction during
+ * which it did so.
+ *
+ * Each thread announces the global epoch it observes when it begins an 
+ * outermost transaction and marks itself inactive (quiescent) when the 
+ * transaction completes. The global epoch advances once all active threads
+ * have observed it. An object retired in epoch <em>e</em> is reclaimed when
+ * the global epoch reaches <em>e+2</em>. At that point every thread that was
+ * active when the object was retired has gone through a quiescent state.
+ *
+ * Retired objects are kept in three lists, one per epoch that may still 
+ * hold unreclaimed objects, and are reclaimed by whichever thread manages
+ * to advance the global epoch when leaving a transaction. Objects retired
+ * outside transactions (e.g. by a loop of non-transactional x_open/x_close)
+ * would never see a thread leave a transaction, so retiring also tries to
+ * advance the epoch once TXC_EPOCH_RETIRE_THRESHOLD objects are waiting.
+ * Retirement is rare (it happens on KOA and sentinel destruction) so the 
+ * lists are protected by a single mutex which is never acquired by a thread
+ * just entering or leaving a transaction unless there is something to 
+ * reclaim.
+ */
+
+#include <misc/result.h>
+#include <misc/malloc.h>
+#include <misc/debug.h>
+#include <misc/mutex.h>
+#include <misc/atomic.h>
+#include <core/config.h>
+#include <core/epoch.h>
+
+#define TXC_EPOCH_NUM_LISTS 3
+
+/** Number of waiting objects at which retiring tries to advance the epoch. */
+#define TXC_EPOCH_RETIRE_THRESHOLD 32
+
+/** Per thread epoch record. */
+struct txc_epoch_s {
+	volatile unsigned int epoch;    /**< Global epoch observed by the thread */
+	volatile int          active;   /**< Set while the thread runs a transaction */
+	txc_epochmgr_t        *manager; /**< Epoch manager */
+};
+
+
+/** Epoch manager */
+struct txc_epochmgr_s {
+	txc_mutex_t           mutex;                          /**< Protects the retire lists */
+	volatile unsigned int global_epoch;                   /**< Global epoch */
+	volatile int          num_retired;                    /**< Objects waiting for reclamation */
+	txc_epoch_entry_t     *retired[TXC_EPOCH_NUM_LISTS];  /**< Retire list per epoch */
+	int                   num_records;                    /**< Number of registered threads */
+	txc_epoch_t           records[TXC_MAX_NUM_THREADS];   /**< Per thread records */
+};
+
+
+txc_epochmgr_t *txc_g_epochmgr;
+
+/* 
+ * Set while the thread reclaims objects. Reclaiming a KOA may retire its 
+ * sentinel, which must not recursively advance the epoch.
+ */
+static __thread int epoch_reclaiming = 0;
+
+
+/**
+ * \brief Creates an epoch manager.
+ *
+ * \param[out] epochmgrp Pointer to the created manager.
+ * \return Code indicating success or failure (reason) of the operation.
+ */
+txc_result_t
+txc_epochmgr_create(txc_epochmgr_t **epochmgrp)
+{
+	int i;
+
+	*epochmgrp = (txc_epochmgr_t *) MALLOC(TXC_MALLOC_EPOCH, sizeof(txc_epochmgr_t));
+	if (*epochmgrp == NULL) {
+		return TXC_R_NOMEMORY;
+	}
+	TXC_MUTEX_INIT(&(*epochmgrp)->mutex, NULL);
+	(*epochmgrp)->global_epoch = 0;
+	(*epochmgrp)->num_retired = 0;
+	(*epochmgrp)->num_records = 0;
+	for (i=0; i<TXC_EPOCH_NUM_LISTS; i++) {
+		(*epochmgrp)->retired[i] = NULL;
+	}
+	for (i=0; i<TXC_MAX_NUM_THREADS; i++) {
+		(*epochmgrp)->records[i].epoch = 0;
+		(*epochmgrp)->records[i].active = 0;
+		(*epochmgrp)->records[i].manager = *epochmgrp;
+	}
+
+	return TXC_R_SUCCESS;
+}
+
+
+static inline
+void
+reclaim_list(txc_epoch_entry_t *entry)
+{
+	txc_epoch_entry_t *next;
+
+	for (; entry; entry = next) {
+		next = entry->next;
+		entry->function(entry->obj);
+	}
+}
+
+
+/**
+ * \brief Destroys an epoch manager.
+ *
+ * Reclaims all retired objects. No thread may be running a transaction.
+ *
+ * \param[in,out] epochmgrp Pointer to the manager to be destroyed.
+ */
+void
+txc_epochmgr_destroy(txc_epochmgr_t **epochmgrp)
+{
+	int i;
+
+	for (i=0; i<TXC_EPOCH_NUM_LISTS; i++) {
+		reclaim_list((*epochmgrp)->retired[i]);
+	}
+	FREE(*epochmgrp);
+	*epochmgrp = NULL;
+}
+
+
+/**
+ * \brief Assigns an epoch record to a thread descriptor.
+ *
+ * Records are never returned; a recycled thread descriptor keeps its 
+ * record.
+ *
+ * \param[in] epochmgr Epoch manager.
+ * \param[out] epochp Pointer to the assigned record.
+ * \return Code indicating success or failure (reason) of the operation.
+ */
+txc_result_t
+txc_epoch_register(txc_epochmgr_t *epochmgr, txc_epoch_t **epochp)
+{
+	TXC_MUTEX_LOCK(&epochmgr->mutex);
+	if (epochmgr->num_records == TXC_MAX_NUM_THREADS) {
+		TXC_MUTEX_UNLOCK(&epochmgr->mutex);
+		return TXC_R_NORESOURCES;
+	}
+	*epochp = &epochmgr->records[epochmgr->num_records++];
+	TXC_MUTEX_UNLOCK(&epochmgr->mutex);
+	return TXC_R_SUCCESS;
+}
+
+
+/**
+ * \brief Announces that a thread begins an outermost transaction.
+ *
+ * \param[in] epoch The thread's epoch record.
+ */
+void
+txc_epoch_enter(txc_epoch_t *epoch)
+{
+	epoch->active = 1;
+	TXC_MEMORY_BARRIER();
+	epoch->epoch = epoch->manager->global_epoch;
+	TXC_MEMORY_BARRIER();
+}
+
+
+/**
+ * \brief Tries to advance the global epoch and reclaim what became safe.
+ *
+ * Gives up if some other thread is already doing so or if some active 
+ * thread has not yet observed the current global epoch.
+ */
+static
+void
+epoch_try_advance(txc_epochmgr_t *epochmgr)
+{
+	txc_epoch_entry_t *list;
+	txc_epoch_entry_t *next;
+	unsigned int      global_epoch;
+	int               i;
+
+	if (TXC_MUTEX_TRYLOCK(&epochmgr->mutex) != 0) {
+		return;
+	}
+	global_epoch = epochmgr->global_epoch;
+	for (i=0; i<epochmgr->num_records; i++) {
+		if (epochmgr->records[i].active && 
+		    epochmgr->records[i].epoch != global_epoch) 
+		{
+			TXC_MUTEX_UNLOCK(&epochmgr->mutex);
+			return;
+		}
+	}
+	global_epoch++;
+	epochmgr->global_epoch = global_epoch;
+	/* Objects retired two epochs ago can no longer be referenced. */
+	list = epochmgr->retired[(global_epoch+1) % TXC_EPOCH_NUM_LISTS];
+	epochmgr->retired[(global_epoch+1) % TXC_EPOCH_NUM_LISTS] = NULL;
+	TXC_MUTEX_UNLOCK(&epochmgr->mutex);
+
+	TXC_DEBUG_PRINT(TXC_DEBUG_TX, "EPOCH ADVANCE: %u\n", global_epoch);
+
+	/* Reclaim outside the mutex; reclaiming a KOA may retire its sentinel. */
+	epoch_reclaiming = 1;
+	for (; list; list = next) {
+		next = list->next;
+		TXC_ATOMIC_DEC(&epochmgr->num_retired);
+		list->function(list->obj);
+	}
+	epoch_reclaiming = 0;
+}
+
+
+/**
+ * \brief Announces that a thread has completed its outermost transaction.
+ *
+ * The thread holds no references to KOAs or sentinels other than the ones
+ * it has logically attached to.
+ *
+ * \param[in] epoch The thread's epoch record.
+ */
+void
+txc_epoch_exit(txc_epoch_t *epoch)
+{
+	TXC_MEMORY_BARRIER();
+	epoch->active = 0;
+	if (epoch->manager->num_retired > 0) {
+		epoch_try_advance(epoch->manager);
+	}
+}
+
+
+/**
+ * \brief Retires an object.
+ *
+ * The object is reclaimed by calling function(obj) once no thread can 
+ * hold a reference to it any longer. If many objects are waiting, tries to
+ * advance the epoch so that objects retired outside transactions are 
+ * reclaimed too.
+ *
+ * \param[in] epochmgr Epoch manager.
+ * \param[in] entry Retire list entry embedded in the object.
+ * \param[in] function Function reclaiming the object.
+ * \param[in] obj Object to reclaim.
+ */
+void
+txc_epoch_retire(txc_epochmgr_t *epochmgr, 
+                 txc_epoch_entry_t *entry, 
+                 txc_epoch_reclaim_function_t function, 
+                 void *obj)
+{
+	unsigned int index;
+
+	entry->function = function;
+	entry->obj = obj;
+	TXC_MUTEX_LOCK(&epochmgr->mutex);
+	index = epochmgr->global_epoch % TXC_EPOCH_NUM_LISTS;
+	entry->next = epochmgr->retired[index];
+	epochmgr->retired[index] = entry;
+	TXC_ATOMIC_INC(&epochmgr->num_retired);
+	TXC_MUTEX_UNLOCK(&epochmgr->mutex);
+	if (!epoch_reclaiming && 
+	    epochmgr->num_retired >= TXC_EPOCH_RETIRE_THRESHOLD) 
+	{
+		epoch_try_advance(epochmgr);
+	}
+}
@@ -0,0 +1,67 @@
+/*
+    Copyright (C) 2008-2009 Computer Sciences Department, 
+    University of Wisconsin -- Madison
+
+    ----------------------------------------------------------------------
+
+    This file is part of the xCalls transactional API, originally 
+    developed at the University of Wisconsin -- Madison.
+
+    xCalls was originally developed primarily by Haris Volos and 
+    Neelam Goyal with contributions from Andres Jaan Tack.
+
+    ----------------------------------------------------------------------
+
+    xCalls is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as 
+    published by the Free Software Foundation, either version 3 of 
+    the License, or (at your option) any later version.
+
+    xCalls is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public 
+    License along with xCalls.  If not, see <http://www.gnu.org/licenses/>.
+
+### END HEADER ###
+*/
+
+/**
+ * \file epoch.h
+ *
+ * \brief Epoch based reclamation interface.
+ */
+
+#ifndef _TXC_EPOCH_H
+#define _TXC_EPOCH_H
+
+#include <misc/result.h>
+
+typedef struct txc_epochmgr_s txc_epochmgr_t;
+typedef struct txc_epoch_s txc_epoch_t;
+typedef struct txc_epoch_entry_s txc_epoch_entry_t;
+
+typedef void (*txc_epoch_reclaim_function_t)(void *);
+
+/** 
+ * Retire list entry. Objects reclaimed through the epoch manager embed 
+ * one so that retiring an object never allocates memory.
+ */
+struct txc_epoch_entry_s {
+	txc_epoch_reclaim_function_t function;  /**< Function reclaiming the object */
+	void                         *obj;      /**< Object to reclaim */
+	txc_epoch_entry_t            *next;     /**< Next entry in the retire list */
+};
+
+extern txc_epochmgr_t *txc_g_epochmgr;
+
+txc_result_t txc_epochmgr_create(txc_epochmgr_t **);
+void txc_epochmgr_destroy(txc_epochmgr_t **);
+txc_result_t txc_epoch_register(txc_epochmgr_t *, txc_epoch_t **);
+void txc_epoch_enter(txc_epoch_t *);
+void txc_epoch_exit(txc_epoch_t *);
+void txc_epoch_retire(txc_epochmgr_t *, txc_epoch_entry_t *, txc_epoch_reclaim_function_t, void *);
+
+#endif /* _TXC_EPOCH_H */
@@ -47,6 +47,7 @@
 #include <sched.h>
 #include <misc/debug.h>
 #include <misc/generic_types.h>
+#include <misc/malloc.h>
 #include <core/stats.h>
 #include <core/sentinel.h>
 #include <core/koa.h>
@@ -54,13 +55,17 @@
 #include <core/buffer.h>
 #include <core/config.h>
 #include <core/tx.h>
+#include <core/epoch.h>
+#include <core/journal.h>
 
 
+extern txc_epochmgr_t *txc_g_epochmgr;
 extern txc_sentinelmgr_t *txc_g_sentinelmgr;
 extern txc_buffermgr_t *txc_g_buffermgr;
 extern txc_koamgr_t *txc_g_koamgr;
 extern txc_txmgr_t *txc_g_txmgr;
 extern txc_statsmgr_t *txc_g_statsmgr;
+extern txc_journalmgr_t *txc_g_journalmgr;
 
 #ifndef _TXC_COMMIT_FUNCTION_T
 #define _TXC_COMMIT_FUNCTION_T
@@ -83,15 +88,30 @@ struct timeval txc_initialization_time;
 int
 _TXC_global_init()
 {
+	txc_result_t result;
+
 	txc_config_init();
-	txc_sentinelmgr_create(&txc_g_sentinelmgr);
+	if ((result = txc_malloc_init(txc_runtime_settings.allocator)) 
+	    != TXC_R_SUCCESS) 
+	{
+		return (int) result;
+	}
+	/* Recover before anything touches the files. */
+	if (txc_journalmgr_create(&txc_g_journalmgr, txc_runtime_settings.journal) 
+	    != TXC_R_SUCCESS) 
+	{
+		TXC_ERROR("Cannot open journal %s\n", txc_runtime_settings.journal);
+	}
+	txc_epochmgr_create(&txc_g_epochmgr);
+	txc_sentinelmgr_create(&txc_g_sentinelmgr, txc_g_epochmgr);
 	txc_buffermgr_create(&txc_g_buffermgr);
 #ifdef _TXC_STATS_BUILD	
 	txc_statsmgr_create(&txc_g_statsmgr);
 #endif	
 	txc_txmgr_create(&txc_g_txmgr, txc_g_buffermgr, txc_g_sentinelmgr, 
-	                 txc_g_statsmgr);
-	txc_koamgr_create(&txc_g_koamgr, txc_g_sentinelmgr, txc_g_buffermgr);
+	                 txc_g_statsmgr, txc_g_epochmgr, txc_g_journalmgr);
+	txc_koamgr_create(&txc_g_koamgr, txc_g_sentinelmgr, txc_g_buffermgr,
+	                  txc_g_epochmgr);
 
 	if (txc_runtime_settings.debug_all == TXC_BOOL_TRUE) {
 		txc_runtime_settings.debug_koa      = TXC_BOOL_TRUE;
@@ -116,11 +136,36 @@ int
 _TXC_global_shutdown()
 {
 	txc_stats_print(txc_g_statsmgr);
+	txc_journalmgr_destroy(&txc_g_journalmgr);
 
 	return (int) TXC_R_SUCCESS;
 }
 
 
+/**
+ * \brief Replaces the memory allocator used by the library.
+ *
+ * Must be called before _TXC_global_init. Passing NULL functions restores
+ * the default allocator.
+ *
+ * \param[in] malloc_fn Allocates a block of the given size.
+ * \param[in] free_fn Frees a block returned by malloc_fn.
+ * \return Returns 0 on success.
+ */
+int
+_TXC_set_allocator(void *(*malloc_fn)(size_t size), void (*free_fn)(void *ptr))
+{
+	txc_allocator_t allocator;
+
+	if (malloc_fn == NULL && free_fn == NULL) {
+		return (int) txc_malloc_set_allocator(NULL);
+	}
+	allocator.malloc = malloc_fn;
+	allocator.free = free_fn;
+	return (int) txc_malloc_set_allocator(&allocator);
+}
+
+
 /**
  * \brief Initializes and assigns an xCalls descriptor to a thread.
  *
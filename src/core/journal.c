@@ -0,0 +1,1182 @@
+/*
+    Copyright (C) 2008-2009 Computer Sciences Department, 
+    University of Wisconsin -- Madison
+
+    ----------------------------------------------------------------------
+
+    This file is part of the xCalls transactional API, originally 
+    developed at the University of Wisconsin -- Madison.
+
+    xCalls was originally developed primarily by Haris Volos and 
+    Neelam Goyal with contributions from Andres Jaan Tack.
+
+    ----------------------------------------------------------------------
+
+    xCalls is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as 
+    published by the Free Software Foundation, either version 3 of 
+    the License, or (at your option) any later version.
+
+    xCalls is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public 
+    License along with xCalls.  If not, see <http://www.gnu.org/licenses/>.
+
+### END HEADER ###
+*/
+
+/**
+ * \file journal.c
+ *
+ * \brief Write-ahead journal implementation.
+ *
+ * xCalls are atomic with respect to concurrent transactions and aborts, 
+ * but a crash in the middle of a commit, or after in-place xCalls have 
+ * run, leaves files half updated. When a journal file is configured, 
+ * transactions describe their effects on files in it so that the next 
+ * process initializing the library can complete or roll them back.
+ *
+ * A transaction appends two kinds of records:
+ *  - redo records for the data it writes, in place or deferred, and for 
+ *    the names it removes at commit. They need not be durable until the
+ *    transaction commits, when a commit record is appended and the journal
+ *    is synced. Syncs of concurrently committing transactions are grouped 
+ *    into one, and the changes themselves are applied lazily by the commit
+ *    actions without syncing the files.
+ *  - undo records describing how to revert an in-place xCall. They are 
+ *    synced before the xCall changes the file system, as the change may 
+ *    become durable any time after.
+ *
+ * Recovery first rolls back, in reverse order, the transactions that have
+ * neither committed nor finished rolling back, and then replays, in 
+ * order, the redo records of the committed ones. Conflicting transactions
+ * are serialized by sentinels, so the ones rolled back follow the 
+ * committed ones they conflict with and the data they saved already 
+ * include the committed changes. Records identify files by path and 
+ * inode number; a record whose file has been replaced is skipped. Names 
+ * are removed or restored only if they still refer to the inode the 
+ * record names, which makes undoing and redoing them idempotent.
+ *
+ * Once the journal grows past journal_checkpoint_size, new transactions 
+ * wait until the ones in flight finish; then the files and directories 
+ * the journal refers to are synced and the journal is truncated. To sync
+ * them even after the application has closed them, the journal keeps a 
+ * descriptor of each until the checkpoint. If any of them fails to sync,
+ * the journal is kept for recovery and no longer checkpointed.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <misc/result.h>
+#include <misc/malloc.h>
+#include <misc/debug.h>
+#include <misc/mutex.h>
+#include <core/config.h>
+#include <core/tx.h>
+#include <core/txdesc.h>
+#include <core/journal.h>
+#include <libc/syscalls.h>
+
+#define TXC_JOURNAL_MAGIC          0x4a435854U        /* "TXCJ" */
+#define TXC_JOURNAL_ALIGN          8
+#define TXC_JOURNAL_CHUNK_SIZE     (64*1024)          /* Data saved per undo record */
+#define TXC_JOURNAL_DATA_MAX       (1024*1024*1024)   /* Data written per redo record */
+#define TXC_JOURNAL_CHECKSUM_BASIS 2166136261U
+
+typedef struct txc_journal_record_s txc_journal_record_t;
+typedef struct txc_journal_file_s txc_journal_file_t;
+
+/** 
+ * Record header. The path, the second path and the data follow it, and 
+ * the record is padded to TXC_JOURNAL_ALIGN bytes.
+ */
+struct txc_journal_record_s {
+	uint32_t magic;
+	uint32_t checksum;   /**< Of the rest of the header and the payload */
+	uint64_t txid;
+	uint64_t inode;      /**< Inode number of the file, or 0 for any */
+	int64_t  offset;     /**< File offset of the data, or size of the file */
+	uint32_t type;
+	uint32_t path_len;
+	uint32_t path2_len;
+	uint32_t data_len;
+};
+
+/** A file or directory to sync at the next checkpoint. */
+struct txc_journal_file_s {
+	dev_t dev;
+	ino_t ino;
+	int   fd;
+};
+
+/** Journal manager. */
+struct txc_journalmgr_s {
+	txc_mutex_t        mutex;
+	pthread_cond_t     cond;                /**< Signaled when a sync or a checkpoint completes */
+	int                fd;
+	off_t              end;                 /**< Offset the next record is appended at */
+	off_t              synced;              /**< Records before this offset are durable */
+	int                syncing;
+	unsigned long long next_txid;
+	int                active;              /**< Transactions with records in the journal that have not finished */
+	int                checkpoint_pending;
+	int                checkpoint_failed;   /**< A checkpoint could not sync the files; keep the journal */
+	off_t              checkpoint_size;
+	txc_journal_file_t *files;              /**< Files the journal refers to since the last checkpoint */
+	int                files_num;
+	int                files_max;
+};
+
+txc_journalmgr_t *txc_g_journalmgr;
+
+
+static
+uint32_t
+checksum_update(uint32_t sum, const void *buf, size_t len)
+{
+	const unsigned char *p = (const unsigned char *) buf;
+
+	while (len-- > 0) {
+		sum ^= *p++;
+		sum *= 16777619U;
+	}
+	return sum;
+}
+
+
+static
+size_t
+record_size(txc_journal_record_t *record)
+{
+	size_t len;
+
+	len = sizeof(txc_journal_record_t) + record->path_len + 
+	      record->path2_len + record->data_len;
+	return (len + TXC_JOURNAL_ALIGN - 1) & ~((size_t) TXC_JOURNAL_ALIGN - 1);
+}
+
+
+static
+uint32_t
+record_checksum(txc_journal_record_t *record)
+{
+	return checksum_update(TXC_JOURNAL_CHECKSUM_BASIS, &record->txid,
+	                       record_size(record) - 
+	                       offsetof(txc_journal_record_t, txid));
+}
+
+
+static
+int
+pwrite_all(int fd, const void *buf, size_t len, off_t offset)
+{
+	size_t  done;
+	ssize_t ret;
+
+	for (done = 0; done < len; done += ret) {
+		if ((ret = txc_libc_pwrite(fd, (const char *) buf + done, 
+		                           len - done, offset + done)) < 0) 
+		{
+			if (errno == EINTR) {
+				ret = 0;
+				continue;
+			}
+			return -1;
+		}
+	}
+	return 0;
+}
+
+
+/**
+ * Appends a record. The record is built in place in the journal file 
+ * from its header, paths and data.
+ *
+ * \return 0 on success, or an errno value.
+ */
+static
+int
+journal_append(txc_journalmgr_t *journalmgr, txc_journal_record_t *record, 
+               const char *path, const char *path2, const void *data,
+               off_t *lsnp)
+{
+	static const char pad[TXC_JOURNAL_ALIGN];
+	struct iovec      iov[5];
+	int               iovcnt = 0;
+	size_t            len;
+	size_t            written;
+	ssize_t           ret;
+	uint32_t          sum;
+
+	record->magic = TXC_JOURNAL_MAGIC;
+	record->path_len = path ? strlen(path) : 0;
+	record->path2_len = path2 ? strlen(path2) : 0;
+	len = record_size(record);
+
+	iov[iovcnt].iov_base = record;
+	iov[iovcnt++].iov_len = sizeof(txc_journal_record_t);
+	if (record->path_len > 0) {
+		iov[iovcnt].iov_base = (void *) (uintptr_t) path;
+		iov[iovcnt++].iov_len = record->path_len;
+	}
+	if (record->path2_len > 0) {
+		iov[iovcnt].iov_base = (void *) (uintptr_t) path2;
+		iov[iovcnt++].iov_len = record->path2_len;
+	}
+	if (record->data_len > 0) {
+		iov[iovcnt].iov_base = (void *) (uintptr_t) data;
+		iov[iovcnt++].iov_len = record->data_len;
+	}
+	written = sizeof(txc_journal_record_t) + record->path_len + 
+	          record->path2_len + record->data_len;
+	if (written < len) {
+		iov[iovcnt].iov_base = (void *) (uintptr_t) pad;
+		iov[iovcnt++].iov_len = len - written;
+	}
+
+	sum = checksum_update(TXC_JOURNAL_CHECKSUM_BASIS, &record->txid,
+	                      sizeof(txc_journal_record_t) - 
+	                      offsetof(txc_journal_record_t, txid));
+	sum = checksum_update(sum, path, record->path_len);
+	sum = checksum_update(sum, path2, record->path2_len);
+	sum = checksum_update(sum, data, record->data_len);
+	sum = checksum_update(sum, pad, len - written);
+	record->checksum = sum;
+
+	TXC_MUTEX_LOCK(&journalmgr->mutex);
+	for (written = 0; written < len; written += ret) {
+		if ((ret = txc_libc_pwritev(journalmgr->fd, iov, iovcnt, 
+		                            journalmgr->end + written)) < 0) 
+		{
+			if (errno == EINTR) {
+				ret = 0;
+				continue;
+			}
+			/* The torn record is overwritten by the next one. */
+			TXC_MUTEX_UNLOCK(&journalmgr->mutex);
+			return errno;
+		}
+		if (written + ret < len) {
+			size_t n = ret;
+			int    j;
+
+			for (j = 0; n >= iov[j].iov_len; j++) {
+				n -= iov[j].iov_len;
+			}
+			iov[j].iov_base = (char *) iov[j].iov_base + n;
+			iov[j].iov_len -= n;
+			memmove(&iov[0], &iov[j], (iovcnt - j) * sizeof(struct iovec));
+			iovcnt -= j;
+		}
+	}
+	journalmgr->end += len;
+	if (lsnp) {
+		*lsnp = journalmgr->end;
+	}
+	TXC_MUTEX_UNLOCK(&journalmgr->mutex);
+	return 0;
+}
+
+
+/**
+ * Waits until the records before lsn are durable. Whoever finds no sync 
+ * in progress syncs everything appended so far on behalf of all waiting.
+ *
+ * \return 0 on success, or an errno value.
+ */
+static
+int
+journal_sync(txc_journalmgr_t *journalmgr, off_t lsn)
+{
+	off_t target;
+	int   ret;
+
+	TXC_MUTEX_LOCK(&journalmgr->mutex);
+	while (journalmgr->synced < lsn) {
+		if (journalmgr->syncing) {
+			pthread_cond_wait(&journalmgr->cond, &journalmgr->mutex);
+			continue;
+		}
+		journalmgr->syncing = 1;
+		target = journalmgr->end;
+		TXC_MUTEX_UNLOCK(&journalmgr->mutex);
+		ret = txc_libc_fdatasync(journalmgr->fd);
+		TXC_MUTEX_LOCK(&journalmgr->mutex);
+		journalmgr->syncing = 0;
+		pthread_cond_broadcast(&journalmgr->cond);
+		if (ret < 0) {
+			ret = errno;
+			TXC_MUTEX_UNLOCK(&journalmgr->mutex);
+			return ret;
+		}
+		journalmgr->synced = target;
+	}
+	TXC_MUTEX_UNLOCK(&journalmgr->mutex);
+	return 0;
+}
+
+
+/** 
+ * Assigns the transaction an identifier on its first record. Waits while
+ * a checkpoint is pending so that in-flight transactions can drain.
+ */
+static
+void
+journal_begin(txc_journalmgr_t *journalmgr, txc_tx_t *txd)
+{
+	if (txd->journal_txid != 0) {
+		return;
+	}
+	TXC_MUTEX_LOCK(&journalmgr->mutex);
+	while (journalmgr->checkpoint_pending) {
+		pthread_cond_wait(&journalmgr->cond, &journalmgr->mutex);
+	}
+	txd->journal_txid = ++journalmgr->next_txid;
+	journalmgr->active++;
+	TXC_MUTEX_UNLOCK(&journalmgr->mutex);
+}
+
+
+/**
+ * Remembers to sync a file or directory at the next checkpoint. Keeps a 
+ * descriptor of its own, as the application may close fd before then; 
+ * if fd is -1, path is opened instead.
+ *
+ * \return 0 on success, or an errno value.
+ */
+static
+int
+journal_track(txc_journalmgr_t *journalmgr, int fd, const char *path, 
+              struct stat *stat_buf)
+{
+	txc_journal_file_t *files;
+	int                i;
+	int                ret = 0;
+
+	TXC_MUTEX_LOCK(&journalmgr->mutex);
+	for (i = journalmgr->files_num - 1; i >= 0; i--) {
+		if (journalmgr->files[i].ino == stat_buf->st_ino &&
+		    journalmgr->files[i].dev == stat_buf->st_dev) 
+		{
+			goto done;
+		}
+	}
+	if (journalmgr->files_num == journalmgr->files_max) {
+		if ((files = (txc_journal_file_t *) 
+		             REALLOC(TXC_MALLOC_JOURNAL, journalmgr->files, 
+		                     2 * journalmgr->files_max * sizeof(txc_journal_file_t)))
+		    == NULL)
+		{
+			ret = ENOMEM;
+			goto done;
+		}
+		journalmgr->files = files;
+		journalmgr->files_max *= 2;
+	}
+	if (fd >= 0) {
+		fd = txc_libc_fcntl_dupfd_cloexec(fd);
+	} else {
+		fd = txc_libc_open(path, O_RDONLY | O_CLOEXEC, 0);
+	}
+	if (fd < 0) {
+		ret = errno;
+		goto done;
+	}
+	journalmgr->files[journalmgr->files_num].dev = stat_buf->st_dev;
+	journalmgr->files[journalmgr->files_num].ino = stat_buf->st_ino;
+	journalmgr->files[journalmgr->files_num].fd = fd;
+	journalmgr->files_num++;
+done:
+	TXC_MUTEX_UNLOCK(&journalmgr->mutex);
+	return ret;
+}
+
+
+/** Remembers to sync the directory holding a name at the next checkpoint. */
+static
+int
+journal_track_parent(txc_journalmgr_t *journalmgr, const char *abspath)
+{
+	char        dir[PATH_MAX];
+	char        *slash;
+	struct stat stat_buf;
+
+	strcpy(dir, abspath);
+	if ((slash = strrchr(dir, '/')) == NULL) {
+		strcpy(dir, ".");
+	} else if (slash == dir) {
+		dir[1] = '\0';
+	} else {
+		*slash = '\0';
+	}
+	if (stat(dir, &stat_buf) < 0) {
+		return errno;
+	}
+	return journal_track(journalmgr, -1, dir, &stat_buf);
+}
+
+
+/**
+ * Makes every change applied so far durable and empties the journal.
+ * Called with the mutex held and no transaction in flight.
+ *
+ * The journal is emptied only if every file it refers to synced; the 
+ * error of a failed sync is reported once, so a later checkpoint could 
+ * not tell that the data are lost and the journal is kept for good.
+ */
+static
+void
+journal_checkpoint(txc_journalmgr_t *journalmgr)
+{
+	int i;
+
+	for (i = 0; i < journalmgr->files_num; i++) {
+		if (txc_libc_fsync(journalmgr->files[i].fd) < 0 && errno != EINVAL) {
+			TXC_WARNING("Cannot sync a journaled file (%s); keeping the journal\n",
+			            strerror(errno));
+			journalmgr->checkpoint_failed = 1;
+		}
+		txc_libc_close(journalmgr->files[i].fd);
+	}
+	journalmgr->files_num = 0;
+	if (!journalmgr->checkpoint_failed &&
+	    txc_libc_ftruncate(journalmgr->fd, 0) == 0 &&
+	    txc_libc_fsync(journalmgr->fd) == 0) 
+	{
+		journalmgr->end = 0;
+		journalmgr->synced = 0;
+	}
+	journalmgr->checkpoint_pending = 0;
+	pthread_cond_broadcast(&journalmgr->cond);
+}
+
+
+/** Gets the path and the status of the file a descriptor refers to. */
+static
+int
+journal_fd2path(int fd, char *path, struct stat *stat_buf)
+{
+	char    proc_path[64];
+	ssize_t len;
+
+	if (txc_libc_fstat(fd, stat_buf) < 0) {
+		return -1;
+	}
+	snprintf(proc_path, sizeof(proc_path), "/proc/self/fd/%d", fd);
+	if ((len = readlink(proc_path, path, PATH_MAX - 1)) < 0) {
+		return -1;
+	}
+	path[len] = '\0';
+	return 0;
+}
+
+
+/** Makes a path absolute, as recovery may run in another directory. */
+static
+int
+journal_abspath(const char *path, char *abspath)
+{
+	size_t len;
+
+	if (path[0] == '/') {
+		len = 0;
+	} else {
+		if (getcwd(abspath, PATH_MAX) == NULL) {
+			return -1;
+		}
+		len = strlen(abspath);
+		abspath[len++] = '/';
+	}
+	if (len + strlen(path) >= PATH_MAX) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	strcpy(abspath + len, path);
+	return 0;
+}
+
+
+/**
+ * Redoes or undoes a record during recovery. Records of operations that 
+ * never took place, or whose file has since been replaced, are skipped.
+ * What is changed is synced by the checkpoint ending recovery; if it 
+ * cannot be tracked for that, the journal is kept.
+ */
+static
+void
+journal_replay(txc_journalmgr_t *journalmgr, txc_journal_record_t *record)
+{
+	char        path[PATH_MAX];
+	char        path2[PATH_MAX];
+	const char  *payload = (const char *) (record + 1);
+	struct stat stat_buf;
+	int         fd;
+
+	memcpy(path, payload, record->path_len);
+	path[record->path_len] = '\0';
+	memcpy(path2, payload + record->path_len, record->path2_len);
+	path2[record->path2_len] = '\0';
+
+	switch (record->type) {
+		case TXC_JOURNAL_REDO_WRITE:
+		case TXC_JOURNAL_UNDO_WRITE:
+		case TXC_JOURNAL_UNDO_TRUNCATE:
+			if ((fd = txc_libc_open(path, O_WRONLY, 0)) < 0) {
+				break;
+			}
+			if (txc_libc_fstat(fd, &stat_buf) == 0 &&
+			    (record->inode == 0 || stat_buf.st_ino == record->inode)) 
+			{
+				if (record->type == TXC_JOURNAL_UNDO_TRUNCATE) {
+					txc_libc_ftruncate(fd, record->offset);
+				} else {
+					pwrite_all(fd, payload + record->path_len + record->path2_len,
+					           record->data_len, record->offset);
+				}
+				if (journal_track(journalmgr, fd, path, &stat_buf) != 0) {
+					journalmgr->checkpoint_failed = 1;
+				}
+			}
+			txc_libc_close(fd);
+			break;
+		case TXC_JOURNAL_REDO_UNLINK:
+		case TXC_JOURNAL_UNDO_UNLINK:
+		case TXC_JOURNAL_UNDO_RENAME:
+			if (txc_libc_stat(path, &stat_buf) < 0 ||
+			    (record->inode != 0 && stat_buf.st_ino != record->inode)) 
+			{
+				break;
+			}
+			if (record->type == TXC_JOURNAL_UNDO_RENAME) {
+				txc_libc_rename(path, path2);
+				if (journal_track_parent(journalmgr, path2) != 0) {
+					journalmgr->checkpoint_failed = 1;
+				}
+			} else {
+				txc_libc_unlink(path);
+			}
+			if (journal_track_parent(journalmgr, path) != 0) {
+				journalmgr->checkpoint_failed = 1;
+			}
+			break;
+	}
+}
+
+
+static
+int
+txid_compare(const void *a, const void *b)
+{
+	unsigned long long x = *(const unsigned long long *) a;
+	unsigned long long y = *(const unsigned long long *) b;
+
+	return (x > y) - (x < y);
+}
+
+
+static
+int
+txid_find(unsigned long long *txids, int num_txids, unsigned long long txid)
+{
+	return bsearch(&txid, txids, num_txids, sizeof(unsigned long long), 
+	               txid_compare) != NULL;
+}
+
+
+/**
+ * Brings the files the transactions of the previous process touched 
+ * to a transaction consistent state and empties the journal.
+ */
+static
+txc_result_t
+journal_recover(txc_journalmgr_t *journalmgr)
+{
+	struct stat          stat_buf;
+	char                 *image;
+	txc_journal_record_t **records;
+	txc_journal_record_t *record;
+	unsigned long long   *committed;
+	unsigned long long   *finished;
+	int                  num_records;
+	int                  num_committed;
+	int                  num_finished;
+	size_t               pos;
+	size_t               len;
+	ssize_t              ret;
+	int                  i;
+
+	if (txc_libc_fstat(journalmgr->fd, &stat_buf) < 0) {
+		return TXC_R_FAILURE;
+	}
+	if (stat_buf.st_size == 0) {
+		return TXC_R_SUCCESS;
+	}
+	if ((image = (char *) MALLOC(TXC_MALLOC_JOURNAL, stat_buf.st_size)) == NULL) {
+		return TXC_R_NOMEMORY;
+	}
+	for (pos = 0; pos < (size_t) stat_buf.st_size; pos += ret) {
+		if ((ret = txc_libc_pread(journalmgr->fd, image + pos, 
+		                          stat_buf.st_size - pos, pos)) <= 0) 
+		{
+			if (ret < 0 && errno == EINTR) {
+				ret = 0;
+				continue;
+			}
+			break;
+		}
+	}
+	len = pos;
+
+	/* Records past a torn or corrupted one were never synced. */
+	for (pos = 0, num_records = 0; 
+	     pos + sizeof(txc_journal_record_t) <= len; 
+	     pos += record_size(record), num_records++) 
+	{
+		record = (txc_journal_record_t *) (image + pos);
+		if (record->magic != TXC_JOURNAL_MAGIC ||
+		    record->path_len >= PATH_MAX || record->path2_len >= PATH_MAX ||
+		    record->data_len > TXC_JOURNAL_DATA_MAX ||
+		    pos + record_size(record) > len ||
+		    record_checksum(record) != record->checksum)
+		{
+			break;
+		}
+	}
+	records = (txc_journal_record_t **) MALLOC(TXC_MALLOC_JOURNAL, 
+	                                           (num_records + 1) * sizeof(txc_journal_record_t *));
+	committed = (unsigned long long *) MALLOC(TXC_MALLOC_JOURNAL, 
+	                                          (num_records + 1) * sizeof(unsigned long long));
+	finished = (unsigned long long *) MALLOC(TXC_MALLOC_JOURNAL, 
+	                                         (num_records + 1) * sizeof(unsigned long long));
+	if (records == NULL || committed == NULL || finished == NULL) {
+		FREE(records);
+		FREE(committed);
+		FREE(finished);
+		FREE(image);
+		return TXC_R_NOMEMORY;
+	}
+	num_committed = num_finished = 0;
+	for (i = 0, pos = 0; i < num_records; pos += record_size(record), i++) {
+		record = records[i] = (txc_journal_record_t *) (image + pos);
+		if (record->type == TXC_JOURNAL_COMMIT) {
+			committed[num_committed++] = record->txid;
+		}
+		if (record->type == TXC_JOURNAL_COMMIT || 
+		    record->type == TXC_JOURNAL_ABORT) 
+		{
+			finished[num_finished++] = record->txid;
+		}
+	}
+	qsort(committed, num_committed, sizeof(unsigned long long), txid_compare);
+	qsort(finished, num_finished, sizeof(unsigned long long), txid_compare);
+
+	for (i = num_records - 1; i >= 0; i--) {
+		record = records[i];
+		if ((record->type == TXC_JOURNAL_UNDO_WRITE ||
+		     record->type == TXC_JOURNAL_UNDO_TRUNCATE ||
+		     record->type == TXC_JOURNAL_UNDO_UNLINK ||
+		     record->type == TXC_JOURNAL_UNDO_RENAME) &&
+		    !txid_find(finished, num_finished, record->txid))
+		{
+			journal_replay(journalmgr, record);
+		}
+	}
+	for (i = 0; i < num_records; i++) {
+		record = records[i];
+		if ((record->type == TXC_JOURNAL_REDO_WRITE ||
+		     record->type == TXC_JOURNAL_REDO_UNLINK) &&
+		    txid_find(committed, num_committed, record->txid))
+		{
+			journal_replay(journalmgr, record);
+		}
+	}
+
+	FREE(records);
+	FREE(committed);
+	FREE(finished);
+	FREE(image);
+	journal_checkpoint(journalmgr);
+	if (journalmgr->checkpoint_failed) {
+		/* 
+		 * The journal must stay as it is for the next attempt; new 
+		 * records cannot be appended to it.
+		 */
+		return TXC_R_FAILURE;
+	}
+	return TXC_R_SUCCESS;
+}
+
+
+/**
+ * \brief Opens the journal and recovers the transactions it describes.
+ *
+ * \param[out] journalmgrp The journal manager, or NULL if no journal is 
+ * configured.
+ * \param[in] path The journal file, or an empty string for none.
+ * \return TXC_R_SUCCESS on success, or an error code.
+ */
+txc_result_t
+txc_journalmgr_create(txc_journalmgr_t **journalmgrp, const char *path)
+{
+	txc_journalmgr_t *journalmgr;
+	txc_result_t     result;
+
+	*journalmgrp = NULL;
+	if (path == NULL || path[0] == '\0') {
+		return TXC_R_SUCCESS;
+	}
+	if ((journalmgr = (txc_journalmgr_t *) 
+	                  MALLOC(TXC_MALLOC_JOURNAL, sizeof(txc_journalmgr_t))) 
+	    == NULL) 
+	{
+		return TXC_R_NOMEMORY;
+	}
+	if ((journalmgr->fd = txc_libc_open(path, O_RDWR | O_CREAT | O_CLOEXEC, 
+	                                    0600)) < 0) 
+	{
+		FREE(journalmgr);
+		return TXC_R_FAILURE;
+	}
+	TXC_MUTEX_INIT(&journalmgr->mutex, NULL);
+	pthread_cond_init(&journalmgr->cond, NULL);
+	journalmgr->end = 0;
+	journalmgr->synced = 0;
+	journalmgr->syncing = 0;
+	journalmgr->next_txid = 0;
+	journalmgr->active = 0;
+	journalmgr->checkpoint_pending = 0;
+	journalmgr->checkpoint_failed = 0;
+	journalmgr->checkpoint_size = (off_t) txc_runtime_settings.journal_checkpoint_size * 1024;
+	journalmgr->files_num = 0;
+	journalmgr->files_max = 64;
+	if ((journalmgr->files = (txc_journal_file_t *) 
+	                         MALLOC(TXC_MALLOC_JOURNAL, 
+	                                journalmgr->files_max * sizeof(txc_journal_file_t)))
+	    == NULL)
+	{
+		txc_libc_close(journalmgr->fd);
+		FREE(journalmgr);
+		return TXC_R_NOMEMORY;
+	}
+	if ((result = journal_recover(journalmgr)) != TXC_R_SUCCESS) {
+		txc_libc_close(journalmgr->fd);
+		FREE(journalmgr->files);
+		FREE(journalmgr);
+		return result;
+	}
+	*journalmgrp = journalmgr;
+	return TXC_R_SUCCESS;
+}
+
+
+/**
+ * \brief Empties the journal, if no transaction is in flight, and closes it.
+ *
+ * \param[in,out] journalmgrp The journal manager.
+ */
+void
+txc_journalmgr_destroy(txc_journalmgr_t **journalmgrp)
+{
+	txc_journalmgr_t *journalmgr = *journalmgrp;
+	int              i;
+
+	if (journalmgr == NULL) {
+		return;
+	}
+	TXC_MUTEX_LOCK(&journalmgr->mutex);
+	if (journalmgr->active == 0) {
+		journal_checkpoint(journalmgr);
+	}
+	for (i = 0; i < journalmgr->files_num; i++) {
+		txc_libc_close(journalmgr->files[i].fd);
+	}
+	TXC_MUTEX_UNLOCK(&journalmgr->mutex);
+	txc_libc_close(journalmgr->fd);
+	pthread_cond_destroy(&journalmgr->cond);
+	FREE(journalmgr->files);
+	FREE(journalmgr);
+	*journalmgrp = NULL;
+}
+
+
+/**
+ * \brief Logs data a transaction writes to a file.
+ *
+ * The record becomes durable when the transaction commits.
+ *
+ * \param[in] journalmgr The journal manager.
+ * \param[in] txd The transaction descriptor.
+ * \param[in] fd The file descriptor written to.
+ * \param[in] offset The file offset written at.
+ * \param[in] buf The data written.
+ * \param[in] nbyte The number of bytes written.
+ * \return 0 on success, or an errno value.
+ */
+int
+txc_journal_log_write(txc_journalmgr_t *journalmgr, txc_tx_t *txd, int fd,
+                      off_t offset, const void *buf, size_t nbyte)
+{
+	txc_journal_record_t record;
+	char                 path[PATH_MAX];
+	struct stat          stat_buf;
+	size_t               done;
+	int                  ret;
+
+	if (journal_fd2path(fd, path, &stat_buf) < 0) {
+		return errno;
+	}
+	if ((ret = journal_track(journalmgr, fd, path, &stat_buf)) != 0) {
+		return ret;
+	}
+	journal_begin(journalmgr, txd);
+	for (done = 0; done < nbyte; done += record.data_len) {
+		record.txid = txd->journal_txid;
+		record.type = TXC_JOURNAL_REDO_WRITE;
+		record.inode = stat_buf.st_ino;
+		record.offset = offset + done;
+		record.data_len = (nbyte - done > TXC_JOURNAL_DATA_MAX) ? 
+		                  TXC_JOURNAL_DATA_MAX : nbyte - done;
+		if ((ret = journal_append(journalmgr, &record, path, NULL, 
+		                          (const char *) buf + done, NULL)) != 0) 
+		{
+			return ret;
+		}
+	}
+	return 0;
+}
+
+
+/**
+ * \brief Saves the data an in-place write is about to overwrite.
+ *
+ * The data are read from the file and are durable when the function 
+ * returns. If the write extends the file, its size is saved too.
+ *
+ * \param[in] journalmgr The journal manager.
+ * \param[in] txd The transaction descriptor.
+ * \param[in] fd The file descriptor to be written to.
+ * \param[in] offset The file offset to be written at, or -1 for the
+ * current file offset.
+ * \param[in] nbyte The number of bytes to be written.
+ * \return 0 on success, or an errno value.
+ */
+int
+txc_journal_log_undo_write(txc_journalmgr_t *journalmgr, txc_tx_t *txd, 
+                           int fd, off_t offset, size_t nbyte)
+{
+	txc_journal_record_t record;
+	char                 path[PATH_MAX];
+	struct stat          stat_buf;
+	char                 *buf;
+	size_t               done;
+	ssize_t              nread;
+	off_t                lsn = 0;
+	int                  ret = 0;
+
+	if (offset < 0 && (offset = txc_libc_lseek(fd, 0, SEEK_CUR)) < 0) {
+		return errno;
+	}
+	if (journal_fd2path(fd, path, &stat_buf) < 0) {
+		return errno;
+	}
+	if ((ret = journal_track(journalmgr, fd, path, &stat_buf)) != 0) {
+		return ret;
+	}
+	if ((buf = (char *) MALLOC(TXC_MALLOC_JOURNAL, TXC_JOURNAL_CHUNK_SIZE)) == NULL) {
+		return ENOMEM;
+	}
+	journal_begin(journalmgr, txd);
+	for (done = 0; done < nbyte; done += nread) {
+		nread = (nbyte - done > TXC_JOURNAL_CHUNK_SIZE) ? 
+		        TXC_JOURNAL_CHUNK_SIZE : nbyte - done;
+		if ((nread = txc_libc_pread(fd, buf, nread, offset + done)) < 0) {
+			if (errno == EINTR) {
+				nread = 0;
+				continue;
+			}
+			ret = errno;
+			goto done;
+		}
+		if (nread == 0) {
+			break;
+		}
+		record.txid = txd->journal_txid;
+		record.type = TXC_JOURNAL_UNDO_WRITE;
+		record.inode = stat_buf.st_ino;
+		record.offset = offset + done;
+		record.data_len = nread;
+		if ((ret = journal_append(journalmgr, &record, path, NULL, buf, &lsn)) != 0) {
+			goto done;
+		}
+	}
+	if (done < nbyte) {
+		/* 
+		 * Undone first, as records are undone in reverse order. A write
+		 * starting past the end of the file leaves a hole before offset,
+		 * so truncate back to the size, not to offset.
+		 */
+		record.txid = txd->journal_txid;
+		record.type = TXC_JOURNAL_UNDO_TRUNCATE;
+		record.inode = stat_buf.st_ino;
+		record.offset = offset + done;
+		if (record.offset > stat_buf.st_size) {
+			record.offset = stat_buf.st_size;
+		}
+		record.data_len = 0;
+		if ((ret = journal_append(journalmgr, &record, path, NULL, NULL, &lsn)) != 0) {
+			goto done;
+		}
+	}
+	ret = journal_sync(journalmgr, lsn);
+done:
+	FREE(buf);
+	return ret;
+}
+
+
+/**
+ * \brief Saves the size of a file an in-place write is about to extend.
+ *
+ * \param[in] journalmgr The journal manager.
+ * \param[in] txd The transaction descriptor.
+ * \param[in] fd The file descriptor to be written to.
+ * \param[in] size The size to restore, or -1 for where the next write 
+ * goes: the end of the file if opened for appending, or else the current
+ * file offset.
+ * \return 0 on success, or an errno value.
+ */
+int
+txc_journal_log_undo_truncate(txc_journalmgr_t *journalmgr, txc_tx_t *txd, 
+                              int fd, off_t size)
+{
+	txc_journal_record_t record;
+	char                 path[PATH_MAX];
+	struct stat          stat_buf;
+	off_t                lsn;
+	int                  ret;
+
+	if (journal_fd2path(fd, path, &stat_buf) < 0) {
+		return errno;
+	}
+	if ((ret = journal_track(journalmgr, fd, path, &stat_buf)) != 0) {
+		return ret;
+	}
+	if (size < 0) {
+		if ((ret = txc_libc_fcntl_getfl(fd)) < 0) {
+			return errno;
+		}
+		if (ret & O_APPEND) {
+			size = stat_buf.st_size;
+		} else if ((size = txc_libc_lseek(fd, 0, SEEK_CUR)) < 0) {
+			return errno;
+		}
+	}
+	journal_begin(journalmgr, txd);
+	record.txid = txd->journal_txid;
+	record.type = TXC_JOURNAL_UNDO_TRUNCATE;
+	record.inode = stat_buf.st_ino;
+	record.offset = size;
+	record.data_len = 0;
+	if ((ret = journal_append(journalmgr, &record, path, NULL, NULL, &lsn)) != 0) {
+		return ret;
+	}
+	return journal_sync(journalmgr, lsn);
+}
+
+
+/**
+ * \brief Logs a change to the file system namespace.
+ *
+ * Undo records (TXC_JOURNAL_UNDO_UNLINK, TXC_JOURNAL_UNDO_RENAME) are 
+ * durable when the function returns; redo records 
+ * (TXC_JOURNAL_REDO_UNLINK) when the transaction commits. 
+ *
+ * \param[in] journalmgr The journal manager.
+ * \param[in] txd The transaction descriptor.
+ * \param[in] type The record type.
+ * \param[in] path The name to remove, or to move back from.
+ * \param[in] path2 The name to move back to, or NULL.
+ * \param[in] inode The inode number path must refer to, or 0 for any.
+ * \return 0 on success, or an errno value.
+ */
+int
+txc_journal_log_name(txc_journalmgr_t *journalmgr, txc_tx_t *txd, int type,
+                     const char *path, const char *path2, ino_t inode)
+{
+	txc_journal_record_t record;
+	char                 abspath[PATH_MAX];
+	char                 abspath2[PATH_MAX];
+	off_t                lsn;
+	int                  ret;
+
+	if (journal_abspath(path, abspath) < 0 ||
+	    (path2 && journal_abspath(path2, abspath2) < 0)) 
+	{
+		return errno;
+	}
+	if ((ret = journal_track_parent(journalmgr, abspath)) != 0 ||
+	    (path2 && (ret = journal_track_parent(journalmgr, abspath2)) != 0))
+	{
+		return ret;
+	}
+	journal_begin(journalmgr, txd);
+	record.txid = txd->journal_txid;
+	record.type = type;
+	record.inode = inode;
+	record.offset = 0;
+	record.data_len = 0;
+	if ((ret = journal_append(journalmgr, &record, abspath, 
+	                          path2 ? abspath2 : NULL, NULL, &lsn)) != 0) 
+	{
+		return ret;
+	}
+	if (type == TXC_JOURNAL_REDO_UNLINK) {
+		return 0;
+	}
+	return journal_sync(journalmgr, lsn);
+}
+
+
+/**
+ * \brief Makes a name created in place durable.
+ *
+ * Redo records may refer to the name, so it must not go away in a crash
+ * after the transaction commits.
+ *
+ * \param[in] path The name.
+ * \return 0 on success, or an errno value.
+ */
+int
+txc_journal_sync_parent(const char *path)
+{
+	char   dir[PATH_MAX];
+	char   *slash;
+	int    fd;
+	int    ret = 0;
+
+	if (strlen(path) >= PATH_MAX) {
+		return ENAMETOOLONG;
+	}
+	strcpy(dir, path);
+	if ((slash = strrchr(dir, '/')) == NULL) {
+		strcpy(dir, ".");
+	} else if (slash == dir) {
+		dir[1] = '\0';
+	} else {
+		*slash = '\0';
+	}
+	if ((fd = txc_libc_open(dir, O_RDONLY | O_DIRECTORY, 0)) < 0) {
+		return errno;
+	}
+	if (txc_libc_fsync(fd) < 0) {
+		ret = errno;
+	}
+	txc_libc_close(fd);
+	return ret;
+}
+
+
+/**
+ * \brief Makes a transaction's records durable along with its commit.
+ *
+ * Called before the commit actions of the transaction run.
+ *
+ * \param[in] journalmgr The journal manager.
+ * \param[in] txd The transaction descriptor.
+ * \return 0 on success, or an errno value.
+ */
+int
+txc_journal_commit(txc_journalmgr_t *journalmgr, txc_tx_t *txd)
+{
+	txc_journal_record_t record;
+	off_t                lsn;
+	int                  ret;
+
+	if (txd->journal_txid == 0) {
+		return 0;
+	}
+	record.txid = txd->journal_txid;
+	record.type = TXC_JOURNAL_COMMIT;
+	record.inode = 0;
+	record.offset = 0;
+	record.data_len = 0;
+	if ((ret = journal_append(journalmgr, &record, NULL, NULL, NULL, &lsn)) != 0) {
+		return ret;
+	}
+	return journal_sync(journalmgr, lsn);
+}
+
+
+/**
+ * \brief Marks a transaction finished. 
+ *
+ * Called after the commit actions of the transaction run. The last 
+ * transaction to finish while a checkpoint is pending takes it.
+ *
+ * \param[in] journalmgr The journal manager.
+ * \param[in] txd The transaction descriptor.
+ */
+void
+txc_journal_end(txc_journalmgr_t *journalmgr, txc_tx_t *txd)
+{
+	if (txd->journal_txid == 0) {
+		return;
+	}
+	txd->journal_txid = 0;
+	TXC_MUTEX_LOCK(&journalmgr->mutex);
+	journalmgr->active--;
+	if (journalmgr->end >= journalmgr->checkpoint_size && 
+	    !journalmgr->checkpoint_failed) 
+	{
+		journalmgr->checkpoint_pending = 1;
+	}
+	if (journalmgr->checkpoint_pending && journalmgr->active == 0) {
+		journal_checkpoint(journalmgr);
+	}
+	TXC_MUTEX_UNLOCK(&journalmgr->mutex);
+}
+
+
+/**
+ * \brief Marks a transaction rolled back.
+ *
+ * Called after the undo actions of the transaction run. The record is 
+ * synced so that recovery does not roll the transaction back a second 
+ * time, over names later transactions may have reused.
+ *
+ * \param[in] journalmgr The journal manager.
+ * \param[in] txd The transaction descriptor.
+ */
+void
+txc_journal_abort(txc_journalmgr_t *journalmgr, txc_tx_t *txd)
+{
+	txc_journal_record_t record;
+	off_t                lsn;
+
+	if (txd->journal_txid == 0) {
+		return;
+	}
+	record.txid = txd->journal_txid;
+	record.type = TXC_JOURNAL_ABORT;
+	record.inode = 0;
+	record.offset = 0;
+	record.data_len = 0;
+	if (journal_append(journalmgr, &record, NULL, NULL, NULL, &lsn) == 0) {
+		journal_sync(journalmgr, lsn);
+	}
+	txc_journal_end(journalmgr, txd);
+}
@@ -0,0 +1,74 @@
+/*
+    Copyright (C) 2008-2009 Computer Sciences Department, 
+    University of Wisconsin -- Madison
+
+    ----------------------------------------------------------------------
+
+    This file is part of the xCalls transactional API, originally 
+    developed at the University of Wisconsin -- Madison.
+
+    xCalls was originally developed primarily by Haris Volos and 
+    Neelam Goyal with contributions from Andres Jaan Tack.
+
+    ----------------------------------------------------------------------
+
+    xCalls is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as 
+    published by the Free Software Foundation, either version 3 of 
+    the License, or (at your option) any later version.
+
+    xCalls is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public 
+    License along with xCalls.  If not, see <http://www.gnu.org/licenses/>.
+
+### END HEADER ###
+*/
+
+/**
+ * \file journal.h
+ *
+ * \brief Write-ahead journal interface.
+ */
+
+#ifndef _TXC_JOURNAL_H
+#define _TXC_JOURNAL_H
+
+#include <sys/types.h>
+#include <misc/result.h>
+
+/* See tx.h */
+# ifndef TYPEDEF_TXC_TX_T
+# define TYPEDEF_TXC_TX_T
+typedef struct txc_tx_s txc_tx_t;
+# endif /* TYPEDEF_TXC_TX_T */
+
+typedef struct txc_journalmgr_s txc_journalmgr_t;
+
+/** Journal record types. */
+#define TXC_JOURNAL_COMMIT         1  /**< Transaction committed */
+#define TXC_JOURNAL_ABORT          2  /**< Transaction rolled back */
+#define TXC_JOURNAL_REDO_WRITE     3  /**< Data written to a file */
+#define TXC_JOURNAL_REDO_UNLINK    4  /**< Name removed at commit */
+#define TXC_JOURNAL_UNDO_WRITE     5  /**< Data a write overwrote */
+#define TXC_JOURNAL_UNDO_TRUNCATE  6  /**< Size of a file before it grew */
+#define TXC_JOURNAL_UNDO_UNLINK    7  /**< Name created in place */
+#define TXC_JOURNAL_UNDO_RENAME    8  /**< Name moved away in place */
+
+extern txc_journalmgr_t *txc_g_journalmgr;
+
+txc_result_t txc_journalmgr_create(txc_journalmgr_t **, const char *);
+void txc_journalmgr_destroy(txc_journalmgr_t **);
+int txc_journal_log_write(txc_journalmgr_t *, txc_tx_t *, int, off_t, const void *, size_t);
+int txc_journal_log_undo_write(txc_journalmgr_t *, txc_tx_t *, int, off_t, size_t);
+int txc_journal_log_undo_truncate(txc_journalmgr_t *, txc_tx_t *, int, off_t);
+int txc_journal_log_name(txc_journalmgr_t *, txc_tx_t *, int, const char *, const char *, ino_t);
+int txc_journal_sync_parent(const char *);
+int txc_journal_commit(txc_journalmgr_t *, txc_tx_t *);
+void txc_journal_end(txc_journalmgr_t *, txc_tx_t *);
+void txc_journal_abort(txc_journalmgr_t *, txc_tx_t *);
+
+#endif /* _TXC_JOURNAL_H */
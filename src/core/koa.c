@@ -55,9 +55,17 @@
  * following a valid reference through a file descriptor. This is because a KOA
  * cannot be destroyed without holding locks on all the file descriptors
  * referencing the KOA.
- * \li KOA mutex lock: Synchronizes KOA accesses when not holding the alias or
- * file descriptor lock. This can happen when deattaching from a KOA/sentinel
- * when a transaction commits/aborts. \todo This lock might be unnecessary.
+ *
+ * KOA reference counters are updated atomically so attaching to and 
+ * detaching from a KOA when not holding the alias or file descriptor lock 
+ * (e.g. when a transaction commits/aborts) takes no lock. A destroyed KOA 
+ * is retired to the epoch manager and reclaimed only after every 
+ * transaction that might have followed a reference to it has completed 
+ * (see epoch.c). Looking up the KOA of a file descriptor still takes the 
+ * file descriptor lock: xCalls may run outside transactions, where the 
+ * epoch manager does not protect them, and they read and update the 
+ * descriptor's mapping and the KOA's metadata (e.g. pending output) under
+ * the same lock.
  * 
  * <em>More on file descriptor locks</em>
  * \li Operations that use a file descriptor don't acquire the KOA cache lock
@@ -78,6 +86,7 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <fcntl.h>
 #include <libc/syscalls.h>
 #include <misc/malloc.h>
 #include <misc/result.h>
@@ -85,71 +94,121 @@
 #include <misc/pool.h>
 #include <misc/hash_table.h>
 #include <misc/mutex.h>
+#include <misc/atomic.h>
 #include <core/config.h>
 #include <core/koa.h>
 #include <core/sentinel.h>
 #include <core/buffer.h>
+#include <core/epoch.h>
 #include <stdlib.h>
 #include <pthread.h>
 #include <stddef.h>
 
 
 typedef struct txc_koa_file_s txc_koa_file_t;
+typedef struct txc_koa_sock_stream_s txc_koa_sock_stream_t;
 typedef struct txc_koa_sock_dgram_s txc_koa_sock_dgram_t;
-typedef struct txc_koa_pipe_read_end_s txc_koa_pipe_read_end_t;
+typedef struct txc_koa_pipe_write_end_s txc_koa_pipe_write_end_t;
+
+
+/** 
+ * Flushes of a file requested by committing transactions. Requests take
+ * increasing tickets; a flush started after a ticket was taken covers it.
+ * Each caller waits on a record of its own, in which the flush covering 
+ * its ticket stores the outcome.
+ */
+typedef struct txc_koa_file_sync_s txc_koa_file_sync_t;
+typedef struct txc_koa_file_sync_waiter_s txc_koa_file_sync_waiter_t;
+
+struct txc_koa_file_sync_waiter_s {
+	unsigned long              ticket;
+	int                        done;  /**< A flush covering the ticket has completed */
+	int                        error; /**< Error of that flush, 0 on success */
+	txc_koa_file_sync_waiter_t *next;
+};
+
+struct txc_koa_file_sync_s {
+	txc_mutex_t                mutex;
+	pthread_cond_t             cond;
+	int                        busy;           /**< A leader is flushing the file */
+	unsigned long              requested;      /**< Last ticket taken */
+	unsigned long              full_requested; /**< Last ticket asking for fsync rather than fdatasync */
+	unsigned long              completed;      /**< Last ticket covered by a completed flush */
+	txc_koa_file_sync_waiter_t *waiters;       /**< Callers whose flush has not completed */
+};
 
 
 /** File KOA */
 struct txc_koa_file_s {
-	ino_t st_ino;   /**< Inode number  */
-	dev_t st_dev;   /**< Device        */
-	dev_t st_rdev;  /**< Device type   */
+	ino_t               st_ino;          /**< Inode number  */
+	dev_t               st_dev;          /**< Device        */
+	dev_t               st_rdev;         /**< Device type   */
+	void                *pending_output; /**< Deferred writes of the transaction holding the sentinel */
+	txc_koa_file_sync_t sync;
 };	
 
 
+/** Stream socket KOA */
+struct txc_koa_sock_stream_s {
+	void                    *pending_output;        /**< Deferred output of the transaction holding the sentinel */
+};
+
+
 /** Datagram socket KOA */
 struct txc_koa_sock_dgram_s {
-	txc_buffer_circular_t   *buffer_circular_input; 
+	void                    *pending_output;        /**< Deferred output of the transaction holding the sentinel */
 };
 
 
-/** Pipe read end KOA */
-struct txc_koa_pipe_read_end_s {
-	txc_buffer_circular_t   *buffer_circular_input; 
+/** Pipe write end KOA */
+struct txc_koa_pipe_write_end_s {
+	void                    *pending_output;        /**< Deferred output of the transaction holding the sentinel */
 };
 
 
 /** 
  * KOA (Kernel Object Abstraction): A user-mode representation of a 
  * logical kernel object.
+ *
+ * The fields used by the xCalls' lookup-then-tryacquire path come first
+ * so that, with the object aligned to a cache line, an xCall touches a 
+ * single line of the KOA before it gets to the kernel object.
  */
 struct txc_koa_s {
-	txc_koamgr_t                *manager;                   /**< Manager responsible for this KOA */
-	txc_mutex_t                 mutex;                      /**< Mutex for synchronizing access to the fields of this KOA */
 	txc_sentinel_t              *sentinel;                  /**< User level sentinel providing transactional isolation for this KOA */
+	int                         type;                       /**< Type of object */
+	volatile int                refcnt;                     /**< Total reference count */
+	txc_buffer_ring_t           *buffer;                    /**< Input buffer of pipe read end and socket KOAs, NULL otherwise */
+	txc_koamgr_t                *manager;                   /**< Manager responsible for this KOA */
 	struct {
 		int                     fd[TXC_MAX_NUM_FDREFS_PER_KOA]; /**< File descriptors referencing the kernel object of this KOA */
 		int                     refcnt;                         /**< Number of file descriptors referencing the kernel object of this KOA */ 
 	} fdref;
-	int                         refcnt;                     /**< Total reference count */
-	int                         type;                       /**< Type of object */
+	txc_epoch_entry_t           retire_entry;               /**< Retire list entry used by the epoch manager */
 	union {
 		txc_koa_file_t          file;                       /**< File specific fields */
+		txc_koa_sock_stream_t   sock_stream;                /**< Stream socket specific fields */
 		txc_koa_sock_dgram_t    sock_dgram;                 /**< Datagram socket specific fields */
-		txc_koa_pipe_read_end_t pipe_read_end;              /**< Pipe read end specific rields */
+		txc_koa_pipe_write_end_t pipe_write_end;            /**< Pipe write end specific fields */
 	};	
-}; 
+} __attribute__ ((aligned (TXC_CACHELINE_SIZE))); 
 
 typedef struct txc_fd2koa_s txc_fd2koa_t;
 
 
-/** Maps a file/pipe/socket descriptor to a KOA. */
+/** 
+ * Maps a file/pipe/socket descriptor to a KOA. Entries of descriptors 
+ * used by different threads must not share a cache line.
+ */
 struct txc_fd2koa_s {
 	txc_mutex_t mutex;
 	txc_koa_t   *koa;
-};
+	void        *shadow_offset;  /**< Offset shadowed by the transaction holding the KOA's sentinel */
+} __attribute__ ((aligned (TXC_CACHELINE_SIZE)));
 
 typedef struct txc_alias_cache_s txc_alias_cache_t;
+typedef struct txc_fdcache_entry_s txc_fdcache_entry_t;
+typedef struct txc_fdcache_s txc_fdcache_t;
 
 
 /** 
@@ -166,27 +225,85 @@ struct txc_alias_cache_s {
 };
 
 
+/** A file descriptor parked in the descriptor cache. */
+struct txc_fdcache_entry_s {
+	int                 fd;     /**< Parked file descriptor                    */
+	txc_koa_t           *koa;   /**< File KOA the descriptor refers to         */
+	txc_fdcache_entry_t *prev;  /**< Previous (more recently used) entry       */
+	txc_fdcache_entry_t *next;  /**< Next (less recently used) entry           */
+};
+
+
+/** 
+ * Descriptor cache: Keeps file descriptors closed by committed 
+ * transactions open so that a later open of the same file can reuse 
+ * them instead of paying for an open system call and a KOA 
+ * creation/destruction. A parked descriptor holds a logical reference to
+ * its KOA, which keeps the KOA and its sentinel alive. Entries are kept 
+ * in LRU order and the least recently parked descriptor is closed when the
+ * cache is full. Accesses are serialized using the alias cache's mutex.
+ */
+struct txc_fdcache_s {
+	txc_fdcache_entry_t *entries;             /* preallocated entries */
+	txc_fdcache_entry_t *free;                /* unused entries */
+	txc_fdcache_entry_t *head;                /* most recently used */
+	txc_fdcache_entry_t *tail;                /* least recently used */
+	int                 size;                 /* number of parked descriptors */
+	int                 size_max;             /* capacity (0 if disabled) */
+};
+
+
 /** KOA Manager */
 struct txc_koamgr_s {
 	txc_alias_cache_t alias_cache;            /**< Alias cache                     */
+	txc_fdcache_t     fdcache;                /**< Cache of closed descriptors     */
 	txc_fd2koa_t      map[TXC_KOA_MAP_SIZE];  /**< Maps file descriptor to KOA.    */
 	txc_sentinelmgr_t *sentinelmgr;           /**< Pointer to the sentinel manager *
 	                                           *   providing the sentinels.        */
 	txc_buffermgr_t   *buffermgr;             /**< Pointer to the buffer manager   *
 	                                           *   that provides buffers to the    *
 											   *   KOA objects.                    */
-	txc_pool_t        *pool_koa_obj;          /**< Pool from where we allocate     *
-	                                           *   KOA objects.                    */
+	txc_pool_t        *pool_koa_obj[TXC_KOA_TYPE_MAX+1];
+	                                          /**< Per type pools from where we    *
+	                                           *   allocate KOA objects.           */
+	txc_epochmgr_t    *epochmgr;              /**< Pointer to the epoch manager    *
+	                                           *   reclaiming destroyed KOAs.      */
 };
 
 
 txc_koamgr_t *txc_g_koamgr;
 
 
+/** Number of KOA objects preallocated for each type of KOA. */
+static const unsigned int koa_pool_size[TXC_KOA_TYPE_MAX+1] = {
+	0,
+	TXC_KOA_SOCK_DGRAM_NUM,      /* TXC_KOA_IS_SOCK_DGRAM */
+	TXC_KOA_SOCK_STREAM_NUM,     /* TXC_KOA_IS_SOCK_STREAM */
+	TXC_KOA_PIPE_READ_END_NUM,   /* TXC_KOA_IS_PIPE_READ_END */
+	TXC_KOA_PIPE_WRITE_END_NUM,  /* TXC_KOA_IS_PIPE_WRITE_END */
+	TXC_KOA_FILE_NUM             /* TXC_KOA_IS_FILE */
+};
+
+
+static
+void
+koa_pools_destroy(txc_koamgr_t *koamgr)
+{
+	int type;
+
+	for (type=1; type<=TXC_KOA_TYPE_MAX; type++) {
+		if (koamgr->pool_koa_obj[type]) {
+			txc_pool_destroy(&(koamgr->pool_koa_obj[type]));
+		}
+	}
+}
+
+
 /**
  * \brief Creates a KOA manager.
  *
- * It creates a pool of KOAs and an alias cache for file KOAs.
+ * It creates a pool of KOAs for each type of KOA and an alias cache 
+ * for file KOAs.
  * It also precreates pipe KOAs for standard input, output, error.
  *
  * \param[out] koamgrp Pointer to the create manager.
@@ -194,35 +311,48 @@ txc_koamgr_t *txc_g_koamgr;
  *            manager's KOAs with sentinels.
  * \param[in] buffermgr The buffer manager backing this 
  *            manager's KOAs with buffers.
+ * \param[in] epochmgr The epoch manager reclaiming destroyed KOAs.
  * \return Code indicating success or failure (reason) of the operation.
  */
 txc_result_t
 txc_koamgr_create(txc_koamgr_t **koamgrp, 
                   txc_sentinelmgr_t *sentinelmgr, 
-                  txc_buffermgr_t *buffermgr) 
+                  txc_buffermgr_t *buffermgr,
+                  txc_epochmgr_t *epochmgr) 
 {
 	int          i;
+	int          type;
 	txc_result_t result;
 	txc_koa_t    *koa;
 
-	*koamgrp = (txc_koamgr_t *) MALLOC(sizeof(txc_koamgr_t));
-	if (*koamgrp == NULL) {
+	/* The descriptor map is cache line aligned. */
+	if (MEMALIGN(TXC_MALLOC_KOA, (void **) koamgrp, TXC_CACHELINE_SIZE, sizeof(txc_koamgr_t)) != 0) {
+		*koamgrp = NULL;
 		return TXC_R_NOMEMORY;
 	}
-	if ((result = txc_pool_create(&((*koamgrp)->pool_koa_obj), 
-	                              sizeof(txc_koa_t),
-	                              TXC_KOA_NUM, 
-	                              NULL)) != TXC_R_SUCCESS) 
-	{
-		FREE(*koamgrp);
-		return result;
+	for (type=0; type<=TXC_KOA_TYPE_MAX; type++) {
+		(*koamgrp)->pool_koa_obj[type] = NULL;
+	}
+	for (type=1; type<=TXC_KOA_TYPE_MAX; type++) {
+		if ((result = txc_pool_create_aligned(&((*koamgrp)->pool_koa_obj[type]), 
+		                                      sizeof(txc_koa_t),
+		                                      koa_pool_size[type], 
+		                                      TXC_CACHELINE_SIZE,
+		                                      TXC_POOL_HUGEPAGES,
+		                                      NULL)) != TXC_R_SUCCESS) 
+		{
+			(*koamgrp)->pool_koa_obj[type] = NULL;
+			koa_pools_destroy(*koamgrp);
+			FREE(*koamgrp);
+			return result;
+		}
 	}
 
 	if ((result = txc_hash_table_create(&((*koamgrp)->alias_cache.hash_tbl), 
 	                                    TXC_KOA_CACHE_HASHTBL_SIZE,
 	                                    TXC_BOOL_FALSE)) != TXC_R_SUCCESS) 
 	{
-		txc_pool_destroy(&((*koamgrp)->pool_koa_obj));
+		koa_pools_destroy(*koamgrp);
 		FREE(*koamgrp);
 		return result;
 	}
@@ -230,10 +360,32 @@ txc_koamgr_create(txc_koamgr_t **koamgrp,
 	for (i=0; i<TXC_KOA_MAP_SIZE; i++) {
 		TXC_MUTEX_INIT(&((*koamgrp)->map[i].mutex), NULL);
 		(*koamgrp)->map[i].koa = NULL;
+		(*koamgrp)->map[i].shadow_offset = NULL;
+	}
+
+	(*koamgrp)->fdcache.size = 0;
+	(*koamgrp)->fdcache.size_max = txc_runtime_settings.koa_fdcache_size;
+	(*koamgrp)->fdcache.head = (*koamgrp)->fdcache.tail = NULL;
+	(*koamgrp)->fdcache.free = (*koamgrp)->fdcache.entries = NULL;
+	if ((*koamgrp)->fdcache.size_max > 0) {
+		(*koamgrp)->fdcache.entries = (txc_fdcache_entry_t *) 
+		                              CALLOC(TXC_MALLOC_KOA, (*koamgrp)->fdcache.size_max, 
+		                                     sizeof(txc_fdcache_entry_t));
+		if ((*koamgrp)->fdcache.entries == NULL) {
+			txc_hash_table_destroy(&((*koamgrp)->alias_cache.hash_tbl));
+			koa_pools_destroy(*koamgrp);
+			FREE(*koamgrp);
+			return TXC_R_NOMEMORY;
+		}
+		for (i=0; i<(*koamgrp)->fdcache.size_max; i++) {
+			(*koamgrp)->fdcache.entries[i].next = (*koamgrp)->fdcache.free;
+			(*koamgrp)->fdcache.free = &(*koamgrp)->fdcache.entries[i];
+		}
 	}
 
 	(*koamgrp)->sentinelmgr = sentinelmgr;
 	(*koamgrp)->buffermgr = buffermgr;
+	(*koamgrp)->epochmgr = epochmgr;
 
 	/* Precreate standard KOAs: input, output, error */
 	txc_koa_create(*koamgrp, &koa, TXC_KOA_IS_PIPE_READ_END, NULL); 
@@ -256,7 +408,15 @@ txc_koamgr_create(txc_koamgr_t **koamgrp,
 void
 txc_koamgr_destroy(txc_koamgr_t **koamgrp) 
 {
-	txc_pool_destroy(&((*koamgrp)->pool_koa_obj));
+	txc_fdcache_entry_t *entry;
+
+	for (entry = (*koamgrp)->fdcache.head; entry; entry = entry->next) {
+		txc_libc_close(entry->fd);
+	}
+	if ((*koamgrp)->fdcache.entries) {
+		FREE((*koamgrp)->fdcache.entries);
+	}
+	koa_pools_destroy(*koamgrp);
 	txc_hash_table_destroy(&((*koamgrp)->alias_cache.hash_tbl));
 	FREE(*koamgrp);
 	*koamgrp = NULL;
@@ -379,10 +539,13 @@ txc_koa_alias_cache_lookup_inode(txc_koamgr_t *koamgr, ino_t inode_number, txc_k
  * \param[in] type Type of the KOA to be created: 
  *                   TXC_KOA_IS_FILE, 
  *                   TXC_KOA_IS_SOCK_DGRAM, 
+ *                   TXC_KOA_IS_SOCK_STREAM, 
  *                   TXC_KOA_IS_PIPE_READ_END
  * \param[in] args Arguments specific to the type of KOA created. 
  *                 For file KOA this is the inode of the file.
- * \return Code indicating success or failure (reason) of the operation.
+ * \return Code indicating success or failure (reason) of the operation;
+ *         TXC_R_NOMEMORY if the KOAs of the type or the sentinels run out,
+ *         or the error of creating the input buffer of a pipe or socket.
  */
 txc_result_t
 txc_koa_create(txc_koamgr_t *koamgr, txc_koa_t **koap, int type, void *args) 
@@ -391,79 +554,107 @@ txc_koa_create(txc_koamgr_t *koamgr, txc_koa_t **koap, int type, void *args)
 	txc_sentinel_t *sentinel;
 	txc_result_t   result;
 
-	if ((result = txc_pool_object_alloc(koamgr->pool_koa_obj,(void **) &koa, 1)) 
+	TXC_ASSERT(type > 0 && type <= TXC_KOA_TYPE_MAX);
+	if ((result = txc_pool_object_alloc(koamgr->pool_koa_obj[type],(void **) &koa, 1)) 
 	    != TXC_R_SUCCESS) 
 	{
-		TXC_INTERNALERROR("Could not create KOA object\n");
-		return result;
+		return TXC_R_NOMEMORY;
 	}
 	if ((result = txc_sentinel_create(koamgr->sentinelmgr, &sentinel)) 
 	    != TXC_R_SUCCESS)
 	{	
-		TXC_INTERNALERROR("Could not create sentinel for KOA object\n");
-		return result;
+		txc_pool_object_free(koamgr->pool_koa_obj[type], (void **) &koa, 1);
+		return TXC_R_NOMEMORY;
 	}	
-	TXC_MUTEX_INIT(&(koa->mutex), NULL); 
 	koa->manager = koamgr;
 	koa->sentinel = sentinel;
 	koa->type = type;
 	koa->refcnt = 0;
 	koa->fdref.refcnt = 0;
+	koa->buffer = NULL;
 
 	switch(type) {
 		case TXC_KOA_IS_FILE:
 			koa->file.st_ino = (ino_t) args;
+			koa->file.pending_output = NULL;
+			TXC_MUTEX_INIT(&koa->file.sync.mutex, NULL);
+			pthread_cond_init(&koa->file.sync.cond, NULL);
+			koa->file.sync.busy = 0;
+			koa->file.sync.requested = 0;
+			koa->file.sync.full_requested = 0;
+			koa->file.sync.completed = 0;
+			koa->file.sync.waiters = NULL;
 			break;
 		case TXC_KOA_IS_SOCK_DGRAM:
-			txc_buffer_circular_create(koa->manager->buffermgr, 
-			                           &(koa->sock_dgram.buffer_circular_input));
+			result = txc_buffer_ring_create(koa->manager->buffermgr, 
+			                                TXC_BUFFER_CLASS_SOCK_DGRAM, &(koa->buffer));
+			koa->sock_dgram.pending_output = NULL;
 			break;
 		case TXC_KOA_IS_PIPE_READ_END:
-			txc_buffer_circular_create(koa->manager->buffermgr, 
-			                           &(koa->pipe_read_end.buffer_circular_input));
+			result = txc_buffer_ring_create(koa->manager->buffermgr, 
+			                                TXC_BUFFER_CLASS_PIPE, &(koa->buffer));
+			break;
+		case TXC_KOA_IS_PIPE_WRITE_END:
+			koa->pipe_write_end.pending_output = NULL;
+			break;
+		case TXC_KOA_IS_SOCK_STREAM:
+			result = txc_buffer_ring_create(koa->manager->buffermgr, 
+			                                TXC_BUFFER_CLASS_SOCK_STREAM, &(koa->buffer));
+			koa->sock_stream.pending_output = NULL;
 			break;
 		default:
 			break; /* do nothing */
 	}
+	if (result != TXC_R_SUCCESS) {
+		/* The KOA was never published; release it right away. */
+		txc_sentinel_detach(sentinel);
+		txc_pool_object_free(koamgr->pool_koa_obj[type], (void **) &koa, 1);
+		return result;
+	}
 
 	*koap = koa;
 	return TXC_R_SUCCESS;
 }
 
 
-/**
- * \brief Destroy a KOA.
- *
- * \param[in,out] Pointer to the KOA to be destroyed. 
- */
+static
 void
-txc_koa_destroy(txc_koa_t **koap) 
+koa_reclaim(void *obj) 
 {
-	txc_koa_t *koa = *koap;
+	txc_koa_t *koa = (txc_koa_t *) obj;
 
 	/* 
 	 * txc_sentinel_detach will destroy the sentinel if after the
  	 * detach operation is (sentinel->refcnt == 0) 
  	 */
-	txc_sentinel_detach((*koap)->sentinel);
+	txc_sentinel_detach(koa->sentinel);
 
-	switch((*koap)->type) {
-		case TXC_KOA_IS_FILE:
-			break;
-		case TXC_KOA_IS_SOCK_DGRAM:
-			txc_buffer_circular_destroy(&((*koap)->sock_dgram.buffer_circular_input));
-			break;
-		case TXC_KOA_IS_PIPE_READ_END:
-			txc_buffer_circular_destroy(&((*koap)->pipe_read_end.buffer_circular_input));
-			break;
-		default:
-			break; /* do nothing */
+	if (koa->buffer) {
+		txc_buffer_ring_destroy(&(koa->buffer));
 	}
-	txc_pool_object_free((*koap)->manager->pool_koa_obj, 
+	txc_pool_object_free(koa->manager->pool_koa_obj[koa->type], 
 	                     (void **) &koa, 1);
 }
 
 
+/**
+ * \brief Destroy a KOA.
+ *
+ * The KOA is retired and its memory, sentinel and buffers are reclaimed 
+ * once no transaction can hold a reference to it.
+ *
+ * \param[in,out] Pointer to the KOA to be destroyed. 
+ */
+void
+txc_koa_destroy(txc_koa_t **koap) 
+{
+	txc_koa_t *koa = *koap;
+
+	txc_epoch_retire(koa->manager->epochmgr, &koa->retire_entry, 
+	                 koa_reclaim, (void *) koa);
+}
+
+
 /**
  * \brief Attach a file descriptor to a KOA.
  *
@@ -488,8 +679,7 @@ txc_koa_attach_fd(txc_koa_t *koa, int fd, int lock)
 	}	
 	TXC_ASSERT(koamgr->map[fd].koa == NULL);
 	koamgr->map[fd].koa = koa;
-	koa->refcnt++;
-	first_attach = (koa->refcnt == 1) ? 1 : 0;
+	first_attach = (TXC_ATOMIC_INC(&koa->refcnt) == 1) ? 1 : 0;
 	if (first_attach) {
 		/** First attach -- insert it into the alias cache if aliasable KOA. */
 		if (koa->type == TXC_KOA_IS_FILE) {
@@ -542,6 +732,7 @@ txc_koa_detach_fd(txc_koa_t *koa, int fd, int lock)
 		return TXC_R_FAILURE;
 	}
 	koamgr->map[fd].koa = NULL;
+	koamgr->map[fd].shadow_offset = NULL;
 	/* Remove backward pointer from KOA to file descriptor */
 	for (i=0; i<koa->fdref.refcnt; i++) {
 		if (koa->fdref.fd[i] == fd) {
@@ -555,11 +746,10 @@ txc_koa_detach_fd(txc_koa_t *koa, int fd, int lock)
 		}	
 		return TXC_R_FAILURE;
 	}
-	koa->fdref.fd[index] = koa->fdref.fd[koa->fdref.refcnt];
+	koa->fdref.fd[index] = koa->fdref.fd[koa->fdref.refcnt-1];
 	koa->fdref.refcnt--;
 
-	koa->refcnt--;
-	last_detach = (koa->refcnt == 0) ? 1 : 0;
+	last_detach = (TXC_ATOMIC_DEC(&koa->refcnt) == 0) ? 1 : 0;
 	if (last_detach) {
 		/* Last detach -- remove it from the alias cache if aliasable KOA. */
 		if (koa->type == TXC_KOA_IS_FILE) {
@@ -581,9 +771,286 @@ txc_koa_detach_fd(txc_koa_t *koa, int fd, int lock)
 }
 
 
+static inline
+void
+fdcache_unlink(txc_fdcache_t *fdcache, txc_fdcache_entry_t *entry)
+{
+	if (entry->prev) {
+		entry->prev->next = entry->next;
+	} else {
+		fdcache->head = entry->next;
+	}
+	if (entry->next) {
+		entry->next->prev = entry->prev;
+	} else {
+		fdcache->tail = entry->prev;
+	}
+	entry->next = fdcache->free;
+	fdcache->free = entry;
+	fdcache->size--;
+}
+
+
+/**
+ * \brief Parks a file descriptor in the descriptor cache instead of closing it.
+ *
+ * The file descriptor is unmapped from its KOA but the KOA is kept alive 
+ * by a logical reference owned by the cache. If the cache is full then the
+ * least recently parked descriptor is closed.
+ *
+ * Caller must hold the alias cache's serialization mutex and the lock on 
+ * the file descriptor.
+ *
+ * \param[in] koa The file KOA the file descriptor is attached to.
+ * \param[in] fd The file descriptor to park.
+ * \return TXC_R_SUCCESS if the descriptor was parked, TXC_R_FAILURE if the 
+ * caller has to close the descriptor itself.
+ */
+txc_result_t
+txc_koa_fdcache_park(txc_koa_t *koa, int fd)
+{
+	txc_koamgr_t        *koamgr = koa->manager;
+	txc_fdcache_t       *fdcache = &koamgr->fdcache;
+	txc_fdcache_entry_t *entry;
+	txc_fdcache_entry_t *victim;
+
+	if (fdcache->size_max == 0 || koa->type != TXC_KOA_IS_FILE) {
+		return TXC_R_FAILURE;
+	}
+	if (fdcache->size == fdcache->size_max) {
+		victim = fdcache->tail;
+		TXC_DEBUG_PRINT(TXC_DEBUG_KOA, 
+		                "txc_koa_fdcache_park: evict koa = %p, fd = %d\n", 
+		                victim->koa, victim->fd);
+		txc_libc_close(victim->fd);
+		txc_koa_detach(victim->koa);
+		fdcache_unlink(fdcache, victim);
+	}
+
+	txc_koa_attach(koa);
+	if (txc_koa_detach_fd(koa, fd, 0) != TXC_R_SUCCESS) {
+		txc_koa_detach(koa);
+		return TXC_R_FAILURE;
+	}
+
+	entry = fdcache->free;
+	fdcache->free = entry->next;
+	entry->fd = fd;
+	entry->koa = koa;
+	entry->prev = NULL;
+	entry->next = fdcache->head;
+	if (fdcache->head) {
+		fdcache->head->prev = entry;
+	} else {
+		fdcache->tail = entry;
+	}
+	fdcache->head = entry;
+	fdcache->size++;
+
+	TXC_DEBUG_PRINT(TXC_DEBUG_KOA, 
+	                "txc_koa_fdcache_park: koa = %p, fd = %d, size = %d\n", 
+	                koa, fd, fdcache->size);
+
+	return TXC_R_SUCCESS;
+}
+
+
+/**
+ * \brief Takes a parked file descriptor of a file out of the descriptor cache.
+ *
+ * Looks for a descriptor of the file parked with the same status flags 
+ * and rewinds its offset. Descriptors of files that have been unlinked in 
+ * the meantime are closed rather than reused.
+ *
+ * The returned descriptor is not mapped to any KOA, but the cache's 
+ * logical reference keeps the file's KOA alive in the alias cache. The 
+ * caller must attach the descriptor to the KOA and then drop that 
+ * reference using txc_koa_detach.
+ *
+ * Caller must hold the alias cache's serialization mutex.
+ *
+ * \param[in] koamgr KOA manager.
+ * \param[in] inode_number Inode number of the file.
+ * \param[in] flags The flags the caller would open the file with.
+ * \param[out] fdp The reused file descriptor.
+ * \return Code indicating success or failure (reason) of the operation.
+ */
+txc_result_t
+txc_koa_fdcache_reuse(txc_koamgr_t *koamgr, ino_t inode_number, int flags, 
+                      int *fdp)
+{
+	txc_fdcache_t       *fdcache = &koamgr->fdcache;
+	txc_fdcache_entry_t *entry;
+	txc_fdcache_entry_t *next;
+	txc_koa_t           *koa;
+	struct stat         stat_buf;
+	int                 fd;
+	int                 fd_flags;
+
+	if (fdcache->size == 0 || (flags & (O_CREAT | O_EXCL | O_TRUNC))) {
+		return TXC_R_NOTFOUND;
+	}
+	for (entry = fdcache->head; entry; entry = next) {
+		next = entry->next;
+		koa = entry->koa;
+		if (koa->file.st_ino != inode_number) {
+			continue;
+		}
+		fd = entry->fd;
+		if ((fd_flags = txc_libc_fcntl_getfl(fd)) < 0 ||
+		    (fd_flags & TXC_KOA_FDCACHE_FLAGS_MASK) != 
+		    (flags & TXC_KOA_FDCACHE_FLAGS_MASK))
+		{
+			continue;
+		}
+		fdcache_unlink(fdcache, entry);
+		if (txc_libc_fstat(fd, &stat_buf) < 0 || 
+		    stat_buf.st_nlink == 0 ||
+		    stat_buf.st_ino != inode_number ||
+		    txc_libc_lseek(fd, 0, SEEK_SET) < 0) 
+		{
+			txc_libc_close(fd);
+			txc_koa_detach(koa);
+			continue;
+		}
+		TXC_DEBUG_PRINT(TXC_DEBUG_KOA, 
+		                "txc_koa_fdcache_reuse: koa = %p, fd = %d, size = %d\n", 
+		                koa, fd, fdcache->size);
+		*fdp = fd;
+		return TXC_R_SUCCESS;
+	}
+	return TXC_R_NOTFOUND;
+}
+
+
+/**
+ * \brief Creates a KOA for a file descriptor not created through xCalls.
+ *
+ * Descriptors inherited at startup or opened with the plain system calls 
+ * have no KOA. We classify the descriptor using fstat and create a KOA of 
+ * the matching type: a file, a pipe end, or a datagram or stream socket. 
+ * A file that is already live in the alias cache shares its existing KOA 
+ * so that both descriptors are isolated by the same sentinel. Stream 
+ * sockets returned by accept are adopted this way.
+ *
+ * Caller must hold the lock on the file descriptor. For a file, the lock
+ * is dropped and reacquired after the alias cache lock, to keep the alias 
+ * cache -> file descriptor locking order, and the descriptor may have been
+ * mapped in the meantime. It is still held when this function returns.
+ *
+ * An adopted descriptor must be closed using x_close, otherwise its stale 
+ * KOA would remain mapped.
+ *
+ * \param[in] koamgr KOA manager.
+ * \param[in] fd File descriptor.
+ * \param[out] koap Pointer to the KOA created for the file descriptor.
+ * \return Code indicating success or failure (reason) of the operation.
+ */
+static
+txc_result_t
+koa_materialize_fd(txc_koamgr_t *koamgr, int fd, txc_koa_t **koap) 
+{
+	struct stat  stat_buf;
+	int          type;
+	int          flags;
+	int          sock_type;
+	socklen_t    optlen;
+	int          i;
+	int          num_fdrefs;
+	txc_koa_t    *koa;
+	txc_result_t result;
+
+	if (txc_libc_fstat(fd, &stat_buf) < 0) {
+		return TXC_R_FAILURE;
+	}
+	if (S_ISREG(stat_buf.st_mode)) {
+		type = TXC_KOA_IS_FILE;
+	} else if (S_ISFIFO(stat_buf.st_mode)) {
+		if ((flags = txc_libc_fcntl_getfl(fd)) < 0) {
+			return TXC_R_FAILURE;
+		}
+		if ((flags & O_ACCMODE) == O_RDONLY) {
+			type = TXC_KOA_IS_PIPE_READ_END;
+		} else {
+			type = TXC_KOA_IS_PIPE_WRITE_END;
+		}
+	} else if (S_ISSOCK(stat_buf.st_mode)) {
+		optlen = sizeof(sock_type);
+		if (txc_libc_getsockopt(fd, SOL_SOCKET, SO_TYPE, &sock_type, &optlen) < 0) {
+			return TXC_R_FAILURE;
+		}
+		if (sock_type == SOCK_DGRAM) {
+			type = TXC_KOA_IS_SOCK_DGRAM;
+		} else if (sock_type == SOCK_STREAM) {
+			type = TXC_KOA_IS_SOCK_STREAM;
+		} else {
+			return TXC_R_NOTIMPLEMENTED;
+		}
+	} else {
+		return TXC_R_NOTIMPLEMENTED;
+	}
+
+	if (type == TXC_KOA_IS_FILE) {
+		txc_koa_unlock_fd(koamgr, fd);
+		txc_koa_lock_alias_cache(koamgr);
+		txc_koa_lock_fd(koamgr, fd);
+		if ((koa = koamgr->map[fd].koa) != NULL) {
+			/* Someone else mapped the descriptor while we didn't hold it. */
+			txc_koa_unlock_alias_cache(koamgr);
+			*koap = koa;
+			return TXC_R_SUCCESS;
+		}
+		if (txc_koa_alias_cache_lookup_inode(koamgr, stat_buf.st_ino, &koa) 
+		    == TXC_R_SUCCESS) 
+		{
+			/* 
+			 * Release only the descriptors attached before ours; the 
+			 * caller keeps holding fd.
+			 */
+			num_fdrefs = koa->fdref.refcnt;
+			txc_koa_lock_fds_refby_koa(koa);
+			txc_koa_attach_fd(koa, fd, 0);
+			for (i=0; i<num_fdrefs; i++) {
+				txc_koa_unlock_fd(koamgr, koa->fdref.fd[i]);
+			}
+		} else {
+			if ((result = txc_koa_create(koamgr, &koa, type, 
+			                             (void *) stat_buf.st_ino)) 
+			    != TXC_R_SUCCESS) 
+			{
+				txc_koa_unlock_alias_cache(koamgr);
+				return result;
+			}
+			txc_koa_attach_fd(koa, fd, 0);
+		}
+		txc_koa_unlock_alias_cache(koamgr);
+	} else {
+		if ((result = txc_koa_create(koamgr, &koa, type, NULL)) 
+		    != TXC_R_SUCCESS) 
+		{
+			return result;
+		}
+		txc_koa_attach_fd(koa, fd, 0);
+	}
+
+	TXC_DEBUG_PRINT(TXC_DEBUG_KOA, 
+	                "koa_materialize_fd: koa = %p, fd = %d, type = %d\n", 
+	                koa, fd, type);
+
+	*koap = koa;
+	return TXC_R_SUCCESS;
+}
+
+
 /**
  * \brief Finds the KOA the file descriptor is mapped to. 
  *
+ * If the file descriptor is not mapped to any KOA but refers to an open 
+ * kernel object then a KOA is created for it lazily. The common case of an 
+ * already mapped descriptor does not touch the alias cache.
+ *
+ * Caller must hold the lock on the file descriptor.
+ *
  * \param[in] koamgr KOA manager.
  * \param[in] fd File descriptor.
  * \param[out] koap Pointer to the KOA the file descriptor is mapped to.
@@ -593,9 +1060,16 @@ txc_result_t
 txc_koa_lookup_fd2koa(txc_koamgr_t *koamgr, int fd, txc_koa_t **koap) 
 {
 	TXC_ASSERT(fd < TXC_KOA_MAP_SIZE);
+	if (fd < 0) {
+		*koap = NULL;
+		return TXC_R_FAILURE;
+	}
 	*koap = koamgr->map[fd].koa;
 	if (*koap == NULL) {
-		return TXC_R_FAILURE;
+		if (koa_materialize_fd(koamgr, fd, koap) != TXC_R_SUCCESS) {
+			*koap = NULL;
+			return TXC_R_FAILURE;
+		}
 	}
 	return TXC_R_SUCCESS;
 }
@@ -731,9 +1205,7 @@ txc_koa_attach(txc_koa_t *koa)
 	TXC_ASSERT(koa != NULL);
 
 	koamgr = koa->manager;
-	TXC_MUTEX_LOCK(&(koa->mutex));
-	koa->refcnt++;
-	first_attach = (koa->refcnt == 1) ? 1 : 0;
+	first_attach = (TXC_ATOMIC_INC(&koa->refcnt) == 1) ? 1 : 0;
 	if (first_attach) {
 		/** 
           * If this is the first attach, then insert KOA into the alias 
@@ -747,7 +1219,6 @@ txc_koa_attach(txc_koa_t *koa)
 	TXC_DEBUG_PRINT(TXC_DEBUG_KOA, 
 	                "txc_koa_attach: koa = %p, refcnt = %d, sentinel = %p\n", 
 	                koa, koa->refcnt, koa->sentinel);
-	TXC_MUTEX_UNLOCK(&(koa->mutex));
 
 	return TXC_R_SUCCESS;
 }
@@ -772,9 +1243,7 @@ txc_koa_detach(txc_koa_t *koa)
 	TXC_ASSERT(koa != NULL);
 
 	koamgr = koa->manager;
-	TXC_MUTEX_LOCK(&(koa->mutex));
-	koa->refcnt--;
-	last_detach = (koa->refcnt == 0) ? 1 : 0;
+	last_detach = (TXC_ATOMIC_DEC(&koa->refcnt) == 0) ? 1 : 0;
 	if (last_detach) {
 		/** Last detach -- remove it from the alias cache if aliasable KOA. */
 		if (koa->type == TXC_KOA_IS_FILE) {
@@ -786,7 +1255,6 @@ txc_koa_detach(txc_koa_t *koa)
 	TXC_DEBUG_PRINT(TXC_DEBUG_KOA, 
 	                "txc_koa_detach: koa = %p, refcnt = %d, sentinel = %p\n",
 	                koa, koa->refcnt, koa->sentinel);
-	TXC_MUTEX_UNLOCK(&(koa->mutex));
 
 	return TXC_R_SUCCESS;
 }
@@ -827,13 +1295,190 @@ txc_koa_get_koamgr(txc_koa_t *koa)
 void *
 txc_koa_get_buffer(txc_koa_t *koa)
 {
-	void *ret;
+	return (void *) koa->buffer;
+}
+
+
+/** 
+ * Gets the type of a KOA.
+ * 
+ * \param[in] koa The KOA of which to get the type.
+ * \return The type of the KOA.
+ */
+int
+txc_koa_get_type(txc_koa_t *koa)
+{
+	return koa->type;
+}
+
+
+/** 
+ * Gets the number of file descriptors mapped to a KOA.
+ * 
+ * \param[in] koa The KOA.
+ * \return The number of file descriptors referencing the KOA.
+ */
+int
+txc_koa_get_num_fdrefs(txc_koa_t *koa)
+{
+	return koa->fdref.refcnt;
+}
+
 
+/** 
+ * Gets the deferred output pending on a socket, pipe write end or file KOA.
+ * 
+ * The pending output is owned by the transaction holding the KOA's 
+ * sentinel, so no locking is needed to access it.
+ *
+ * \param[in] koa The KOA of which to get the pending output.
+ * \return The pending output or NULL if there is none.
+ */
+void *
+txc_koa_get_pending_output(txc_koa_t *koa)
+{
 	switch (koa->type) {
+		case TXC_KOA_IS_SOCK_STREAM:
+			return koa->sock_stream.pending_output;
 		case TXC_KOA_IS_SOCK_DGRAM:
-			ret = (void *) koa->sock_dgram.buffer_circular_input;
-		case TXC_KOA_IS_PIPE_READ_END:
-			ret = (void *) koa->pipe_read_end.buffer_circular_input;
+			return koa->sock_dgram.pending_output;
+		case TXC_KOA_IS_PIPE_WRITE_END:
+			return koa->pipe_write_end.pending_output;
+		case TXC_KOA_IS_FILE:
+			return koa->file.pending_output;
+		default:
+			return NULL;
+	}
+}
+
+
+/** 
+ * Sets the deferred output pending on a socket, pipe write end or file KOA.
+ * 
+ * \param[in] koa The KOA of which to set the pending output.
+ * \param[in] pending_output The pending output or NULL to clear it.
+ */
+void
+txc_koa_set_pending_output(txc_koa_t *koa, void *pending_output)
+{
+	switch (koa->type) {
+		case TXC_KOA_IS_SOCK_STREAM:
+			koa->sock_stream.pending_output = pending_output;
+			break;
+		case TXC_KOA_IS_SOCK_DGRAM:
+			koa->sock_dgram.pending_output = pending_output;
+			break;
+		case TXC_KOA_IS_PIPE_WRITE_END:
+			koa->pipe_write_end.pending_output = pending_output;
+			break;
+		case TXC_KOA_IS_FILE:
+			koa->file.pending_output = pending_output;
+			break;
+		default:
+			break; /* do nothing */
+	}
+}
+
+
+/** 
+ * \brief Flushes a file KOA to storage on behalf of a group of committers.
+ *
+ * The caller takes a ticket and, if no flush is in progress, becomes the
+ * leader: it issues a single fsync or fdatasync covering the tickets taken
+ * so far. Callers arriving during a flush wait for it to complete and for
+ * the next one, issued by one of them, to cover their own ticket. A flush
+ * started after a caller's writes therefore makes them durable whoever 
+ * issues it.
+ *
+ * \param[in] koa The file KOA.
+ * \param[in] fd A file descriptor of the file, used if the caller leads.
+ * \param[in] datasync Whether fdatasync is enough for the caller.
+ * \return 0 on success, or the error of the flush covering the caller.
+ */
+int
+txc_koa_file_sync(txc_koa_t *koa, int fd, int datasync)
+{
+	txc_koa_file_sync_t        *sync = &koa->file.sync;
+	txc_koa_file_sync_waiter_t self;
+	txc_koa_file_sync_waiter_t **waiterp;
+	txc_koa_file_sync_waiter_t *waiter;
+	unsigned long              target;
+	unsigned long              first;
+	int                        full;
+	int                        ret;
+	int                        error;
+
+	TXC_ASSERT(koa->type == TXC_KOA_IS_FILE);
+
+	TXC_MUTEX_LOCK(&sync->mutex);
+	self.ticket = ++sync->requested;
+	self.done = 0;
+	self.error = 0;
+	self.next = sync->waiters;
+	sync->waiters = &self;
+	if (!datasync) {
+		sync->full_requested = self.ticket;
 	}
-	return ret;
+	while (!self.done) {
+		if (sync->busy) {
+			pthread_cond_wait(&sync->cond, &sync->mutex);
+			continue;
+		}
+		/* Lead a flush covering every ticket taken so far. */
+		sync->busy = 1;
+		first = sync->completed + 1;
+		target = sync->requested;
+		full = (sync->full_requested >= first);
+		TXC_MUTEX_UNLOCK(&sync->mutex);
+		ret = full ? txc_libc_fsync(fd) : txc_libc_fdatasync(fd);
+		error = (ret < 0) ? errno : 0;
+		TXC_MUTEX_LOCK(&sync->mutex);
+		/* Hand the outcome to every caller the flush covered. */
+		for (waiterp = &sync->waiters; (waiter = *waiterp) != NULL; ) {
+			if (waiter->ticket <= target) {
+				waiter->done = 1;
+				waiter->error = error;
+				*waiterp = waiter->next;
+			} else {
+				waiterp = &waiter->next;
+			}
+		}
+		sync->completed = target;
+		sync->busy = 0;
+		pthread_cond_broadcast(&sync->cond);
+	}
+	TXC_MUTEX_UNLOCK(&sync->mutex);
+	return self.error;
+}
+
+
+/** 
+ * Gets the file offset a transaction shadows for a file descriptor.
+ * 
+ * The shadow offset is owned by the transaction holding the sentinel of
+ * the KOA the descriptor is mapped to, so no locking is needed to access
+ * it.
+ *
+ * \param[in] koamgr KOA manager.
+ * \param[in] fd File descriptor.
+ * \return The shadow offset or NULL if there is none.
+ */
+void *
+txc_koa_get_shadow_offset(txc_koamgr_t *koamgr, int fd)
+{
+	return koamgr->map[fd].shadow_offset;
+}
+
+
+/** 
+ * Sets the file offset a transaction shadows for a file descriptor.
+ * 
+ * \param[in] koamgr KOA manager.
+ * \param[in] fd File descriptor.
+ * \param[in] shadow_offset The shadow offset or NULL to clear it.
+ */
+void
+txc_koa_set_shadow_offset(txc_koamgr_t *koamgr, int fd, void *shadow_offset)
+{
+	koamgr->map[fd].shadow_offset = shadow_offset;
 }
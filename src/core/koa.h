@@ -41,6 +41,7 @@
 #include <misc/result.h>
 #include <core/sentinel.h>
 #include <core/buffer.h>
+#include <core/epoch.h>
 #include <sys/stat.h>
 
 
@@ -50,13 +51,14 @@
 #define TXC_KOA_IS_PIPE_READ_END            3  /**< KOA for a pipe's read end */
 #define TXC_KOA_IS_PIPE_WRITE_END           4  /**< KOA for a pipe's write end */
 #define TXC_KOA_IS_FILE                     5  /**< KOA for a file */
+#define TXC_KOA_TYPE_MAX                    5  /**< Largest KOA type value */
 
 typedef struct txc_koa_s txc_koa_t;
 typedef struct txc_koamgr_s txc_koamgr_t;
 
 extern txc_koamgr_t *txc_g_koamgr;
 
-txc_result_t txc_koamgr_create(txc_koamgr_t **, txc_sentinelmgr_t *, txc_buffermgr_t *); 
+txc_result_t txc_koamgr_create(txc_koamgr_t **, txc_sentinelmgr_t *, txc_buffermgr_t *, txc_epochmgr_t *); 
 void txc_koamgr_destroy(txc_koamgr_t **);
 txc_result_t txc_koa_create(txc_koamgr_t *, txc_koa_t **, int, void *);
 void txc_koa_destroy(txc_koa_t **);
@@ -68,6 +70,8 @@ txc_result_t txc_koa_detach_fd(txc_koa_t *koa, int fd, int lock);
 txc_result_t txc_koa_lock_alias_cache(txc_koamgr_t *koamgr);
 txc_result_t txc_koa_unlock_alias_cache(txc_koamgr_t *koamgr);
 txc_result_t txc_koa_lookup_fd2koa(txc_koamgr_t *, int, txc_koa_t **);
+txc_result_t txc_koa_fdcache_park(txc_koa_t *koa, int fd);
+txc_result_t txc_koa_fdcache_reuse(txc_koamgr_t *koamgr, ino_t inode_number, int flags, int *fdp);
 txc_result_t txc_koa_alias_cache_lookup_inode(txc_koamgr_t *koamgr, ino_t inode_number, txc_koa_t **koap);
 txc_result_t txc_koa_lock_fd(txc_koamgr_t *koamgr, int fd);
 txc_result_t txc_koa_unlock_fd(txc_koamgr_t *koamgr, int fd);
@@ -76,5 +80,12 @@ txc_result_t txc_koa_unlock_fds_refby_koa(txc_koa_t *koa);
 txc_sentinel_t *txc_koa_get_sentinel(txc_koa_t *koa);
 txc_koamgr_t *txc_koa_get_koamgr(txc_koa_t *koa);
 void *txc_koa_get_buffer(txc_koa_t *koa);
+int txc_koa_get_type(txc_koa_t *koa);
+int txc_koa_get_num_fdrefs(txc_koa_t *koa);
+void *txc_koa_get_pending_output(txc_koa_t *koa);
+void txc_koa_set_pending_output(txc_koa_t *koa, void *pending_output);
+int txc_koa_file_sync(txc_koa_t *koa, int fd, int datasync);
+void *txc_koa_get_shadow_offset(txc_koamgr_t *koamgr, int fd);
+void txc_koa_set_shadow_offset(txc_koamgr_t *koamgr, int fd, void *shadow_offset);
 
 #endif /* _TXC_KOA_H */
@@ -116,6 +116,14 @@
  * avoid is the sentinel to protect another KOA between the time we see a 
  * KOA and we acquire the sentinel.
  *
+ * Reference counters are updated atomically. When the counter drops to 
+ * zero the sentinel is not freed immediately but retired to the epoch 
+ * manager (see epoch.c), which returns it to the pool only after every 
+ * transaction that could have read a pointer to it has completed. Thus a 
+ * transaction that follows a stale pointer to a retired sentinel still 
+ * finds valid memory, and attaching to and detaching from sentinels need
+ * no latch.
+ *
  */
 
 
@@ -129,8 +137,10 @@
 #include <misc/malloc.h>
 #include <misc/debug.h>
 #include <misc/mutex.h>
+#include <misc/atomic.h>
 #include <core/config.h>
 #include <core/sentinel.h>
+#include <core/epoch.h>
 #include <core/tx.h>
 #include <core/txdesc.h>
 
@@ -139,11 +149,12 @@
 /** Sentinel. */
 struct txc_sentinel_s {
 	txc_mutex_t       sentinel_mutex;  /**< The actual lock backing the sentinel. */
-	txc_mutex_t       synch_mutex;     /**< The latch that synchronizes metadata updates. */
 	int               id;              /**< Sentinel identifier used to acquire sentinels in order to prevent deadlock. */ 
-	int               refcnt;          /**< Reference counter counting entities logically attached to the sentinel. */
+	volatile int      refcnt;          /**< Reference counter counting entities logically attached to the sentinel. */
+	volatile int      retired;         /**< Set once the sentinel has been handed to the epoch manager. */
 	txc_tx_t          *owner;          /**< Transaction holding the sentinel. */
 	txc_sentinelmgr_t *manager;        /**< Sentinel manager responsible for the sentinel. */
+	txc_epoch_entry_t retire_entry;    /**< Retire list entry used by the epoch manager. */
 };
 
 /** Sentinel list entry. */
@@ -163,8 +174,9 @@ struct txc_sentinel_list_s {
 
 /** Sentinel manager */
 struct txc_sentinelmgr_s {
-	txc_mutex_t mutex;
-	txc_pool_t  *pool_sentinel;
+	txc_mutex_t    mutex;
+	txc_pool_t     *pool_sentinel;
+	txc_epochmgr_t *epochmgr;
 };
 
 
@@ -182,30 +194,39 @@ txc_sentinelmgr_t *txc_g_sentinelmgr;
  * It preallocates a pool of sentinels to make sentinel allocation fast.
  *
  * \param[out] sentinelmgrp Pointer to the created sentinel manager.
+ * \param[in] epochmgr The epoch manager reclaiming retired sentinels.
  * \return Code indicating success or failure (reason) of the operation.
  */
 txc_result_t
-txc_sentinelmgr_create(txc_sentinelmgr_t **sentinelmgrp) 
+txc_sentinelmgr_create(txc_sentinelmgr_t **sentinelmgrp, 
+                       txc_epochmgr_t *epochmgr) 
 {
 	txc_result_t      result;
 	txc_pool_object_t *pool_object;
 	txc_sentinel_t    *sentinel;
 	int               i;
 
-	*sentinelmgrp = (txc_sentinelmgr_t *) MALLOC(sizeof(txc_sentinelmgr_t));
+	*sentinelmgrp = (txc_sentinelmgr_t *) MALLOC(TXC_MALLOC_SENTINEL, sizeof(txc_sentinelmgr_t));
 	if (*sentinelmgrp == NULL) {
 		return TXC_R_NOMEMORY;
 	}
 
-	if ((result = txc_pool_create(&((*sentinelmgrp)->pool_sentinel), 
-	                              sizeof(txc_sentinel_t),
-	                              TXC_SENTINEL_NUM, 
-                                  NULL)) != TXC_R_SUCCESS) 
+	/* 
+	 * Sentinels are acquired concurrently by different threads; give each
+	 * its own cache lines.
+	 */
+	if ((result = txc_pool_create_aligned(&((*sentinelmgrp)->pool_sentinel), 
+	                                      sizeof(txc_sentinel_t),
+	                                      TXC_SENTINEL_NUM, 
+	                                      TXC_CACHELINE_SIZE,
+	                                      0,
+	                                      NULL)) != TXC_R_SUCCESS) 
 	{
 		FREE(*sentinelmgrp);
 		return result;
 	}
 	TXC_MUTEX_INIT(&((*sentinelmgrp)->mutex), NULL);
+	(*sentinelmgrp)->epochmgr = epochmgr;
 	for (i = 0,
 	     pool_object = txc_pool_object_first((*sentinelmgrp)->pool_sentinel,
 	                                         TXC_POOL_OBJECT_ALLOCATED & 
@@ -214,7 +235,6 @@ txc_sentinelmgr_create(txc_sentinelmgr_t **sentinelmgrp)
 		 i++, pool_object = txc_pool_object_next(pool_object))
 	{
 		sentinel = (txc_sentinel_t *) txc_pool_object_of(pool_object);
-		TXC_MUTEX_INIT(&sentinel->synch_mutex, NULL);
 		TXC_MUTEX_INIT(&sentinel->sentinel_mutex, NULL);
 		sentinel->id = i;
 		sentinel->manager = *sentinelmgrp;
@@ -257,22 +277,42 @@ txc_sentinel_create(txc_sentinelmgr_t *sentinelmgr, txc_sentinel_t **sentinelp)
 
 	sentinel->owner = TXC_SENTINEL_NOOWNER;
 	sentinel->refcnt = 1;
+	sentinel->retired = 0;
 	*sentinelp = sentinel;
 
 	return TXC_R_SUCCESS;
 }
 
 
-static inline
+static
 void 
-sentinel_destroy(txc_sentinel_t *sentinel) 
+sentinel_reclaim(void *obj) 
 {
+	txc_sentinel_t *sentinel = (txc_sentinel_t *) obj;
 	txc_sentinel_t **sentinelp = &sentinel;
 
 	txc_pool_object_free(sentinel->manager->pool_sentinel, 
 	                     (void **) sentinelp, 1);
 }
 
+
+/*
+ * A transaction may attach to a sentinel through a stale pointer after 
+ * the counter dropped to zero. The retired flag makes sure the sentinel
+ * is handed to the epoch manager only once.
+ */
+static inline
+void 
+sentinel_destroy(txc_sentinel_t *sentinel) 
+{
+	if (TXC_ATOMIC_CAS(&sentinel->retired, 0, 1)) {
+		txc_epoch_retire(sentinel->manager->epochmgr, 
+		                 &sentinel->retire_entry, 
+		                 sentinel_reclaim, 
+		                 (void *) sentinel);
+	}
+}
+
 /**
  * \brief Destroys a sentinel.
  * 
@@ -282,28 +322,23 @@ void
 txc_sentinel_destroy(txc_sentinel_t *sentinel) 
 {
 	TXC_ASSERT(sentinel != NULL);
-	TXC_MUTEX_LOCK(&sentinel->synch_mutex);
 	sentinel_destroy(sentinel);
-	TXC_MUTEX_UNLOCK(&sentinel->synch_mutex);
 }
 
 
-static 
+static inline
 void
 sentinel_attach(txc_sentinel_t *sentinel)
 {
-	sentinel->refcnt++;
+	TXC_ATOMIC_INC(&sentinel->refcnt);
 }
 
 
-/*
- * Assumes lock sentinel->synch_mutex is held by the caller.
- */
-static
+static inline
 txc_result_t 
 sentinel_detach(txc_sentinel_t *sentinel)
 {
-	if (--sentinel->refcnt==0) {
+	if (TXC_ATOMIC_DEC(&sentinel->refcnt) == 0) {
 		sentinel_destroy(sentinel);	
 	}
 	return TXC_R_SUCCESS;
@@ -323,12 +358,7 @@ sentinel_detach(txc_sentinel_t *sentinel)
 txc_result_t
 txc_sentinel_detach(txc_sentinel_t *sentinel)
 {
-	txc_result_t ret;
-
-	TXC_MUTEX_LOCK(&sentinel->synch_mutex);
-	ret = sentinel_detach(sentinel);
-	TXC_MUTEX_UNLOCK(&sentinel->synch_mutex);
-	return ret;
+	return sentinel_detach(sentinel);
 }
 
 
@@ -388,7 +418,6 @@ sentinel_list_release(txc_sentinel_list_t *sentinel_list, int transaction_comple
 	TXC_DEBUG_PRINT(TXC_DEBUG_SENTINEL, "SENTINEL LIST: RELEASE SENTINELS\n");
 	for (i=0; i<sentinel_list->num_entries; i++) {
 		entry = &sentinel_list->entries[i];
-		TXC_MUTEX_LOCK(&(entry->sentinel->synch_mutex));
 		if (entry->status & TXC_SENTINEL_ACQUIRED) {
 			entry->sentinel->owner = TXC_SENTINEL_NOOWNER;
 			TXC_MUTEX_UNLOCK(&(entry->sentinel->sentinel_mutex));
@@ -412,7 +441,6 @@ sentinel_list_release(txc_sentinel_list_t *sentinel_list, int transaction_comple
 				sentinel_detach(entry->sentinel);
 			}
 		}
-		TXC_MUTEX_UNLOCK(&(entry->sentinel->synch_mutex));
 	}
 }
 
@@ -614,7 +642,7 @@ allocate_sentinel_list_entries(txc_sentinel_list_t *la, int extend)
 		/* Extend action list */
 		la->size *= 2;
 		if ((la->entries = 
-		     (txc_sentinel_list_entry_t *) REALLOC (la->entries, 
+		     (txc_sentinel_list_entry_t *) REALLOC(TXC_MALLOC_SENTINEL, la->entries, 
 		                                             la->size * sizeof(txc_sentinel_list_entry_t)))
 		    == NULL)
 		{
@@ -623,7 +651,7 @@ allocate_sentinel_list_entries(txc_sentinel_list_t *la, int extend)
 	} else {
 		/* Allocate action list */
 		if ((la->entries = 
-		     (txc_sentinel_list_entry_t *) MALLOC (la->size * sizeof(txc_sentinel_list_entry_t)))
+		     (txc_sentinel_list_entry_t *) MALLOC(TXC_MALLOC_SENTINEL, la->size * sizeof(txc_sentinel_list_entry_t)))
 		    == NULL)
 		{
 			return TXC_R_NOMEMORY;
@@ -656,7 +684,7 @@ txc_sentinel_list_create(txc_sentinelmgr_t *sentinelmgr,
 {
 	txc_result_t result;
 
-	if ((*sentinel_list = (txc_sentinel_list_t *) MALLOC(sizeof(txc_sentinel_list_t)))
+	if ((*sentinel_list = (txc_sentinel_list_t *) MALLOC(TXC_MALLOC_SENTINEL, sizeof(txc_sentinel_list_t)))
 	    == NULL) 
 	{
 		return TXC_R_NOMEMORY;
@@ -770,9 +798,7 @@ txc_sentinel_enlist(txc_tx_t *txd, txc_sentinel_t *sentinel, int flags)
 	acquire_on_retry = (flags & TXC_SENTINEL_ACQUIREONRETRY) > 0 ? 
 	                   TXC_SENTINEL_ACQUIREONRETRY : 0;
 
-	TXC_MUTEX_LOCK(&sentinel->synch_mutex);
 	sentinel_attach(sentinel);
-	TXC_MUTEX_UNLOCK(&sentinel->synch_mutex);
 	enlist_sentinel(txd->sentinel_list, sentinel, acquire_on_retry);
 	return TXC_R_SUCCESS;
 }
@@ -828,9 +854,7 @@ txc_sentinel_tryacquire(txc_tx_t *txd, txc_sentinel_t *sentinel, int flags)
 					ret = TXC_MUTEX_TRYLOCK(&sentinel->sentinel_mutex);
 				} while (--num_spin_retries >= 0 && ret != 0);
 				if (ret == 0) {
-					TXC_MUTEX_LOCK(&sentinel->synch_mutex);
 					sentinel_attach(sentinel);
-					TXC_MUTEX_UNLOCK(&sentinel->synch_mutex);
 					sentinel->owner = txd;
 					enlist_sentinel(txd->sentinel_list, sentinel, 
 					                TXC_SENTINEL_ACQUIRED | 
@@ -840,9 +864,7 @@ txc_sentinel_tryacquire(txc_tx_t *txd, txc_sentinel_t *sentinel, int flags)
 					                sentinel->id);
 					result = TXC_R_SUCCESS;
 				} else {
-					TXC_MUTEX_LOCK(&sentinel->synch_mutex);
 					sentinel_attach(sentinel);
-					TXC_MUTEX_UNLOCK(&sentinel->synch_mutex);
 					enlist_sentinel(txd->sentinel_list, sentinel, 
 					                acquire_on_retry);
 					TXC_DEBUG_PRINT(TXC_DEBUG_SENTINEL, 
@@ -38,6 +38,7 @@
 #define _TXC_SENTINEL_H
 
 #include <misc/result.h>
+#include <core/epoch.h>
 
 
 #define TXC_SENTINEL_ACQUIRED               0x1 /**< Sentinel has been acquired. Drop it when transaction completes (commit/abort) or restarts execution. */
@@ -61,7 +62,7 @@ typedef struct txc_sentinel_list_entry_s txc_sentinel_list_entry_t;
 
 extern txc_sentinelmgr_t *txc_g_sentinelmgr;
 
-txc_result_t txc_sentinelmgr_create(txc_sentinelmgr_t **);
+txc_result_t txc_sentinelmgr_create(txc_sentinelmgr_t **, txc_epochmgr_t *);
 void txc_sentinelmgr_destroy(txc_sentinelmgr_t **sentinelmgrp);
 txc_result_t txc_sentinel_create(txc_sentinelmgr_t *, txc_sentinel_t **);
 void txc_sentinel_destroy(txc_sentinel_t *);
@@ -84,7 +84,7 @@ struct txc_statsmgr_s {
 txc_result_t
 txc_statsmgr_create(txc_statsmgr_t **statsmgrp)
 {
-	*statsmgrp = (txc_statsmgr_t *) MALLOC(sizeof(txc_statsmgr_t));
+	*statsmgrp = (txc_statsmgr_t *) MALLOC(TXC_MALLOC_STATS, sizeof(txc_statsmgr_t));
 	if (*statsmgrp == NULL) {
 		return TXC_R_NOMEMORY;
 	}
@@ -128,7 +128,7 @@ txc_stats_threadstat_create(txc_statsmgr_t *statsmgr,
 	txc_stats_threadstat_t *threadstat;
 	int                    i;
 
-	threadstat = (txc_stats_threadstat_t *) MALLOC(sizeof(txc_stats_threadstat_t));
+	threadstat = (txc_stats_threadstat_t *) MALLOC(TXC_MALLOC_STATS, sizeof(txc_stats_threadstat_t));
 
 	TXC_MUTEX_LOCK(&(statsmgr->mutex));
 	if (statsmgr->alloc_threadstat_list_head == NULL) {
@@ -166,7 +166,7 @@ txc_stats_txstat_create(txc_stats_txstat_t **txstatp)
 {
 	txc_stats_txstat_t *txstat;
 
-	txstat = (txc_stats_txstat_t *) MALLOC(sizeof(txc_stats_txstat_t));
+	txstat = (txc_stats_txstat_t *) MALLOC(TXC_MALLOC_STATS, sizeof(txc_stats_txstat_t));
 	txstat->count = 0;
 	*txstatp = txstat;
 
@@ -236,7 +236,7 @@ stats_get_txstat_container(txc_hash_table_t *tx_stats,
 	{
 		txstat_container = (txc_stats_txstat_t *) value;	
 	} else {
-		txstat_container = (txc_stats_txstat_t *) MALLOC(sizeof(txc_stats_txstat_t));
+		txstat_container = (txc_stats_txstat_t *) MALLOC(TXC_MALLOC_STATS, sizeof(txc_stats_txstat_t));
 		stats_txstat_reset(txstat_container);
 		txstat_container->count = 0;
 		txstat_container->srcloc_str = txstat->srcloc_str;
@@ -570,6 +570,10 @@ txc_stats_print(txc_statsmgr_t *statsmgr)
 		txstat_grand_total.total_stats[i] = summary.total_stats[i];
 	}	
 	stats_txstat_print(fout, &txstat_grand_total, 0, TXC_BOOL_FALSE);
+	fprintf(fout, "\n");
+
+	/* Print MEMORY totals */
+	txc_malloc_print(fout);
 	
 	fclose(fout);
 }	
@@ -52,16 +52,25 @@
   ACTION(x_open)                                                             \
   ACTION(x_pipe)                                                             \
   ACTION(x_printf)                                                           \
+  ACTION(x_pread)                                                            \
+  ACTION(x_preadv)                                                           \
+  ACTION(x_pwrite)                                                           \
+  ACTION(x_pwritev)                                                          \
   ACTION(x_read)                                                             \
   ACTION(x_read_pipe)                                                        \
+  ACTION(x_read_pipe_syscalls_saved)                                         \
+  ACTION(x_recv)                                                             \
   ACTION(x_recvmsg)                                                          \
   ACTION(x_rename)                                                           \
+  ACTION(x_send)                                                             \
   ACTION(x_sendmsg)                                                          \
   ACTION(x_socket)                                                           \
   ACTION(x_unlink)                                                           \
+  ACTION(x_write_deferred)                                                   \
   ACTION(x_write_ovr)                                                        \
   ACTION(x_write_ovr_ignore)                                                 \
   ACTION(x_write_pipe)                                                       \
+  ACTION(x_write_pipe_syscalls_saved)                                        \
   ACTION(x_write_seq)
 
 
@@ -42,6 +42,7 @@
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <setjmp.h>
 #include <assert.h>
 #include <sched.h>
@@ -49,13 +50,17 @@
 #include <misc/pool.h>
 #include <misc/malloc.h>
 #include <misc/mutex.h>
+#include <misc/atomic.h>
 #include <core/config.h>
 #include <core/sentinel.h>
 #include <core/buffer.h>
 #include <core/koa.h>
+#include <core/epoch.h>
 #include <core/fm.h>
 #include <core/tx.h>
 #include <core/txdesc.h>
+#include <core/uring.h>
+#include <core/journal.h>
 
 
 static void tx_generic_undo_action(txc_tx_t *);
@@ -71,6 +76,8 @@ struct txc_tx_action_list_entry_s {
 	void *args;
 	int *error_result;
 	int order;
+	int key;     /* File descriptor the action is confined to; -1 if none */
+	int next;    /* Next action of the same commit partition; -1 if last */
 };
 
 
@@ -81,14 +88,43 @@ struct txc_tx_action_list_s {
 };
 
 							  
+typedef struct txc_tx_commit_batch_s txc_tx_commit_batch_t;
+
+/* 
+ * Commit actions of an order level confined to file descriptors, split 
+ * into partitions by descriptor. The partitions are run concurrently by 
+ * the committing thread and the commit helpers; the actions of a 
+ * partition run in registration order.
+ */
+struct txc_tx_commit_batch_s {
+	txc_tx_action_list_entry_t *entries;
+	int                        head[TXC_COMMIT_PARTITIONS_MAX];  /* First action of each partition */
+	int                        tail[TXC_COMMIT_PARTITIONS_MAX];
+	int                        used[TXC_COMMIT_PARTITIONS_MAX];  /* Partitions with actions */
+	int                        num_used;
+	int                        num_claimed;                      /* Used partitions claimed to be run */
+	int                        num_running;                      /* Claimed partitions not finished yet */
+	int                        first_error_result;
+	txc_tx_commit_batch_t      *next;
+};
+
+							  
 struct txc_txmgr_s {
-	txc_mutex_t     mutex;
-	unsigned int    alloc_txd_num;
-	txc_tx_t        *alloc_txd_list_head;
-	txc_tx_t        *alloc_txd_list_tail;
-	txc_pool_t      *pool_txd;
-	txc_buffermgr_t *buffermgr;
-	txc_statsmgr_t  *statsmgr;
+	txc_mutex_t           mutex;
+	unsigned int          alloc_txd_num;
+	txc_tx_t              *alloc_txd_list_head;
+	txc_tx_t              *alloc_txd_list_tail;
+	txc_pool_t            *pool_txd;
+	txc_buffermgr_t       *buffermgr;
+	txc_statsmgr_t        *statsmgr;
+	txc_journalmgr_t      *journalmgr;        /* NULL if no journal is kept */
+	txc_mutex_t           helpers_mutex;
+	pthread_cond_t        helpers_cond;       /* Signaled when a batch is queued or helpers must exit */
+	pthread_cond_t        helpers_done_cond;  /* Signaled when a partition of a batch is finished */
+	txc_tx_commit_batch_t *helpers_queue;     /* Batches with partitions not claimed yet */
+	int                   helpers_exit;
+	int                   helpers_num;
+	pthread_t             helpers[TXC_COMMIT_HELPER_THREADS_MAX];
 };
 
 
@@ -106,7 +142,7 @@ allocate_action_list_entries(txc_tx_action_list_t *la, int extend)
 		/* Extend action list */
 		la->size *= 2;
 		if ((la->entries = 
-		     (txc_tx_action_list_entry_t *) REALLOC (la->entries, 
+		     (txc_tx_action_list_entry_t *) REALLOC(TXC_MALLOC_TX, la->entries, 
 		                                             la->size * sizeof(txc_tx_action_list_entry_t)))
 		    == NULL)
 		{
@@ -115,7 +151,7 @@ allocate_action_list_entries(txc_tx_action_list_t *la, int extend)
 	} else {
 		/* Allocate action list */
 		if ((la->entries = 
-		     (txc_tx_action_list_entry_t *) MALLOC (la->size * sizeof(txc_tx_action_list_entry_t)))
+		     (txc_tx_action_list_entry_t *) MALLOC(TXC_MALLOC_TX, la->size * sizeof(txc_tx_action_list_entry_t)))
 		    == NULL)
 		{
 			return TXC_R_NOMEMORY;
@@ -134,24 +170,171 @@ deallocate_action_list_entries(txc_tx_action_list_t *la)
 }
 
 
+static
+void
+commit_action_run(txc_tx_action_list_entry_t *entry, int *first_error_result)
+{
+	int temp_error_result;
+
+	/* 
+	 * It is possible entry->error_result be NULL because the caller
+	 * might have not passed any result variable. Thus, if we simply
+	 * pass entry->error_result we might not get informed about any 
+	 * error happpened. Temporarily save any error of the action in 
+	 * temp_error_result to be able to correctly take any actions 
+	 * needed in case of failure (e.g. informing the failure manager
+	 */
+	temp_error_result = 0; 
+	entry->function(entry->args, &temp_error_result);
+	if (entry->error_result) {
+		*(entry->error_result) = temp_error_result;
+	}
+	if (temp_error_result != 0) {
+		TXC_ATOMIC_CAS(first_error_result, 0, temp_error_result);
+	}
+}
+
+
+static
+void
+commit_partition_run(txc_tx_commit_batch_t *batch, int partition)
+{
+	int i;
+
+	for (i = batch->head[partition]; i >= 0; i = batch->entries[i].next) {
+		commit_action_run(&batch->entries[i], &batch->first_error_result);
+	}
+}
+
+
+/* Claims a partition of a batch. Caller holds the helpers' mutex. */
+static
+int
+commit_batch_claim(txc_txmgr_t *txmgr, txc_tx_commit_batch_t *batch)
+{
+	txc_tx_commit_batch_t **batchp;
+	int                   partition;
+
+	if (batch->num_claimed == batch->num_used) {
+		return -1;
+	}
+	partition = batch->used[batch->num_claimed++];
+	batch->num_running++;
+	if (batch->num_claimed == batch->num_used) {
+		for (batchp = &txmgr->helpers_queue; *batchp; batchp = &(*batchp)->next) {
+			if (*batchp == batch) {
+				*batchp = batch->next;
+				break;
+			}
+		}
+	}
+	return partition;
+}
+
+
+static
+void *
+commit_helper(void *arg)
+{
+	txc_txmgr_t           *txmgr = (txc_txmgr_t *) arg;
+	txc_tx_commit_batch_t *batch;
+	int                   partition;
+
+	TXC_MUTEX_LOCK(&txmgr->helpers_mutex);
+	while (!txmgr->helpers_exit) {
+		if ((batch = txmgr->helpers_queue) == NULL) {
+			pthread_cond_wait(&txmgr->helpers_cond, &txmgr->helpers_mutex);
+			continue;
+		}
+		partition = commit_batch_claim(txmgr, batch);
+		TXC_MUTEX_UNLOCK(&txmgr->helpers_mutex);
+		commit_partition_run(batch, partition);
+		TXC_MUTEX_LOCK(&txmgr->helpers_mutex);
+		if (--batch->num_running == 0) {
+			pthread_cond_broadcast(&txmgr->helpers_done_cond);
+		}
+	}
+	TXC_MUTEX_UNLOCK(&txmgr->helpers_mutex);
+	return NULL;
+}
+
+
+/* 
+ * Runs the partitions of a batch, with the help of the commit helpers if 
+ * there is more than one, and empties the batch.
+ */
+static
+void
+commit_batch_run(txc_txmgr_t *txmgr, txc_tx_commit_batch_t *batch)
+{
+	int partition;
+	int i;
+
+	if (batch->num_used == 1) {
+		commit_partition_run(batch, batch->used[0]);
+	} else if (batch->num_used > 1) {
+		TXC_MUTEX_LOCK(&txmgr->helpers_mutex);
+		batch->next = txmgr->helpers_queue;
+		txmgr->helpers_queue = batch;
+		pthread_cond_broadcast(&txmgr->helpers_cond);
+		while ((partition = commit_batch_claim(txmgr, batch)) >= 0) {
+			TXC_MUTEX_UNLOCK(&txmgr->helpers_mutex);
+			commit_partition_run(batch, partition);
+			TXC_MUTEX_LOCK(&txmgr->helpers_mutex);
+			batch->num_running--;
+		}
+		while (batch->num_running > 0) {
+			pthread_cond_wait(&txmgr->helpers_done_cond, &txmgr->helpers_mutex);
+		}
+		TXC_MUTEX_UNLOCK(&txmgr->helpers_mutex);
+	}
+	for (i = 0; i < batch->num_used; i++) {
+		batch->head[batch->used[i]] = -1;
+	}
+	batch->num_used = 0;
+	batch->num_claimed = 0;
+}
+
+
+static
+void
+commit_batch_add(txc_tx_commit_batch_t *batch, int index)
+{
+	int partition = batch->entries[index].key % TXC_COMMIT_PARTITIONS_MAX;
+
+	batch->entries[index].next = -1;
+	if (batch->head[partition] < 0) {
+		batch->head[partition] = index;
+		batch->used[batch->num_used++] = partition;
+	} else {
+		batch->entries[batch->tail[partition]].next = index;
+	}
+	batch->tail[partition] = index;
+}
+
+
 txc_result_t
 txc_txmgr_create(txc_txmgr_t **txmgrp, 
                  txc_buffermgr_t *buffermgr, 
                  txc_sentinelmgr_t *sentinelmgr,
-                 txc_statsmgr_t *statsmgr)
+                 txc_statsmgr_t *statsmgr,
+                 txc_epochmgr_t *epochmgr,
+                 txc_journalmgr_t *journalmgr)
 {
 	txc_result_t      result;
 	txc_pool_object_t *pool_object;
 	txc_tx_t          *txd;
 	
-	*txmgrp = (txc_txmgr_t *) MALLOC(sizeof(txc_txmgr_t));
+	*txmgrp = (txc_txmgr_t *) MALLOC(TXC_MALLOC_TX, sizeof(txc_txmgr_t));
 	if (*txmgrp == NULL) {
 		return TXC_R_NOMEMORY;
 	}
-	if ((result = txc_pool_create(&((*txmgrp)->pool_txd), 
-	                              sizeof(txc_tx_t),
-	                              TXC_MAX_NUM_THREADS, 
-	                              NULL)) != TXC_R_SUCCESS) 
+	if ((result = txc_pool_create_aligned(&((*txmgrp)->pool_txd), 
+	                                      sizeof(txc_tx_t),
+	                                      TXC_MAX_NUM_THREADS, 
+	                                      TXC_CACHELINE_SIZE,
+	                                      TXC_POOL_HUGEPAGES,
+	                                      NULL)) != TXC_R_SUCCESS) 
 	{
 		FREE(*txmgrp);
 		return result;
@@ -171,21 +354,44 @@ txc_txmgr_create(txc_txmgr_t **txmgrp,
 		txd->manager = *txmgrp;
 		txc_sentinel_list_create(sentinelmgr, &(txd->sentinel_list));
 		txc_sentinel_list_create(sentinelmgr, &(txd->sentinel_list_preacquire));
-		txd->commit_action_list = (txc_tx_commit_action_list_t *) MALLOC(sizeof(txc_tx_commit_action_list_t));
-		txd->undo_action_list = (txc_tx_undo_action_list_t *) MALLOC(sizeof(txc_tx_undo_action_list_t));
+		txd->commit_action_list = (txc_tx_commit_action_list_t *) MALLOC(TXC_MALLOC_TX, sizeof(txc_tx_commit_action_list_t));
+		txd->undo_action_list = (txc_tx_undo_action_list_t *) MALLOC(TXC_MALLOC_TX, sizeof(txc_tx_undo_action_list_t));
 		txd->commit_action_list->size = TXC_ACTION_LIST_SIZE;  
 		txd->undo_action_list->size = TXC_ACTION_LIST_SIZE; 
 		allocate_action_list_entries(txd->commit_action_list, 0);
 		allocate_action_list_entries(txd->undo_action_list, 0);
+		memset(txd->merge_table, 0, sizeof(txd->merge_table));
+		txd->merge_generation = 1;
+		txd->created_unnamed = NULL;
+		txd->journal_txid = 0;
 		txc_buffer_linear_create(buffermgr, &(txd->buffer_linear));
+		txc_epoch_register(epochmgr, &(txd->epoch));
 	}
 
 	(*txmgrp)->alloc_txd_num = 0;
 	(*txmgrp)->alloc_txd_list_head = (*txmgrp)->alloc_txd_list_tail = NULL;
 	(*txmgrp)->buffermgr = buffermgr;
 	(*txmgrp)->statsmgr = statsmgr;
+	(*txmgrp)->journalmgr = journalmgr;
 	TXC_MUTEX_INIT(&(*txmgrp)->mutex, NULL);
 
+	TXC_MUTEX_INIT(&(*txmgrp)->helpers_mutex, NULL);
+	pthread_cond_init(&(*txmgrp)->helpers_cond, NULL);
+	pthread_cond_init(&(*txmgrp)->helpers_done_cond, NULL);
+	(*txmgrp)->helpers_queue = NULL;
+	(*txmgrp)->helpers_exit = 0;
+	for ((*txmgrp)->helpers_num = 0;
+	     (*txmgrp)->helpers_num < txc_runtime_settings.commit_helper_threads;
+	     (*txmgrp)->helpers_num++)
+	{
+		if (pthread_create(&(*txmgrp)->helpers[(*txmgrp)->helpers_num], NULL,
+		                   commit_helper, (void *) *txmgrp) != 0) 
+		{
+			/* Commit with the helpers created so far. */
+			break;
+		}
+	}
+
 	return TXC_R_SUCCESS;
 }
 
@@ -195,6 +401,15 @@ txc_txmgr_destroy(txc_txmgr_t **txmgrp)
 {
 	txc_tx_t          *txd;
 	txc_pool_object_t *pool_object;
+	int               i;
+
+	TXC_MUTEX_LOCK(&(*txmgrp)->helpers_mutex);
+	(*txmgrp)->helpers_exit = 1;
+	pthread_cond_broadcast(&(*txmgrp)->helpers_cond);
+	TXC_MUTEX_UNLOCK(&(*txmgrp)->helpers_mutex);
+	for (i = 0; i < (*txmgrp)->helpers_num; i++) {
+		pthread_join((*txmgrp)->helpers[i], NULL);
+	}
 
 	for (pool_object = txc_pool_object_first((*txmgrp)->pool_txd, 
 	                                         TXC_POOL_OBJECT_ALLOCATED & 
@@ -232,6 +447,12 @@ txc_tx_init(txc_tx_t *txd)
 	txd->abort_reason = TXC_ABORTREASON_TMCONFLICT;
 	txd->commit_action_list->num_entries = 0;
 	txd->undo_action_list->num_entries = 0;
+	/* Invalidate the mergeable undo actions of the previous instance. */
+	if (++txd->merge_generation == 0) {
+		memset(txd->merge_table, 0, sizeof(txd->merge_table));
+		txd->merge_generation = 1;
+	}
+	txd->created_unnamed = NULL;
 	txc_buffer_linear_init(txd->buffer_linear);
 
 	return TXC_R_SUCCESS;
@@ -268,6 +489,11 @@ txc_tx_create(txc_txmgr_t *txmgr, txc_tx_t **txdp)
 
 	txd->tid_pthread = pthread_self();
 	txd->forced_retries = 0;
+	if (txc_runtime_settings.io_uring == TXC_BOOL_TRUE) {
+		/* Deferred data in the log are written without mapping them each time. */
+		txc_uring_register_buffer(txd->buffer_linear->first.buf, 
+		                          txd->buffer_linear->first.size_max);
+	}
 	txc_tx_init(txd);
 	txc_sentinel_list_init(txd->sentinel_list);
 	txc_sentinel_list_init(txd->sentinel_list_preacquire);
@@ -336,7 +562,8 @@ txc_tx_abort_transaction(txc_tx_t *txd, txc_tx_abortreason_t abort_reason)
 
 static inline txc_result_t
 register_action(txc_tx_action_list_t *la, 
-                txc_tx_function_t function, void *args, int *error_result, int order) 
+                txc_tx_function_t function, void *args, int *error_result, int order,
+                int key) 
 {
 	txc_result_t ret;
 
@@ -350,6 +577,7 @@ register_action(txc_tx_action_list_t *la,
 	la->entries[la->num_entries].args = args;
 	la->entries[la->num_entries].error_result = error_result;
 	la->entries[la->num_entries].order = order;
+	la->entries[la->num_entries].key = key;
 	la->num_entries++; 
 
 	return TXC_R_SUCCESS;
@@ -361,12 +589,42 @@ txc_result_t
 txc_tx_register_commit_action(txc_tx_t *txd, 
                               txc_tx_commit_function_t function, 
                               void *args, int *error_result, int order) 
+{
+	return txc_tx_register_keyed_commit_action(txd, function, args, 
+	                                           error_result, order, -1);
+}
+
+
+/**
+ * \brief Registers a commit action confined to a file descriptor.
+ *
+ * Commit actions of the same order level confined to different file 
+ * descriptors may run concurrently, on the commit helper threads. They 
+ * must not touch the transaction descriptor or any other descriptor.
+ * Actions confined to the same descriptor run in registration order,
+ * and actions not confined to any descriptor see all actions of their 
+ * level registered before them completed.
+ *
+ * \param[in] txd Transaction descriptor.
+ * \param[in] function The commit action.
+ * \param[in] args The arguments of the commit action.
+ * \param[in] error_result Where to report failures of the commit action.
+ * \param[in] order The order level of the commit action.
+ * \param[in] key The file descriptor the commit action is confined to,
+ *            or -1 if it is not confined to any.
+ * \return Code indicating success or failure (reason) of the operation.
+ */
+txc_result_t
+txc_tx_register_keyed_commit_action(txc_tx_t *txd, 
+                                    txc_tx_commit_function_t function, 
+                                    void *args, int *error_result, int order,
+                                    int key) 
 {
 	txc_result_t                ret;
 	txc_tx_commit_action_list_t *la;
 
 	la = txd->commit_action_list;
-	if ((ret = register_action(la, function, args, error_result, order)) 
+	if ((ret = register_action(la, function, args, error_result, order, key)) 
 	    != TXC_R_SUCCESS) 
 	{
 		return ret;
@@ -386,7 +644,7 @@ txc_tx_register_undo_action(txc_tx_t *txd,
 	txc_tx_undo_action_list_t *la;
 
 	la = txd->undo_action_list;
-	if ((ret = register_action(la, function, args, error_result, order)) 
+	if ((ret = register_action(la, function, args, error_result, order, -1)) 
 	    != TXC_R_SUCCESS) 
 	{
 		return ret;
@@ -398,9 +656,168 @@ txc_tx_register_undo_action(txc_tx_t *txd,
 }
 
 
+static inline
+txc_tx_merge_entry_t *
+merge_entry(txc_tx_t *txd, int fd, int kind)
+{
+	unsigned int hash = ((unsigned int) fd * 31 + (unsigned int) kind);
+
+	return &txd->merge_table[hash & (TXC_MERGE_TABLE_SIZE - 1)];
+}
+
+
+/**
+ * \brief Registers an undo action later operations may merge into.
+ *
+ * Operations of the same kind on the same file descriptor often need 
+ * just the undo action of the earliest one, such as a truncate back to
+ * the size the file had before a run of appends. The undo action is 
+ * registered as a regular one and remembered by (fd, kind), so that 
+ * later operations can find it with txc_tx_find_mergeable_undo_action 
+ * and fold themselves into its arguments instead of registering their
+ * own. Failures of a merged undo action are reported only to the 
+ * error result of the operation that registered it.
+ *
+ * \param[in] txd Transaction descriptor.
+ * \param[in] function The undo action.
+ * \param[in] args The arguments of the undo action.
+ * \param[in] error_result Where to report failures of the undo action.
+ * \param[in] order The order level of the undo action.
+ * \param[in] fd The file descriptor the undo action is about.
+ * \param[in] kind Caller defined kind of the undo action.
+ * \return Code indicating success or failure (reason) of the operation.
+ */
+txc_result_t
+txc_tx_register_mergeable_undo_action(txc_tx_t *txd, 
+                                      txc_tx_undo_function_t function, 
+                                      void *args, int *error_result, 
+                                      int order, int fd, int kind) 
+{
+	txc_tx_merge_entry_t *entry;
+	txc_result_t              ret;
+
+	if ((ret = txc_tx_register_undo_action(txd, function, args, 
+	                                       error_result, order))
+	    != TXC_R_SUCCESS)
+	{
+		return ret;
+	}
+	/* A colliding entry is simply replaced; it can no longer be merged into. */
+	entry = merge_entry(txd, fd, kind);
+	entry->fd = fd;
+	entry->kind = kind;
+	entry->args = args;
+	entry->index = txd->undo_action_list->num_entries - 1;
+	entry->generation = txd->merge_generation;
+
+	return TXC_R_SUCCESS;
+}
+
+
+/**
+ * \brief Finds the undo action an operation can merge into.
+ *
+ * \param[in] txd Transaction descriptor.
+ * \param[in] fd The file descriptor of the operation.
+ * \param[in] kind Caller defined kind of the undo action.
+ * \param[in] flags TXC_TX_MERGE_ADJACENT if the operation can merge only 
+ *            into an undo action no other undo action has been registered 
+ *            after, as when the undo action depends on the current offset.
+ * \return The arguments of the undo action, or NULL if there is none.
+ */
+void *
+txc_tx_find_mergeable_undo_action(txc_tx_t *txd, int fd, int kind, int flags)
+{
+	txc_tx_merge_entry_t *entry = merge_entry(txd, fd, kind);
+
+	if (entry->generation != txd->merge_generation ||
+	    entry->fd != fd || entry->kind != kind) 
+	{
+		return NULL;
+	}
+	if ((flags & TXC_TX_MERGE_ADJACENT) && 
+	    entry->index != txd->undo_action_list->num_entries - 1) 
+	{
+		return NULL;
+	}
+	return entry->args;
+}
+
+
+/**
+ * \brief Registers a commit action later operations may merge into.
+ *
+ * Like txc_tx_register_mergeable_undo_action but for commit actions, 
+ * such as a flush of a file requested several times by a transaction.
+ * The commit action is confined to fd (see 
+ * txc_tx_register_keyed_commit_action). Kinds of commit actions share 
+ * the table of undo actions and must differ from them.
+ *
+ * \param[in] txd Transaction descriptor.
+ * \param[in] function The commit action.
+ * \param[in] args The arguments of the commit action.
+ * \param[in] error_result Where to report failures of the commit action.
+ * \param[in] order The order level of the commit action.
+ * \param[in] fd The file descriptor the commit action is about.
+ * \param[in] kind Caller defined kind of the commit action.
+ * \return Code indicating success or failure (reason) of the operation.
+ */
+txc_result_t
+txc_tx_register_mergeable_commit_action(txc_tx_t *txd, 
+                                        txc_tx_commit_function_t function, 
+                                        void *args, int *error_result, 
+                                        int order, int fd, int kind) 
+{
+	txc_tx_merge_entry_t *entry;
+	txc_result_t         ret;
+
+	if ((ret = txc_tx_register_keyed_commit_action(txd, function, args, 
+	                                               error_result, order, fd))
+	    != TXC_R_SUCCESS)
+	{
+		return ret;
+	}
+	entry = merge_entry(txd, fd, kind);
+	entry->fd = fd;
+	entry->kind = kind;
+	entry->args = args;
+	entry->index = txd->commit_action_list->num_entries - 1;
+	entry->generation = txd->merge_generation;
+
+	return TXC_R_SUCCESS;
+}
+
+
+/**
+ * \brief Finds the commit action an operation can merge into.
+ *
+ * \param[in] txd Transaction descriptor.
+ * \param[in] fd The file descriptor of the operation.
+ * \param[in] kind Caller defined kind of the commit action.
+ * \return The arguments of the commit action, or NULL if there is none.
+ */
+void *
+txc_tx_find_mergeable_commit_action(txc_tx_t *txd, int fd, int kind)
+{
+	txc_tx_merge_entry_t *entry = merge_entry(txd, fd, kind);
+
+	if (entry->generation != txd->merge_generation ||
+	    entry->fd != fd || entry->kind != kind) 
+	{
+		return NULL;
+	}
+	return entry->args;
+}
+
+
+/**
+ * \brief Runs the undo actions of a transaction in reverse order.
+ *
+ * \return The error of the first undo action that failed, or 0.
+ */
 static
-void
-tx_generic_undo_action(txc_tx_t *txd)
+int
+tx_undo_actions_run(txc_tx_t *txd)
 {
 	txc_tx_undo_action_list_entry_t *entry;
 	int                             i;
@@ -436,6 +853,27 @@ tx_generic_undo_action(txc_tx_t *txd)
 			}	
 		}
 	}
+	return first_error_result;
+}
+
+
+static
+void
+tx_generic_undo_action(txc_tx_t *txd)
+{
+	int first_error_result;
+
+	first_error_result = tx_undo_actions_run(txd);
+	if (txd->manager->journalmgr) {
+		txc_journal_abort(txd->manager->journalmgr, txd);
+	}
+	/* 
+	 * A user abort completes the transaction. Otherwise the transaction 
+	 * restarts and keeps referencing the KOAs and sentinels it has seen.
+	 */
+	if (txd->abort_reason == TXC_ABORTREASON_USERABORT) {
+		txc_epoch_exit(txd->epoch);
+	}
 	txc_tx_init(txd);
 	txc_fm_handle_undo_failure(txd, first_error_result);
 }
@@ -446,12 +884,41 @@ void
 tx_generic_commit_action(txc_tx_t *txd)
 {
 	txc_tx_commit_action_list_entry_t *entry;
+	txc_tx_commit_batch_t             batch;
 	int                               i;
 	int                               order;
 	int                               num_actions_executed;
-	int                               temp_error_result;
 	int                               first_error_result = 0;
 
+	batch.entries = txd->commit_action_list->entries;
+	for (i = 0; i < TXC_COMMIT_PARTITIONS_MAX; i++) {
+		batch.head[i] = -1;
+	}
+	batch.num_used = 0;
+	batch.num_claimed = 0;
+	batch.num_running = 0;
+	batch.first_error_result = 0;
+
+	if (txd->manager->journalmgr &&
+	    (first_error_result = txc_journal_commit(txd->manager->journalmgr, txd)) 
+	    != 0) 
+	{
+		/* 
+		 * Nothing may change before the transaction is durable. Without 
+		 * a durable commit record recovery would roll the transaction 
+		 * back, so roll back its in-place changes now rather than apply
+		 * the deferred ones. The transaction completes, so it releases 
+		 * its sentinels as on a user abort.
+		 */
+		txd->abort_reason = TXC_ABORTREASON_USERABORT;
+		tx_undo_actions_run(txd);
+		txc_journal_abort(txd->manager->journalmgr, txd);
+		txc_tx_init(txd);
+		txd->forced_retries = 0;
+		txc_epoch_exit(txd->epoch);
+		txc_fm_handle_commit_failure(txd, first_error_result);
+		return;
+	}
 	for (order = 0, num_actions_executed = 0; 
 	     num_actions_executed != txd->commit_action_list->num_entries; 
 	     order++) 
@@ -459,28 +926,28 @@ tx_generic_commit_action(txc_tx_t *txd)
 		for (i = 0; i < txd->commit_action_list->num_entries; i++) {
 			entry = &txd->commit_action_list->entries[i];
 			if (entry->order == order) {
-				/* 
-				 * It is possible entry->error_result be NULL because the caller
-				 * might have not passed any result variable. Thus, if we simply
-				 * pass entry->error_result we might not get informed about any 
-				 * error happpened. Temporarily save any error of the action in 
-				 * temp_error_result to be able to correctly take any actions 
-				 * needed in case of failure (e.g. informing the failure manager
-				 */
-				temp_error_result = 0; 
-				entry->function(entry->args, &temp_error_result);
-				if (entry->error_result) {
-					*(entry->error_result) = temp_error_result;
-				}
-				if (first_error_result == 0) {
-					first_error_result = temp_error_result;
-				}
 				num_actions_executed++;
+				if (entry->key >= 0 && txd->manager->helpers_num > 0) {
+					commit_batch_add(&batch, i);
+					continue;
+				}
+				/* Runs after the actions registered before it. */
+				commit_batch_run(txd->manager, &batch);
+				commit_action_run(entry, &first_error_result);
 			}	
 		}
+		/* Order levels are barriers. */
+		commit_batch_run(txd->manager, &batch);
 	}	
+	if (first_error_result == 0) {
+		first_error_result = batch.first_error_result;
+	}
+	if (txd->manager->journalmgr) {
+		txc_journal_end(txd->manager->journalmgr, txd);
+	}
 	txc_tx_init(txd);
 	txd->forced_retries = 0;
+	txc_epoch_exit(txd->epoch);
 	txc_fm_handle_commit_failure(txd, first_error_result);
 }
 
@@ -544,6 +1011,7 @@ tx_pre_outerbegin(txc_tx_t * txd, const char *srcloc_str, txc_tx_srcloc_t *srclo
 	}	
 #endif	
 	txd->forced_retries = 0;
+	txc_epoch_enter(txd->epoch);
 }
 
 
@@ -569,6 +1037,12 @@ txc_tx_pre_begin(txc_tx_t * txd, const char *srcloc_str, txc_tx_srcloc_t *srcloc
 void
 txc_tx_post_begin(txc_tx_t * txd)
 {
+	/* 
+	 * Make sure we get to know when the transaction completes, so that 
+	 * we leave the epoch we announced even if no xCall registers actions.
+	 */
+	tmsystem_register_generic_commit_action(txd);
+	tmsystem_register_generic_undo_action(txd);
 	txc_sentinel_transaction_postbegin(txd);
 #ifdef _TXC_STATS_BUILD	
 	if (txc_runtime_settings.statistics == TXC_BOOL_TRUE) {
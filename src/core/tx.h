@@ -39,6 +39,8 @@
 
 #include <core/buffer.h>
 #include <core/sentinel.h>
+#include <core/epoch.h>
+#include <core/journal.h>
 
 /* 
  * This opaque type is defined here. 
@@ -87,6 +89,10 @@ typedef enum {
 # endif /* TYPEDEF_TXC_TX_XACTSTATE_T */
 
 
+/* Flags of txc_tx_find_mergeable_undo_action */
+#define TXC_TX_MERGE_ADJACENT 0x1  /**< Only if no undo action has been registered since */
+
+
 typedef struct txc_tx_srcloc_s txc_tx_srcloc_t;
 
 struct txc_tx_srcloc_s {
@@ -103,13 +109,18 @@ int txc_tx_xact_state_get();
 
 #include <core/stats.h>
 
-txc_result_t txc_txmgr_create(txc_txmgr_t **, txc_buffermgr_t *, txc_sentinelmgr_t *, txc_statsmgr_t *statsmgr);
+txc_result_t txc_txmgr_create(txc_txmgr_t **, txc_buffermgr_t *, txc_sentinelmgr_t *, txc_statsmgr_t *statsmgr, txc_epochmgr_t *epochmgr, txc_journalmgr_t *journalmgr);
 txc_result_t txc_txmgr_destroy(txc_txmgr_t **);
 txc_result_t txc_tx_create(txc_txmgr_t *, txc_tx_t **);
 txc_result_t txc_tx_destroy(txc_tx_t **);
 void txc_tx_abort_transaction(txc_tx_t *, txc_tx_abortreason_t);
 txc_result_t txc_tx_register_commit_action(txc_tx_t *, txc_tx_commit_function_t, void *, int *, int); 
+txc_result_t txc_tx_register_keyed_commit_action(txc_tx_t *, txc_tx_commit_function_t, void *, int *, int, int);
 txc_result_t txc_tx_register_undo_action(txc_tx_t *, txc_tx_undo_function_t, void *, int *, int);
+txc_result_t txc_tx_register_mergeable_undo_action(txc_tx_t *, txc_tx_undo_function_t, void *, int *, int, int, int);
+void *txc_tx_find_mergeable_undo_action(txc_tx_t *, int, int, int);
+txc_result_t txc_tx_register_mergeable_commit_action(txc_tx_t *, txc_tx_commit_function_t, void *, int *, int, int, int);
+void *txc_tx_find_mergeable_commit_action(txc_tx_t *, int, int);
 txc_tx_t *txc_tx_get_txd();   
 unsigned int txc_tx_get_tid(txc_tx_t *txd);
 unsigned int txc_tx_get_tid_pthread(txc_tx_t *txd);
@@ -37,6 +37,8 @@
 #ifndef _TXDESC_H
 #define _TXDESC_H
 
+#include <core/config.h>
+
 #if (_TM_SYSTEM_ITM)
 #  include <itm.h>
 #endif
@@ -47,6 +49,17 @@ typedef struct txc_tx_action_list_s txc_tx_action_list_t;
 typedef struct txc_tx_action_list_entry_s txc_tx_commit_action_list_entry_t;
 typedef struct txc_tx_action_list_entry_s txc_tx_undo_action_list_entry_t;
 typedef struct txc_tx_action_list_entry_s txc_tx_action_list_entry_t;
+typedef struct txc_tx_merge_entry_s txc_tx_merge_entry_t;
+
+
+/** Mergeable action registered by the running transaction. */
+struct txc_tx_merge_entry_s {
+	int          fd;
+	int          kind;
+	void         *args;        /**< Arguments of the action later operations merge into */
+	unsigned int index;        /**< Position of the action in its action list */
+	unsigned int generation;   /**< Transaction instance that registered the action */
+};
 
 
 /** Transaction descriptor. */
@@ -63,9 +76,14 @@ struct txc_tx_s {
 	unsigned int                 forced_retries;                         /**< Number of times the transaction was forced to retry. */
 	txc_tx_commit_action_list_t  *commit_action_list;                    /**< List of undo actions to be executed after the transaction rollbacks. */
 	txc_tx_undo_action_list_t    *undo_action_list;                      /**< List of commit actions to be executed after the transaction commits. */
+	txc_tx_merge_entry_t         merge_table[TXC_MERGE_TABLE_SIZE];      /**< Mergeable actions by file descriptor and kind. */
+	unsigned int                 merge_generation;                       /**< Transaction instance owning the entries of merge_table. */
+	void                         *created_unnamed;                       /**< Files created unnamed by the transaction instance, which x_create names on reference. */
+	unsigned long long           journal_txid;                           /**< Identifier of the transaction's records in the journal, or 0 if it has none. */
 	txc_sentinel_list_t          *sentinel_list;                         /**< List of sentinels the transaction has tried to acquired together with an indication of the acquisition's success/failure. */
 	txc_sentinel_list_t          *sentinel_list_preacquire;              /**< List of sentinels to preacquire before transaction restarts. */
 	txc_buffer_linear_t          *buffer_linear;                         /**< Private linear buffer. */
+	txc_epoch_t                  *epoch;                                 /**< Epoch record announcing when the thread runs a transaction. */
 	txc_txmgr_t                  *manager;                               /**< Generic transaction manager responsible for this transaction descriptor. */
 	struct txc_tx_s              *next;                                  /**< Next transaction descriptor in the list of descriptors. */
 	struct txc_tx_s              *prev;                                  /**< Previous transaction descriptor in the list of descriptors. */
@@ -0,0 +1,401 @@
+/*
+    Copyright (C) 2008-2009 Computer Sciences Department, 
+    University of Wisconsin -- Madison
+
+    ----------------------------------------------------------------------
+
+    This file is part of the xCalls transactional API, originally 
+    developed at the University of Wisconsin -- Madison.
+
+    xCalls was originally developed primarily by Haris Volos and 
+    Neelam Goyal with contributions from Andres Jaan Tack.
+
+    ----------------------------------------------------------------------
+
+    xCalls is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as 
+    published by the Free Software Foundation, either version 3 of 
+    the License, or (at your option) any later version.
+
+    xCalls is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public 
+    License along with xCalls.  If not, see <http://www.gnu.org/licenses/>.
+
+### END HEADER ###
+*/
+
+/**
+ * \file uring.c
+ *
+ * \brief io_uring backend.
+ *
+ * The writes of the runs of deferred data of a file are submitted to the
+ * kernel together at commit through a per thread io_uring instead of one
+ * system call each. Only these writes use the ring: syncs are grouped 
+ * across transactions by the KOA (see txc_koa_file_sync), which already 
+ * saves more system calls than a ring could, and sends keep their 
+ * datagram batching through sendmmsg. The operations of a submission are
+ * linked: they run in order and a failed or short one cancels the rest, 
+ * which the caller then completes through the synchronous path.
+ *
+ * The ring of a thread is set up on first use. Where the kernel lacks 
+ * io_uring, or the ring cannot be set up, txc_uring_submit fails and 
+ * callers use the synchronous path. A ring is torn down when its thread
+ * exits.
+ *
+ * A thread can register a buffer, such as the first segment of its 
+ * linear log, with its ring; single buffer writes from it do not need 
+ * the kernel to map the user pages each time. Threads that register no 
+ * buffer, such as commit helper threads running the actions of many 
+ * transactions, write through WRITEV only. File descriptors are not 
+ * registered: the descriptors a transaction touches differ from one 
+ * transaction to the next, and registering them would cost as many 
+ * system calls as the batching saves.
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <misc/result.h>
+#include <misc/debug.h>
+#include <core/config.h>
+#include <core/uring.h>
+
+#if defined(__has_include)
+# if __has_include(<linux/io_uring.h>) && defined(SYS_io_uring_setup)
+#  define TXC_HAVE_IO_URING 1
+#  include <linux/io_uring.h>
+# endif
+#endif
+
+
+#ifdef TXC_HAVE_IO_URING
+
+typedef struct txc_uring_s txc_uring_t;
+
+/** A thread's io_uring */
+struct txc_uring_s {
+	int                 state;        /**< 0: not set up yet, 1: ready, -1: unavailable */
+	int                 fd;
+	unsigned int        *sq_tail;
+	unsigned int        *sq_mask;
+	unsigned int        *sq_array;
+	unsigned int        *cq_head;
+	unsigned int        *cq_tail;
+	unsigned int        *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	void                *sq_ring;
+	size_t              sq_ring_len;
+	void                *cq_ring;
+	size_t              cq_ring_len;
+	size_t              sqes_len;
+	char                *fixed_base;  /**< Registered buffer; NULL if none */
+	size_t              fixed_len;
+};
+
+
+static __thread txc_uring_t uring;
+static pthread_key_t        uring_key;
+static pthread_once_t       uring_key_once = PTHREAD_ONCE_INIT;
+static volatile int         uring_unsupported = 0;
+
+
+static
+void
+uring_teardown(void *arg)
+{
+	txc_uring_t *ring = (txc_uring_t *) arg;
+
+	if (ring->sqes) {
+		munmap(ring->sqes, ring->sqes_len);
+	}
+	if (ring->cq_ring && ring->cq_ring != ring->sq_ring) {
+		munmap(ring->cq_ring, ring->cq_ring_len);
+	}
+	if (ring->sq_ring) {
+		munmap(ring->sq_ring, ring->sq_ring_len);
+	}
+	if (ring->fd >= 0) {
+		close(ring->fd);
+	}
+	memset(ring, 0, sizeof(*ring));
+	ring->state = -1;
+}
+
+
+/* 
+ * Collects the completions of a submission; returns the number of 
+ * operations completed.
+ */
+static
+int
+uring_reap(txc_uring_t *ring, txc_uring_op_t *ops, int num_ops)
+{
+	struct io_uring_cqe *cqe;
+	unsigned int        head;
+	int                 completed = 0;
+
+	head = *ring->cq_head;
+	while (head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+		cqe = &ring->cqes[head & *ring->cq_mask];
+		if (cqe->user_data < (unsigned long) num_ops) {
+			ops[cqe->user_data].res = cqe->res;
+			completed++;
+		}
+		head++;
+	}
+	__atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+	return completed;
+}
+
+
+static
+void
+uring_key_create(void)
+{
+	pthread_key_create(&uring_key, uring_teardown);
+}
+
+
+static
+txc_uring_t *
+uring_get(void)
+{
+	txc_uring_t            *ring = &uring;
+	struct io_uring_params params;
+
+	if (ring->state != 0) {
+		return (ring->state > 0) ? ring : NULL;
+	}
+	ring->state = -1;
+	ring->fd = -1;
+	if (uring_unsupported) {
+		return NULL;
+	}
+	memset(&params, 0, sizeof(params));
+	if ((ring->fd = syscall(SYS_io_uring_setup, TXC_URING_BATCH_MAX, &params)) 
+	    < 0) 
+	{
+		if (errno == ENOSYS) {
+			uring_unsupported = 1;
+		}
+		ring->fd = -1;
+		return NULL;
+	}
+	ring->sq_ring_len = params.sq_off.array + 
+	                    params.sq_entries * sizeof(unsigned int);
+	ring->cq_ring_len = params.cq_off.cqes + 
+	                    params.cq_entries * sizeof(struct io_uring_cqe);
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		if (ring->cq_ring_len > ring->sq_ring_len) {
+			ring->sq_ring_len = ring->cq_ring_len;
+		}
+	}
+	ring->sq_ring = mmap(NULL, ring->sq_ring_len, PROT_READ | PROT_WRITE, 
+	                     MAP_SHARED | MAP_POPULATE, ring->fd, 
+	                     IORING_OFF_SQ_RING);
+	if (ring->sq_ring == MAP_FAILED) {
+		ring->sq_ring = NULL;
+		goto error;
+	}
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		ring->cq_ring = ring->sq_ring;
+	} else {
+		ring->cq_ring = mmap(NULL, ring->cq_ring_len, PROT_READ | PROT_WRITE, 
+		                     MAP_SHARED | MAP_POPULATE, ring->fd, 
+		                     IORING_OFF_CQ_RING);
+		if (ring->cq_ring == MAP_FAILED) {
+			ring->cq_ring = NULL;
+			goto error;
+		}
+	}
+	ring->sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = (struct io_uring_sqe *) 
+	             mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE, 
+	                  MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED) {
+		ring->sqes = NULL;
+		goto error;
+	}
+	ring->sq_tail = (unsigned int *) ((char *) ring->sq_ring + params.sq_off.tail);
+	ring->sq_mask = (unsigned int *) ((char *) ring->sq_ring + params.sq_off.ring_mask);
+	ring->sq_array = (unsigned int *) ((char *) ring->sq_ring + params.sq_off.array);
+	ring->cq_head = (unsigned int *) ((char *) ring->cq_ring + params.cq_off.head);
+	ring->cq_tail = (unsigned int *) ((char *) ring->cq_ring + params.cq_off.tail);
+	ring->cq_mask = (unsigned int *) ((char *) ring->cq_ring + params.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *) ((char *) ring->cq_ring + params.cq_off.cqes);
+
+	pthread_once(&uring_key_once, uring_key_create);
+	pthread_setspecific(uring_key, ring);
+	ring->state = 1;
+	return ring;
+
+error:
+	uring_teardown(ring);
+	return NULL;
+}
+
+
+/**
+ * \brief Registers a buffer with the ring of the calling thread.
+ *
+ * \param[in] base Start of the buffer.
+ * \param[in] len Length of the buffer.
+ * \return Code indicating success or failure (reason) of the operation.
+ */
+txc_result_t
+txc_uring_register_buffer(void *base, size_t len)
+{
+	txc_uring_t  *ring;
+	struct iovec iov;
+
+	if ((ring = uring_get()) == NULL) {
+		return TXC_R_NOTIMPLEMENTED;
+	}
+	if (ring->fixed_base) {
+		syscall(SYS_io_uring_register, ring->fd, IORING_UNREGISTER_BUFFERS, 
+		        NULL, 0);
+		ring->fixed_base = NULL;
+	}
+	iov.iov_base = base;
+	iov.iov_len = len;
+	if (syscall(SYS_io_uring_register, ring->fd, IORING_REGISTER_BUFFERS, 
+	            &iov, 1) < 0) 
+	{
+		/* Most likely over RLIMIT_MEMLOCK; write without it. */
+		return TXC_R_NORESOURCES;
+	}
+	ring->fixed_base = (char *) base;
+	ring->fixed_len = len;
+	return TXC_R_SUCCESS;
+}
+
+
+/**
+ * \brief Runs a batch of operations with a single submission.
+ *
+ * The operations are linked and run in order; once one fails or 
+ * transfers less than asked, the rest complete with -ECANCELED. 
+ *
+ * \param[in,out] ops The operations; their results are stored in res.
+ * \param[in] num_ops The number of operations, up to TXC_URING_BATCH_MAX.
+ * \return TXC_R_SUCCESS if all operations completed, whatever their 
+ * results. Otherwise the caller must run them through the synchronous 
+ * path; some of them may have run already, so they must be idempotent.
+ * None of them is still in flight by then.
+ */
+txc_result_t
+txc_uring_submit(txc_uring_op_t *ops, int num_ops)
+{
+	txc_uring_t         *ring;
+	struct io_uring_sqe *sqe;
+	unsigned int        tail;
+	unsigned int        index;
+	int                 to_submit;
+	int                 completed;
+	long                ret;
+	int                 i;
+
+	TXC_ASSERT(num_ops <= TXC_URING_BATCH_MAX);
+	if ((ring = uring_get()) == NULL) {
+		return TXC_R_NOTIMPLEMENTED;
+	}
+
+	tail = *ring->sq_tail;
+	for (i = 0; i < num_ops; i++) {
+		index = tail & *ring->sq_mask;
+		sqe = &ring->sqes[index];
+		memset(sqe, 0, sizeof(*sqe));
+		sqe->fd = ops[i].fd;
+		sqe->user_data = i;
+		switch (ops[i].opcode) {
+			case TXC_URING_OP_WRITEV:
+				sqe->off = ops[i].offset;
+				if (ops[i].iovcnt == 1 && ring->fixed_base &&
+				    (char *) ops[i].iov[0].iov_base >= ring->fixed_base &&
+				    (char *) ops[i].iov[0].iov_base + ops[i].iov[0].iov_len <= 
+				    ring->fixed_base + ring->fixed_len)
+				{
+					sqe->opcode = IORING_OP_WRITE_FIXED;
+					sqe->addr = (unsigned long) ops[i].iov[0].iov_base;
+					sqe->len = ops[i].iov[0].iov_len;
+					sqe->buf_index = 0;
+				} else {
+					sqe->opcode = IORING_OP_WRITEV;
+					sqe->addr = (unsigned long) ops[i].iov;
+					sqe->len = ops[i].iovcnt;
+				}
+				break;
+			default:
+				TXC_INTERNALERROR("Unknown io_uring operation\n");
+		}
+		if (i < num_ops - 1) {
+			sqe->flags |= IOSQE_IO_LINK;
+		}
+		ring->sq_array[index] = index;
+		ops[i].res = -ECANCELED;
+		tail++;
+	}
+	__atomic_store_n(ring->sq_tail, tail, __ATOMIC_RELEASE);
+
+	for (to_submit = num_ops, completed = 0; completed < num_ops; ) {
+		if ((ret = syscall(SYS_io_uring_enter, ring->fd, to_submit, 
+		                   num_ops - completed, IORING_ENTER_GETEVENTS, 
+		                   NULL, 0)) < 0) 
+		{
+			if (errno == EINTR) {
+				continue;
+			}
+			if (to_submit == num_ops) {
+				/* Nothing was submitted; take the entries back. */
+				*ring->sq_tail = tail - num_ops;
+				return TXC_R_FAILURE;
+			}
+			/* 
+			 * Some were submitted but the rest cannot be. Wait for the
+			 * submitted ones before the caller falls back, so that none
+			 * of them lands after the synchronous path has run.
+			 */
+			while (completed < num_ops - to_submit) {
+				if (syscall(SYS_io_uring_enter, ring->fd, 0, 1, 
+				            IORING_ENTER_GETEVENTS, NULL, 0) < 0 &&
+				    errno != EINTR && errno != EAGAIN && errno != EBUSY) 
+				{
+					break;
+				}
+				completed += uring_reap(ring, ops, num_ops);
+			}
+			uring_teardown(ring);
+			return TXC_R_FAILURE;
+		}
+		to_submit -= ret;
+		completed += uring_reap(ring, ops, num_ops);
+	}
+	return TXC_R_SUCCESS;
+}
+
+#else /* !TXC_HAVE_IO_URING */
+
+txc_result_t
+txc_uring_register_buffer(void *base, size_t len)
+{
+	return TXC_R_NOTIMPLEMENTED;
+}
+
+
+txc_result_t
+txc_uring_submit(txc_uring_op_t *ops, int num_ops)
+{
+	return TXC_R_NOTIMPLEMENTED;
+}
+
+#endif /* TXC_HAVE_IO_URING */
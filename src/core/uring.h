@@ -0,0 +1,64 @@
+/*
+    Copyright (C) 2008-2009 Computer Sciences Department, 
+    University of Wisconsin -- Madison
+
+    ----------------------------------------------------------------------
+
+    This file is part of the xCalls transactional API, originally 
+    developed at the University of Wisconsin -- Madison.
+
+    xCalls was originally developed primarily by Haris Volos and 
+    Neelam Goyal with contributions from Andres Jaan Tack.
+
+    ----------------------------------------------------------------------
+
+    xCalls is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as 
+    published by the Free Software Foundation, either version 3 of 
+    the License, or (at your option) any later version.
+
+    xCalls is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public 
+    License along with xCalls.  If not, see <http://www.gnu.org/licenses/>.
+
+### END HEADER ###
+*/
+
+/**
+ * \file uring.h
+ *
+ * \brief io_uring backend interface.
+ */
+
+#ifndef _TXC_URING_H
+#define _TXC_URING_H
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <misc/result.h>
+
+#define TXC_URING_OP_WRITEV    1  /**< pwritev(fd, iov, iovcnt, offset) */
+
+/** Maximum number of operations submitted together. */
+#define TXC_URING_BATCH_MAX    32
+
+typedef struct txc_uring_op_s txc_uring_op_t;
+
+/** An operation submitted to the io_uring backend. */
+struct txc_uring_op_s {
+	int                opcode;
+	int                fd;
+	const struct iovec *iov;
+	int                iovcnt;
+	off_t              offset;
+	ssize_t            res;     /**< Bytes transferred, or -errno if the operation failed */
+};
+
+txc_result_t txc_uring_register_buffer(void *base, size_t len);
+txc_result_t txc_uring_submit(txc_uring_op_t *ops, int num_ops);
+
+#endif /* _TXC_URING_H */
@@ -134,11 +134,14 @@ TM_WAIVER int _TXC_register_undo_action(_TXC_undo_function_t function, void *arg
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <fcntl.h>
 
 #define XCALL_DEF(xcall) _TXC_##xcall 
 #define _XCALL(xcall) _TXC_##xcall 
 
+TM_WAIVER int _TXC_set_allocator(void *(*malloc_fn)(size_t size), void (*free_fn)(void *ptr));
+
 TM_WAIVER int     XCALL_DEF(x_close)(int fildes, int *result);
 TM_WAIVER int     XCALL_DEF(x_create)(const char *, mode_t, int *);
 TM_WAIVER int     XCALL_DEF(x_dup)(int oldfd, int *result);
@@ -152,12 +155,19 @@ TM_WAIVER int     XCALL_DEF(x_pthread_create)(pthread_t *thread, const pthread_a
 TM_WAIVER int     XCALL_DEF(x_pthread_mutex_init)(pthread_mutex_t *mutex, const pthread_mutexattr_t *attr, int *result);
 TM_WAIVER int     XCALL_DEF(x_pthread_mutex_lock)(pthread_mutex_t *mutex, int *result);
 TM_WAIVER int     XCALL_DEF(x_pthread_mutex_unlock)(pthread_mutex_t *mutex, int *result);
+TM_WAIVER ssize_t XCALL_DEF(x_pread)(int fd, void *buf, size_t nbyte, off_t offset, int *result);
+TM_WAIVER ssize_t XCALL_DEF(x_preadv)(int fd, const struct iovec *iov, int iovcnt, off_t offset, int *result);
+TM_WAIVER ssize_t XCALL_DEF(x_pwrite)(int fd, const void *buf, size_t nbyte, off_t offset, int *result);
+TM_WAIVER ssize_t XCALL_DEF(x_pwritev)(int fd, const struct iovec *iov, int iovcnt, off_t offset, int *result);
 TM_WAIVER ssize_t XCALL_DEF(x_read)(int fd, void *buf, size_t nbyte, int *result);
 TM_WAIVER ssize_t XCALL_DEF(x_read_pipe)(int fd, void *buf, size_t nbyte, int *result);
+TM_WAIVER ssize_t XCALL_DEF(x_recv)(int s, void *buf, size_t len, int flags, int *result);
 TM_WAIVER ssize_t XCALL_DEF(x_recvmsg)(int s, struct msghdr *msg, int flags, int *result);
 TM_WAIVER int     XCALL_DEF(x_rename)(const char *oldpath, const char *newpath, int *result);
 TM_WAIVER int     XCALL_DEF(x_socket)(int domain, int type, int protocol, int *result); 
+TM_WAIVER ssize_t XCALL_DEF(x_send)(int s, const void *buf, size_t len, int flags, int *result);
 TM_WAIVER ssize_t XCALL_DEF(x_sendmsg)(int fd, const struct msghdr *msg, int flags, int *result);
+TM_WAIVER ssize_t XCALL_DEF(x_write_deferred)(int fd, const void *buf, size_t nbyte, int *result);
 TM_WAIVER ssize_t XCALL_DEF(x_write_ovr)(int fd, const void *buf, size_t nbyte, int *result);
 TM_WAIVER ssize_t XCALL_DEF(x_write_ovr_save)(int fd, const void *buf, size_t nbyte, int *result);
 TM_WAIVER ssize_t XCALL_DEF(x_write_ovr_ignore)(int fd, const void *buf, size_t nbyte, int *result);
@@ -42,9 +42,15 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <stdio.h>
+#include <errno.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <stdint.h>
 
 
 
@@ -88,6 +94,30 @@ txc_libc_stat(const char *path, struct stat *buf)
 }
 
 
+static inline
+int
+txc_libc_fstat(int fd, struct stat *buf)
+{
+	return fstat(fd, buf);
+}
+
+
+static inline
+int
+txc_libc_fcntl_getfl(int fd)
+{
+	return fcntl(fd, F_GETFL);
+}
+
+
+static inline
+int
+txc_libc_fcntl_dupfd_cloexec(int fd)
+{
+	return fcntl(fd, F_DUPFD_CLOEXEC, 0);
+}
+
+
 static inline
 int
 txc_libc_unlink(const char *path)
@@ -104,6 +134,14 @@ txc_libc_write(int fd, const void *buf, size_t nbyte)
 }
 
 
+static inline
+ssize_t 
+txc_libc_writev(int fd, const struct iovec *iov, int iovcnt)
+{
+	return writev(fd, iov, iovcnt);
+}
+
+
 static inline
 ssize_t
 txc_libc_read(int fd, void *buf, size_t nbyte)
@@ -128,6 +166,14 @@ txc_libc_pread(int fd, void *buf, size_t count, off_t offset)
 }
 
 
+static inline
+ssize_t 
+txc_libc_preadv(int fd, const struct iovec *iov, int iovcnt, off_t offset)
+{
+	return preadv(fd, iov, iovcnt, offset);
+}
+
+
 static inline
 ssize_t 
 txc_libc_pwrite(int fd, const void *buf, size_t count, off_t offset)
@@ -136,6 +182,14 @@ txc_libc_pwrite(int fd, const void *buf, size_t count, off_t offset)
 }
 
 
+static inline
+ssize_t 
+txc_libc_pwritev(int fd, const struct iovec *iov, int iovcnt, off_t offset)
+{
+	return pwritev(fd, iov, iovcnt, offset);
+}
+
+
 static inline
 int 
 txc_libc_ftruncate(int fd, off_t length)
@@ -242,4 +296,143 @@ txc_libc_fdatasync(int fd)
 }
 
 
+static inline
+int 
+txc_libc_getsockopt(int s, int level, int optname, void *optval, 
+                    socklen_t *optlen)
+{
+	return getsockopt(s, level, optname, optval, optlen);
+}
+
+
+
+static inline
+int 
+txc_libc_memfd_create(const char *name, unsigned int flags)
+{
+#ifdef SYS_memfd_create
+	return syscall(SYS_memfd_create, name, flags);
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+
+/** Same layout as struct file_clone_range of linux/fs.h. */
+typedef struct txc_libc_file_clone_range_s txc_libc_file_clone_range_t;
+
+struct txc_libc_file_clone_range_s {
+	int64_t  src_fd;
+	uint64_t src_offset;
+	uint64_t src_length;
+	uint64_t dest_offset;
+};
+
+#ifndef FICLONERANGE
+# define FICLONERANGE _IOW(0x94, 13, txc_libc_file_clone_range_t)
+#endif
+
+
+/** 
+ * Makes [dest_offset, dest_offset+len) of dest_fd share the extents of 
+ * [src_offset, src_offset+len) of src_fd. Fails unless both are on the 
+ * same filesystem, it supports reflinks, and the ranges are aligned to 
+ * its block size.
+ */
+static inline
+int 
+txc_libc_clone_range(int dest_fd, off_t dest_offset, int src_fd, 
+                     off_t src_offset, size_t len)
+{
+	txc_libc_file_clone_range_t range;
+
+	range.src_fd = src_fd;
+	range.src_offset = src_offset;
+	range.src_length = len;
+	range.dest_offset = dest_offset;
+	return ioctl(dest_fd, FICLONERANGE, &range);
+}
+
+
+static inline
+ssize_t 
+txc_libc_copy_file_range(int fd_in, off_t *off_in, int fd_out, 
+                         off_t *off_out, size_t len, unsigned int flags)
+{
+#ifdef SYS_copy_file_range
+	return syscall(SYS_copy_file_range, fd_in, off_in, fd_out, off_out, 
+	               len, flags);
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+
+#ifndef MSG_WAITFORONE
+# define MSG_WAITFORONE 0x10000
+#endif
+
+/** Same layout as struct mmsghdr, which is only visible with _GNU_SOURCE. */
+typedef struct txc_libc_mmsghdr_s txc_libc_mmsghdr_t;
+
+struct txc_libc_mmsghdr_s {
+	struct msghdr msg_hdr;
+	unsigned int  msg_len;
+};
+
+
+/** 
+ * Receives up to vlen messages with a single system call. Falls back to 
+ * receiving a single message where recvmmsg is not available. 
+ */
+static inline
+int 
+txc_libc_recvmmsg(int s, txc_libc_mmsghdr_t *msgvec, unsigned int vlen, 
+                  int flags)
+{
+	ssize_t ret;
+
+#ifdef SYS_recvmmsg
+	if ((ret = syscall(SYS_recvmmsg, s, msgvec, vlen, flags, NULL)) >= 0 ||
+	    errno != ENOSYS) 
+	{
+		return (int) ret;
+	}
+#endif
+	if ((ret = recvmsg(s, &msgvec[0].msg_hdr, flags & ~MSG_WAITFORONE)) < 0) {
+		return -1;
+	}
+	msgvec[0].msg_len = (unsigned int) ret;
+	return 1;
+}
+
+
+/** 
+ * Sends up to vlen messages with a single system call. Falls back to 
+ * sending a single message where sendmmsg is not available. 
+ */
+static inline
+int 
+txc_libc_sendmmsg(int s, txc_libc_mmsghdr_t *msgvec, unsigned int vlen, 
+                  int flags)
+{
+	ssize_t ret;
+
+#ifdef SYS_sendmmsg
+	if ((ret = syscall(SYS_sendmmsg, s, msgvec, vlen, flags)) >= 0 ||
+	    errno != ENOSYS) 
+	{
+		return (int) ret;
+	}
+#endif
+	if ((ret = sendmsg(s, &msgvec[0].msg_hdr, flags)) < 0) {
+		return -1;
+	}
+	msgvec[0].msg_len = (unsigned int) ret;
+	return 1;
+}
+
+
 #endif
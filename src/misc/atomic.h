@@ -0,0 +1,49 @@
+/*
+    Copyright (C) 2008-2009 Computer Sciences Department, 
+    University of Wisconsin -- Madison
+
+    ----------------------------------------------------------------------
+
+    This file is part of the xCalls transactional API, originally 
+    developed at the University of Wisconsin -- Madison.
+
+    xCalls was originally developed primarily by Haris Volos and 
+    Neelam Goyal with contributions from Andres Jaan Tack.
+
+    ----------------------------------------------------------------------
+
+    xCalls is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as 
+    published by the Free Software Foundation, either version 3 of 
+    the License, or (at your option) any later version.
+
+    xCalls is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public 
+    License along with xCalls.  If not, see <http://www.gnu.org/licenses/>.
+
+### END HEADER ###
+*/
+
+/**
+ * \file atomic.h
+ *
+ * \brief Atomic operation MACROs
+ *
+ * The library should use these macros whenever it needs to update shared 
+ * words without holding a lock. This allows us to use other implementations
+ * of the primitives in the future if we find it useful.
+ */
+
+#ifndef _TXC_ATOMIC_H
+#define _TXC_ATOMIC_H
+
+#define TXC_ATOMIC_INC(ptr)           __sync_add_and_fetch((ptr), 1)
+#define TXC_ATOMIC_DEC(ptr)           __sync_sub_and_fetch((ptr), 1)
+#define TXC_ATOMIC_CAS(ptr, old, new) __sync_bool_compare_and_swap((ptr), (old), (new))
+#define TXC_MEMORY_BARRIER()          __sync_synchronize()
+
+#endif
@@ -68,12 +68,12 @@ txc_hash_table_create(txc_hash_table_t** hp, unsigned int table_size, txc_bool_t
 {
 	int i;
 
-	*hp = (txc_hash_table_t *) MALLOC(sizeof(txc_hash_table_t));
+	*hp = (txc_hash_table_t *) MALLOC(TXC_MALLOC_HASH, sizeof(txc_hash_table_t));
 	if (*hp == NULL) 
 	{
 		return TXC_R_NOMEMORY;
 	}
-	(*hp)->tbl = (txc_hash_table_bucket_list_t*) CALLOC (table_size,
+	(*hp)->tbl = (txc_hash_table_bucket_list_t*) CALLOC(TXC_MALLOC_HASH, table_size,
 	                                               sizeof(txc_hash_table_bucket_list_t));
 	if ((*hp)->tbl == NULL) 
 	{
@@ -182,7 +182,7 @@ txc_hash_table_add(txc_hash_table_t* h,
 		bucket = bucket_list->free;
 		bucket_list_remove(&bucket_list->free, bucket);
 	} else {
-		bucket = (txc_hash_table_bucket_t *) MALLOC(sizeof(txc_hash_table_bucket_t));
+		bucket = (txc_hash_table_bucket_t *) MALLOC(TXC_MALLOC_HASH, sizeof(txc_hash_table_bucket_t));
 	}	
 	bucket->key = key;
 	bucket->value = value;
@@ -0,0 +1,550 @@
+/*
+    Copyright (C) 2008-2009 Computer Sciences Department, 
+    University of Wisconsin -- Madison
+
+    ----------------------------------------------------------------------
+
+    This file is part of the xCalls transactional API, originally 
+    developed at the University of Wisconsin -- Madison.
+
+    xCalls was originally developed primarily by Haris Volos and 
+    Neelam Goyal with contributions from Andres Jaan Tack.
+
+    ----------------------------------------------------------------------
+
+    xCalls is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as 
+    published by the Free Software Foundation, either version 3 of 
+    the License, or (at your option) any later version.
+
+    xCalls is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public 
+    License along with xCalls.  If not, see <http://www.gnu.org/licenses/>.
+
+### END HEADER ###
+*/
+
+/**
+ * \file malloc.c
+ *
+ * \brief Memory allocator hooks and per subsystem memory accounting.
+ *
+ * Every block handed out carries a small header in front of it recording
+ * the requested size and the subsystem it is accounted to, so that FREE 
+ * needs nothing more than the pointer. Accounting is kept in per thread 
+ * counters that are summed when the report is printed, which keeps the 
+ * allocation path free of shared writes.
+ *
+ * The arena allocator serves small blocks out of per thread free lists, 
+ * one for each power of two size class, carved from chunks obtained from 
+ * libc. A thread caching too many free blocks of a class moves half of 
+ * them to a shared depot, from where other threads refill their lists.
+ * The state of a thread that exits, including its free lists and the 
+ * rest of its chunk, is handed to the next thread that starts.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <misc/result.h>
+#include <misc/malloc.h>
+#include <misc/debug.h>
+
+#define ARENA_MIN_SHIFT      4                          /* 16 bytes */
+#define ARENA_NUM_CLASSES    9                          /* up to 4 KB */
+#define ARENA_MAX_SIZE       (1 << (ARENA_MIN_SHIFT + ARENA_NUM_CLASSES - 1))
+#define ARENA_CHUNK_SIZE     (64*1024)
+#define ARENA_CACHE_MAX      256                        /* blocks per class */
+
+typedef enum {
+	txc_malloc_allocator_libc = 0,
+	txc_malloc_allocator_arena,
+	txc_malloc_allocator_user
+} txc_malloc_allocator_t;
+
+typedef union txc_malloc_header_u txc_malloc_header_t;
+typedef struct txc_malloc_thread_s txc_malloc_thread_t;
+typedef struct arena_block_s arena_block_t;
+
+/** 
+ * Header placed right before every block. Padded to 16 bytes to keep the
+ * alignment the underlying allocator guarantees.
+ */
+union txc_malloc_header_u {
+	struct {
+		unsigned int size;          /**< Bytes requested by the caller. */
+		unsigned int raw_len;       /**< Bytes obtained from the allocator. */
+		unsigned int offset;        /**< Distance from the start of the raw block. */
+		unsigned int subsystem;     /**< Subsystem the block is accounted to. */
+	} h;
+	char pad[16];
+};
+
+struct arena_block_s {
+	arena_block_t *next;
+};
+
+/** Per thread allocator state and accounting. */
+struct txc_malloc_thread_s {
+	unsigned long       alloc_num[txc_malloc_num_of_subsystems];
+	unsigned long       free_num[txc_malloc_num_of_subsystems];
+	unsigned long long  alloc_bytes[txc_malloc_num_of_subsystems];
+	unsigned long long  free_bytes[txc_malloc_num_of_subsystems];
+	arena_block_t       *arena_free[ARENA_NUM_CLASSES];
+	unsigned int        arena_free_num[ARENA_NUM_CLASSES];
+	char                *arena_chunk;
+	size_t              arena_chunk_left;
+	txc_malloc_thread_t *next;         /**< All thread states ever created. */
+	txc_malloc_thread_t *next_unused;  /**< States left behind by exited threads. */
+};
+
+static const char *malloc_subsystem_strings[] = {
+#define MALLOC_SUBSYSTEM_STRING(tag, name) #name,
+	FOREACH_MALLOC_SUBSYSTEM (MALLOC_SUBSYSTEM_STRING)
+#undef MALLOC_SUBSYSTEM_STRING
+};
+
+static txc_malloc_allocator_t malloc_allocator = txc_malloc_allocator_libc;
+static txc_allocator_t        malloc_user_allocator;
+static volatile int           malloc_in_use = 0;
+static struct timeval         malloc_init_time;
+
+static pthread_once_t         malloc_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t          malloc_key;
+static pthread_mutex_t        malloc_mutex = PTHREAD_MUTEX_INITIALIZER;
+static txc_malloc_thread_t    *malloc_thread_list = NULL;
+static txc_malloc_thread_t    *malloc_thread_unused = NULL;
+static arena_block_t          *arena_depot[ARENA_NUM_CLASSES];
+static unsigned int           arena_depot_num[ARENA_NUM_CLASSES];
+
+static __thread txc_malloc_thread_t *malloc_self = NULL;
+
+
+static
+void
+malloc_thread_exit(void *arg)
+{
+	txc_malloc_thread_t *self = (txc_malloc_thread_t *) arg;
+
+	/* 
+	 * Frees made by later destructors of this thread pick a state of their
+	 * own, which is released on the next destructor iteration.
+	 */
+	malloc_self = NULL;
+	pthread_mutex_lock(&malloc_mutex);
+	self->next_unused = malloc_thread_unused;
+	malloc_thread_unused = self;
+	pthread_mutex_unlock(&malloc_mutex);
+}
+
+
+static
+void
+malloc_key_create(void)
+{
+	pthread_key_create(&malloc_key, malloc_thread_exit);
+}
+
+
+/* 
+ * Returns the state of the calling thread. The state comes straight from
+ * libc since it outlives the thread and is never freed.
+ */
+static inline
+txc_malloc_thread_t *
+malloc_thread_self(void)
+{
+	txc_malloc_thread_t *self;
+
+	if ((self = malloc_self) != NULL) {
+		return self;
+	}
+	pthread_once(&malloc_key_once, malloc_key_create);
+	pthread_mutex_lock(&malloc_mutex);
+	if ((self = malloc_thread_unused) != NULL) {
+		malloc_thread_unused = self->next_unused;
+	} else if ((self = (txc_malloc_thread_t *) calloc(1, sizeof(txc_malloc_thread_t))) != NULL) {
+		self->next = malloc_thread_list;
+		malloc_thread_list = self;
+	}
+	pthread_mutex_unlock(&malloc_mutex);
+	if (self == NULL) {
+		return NULL;
+	}
+	pthread_setspecific(malloc_key, self);
+	malloc_self = self;
+	return self;
+}
+
+
+static inline
+int
+arena_class_of(size_t len)
+{
+	int cls = 0;
+
+	len = (len - 1) >> ARENA_MIN_SHIFT;
+	while (len) {
+		len >>= 1;
+		cls++;
+	}
+	return cls;
+}
+
+
+/* 
+ * Moves up to num blocks from the head of list *fromp to list *top and 
+ * returns the number of blocks moved.
+ */
+static inline
+unsigned int
+arena_move(arena_block_t **fromp, arena_block_t **top, unsigned int num)
+{
+	arena_block_t *block;
+	unsigned int  moved;
+
+	for (moved = 0; moved < num && (block = *fromp) != NULL; moved++) {
+		*fromp = block->next;
+		block->next = *top;
+		*top = block;
+	}
+	return moved;
+}
+
+
+static
+void *
+arena_alloc(txc_malloc_thread_t *self, size_t len)
+{
+	arena_block_t *block;
+	unsigned int  moved;
+	size_t        class_size;
+	int           cls;
+
+	if (len > ARENA_MAX_SIZE) {
+		return malloc(len);
+	}
+	if (self == NULL) {
+		return NULL;
+	}
+	cls = arena_class_of(len);
+	/* Peek at the depot without the lock; arena_move copes with a race. */
+	if (self->arena_free[cls] == NULL && arena_depot[cls] != NULL) {
+		pthread_mutex_lock(&malloc_mutex);
+		moved = arena_move(&arena_depot[cls], &self->arena_free[cls], 
+		                   ARENA_CACHE_MAX / 2);
+		arena_depot_num[cls] -= moved;
+		self->arena_free_num[cls] += moved;
+		pthread_mutex_unlock(&malloc_mutex);
+	}
+	if ((block = self->arena_free[cls]) != NULL) {
+		self->arena_free[cls] = block->next;
+		self->arena_free_num[cls]--;
+		return (void *) block;
+	}
+	class_size = (size_t) 1 << (cls + ARENA_MIN_SHIFT);
+	if (self->arena_chunk_left < class_size) {
+		/* The tail of the old chunk is given up. */
+		if ((self->arena_chunk = (char *) malloc(ARENA_CHUNK_SIZE)) == NULL) {
+			self->arena_chunk_left = 0;
+			return NULL;
+		}
+		self->arena_chunk_left = ARENA_CHUNK_SIZE;
+	}
+	block = (arena_block_t *) self->arena_chunk;
+	self->arena_chunk += class_size;
+	self->arena_chunk_left -= class_size;
+	return (void *) block;
+}
+
+
+static
+void
+arena_free(txc_malloc_thread_t *self, void *ptr, size_t len)
+{
+	arena_block_t *block = (arena_block_t *) ptr;
+	unsigned int  moved;
+	int           cls;
+
+	if (len > ARENA_MAX_SIZE) {
+		free(ptr);
+		return;
+	}
+	TXC_ASSERT(self != NULL);
+	cls = arena_class_of(len);
+	block->next = self->arena_free[cls];
+	self->arena_free[cls] = block;
+	if (++self->arena_free_num[cls] > ARENA_CACHE_MAX) {
+		pthread_mutex_lock(&malloc_mutex);
+		moved = arena_move(&self->arena_free[cls], &arena_depot[cls], 
+		                   ARENA_CACHE_MAX / 2);
+		arena_depot_num[cls] += moved;
+		self->arena_free_num[cls] -= moved;
+		pthread_mutex_unlock(&malloc_mutex);
+	}
+}
+
+
+static inline
+void *
+raw_alloc(txc_malloc_thread_t *self, size_t len)
+{
+	switch (malloc_allocator) {
+		case txc_malloc_allocator_arena:
+			return arena_alloc(self, len);
+		case txc_malloc_allocator_user:
+			return malloc_user_allocator.malloc(len);
+		default:
+			return malloc(len);
+	}
+}
+
+
+static inline
+void
+raw_free(txc_malloc_thread_t *self, void *ptr, size_t len)
+{
+	switch (malloc_allocator) {
+		case txc_malloc_allocator_arena:
+			arena_free(self, ptr, len);
+			break;
+		case txc_malloc_allocator_user:
+			malloc_user_allocator.free(ptr);
+			break;
+		default:
+			free(ptr);
+	}
+}
+
+
+/*
+ * Allocates size bytes aligned to alignment (a power of two no smaller 
+ * than the header) and accounts them to subsystem.
+ */
+static inline
+void *
+malloc_aligned(txc_malloc_subsystem_t subsystem, size_t size, size_t alignment)
+{
+	txc_malloc_thread_t *self;
+	txc_malloc_header_t *header;
+	char                *raw;
+	char                *ptr;
+	size_t              raw_len;
+
+	if (size > 0xFFFFFFFFUL - sizeof(txc_malloc_header_t) - alignment) {
+		return NULL;
+	}
+	if (!malloc_in_use) {
+		malloc_in_use = 1;
+	}
+	self = malloc_thread_self();
+	raw_len = size + sizeof(txc_malloc_header_t);
+	if (alignment > sizeof(txc_malloc_header_t)) {
+		raw_len += alignment;
+	}
+	if ((raw = (char *) raw_alloc(self, raw_len)) == NULL) {
+		return NULL;
+	}
+	ptr = raw + sizeof(txc_malloc_header_t);
+	if (alignment > sizeof(txc_malloc_header_t)) {
+		ptr = (char *) (((unsigned long) ptr + alignment - 1) & ~(alignment - 1));
+	}
+	header = ((txc_malloc_header_t *) ptr) - 1;
+	header->h.size = (unsigned int) size;
+	header->h.raw_len = (unsigned int) raw_len;
+	header->h.offset = (unsigned int) (ptr - raw);
+	header->h.subsystem = subsystem;
+	if (self) {
+		self->alloc_num[subsystem]++;
+		self->alloc_bytes[subsystem] += size;
+	}
+	return (void *) ptr;
+}
+
+
+void *
+txc_malloc(txc_malloc_subsystem_t subsystem, size_t size)
+{
+	return malloc_aligned(subsystem, size, 0);
+}
+
+
+void *
+txc_calloc(txc_malloc_subsystem_t subsystem, size_t num, size_t size)
+{
+	void *ptr;
+
+	if (size != 0 && num > ((size_t) -1) / size) {
+		return NULL;
+	}
+	if ((ptr = malloc_aligned(subsystem, num * size, 0)) != NULL) {
+		memset(ptr, 0, num * size);
+	}
+	return ptr;
+}
+
+
+int
+txc_memalign(txc_malloc_subsystem_t subsystem, void **memptr, 
+             size_t alignment, size_t size)
+{
+	if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+		return EINVAL;
+	}
+	if ((*memptr = malloc_aligned(subsystem, size, alignment)) == NULL) {
+		return ENOMEM;
+	}
+	return 0;
+}
+
+
+void
+txc_free(void *ptr)
+{
+	txc_malloc_thread_t *self;
+	txc_malloc_header_t *header;
+
+	if (ptr == NULL) {
+		return;
+	}
+	header = ((txc_malloc_header_t *) ptr) - 1;
+	self = malloc_thread_self();
+	if (self) {
+		self->free_num[header->h.subsystem]++;
+		self->free_bytes[header->h.subsystem] += header->h.size;
+	}
+	raw_free(self, (char *) ptr - header->h.offset, header->h.raw_len);
+}
+
+
+void *
+txc_realloc(txc_malloc_subsystem_t subsystem, void *ptr, size_t size)
+{
+	txc_malloc_header_t *header;
+	void                *new_ptr;
+
+	if (ptr == NULL) {
+		return txc_malloc(subsystem, size);
+	}
+	header = ((txc_malloc_header_t *) ptr) - 1;
+	if ((new_ptr = txc_malloc(subsystem, size)) == NULL) {
+		return NULL;
+	}
+	memcpy(new_ptr, ptr, size < header->h.size ? size : header->h.size);
+	txc_free(ptr);
+	return new_ptr;
+}
+
+
+/**
+ * \brief Replaces the allocator with functions supplied by the 
+ * application. 
+ *
+ * Must be called before any memory is allocated, that is before the 
+ * library is initialized. Passing NULL restores the libc allocator.
+ *
+ * \param[in] allocator The allocator functions.
+ * \return TXC_R_SUCCESS or TXC_R_ALREADYRUNNING if memory has already 
+ *         been allocated through the previous allocator.
+ */
+txc_result_t
+txc_malloc_set_allocator(txc_allocator_t *allocator)
+{
+	if (malloc_in_use) {
+		return TXC_R_ALREADYRUNNING;
+	}
+	if (allocator == NULL) {
+		malloc_allocator = txc_malloc_allocator_libc;
+		return TXC_R_SUCCESS;
+	}
+	if (allocator->malloc == NULL || allocator->free == NULL) {
+		return TXC_R_UNEXPECTED;
+	}
+	malloc_user_allocator = *allocator;
+	malloc_allocator = txc_malloc_allocator_user;
+	return TXC_R_SUCCESS;
+}
+
+
+/**
+ * \brief Selects the allocator named by the runtime configuration.
+ *
+ * An allocator installed through txc_malloc_set_allocator takes 
+ * precedence. The allocator cannot change once memory has been 
+ * allocated; selecting the allocator already in use again succeeds.
+ *
+ * \param[in] allocator_name "libc" or "arena".
+ * \return Code indicating success or failure (reason) of the operation.
+ */
+txc_result_t
+txc_malloc_init(const char *allocator_name)
+{
+	txc_malloc_allocator_t allocator;
+
+	gettimeofday(&malloc_init_time, NULL);
+	if (malloc_allocator == txc_malloc_allocator_user) {
+		return TXC_R_SUCCESS;
+	}
+	if (allocator_name && strcmp(allocator_name, "arena") == 0) {
+		allocator = txc_malloc_allocator_arena;
+	} else {
+		allocator = txc_malloc_allocator_libc;
+	}
+	if (malloc_in_use) {
+		return (allocator == malloc_allocator) ? TXC_R_SUCCESS 
+		                                       : TXC_R_ALREADYRUNNING;
+	}
+	malloc_allocator = allocator;
+	return TXC_R_SUCCESS;
+}
+
+
+/**
+ * \brief Prints live bytes and allocation counts of each subsystem.
+ */
+void
+txc_malloc_print(FILE *fout)
+{
+	txc_malloc_thread_t *self;
+	struct timeval      now;
+	double              elapsed;
+	unsigned long       alloc_num;
+	unsigned long       free_num;
+	unsigned long long  alloc_bytes;
+	unsigned long long  free_bytes;
+	int                 i;
+
+	gettimeofday(&now, NULL);
+	elapsed = (double) (now.tv_sec - malloc_init_time.tv_sec) + 
+	          (double) (now.tv_usec - malloc_init_time.tv_usec) / 1000000.0;
+	fprintf(fout, "Memory (%s allocator)\n", 
+	        malloc_allocator == txc_malloc_allocator_arena ? "arena" :
+	        malloc_allocator == txc_malloc_allocator_user ? "user" : "libc");
+	fprintf(fout, "  %-25s:%15s%13s%13s%13s\n", 
+	        "", "Live bytes", "Allocs", "Frees", "Allocs/sec");
+	pthread_mutex_lock(&malloc_mutex);
+	for (i=0; i<txc_malloc_num_of_subsystems; i++) {
+		alloc_num = free_num = 0;
+		alloc_bytes = free_bytes = 0;
+		for (self = malloc_thread_list; self != NULL; self = self->next) {
+			alloc_num += self->alloc_num[i];
+			free_num += self->free_num[i];
+			alloc_bytes += self->alloc_bytes[i];
+			free_bytes += self->free_bytes[i];
+		}
+		fprintf(fout, "  %-25s:%15lld%13lu%13lu%13.0f\n", 
+		        malloc_subsystem_strings[i],
+		        (long long) (alloc_bytes - free_bytes),
+		        alloc_num,
+		        free_num,
+		        elapsed > 0 ? (double) alloc_num / elapsed : 0.0);
+	}
+	pthread_mutex_unlock(&malloc_mutex);
+}
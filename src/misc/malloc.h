@@ -34,18 +34,64 @@
  * \brief Memory allocation MACROs
  *
  * The library should use these macros whenever it needs to call the 
- * memory allocator. This allows us to use other more scalable allocators
- * in the future if we find it useful.
+ * memory allocator. Every allocation is tagged with the subsystem that 
+ * makes it so that live bytes and allocation counts can be reported per
+ * subsystem. The allocator behind the macros is selected at runtime: 
+ * libc, the built-in per-thread arena allocator or a set of functions 
+ * supplied by the application through _TXC_set_allocator.
+ *
+ * Memory obtained through these macros must be released with FREE.
  */
 
 #ifndef _TXC_MALLOC_H
 #define _TXC_MALLOC_H
 
 #include <stdlib.h>
+#include <stdio.h>
+#include <misc/result.h>
+
+/** Subsystems memory is accounted to. */
+#define FOREACH_MALLOC_SUBSYSTEM(ACTION)                                     \
+  ACTION(BUFFER, buffer)                                                     \
+  ACTION(EPOCH, epoch)                                                       \
+  ACTION(HASH, hash)                                                         \
+  ACTION(JOURNAL, journal)                                                   \
+  ACTION(KOA, koa)                                                           \
+  ACTION(POOL, pool)                                                         \
+  ACTION(SENTINEL, sentinel)                                                 \
+  ACTION(STATS, stats)                                                       \
+  ACTION(TX, tx)                                                             \
+  ACTION(XCALL, xcall)
+
+typedef enum {
+#define MALLOC_SUBSYSTEM_ENTRY(tag, name) TXC_MALLOC_##tag,
+	FOREACH_MALLOC_SUBSYSTEM (MALLOC_SUBSYSTEM_ENTRY)
+#undef MALLOC_SUBSYSTEM_ENTRY
+	txc_malloc_num_of_subsystems
+} txc_malloc_subsystem_t;
+
+/** Allocator functions supplied by the application. */
+typedef struct txc_allocator_s txc_allocator_t;
+
+struct txc_allocator_s {
+	void *(*malloc)(size_t size);
+	void (*free)(void *ptr);
+};
+
+void *txc_malloc(txc_malloc_subsystem_t subsystem, size_t size);
+void *txc_calloc(txc_malloc_subsystem_t subsystem, size_t num, size_t size);
+void *txc_realloc(txc_malloc_subsystem_t subsystem, void *ptr, size_t size);
+int txc_memalign(txc_malloc_subsystem_t subsystem, void **memptr, size_t alignment, size_t size);
+void txc_free(void *ptr);
+txc_result_t txc_malloc_set_allocator(txc_allocator_t *allocator);
+txc_result_t txc_malloc_init(const char *allocator_name);
+void txc_malloc_print(FILE *fout);
 
-#define MALLOC  malloc
-#define CALLOC  calloc
-#define REALLOC realloc 
-#define FREE    free
+#define MALLOC(subsystem, size)             txc_malloc(subsystem, size)
+#define CALLOC(subsystem, num, size)        txc_calloc(subsystem, num, size)
+#define REALLOC(subsystem, ptr, size)       txc_realloc(subsystem, ptr, size) 
+#define FREE(ptr)                           txc_free(ptr)
+#define MEMALIGN(subsystem, memptr, alignment, size)                         \
+  txc_memalign(subsystem, memptr, alignment, size)
 
 #endif /* _TXC_MALLOC_H */
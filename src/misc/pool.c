@@ -37,9 +37,11 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <pthread.h>
 #include <unistd.h>
 #include <stddef.h>
+#include <string.h>
 #include <misc/result.h>
 #include <misc/malloc.h>
 #include <misc/pool.h>
@@ -47,72 +49,274 @@
 #include <misc/mutex.h>
 #include <core/config.h>
 
+typedef struct txc_pool_magazine_s txc_pool_magazine_t;
+typedef struct txc_pool_cache_s txc_pool_cache_t;
+
 struct txc_pool_object_s {
-	void   *buf;
-	char   status;
+	void                     *buf;
+	char                     status;
 	struct txc_pool_object_s *next;
-	struct txc_pool_object_s *prev;
+	txc_pool_t               *pool;
 };
 
+
+/** 
+ * A magazine is a bounded LIFO stack of free objects owned by a single 
+ * thread. 
+ */
+struct txc_pool_magazine_s {
+	unsigned int               rounds;
+	struct txc_pool_magazine_s *next;
+	txc_pool_object_t          *objects[];
+};
+
+
+/** 
+ * Per thread cache of a pool. The thread allocates from and frees to its
+ * loaded magazine and falls back to the previous one before it goes to
+ * the depot.
+ */
+struct txc_pool_cache_s {
+	txc_pool_t                 *pool;
+	txc_pool_magazine_t        *loaded;
+	txc_pool_magazine_t        *previous;
+	struct txc_pool_cache_s    *next;
+	struct txc_pool_cache_s    *prev;
+};
+
+
 struct txc_pool_s {
 	txc_mutex_t                   mutex;
 	void                          *full_buf;			
+	size_t                        full_buf_map_len;
 	txc_pool_object_t             *obj_list;
 	txc_pool_object_t             *obj_free_head;
-	txc_pool_object_t             *obj_allocated_head;
 	unsigned int                  obj_free_num;
-	unsigned int                  obj_allocated_num;
 	unsigned int                  obj_size;
 	unsigned int                  obj_num;
 	txc_pool_object_constructor_t obj_constructor;
+	int                           iter_status;
+	unsigned int                  magazine_size;
+	pthread_key_t                 cache_key;
+	txc_pool_cache_t              *cache_list;
+	txc_pool_magazine_t           *depot_full;
+	txc_pool_magazine_t           *depot_empty;
+	unsigned int                  depot_full_num;
+	unsigned int                  depot_empty_num;
 };
 
 
+static void pool_cache_destroy(void *arg);
+
+
+/*
+ * Objects cached in magazines are invisible to the other threads. To 
+ * make sure an allocation never fails while the pool still has plenty of
+ * objects, magazines are sized so that all threads together cannot hold 
+ * more than half of the pool, each thread caching at most two magazines.
+ */
+static inline
+unsigned int 
+pool_magazine_size(unsigned int obj_num)
+{
+	unsigned int size;
+
+	size = txc_runtime_settings.pool_magazine_size;
+	if (size > obj_num / (4 * TXC_MAX_NUM_THREADS)) {
+		size = obj_num / (4 * TXC_MAX_NUM_THREADS);
+	}
+	return size;
+}
+
+
+/*
+ * Allocates the slab backing the objects of a pool. Returns the length 
+ * of the mapping through map_lenp, or 0 if the slab comes from the heap.
+ *
+ * Huge pages are only worth it for slabs spanning at least one huge page.
+ * We first ask for reserved huge pages and fall back to a regular mapping
+ * that the kernel may back with transparent huge pages.
+ *
+ * Other slabs of at least a page are mapped too: the pages of an 
+ * anonymous mapping are zero and committed only when first touched, so 
+ * a large pool costs memory only for the objects it hands out. Only 
+ * smaller slabs come from the heap and are zeroed explicitly.
+ */
+static
+void *
+pool_slab_alloc(size_t length, unsigned int align, int flags, size_t *map_lenp)
+{
+	void   *addr;
+	size_t map_len;
+	size_t page_size;
+
+	*map_lenp = 0;
+	if ((flags & TXC_POOL_HUGEPAGES) && 
+	    txc_runtime_settings.pool_hugepages == TXC_BOOL_TRUE &&
+	    length >= TXC_HUGEPAGE_SIZE) 
+	{
+		map_len = (length + TXC_HUGEPAGE_SIZE - 1) & ~((size_t) TXC_HUGEPAGE_SIZE - 1);
+#ifdef MAP_HUGETLB
+		addr = mmap(NULL, map_len, PROT_READ | PROT_WRITE, 
+		            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (addr != MAP_FAILED) {
+			*map_lenp = map_len;
+			return addr;
+		}
+#endif
+		addr = mmap(NULL, map_len, PROT_READ | PROT_WRITE, 
+		            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (addr != MAP_FAILED) {
+#ifdef MADV_HUGEPAGE
+			madvise(addr, map_len, MADV_HUGEPAGE);
+#endif
+			*map_lenp = map_len;
+			return addr;
+		}
+	}
+	page_size = (size_t) sysconf(_SC_PAGESIZE);
+	if (length >= page_size && align <= page_size) {
+		map_len = (length + page_size - 1) & ~(page_size - 1);
+		addr = mmap(NULL, map_len, PROT_READ | PROT_WRITE, 
+		            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (addr != MAP_FAILED) {
+			*map_lenp = map_len;
+			return addr;
+		}
+	}
+	if (MEMALIGN(TXC_MALLOC_POOL, &addr, align, length) != 0) {  
+		return NULL;
+	}
+	memset(addr, 0, length);
+	return addr;
+}
+
+
+static
+void
+pool_slab_free(void *buf, size_t map_len)
+{
+	if (map_len) {
+		munmap(buf, map_len);
+	} else {
+		FREE(buf);
+	}
+}
+
+
+/**
+ * \brief Creates a pool of objects.
+ *
+ * Objects are packed at obj_size stride in a slab aligned to a cache 
+ * line. See txc_pool_create_aligned to control padding and backing.
+ *
+ * \param[out] poolp The created pool.
+ * \param[in] obj_size Size of an object.
+ * \param[in] obj_num Number of objects.
+ * \param[in] obj_constructor Called once for each object, may be NULL.
+ * \return Code indicating success or failure (reason) of the operation.
+ */
 txc_result_t
 txc_pool_create(txc_pool_t **poolp, 
                 unsigned int obj_size, 
                 unsigned int obj_num, 
                 txc_pool_object_constructor_t obj_constructor) 
+{
+	return txc_pool_create_aligned(poolp, obj_size, obj_num, 0, 0, 
+	                               obj_constructor);
+}
+
+
+/**
+ * \brief Creates a pool of objects with the given alignment and backing.
+ *
+ * Each object starts at a multiple of obj_align, which pads objects 
+ * accessed by different threads to their own cache lines and prevents 
+ * false sharing between them.
+ *
+ * \param[out] poolp The created pool.
+ * \param[in] obj_size Size of an object.
+ * \param[in] obj_num Number of objects.
+ * \param[in] obj_align Alignment of each object, a power of two; 0 packs 
+ *            objects at obj_size stride.
+ * \param[in] flags TXC_POOL_HUGEPAGES to back the slab with huge pages 
+ *            when the pool_hugepages runtime option is enabled.
+ * \param[in] obj_constructor Called once for each object, may be NULL.
+ * \return Code indicating success or failure (reason) of the operation.
+ */
+txc_result_t
+txc_pool_create_aligned(txc_pool_t **poolp, 
+                        unsigned int obj_size, 
+                        unsigned int obj_num, 
+                        unsigned int obj_align,
+                        int flags,
+                        txc_pool_object_constructor_t obj_constructor) 
 {
 	txc_pool_object_t *object_list;
 	char *buf; 
 	int i;
 
-	*poolp = (txc_pool_t *) MALLOC(sizeof(txc_pool_t));
+	TXC_ASSERT((obj_align & (obj_align - 1)) == 0);
+	if (obj_align > 1) {
+		obj_size = (obj_size + obj_align - 1) & ~(obj_align - 1);
+	}
+	/* 
+	 * Align the slab to a cache line so that objects whose size is a 
+	 * multiple of the cache line size don't straddle lines. 
+	 */
+	if (obj_align < TXC_CACHELINE_SIZE) {
+		obj_align = TXC_CACHELINE_SIZE;
+	}
+
+	*poolp = (txc_pool_t *) MALLOC(TXC_MALLOC_POOL, sizeof(txc_pool_t));
 	if (*poolp == NULL) {
 		return TXC_R_NOMEMORY;
 	}
 	(*poolp)->obj_size = obj_size;
 	(*poolp)->obj_num = obj_num;
-	object_list = (txc_pool_object_t *) CALLOC(obj_num, 
+	object_list = (txc_pool_object_t *) CALLOC(TXC_MALLOC_POOL, obj_num, 
 	                                           sizeof(txc_pool_object_t));
 	if (object_list == NULL) {
 		FREE(*poolp);
 		return TXC_R_NOMEMORY;
 	}
 	(*poolp)->obj_list = object_list;
-	if ((buf = CALLOC(obj_num, obj_size)) == NULL) {  
+	buf = (char *) pool_slab_alloc((size_t) obj_num * obj_size, obj_align, 
+	                               flags, &((*poolp)->full_buf_map_len));
+	if (buf == NULL) {  
 		FREE(object_list);
 		FREE(*poolp);
 		return TXC_R_NOMEMORY;
 	}
 	(*poolp)->full_buf = buf; 
 	for (i=0;i<obj_num;i++) {
-		object_list[i].buf = &buf[i*obj_size];
-		object_list[i].next = &object_list[(i+1)%obj_num];
-		object_list[i].prev = &object_list[(i-1)%obj_num];
+		object_list[i].buf = &buf[(size_t) i*obj_size];
+		object_list[i].next = &object_list[i+1];
+		object_list[i].pool = *poolp;
 		object_list[i].status = TXC_POOL_OBJECT_FREE;
 		if (obj_constructor != NULL) {
 			obj_constructor(object_list[i].buf);
 		}
 	}
-	object_list[0].prev = object_list[obj_num-1].next = NULL;
+	object_list[obj_num-1].next = NULL;
 	(*poolp)->obj_free_num = obj_num;
 	(*poolp)->obj_free_head = &object_list[0];	
-	(*poolp)->obj_allocated_num = 0;
-	(*poolp)->obj_allocated_head = NULL;	
+	(*poolp)->obj_constructor = obj_constructor;
+	(*poolp)->iter_status = 0;
+	(*poolp)->magazine_size = pool_magazine_size(obj_num);
+	(*poolp)->cache_list = NULL;
+	(*poolp)->depot_full = (*poolp)->depot_empty = NULL;
+	(*poolp)->depot_full_num = (*poolp)->depot_empty_num = 0;
+	if ((*poolp)->magazine_size > 0 &&
+	    pthread_key_create(&((*poolp)->cache_key), pool_cache_destroy) != 0) 
+	{
+		(*poolp)->magazine_size = 0;
+	}
 	if (TXC_MUTEX_INIT(&((*poolp)->mutex), NULL) !=0) {
-		FREE(buf);
+		if ((*poolp)->magazine_size > 0) {
+			pthread_key_delete((*poolp)->cache_key);
+		}
+		pool_slab_free(buf, (*poolp)->full_buf_map_len);
 		FREE(object_list);	
 		FREE(*poolp);
 		return TXC_R_NOTINITLOCK;
@@ -121,11 +325,42 @@ txc_pool_create(txc_pool_t **poolp,
 }
 
 
+static inline
+void
+magazine_list_free(txc_pool_magazine_t *magazine)
+{
+	txc_pool_magazine_t *next;
+
+	for (; magazine != NULL; magazine = next) {
+		next = magazine->next;
+		FREE(magazine);
+	}
+}
+
+
 txc_result_t 
 txc_pool_destroy(txc_pool_t **poolp) 
 {
+	txc_pool_cache_t *cache;
+	txc_pool_cache_t *cache_next;
+
 	TXC_ASSERT(*poolp != NULL);
-	FREE((*poolp)->full_buf);
+	if ((*poolp)->magazine_size > 0) {
+		/* 
+		 * Deleting the key first makes sure no thread exit destructor
+		 * touches the caches freed below.
+		 */
+		pthread_key_delete((*poolp)->cache_key);
+		for (cache = (*poolp)->cache_list; cache != NULL; cache = cache_next) {
+			cache_next = cache->next;
+			FREE(cache->loaded);
+			FREE(cache->previous);
+			FREE(cache);
+		}
+		magazine_list_free((*poolp)->depot_full);
+		magazine_list_free((*poolp)->depot_empty);
+	}
+	pool_slab_free((*poolp)->full_buf, (*poolp)->full_buf_map_len);
 	FREE((*poolp)->obj_list);	
 	FREE(*poolp);
 	*poolp = NULL;
@@ -133,33 +368,262 @@ txc_pool_destroy(txc_pool_t **poolp)
 }
 
 
+static inline
+txc_pool_object_t *
+pool_object_of_buf(txc_pool_t *pool, void *buf)
+{
+	unsigned int index;
+
+	index = (unsigned int) (((char*) buf - (char*) pool->full_buf) / pool->obj_size);
+	return &pool->obj_list[index];
+}
+
+
+/* 
+ * The central free list is protected by the pool mutex. Callers of
+ * pool_central_get and pool_central_put must hold it.
+ */
+static inline
+txc_pool_object_t *
+pool_central_get(txc_pool_t *pool)
+{
+	txc_pool_object_t *pool_object;
+
+	if ((pool_object = pool->obj_free_head) != NULL) {
+		pool->obj_free_head = pool_object->next;
+		pool->obj_free_num--;
+		pool_object->next = NULL;
+	}
+	return pool_object;
+}
+
+
+static inline
+void
+pool_central_put(txc_pool_t *pool, txc_pool_object_t *pool_object)
+{
+	pool_object->next = pool->obj_free_head;
+	pool->obj_free_head = pool_object;
+	pool->obj_free_num++;
+}
+
+
+static inline
+txc_pool_magazine_t *
+pool_magazine_create(txc_pool_t *pool)
+{
+	txc_pool_magazine_t *magazine;
+
+	magazine = (txc_pool_magazine_t *) MALLOC(TXC_MALLOC_POOL, sizeof(txc_pool_magazine_t) + 
+	                                          pool->magazine_size * 
+	                                          sizeof(txc_pool_object_t *));
+	if (magazine) {
+		magazine->rounds = 0;
+		magazine->next = NULL;
+	}
+	return magazine;
+}
+
+
+/* 
+ * Returns the cache of the calling thread, creating it on first use. 
+ * Returns NULL if the cache cannot be created, in which case the caller
+ * goes to the central free list.
+ */
+static inline
+txc_pool_cache_t *
+pool_cache_get(txc_pool_t *pool)
+{
+	txc_pool_cache_t *cache;
+
+	if ((cache = (txc_pool_cache_t *) pthread_getspecific(pool->cache_key)) != NULL) {
+		return cache;
+	}
+	if ((cache = (txc_pool_cache_t *) MALLOC(TXC_MALLOC_POOL, sizeof(txc_pool_cache_t))) == NULL) {
+		return NULL;
+	}
+	cache->pool = pool;
+	cache->loaded = pool_magazine_create(pool);
+	cache->previous = pool_magazine_create(pool);
+	if (cache->loaded == NULL || cache->previous == NULL ||
+	    pthread_setspecific(pool->cache_key, cache) != 0) 
+	{
+		FREE(cache->loaded);
+		FREE(cache->previous);
+		FREE(cache);
+		return NULL;
+	}
+	TXC_MUTEX_LOCK(&pool->mutex);
+	cache->prev = NULL;
+	cache->next = pool->cache_list;
+	if (pool->cache_list) {
+		pool->cache_list->prev = cache;
+	}
+	pool->cache_list = cache;
+	TXC_MUTEX_UNLOCK(&pool->mutex);
+	return cache;
+}
+
+
+/* 
+ * Thread exit destructor. Returns the cached objects to the central free
+ * list and the magazines to the depot.
+ */
+static 
+void
+pool_cache_destroy(void *arg)
+{
+	txc_pool_cache_t    *cache = (txc_pool_cache_t *) arg;
+	txc_pool_t          *pool = cache->pool;
+	txc_pool_magazine_t *magazine;
+	int                 i;
+
+	TXC_MUTEX_LOCK(&pool->mutex);
+	for (i=0; i<2; i++) {
+		magazine = (i == 0) ? cache->loaded : cache->previous;
+		while (magazine->rounds > 0) {
+			pool_central_put(pool, magazine->objects[--magazine->rounds]);
+		}
+		magazine->next = pool->depot_empty;
+		pool->depot_empty = magazine;
+		pool->depot_empty_num++;
+	}
+	if (cache->prev) {
+		cache->prev->next = cache->next;
+	} else {
+		pool->cache_list = cache->next;
+	}
+	if (cache->next) {
+		cache->next->prev = cache->prev;
+	}
+	TXC_MUTEX_UNLOCK(&pool->mutex);
+	FREE(cache);
+}
+
+
+/*
+ * Refills the loaded magazine of an empty cache. Prefers a full magazine
+ * from the depot and otherwise takes objects off the central free list.
+ */
+static inline
+void
+pool_cache_refill(txc_pool_t *pool, txc_pool_cache_t *cache)
+{
+	txc_pool_magazine_t *magazine;
+	txc_pool_object_t   *pool_object;
+
+	TXC_MUTEX_LOCK(&pool->mutex);
+	if ((magazine = pool->depot_full) != NULL) {
+		pool->depot_full = magazine->next;
+		pool->depot_full_num--;
+		cache->previous->next = pool->depot_empty;
+		pool->depot_empty = cache->previous;
+		pool->depot_empty_num++;
+		cache->previous = cache->loaded;
+		cache->loaded = magazine;
+	} else {
+		magazine = cache->loaded;
+		while (magazine->rounds < pool->magazine_size && 
+		       (pool_object = pool_central_get(pool)) != NULL)
+		{
+			magazine->objects[magazine->rounds++] = pool_object;
+		}
+	}
+	TXC_MUTEX_UNLOCK(&pool->mutex);
+}
+
+
+/*
+ * Makes room in a full cache. The previous magazine, which is full too,
+ * goes to the depot and an empty one takes the place of the loaded 
+ * magazine. Returns 0 if no empty magazine could be found.
+ */
+static inline
+int
+pool_cache_drain(txc_pool_t *pool, txc_pool_cache_t *cache)
+{
+	txc_pool_magazine_t *magazine;
+
+	TXC_MUTEX_LOCK(&pool->mutex);
+	if ((magazine = pool->depot_empty) != NULL) {
+		pool->depot_empty = magazine->next;
+		pool->depot_empty_num--;
+	}
+	TXC_MUTEX_UNLOCK(&pool->mutex);
+	if (magazine == NULL && (magazine = pool_magazine_create(pool)) == NULL) {
+		return 0;
+	}
+	TXC_MUTEX_LOCK(&pool->mutex);
+	cache->previous->next = pool->depot_full;
+	pool->depot_full = cache->previous;
+	pool->depot_full_num++;
+	TXC_MUTEX_UNLOCK(&pool->mutex);
+	cache->previous = cache->loaded;
+	cache->loaded = magazine;
+	return 1;
+}
+
+
+static inline
+void
+pool_cache_swap(txc_pool_cache_t *cache)
+{
+	txc_pool_magazine_t *magazine;
+
+	magazine = cache->loaded;
+	cache->loaded = cache->previous;
+	cache->previous = magazine;
+}
+
+
+/**
+ * \brief Allocates an object from the pool.
+ *
+ * Unless the caller already holds the pool lock, objects come from the 
+ * per thread magazines and the pool lock is taken only when a magazine 
+ * has to be exchanged with the depot or refilled.
+ *
+ * \param[in] pool The pool.
+ * \param[out] objp The allocated object.
+ * \param[in] lock Set to 0 if the caller holds the pool lock.
+ * \return TXC_R_SUCCESS or TXC_R_NOMEMORY if the pool is exhausted.
+ */
 txc_result_t
 txc_pool_object_alloc(txc_pool_t *pool, void **objp, int lock) 
 {
-	txc_result_t result;
+	txc_result_t      result;
 	txc_pool_object_t *pool_object;
+	txc_pool_cache_t  *cache;
+
+	if (lock && pool->magazine_size > 0 && 
+	    (cache = pool_cache_get(pool)) != NULL) 
+	{
+		if (cache->loaded->rounds == 0) {
+			if (cache->previous->rounds > 0) {
+				pool_cache_swap(cache);
+			} else {
+				pool_cache_refill(pool, cache);
+			}
+		}
+		if (cache->loaded->rounds == 0) {
+			*objp = NULL;
+			return TXC_R_NOMEMORY;
+		}
+		pool_object = cache->loaded->objects[--cache->loaded->rounds];
+		TXC_ASSERT(pool_object->status == TXC_POOL_OBJECT_FREE);
+		pool_object->status = TXC_POOL_OBJECT_ALLOCATED;
+		*objp = pool_object->buf;
+		return TXC_R_SUCCESS;
+	}
 
 	if (lock) { 
 		TXC_MUTEX_LOCK(&pool->mutex);
 	}	
-	if (pool->obj_free_num == 0) {
+	if ((pool_object = pool_central_get(pool)) == NULL) {
 		*objp = NULL;
 		result = TXC_R_NOMEMORY;
 		goto unlock;
 	}
-	pool_object = pool->obj_free_head;
-	pool->obj_free_head = pool_object->next;
-	if (pool->obj_free_head) {
-		pool->obj_free_head->prev = NULL;
-	}
-	pool_object->prev = NULL;
-	pool_object->next = pool->obj_allocated_head;
-	if (pool->obj_allocated_head) {
-		pool->obj_allocated_head->prev = pool_object;
-	}
-	pool->obj_allocated_head = pool_object; 
-	pool->obj_allocated_num++;
-	pool->obj_free_num--;
 	*objp = pool_object->buf;
 	pool_object->status = TXC_POOL_OBJECT_ALLOCATED;
 	result = TXC_R_SUCCESS;
@@ -171,65 +635,97 @@ unlock:
 }
 
 
+/**
+ * \brief Returns an object back to the pool.
+ *
+ * \param[in] pool The pool.
+ * \param[in,out] objp The object to free. It is set to NULL.
+ * \param[in] lock Set to 0 if the caller holds the pool lock.
+ */
 void
 txc_pool_object_free(txc_pool_t *pool, void **objp, int lock) 
 {
 	txc_pool_object_t *pool_object;
-	unsigned int index;
+	txc_pool_cache_t  *cache;
 
 	TXC_ASSERT(pool);
 	TXC_ASSERT(*objp);
+	pool_object = pool_object_of_buf(pool, *objp);
+	TXC_ASSERT(pool_object->status == TXC_POOL_OBJECT_ALLOCATED);
+	pool_object->status = TXC_POOL_OBJECT_FREE;
+	*objp = NULL;
+
+	if (lock && pool->magazine_size > 0 && 
+	    (cache = pool_cache_get(pool)) != NULL) 
+	{
+		if (cache->loaded->rounds == pool->magazine_size) {
+			if (cache->previous->rounds == 0) {
+				pool_cache_swap(cache);
+			} else if (!pool_cache_drain(pool, cache)) {
+				goto central;
+			}
+		}
+		cache->loaded->objects[cache->loaded->rounds++] = pool_object;
+		return;
+	}
+
+central:
 	if (lock) {
 		TXC_MUTEX_LOCK(&(pool->mutex));
 	}	
-	index = ((unsigned int) ( (char*) *objp - (char*) pool->full_buf)) / pool->obj_size;
-	pool_object = &pool->obj_list[index];
-	TXC_ASSERT(pool_object->status == TXC_POOL_OBJECT_ALLOCATED);
-	if (pool_object->prev) {
-		pool_object->prev->next = pool_object->next;
-	} else { 
-		pool->obj_allocated_head = pool_object->next;
-	}
-	if (pool_object->next) {
-		pool_object->next->prev = pool_object->prev;
-	}
-	pool_object->next = pool->obj_free_head;
-	pool_object->prev = NULL;
-	if (pool->obj_free_head) {
-		pool->obj_free_head->prev = pool_object;
-	} 
-	pool->obj_allocated_num--;
-	pool->obj_free_num++;
-	pool_object->status = TXC_POOL_OBJECT_FREE;
-	pool->obj_free_head = pool_object; 
+	pool_central_put(pool, pool_object);
 	if (lock) {
 		TXC_MUTEX_UNLOCK(&(pool->mutex));
 	}	
-	*objp = NULL;
 }
 
 
+static inline
+txc_pool_object_t *
+pool_object_scan(txc_pool_t *pool, txc_pool_object_t *obj)
+{
+	for (; obj < &pool->obj_list[pool->obj_num]; obj++) {
+		if (pool->iter_status == 0 || (obj->status & pool->iter_status)) {
+			return obj;
+		}
+	}
+	return NULL;
+}
+
+
+/**
+ * \brief Starts iterating over the objects of the pool.
+ *
+ * Iteration walks the slab in order and skips objects whose status does 
+ * not match. Passing TXC_POOL_OBJECT_ALLOCATED & TXC_POOL_OBJECT_FREE
+ * iterates over all objects. Objects cached in per thread magazines count
+ * as free. The status of an object may change concurrently unless the 
+ * pool is quiescent, so iteration is meant for setup and teardown.
+ */
 txc_pool_object_t *
 txc_pool_object_first(txc_pool_t *pool, int obj_status)
 {
 	switch (obj_status) {
 		case TXC_POOL_OBJECT_FREE:
-			return pool->obj_free_head;
 		case TXC_POOL_OBJECT_ALLOCATED:
-			return pool->obj_allocated_head;
+			pool->iter_status = obj_status;
+			break;
 		case TXC_POOL_OBJECT_ALLOCATED & TXC_POOL_OBJECT_FREE:
-			return pool->obj_list;
+		case TXC_POOL_OBJECT_ALLOCATED | TXC_POOL_OBJECT_FREE:
+			pool->iter_status = 0;
+			break;
 		default:
 			TXC_INTERNALERROR("Unknown status of pool object");
+			return NULL;
 	}
-	return NULL;
+	return pool_object_scan(pool, pool->obj_list);
 }
 
 
 txc_pool_object_t *
 txc_pool_object_next(txc_pool_object_t *obj)
 {
-	return obj->next;
+	return pool_object_scan(obj->pool, obj + 1);
 }
 
 
@@ -276,17 +772,11 @@ txc_pool_print(txc_pool_t *pool, txc_pool_object_print_t printer, int verbose)
 			index = (pool_object - pool->obj_list);
 			if (verbose) {
 				fprintf(TXC_DEBUG_OUT, "Object Index = %u\t", index);
-				if (pool_object->prev) {
-					index = (pool_object->prev - pool->obj_list);
-					fprintf(TXC_DEBUG_OUT, "[prev = %u, ", index);
-				} else {
-					fprintf(TXC_DEBUG_OUT, "[prev = NULL, ");
-				} 
 				if (pool_object->next) {
 					index = (pool_object->next - pool->obj_list);
-					fprintf(TXC_DEBUG_OUT, "next = %u]\n", index);
+					fprintf(TXC_DEBUG_OUT, "[next = %u]\n", index);
 				} else {
-					fprintf(TXC_DEBUG_OUT, "next = NULL]\n");
+					fprintf(TXC_DEBUG_OUT, "[next = NULL]\n");
 				}
 			}
 			if (printer) {
@@ -294,29 +784,20 @@ txc_pool_print(txc_pool_t *pool, txc_pool_object_print_t printer, int verbose)
 			} 
 			pool_object = pool_object->next;
 		}
+		fprintf(TXC_DEBUG_OUT, "\nDEPOT: %u full magazines, %u empty magazines\n",
+		        pool->depot_full_num, pool->depot_empty_num);
 		fprintf(TXC_DEBUG_OUT, "\nALLOCATED POOL\n");
-		pool_object = pool->obj_allocated_head;
-		while (pool_object) {
-			index = (pool_object - pool->obj_list);
+		for (index = 0; index < pool->obj_num; index++) {
+			pool_object = &pool->obj_list[index];
+			if (pool_object->status != TXC_POOL_OBJECT_ALLOCATED) {
+				continue;
+			}
 			if (verbose) {
-				fprintf(TXC_DEBUG_OUT, "Object Index = %u\t", index);
-				if (pool_object->prev) {
-					index = (pool_object->prev - pool->obj_list);
-					fprintf(TXC_DEBUG_OUT, "[prev = %u, ", index);
-				} else {
-					fprintf(TXC_DEBUG_OUT, "[prev = NULL, ");
-				} 
-				if (pool_object->next) {
-					index = (pool_object->next - pool->obj_list);
-					fprintf(TXC_DEBUG_OUT, "next = %u]\n", index);
-				} else {
-					fprintf(TXC_DEBUG_OUT, "next = NULL]\n");
-				} 
+				fprintf(TXC_DEBUG_OUT, "Object Index = %u\n", index);
 			}
 			if (printer) {
 				printer(pool_object->buf);
 			} 
-			pool_object = pool_object->next;
 		}
 		TXC_MUTEX_UNLOCK(&(pool->mutex));
 	}
@@ -36,7 +36,11 @@
  * This allocator is used by library subsystems that need to preallocate 
  * and preinitialize a pool of objects. 
  *
- * \todo Consider a scalable multithreaded generic allocator such as Hoard.
+ * Each thread keeps a cache of free objects in two magazines, bounded 
+ * LIFO stacks, so that most allocations and frees don't touch the pool
+ * lock. Full and empty magazines are exchanged with a per pool depot 
+ * and the central free list refills magazines when the depot runs dry.
+ * The magazine size is set with the pool_magazine_size runtime option.
  */
 
 #ifndef _TXC_POOL_H
@@ -47,12 +51,16 @@
 #define TXC_POOL_OBJECT_FREE         0x1	
 #define TXC_POOL_OBJECT_ALLOCATED    0x2	
 
+/** Pool creation flags */
+#define TXC_POOL_HUGEPAGES           0x1	
+
 /**
  * The pool works as a slab allocator. That is when allocating an objects 
  * you can assume that its state is the same as when the object was 
  * returned back to the pool.
  *
- * Objects are allocated from the head 
+ * Objects are allocated from the head of the magazine or the central 
+ * free list.
  */
 
 typedef struct txc_pool_object_s txc_pool_object_t;
@@ -64,6 +72,12 @@ txc_result_t txc_pool_create(txc_pool_t **poolp,
                              unsigned int obj_size,
                              unsigned int obj_num, 
                              txc_pool_object_constructor_t obj_constructor);
+txc_result_t txc_pool_create_aligned(txc_pool_t **poolp, 
+                                     unsigned int obj_size,
+                                     unsigned int obj_num, 
+                                     unsigned int obj_align,
+                                     int flags,
+                                     txc_pool_object_constructor_t obj_constructor);
 txc_result_t txc_pool_destroy(txc_pool_t **poolp);
 txc_result_t txc_pool_object_alloc(txc_pool_t *pool, void **objp, int lock);
 void txc_pool_object_free(txc_pool_t *pool, void **objp, int lock);
@@ -0,0 +1,200 @@
+/*
+    Copyright (C) 2008-2009 Computer Sciences Department, 
+    University of Wisconsin -- Madison
+
+    ----------------------------------------------------------------------
+
+    This file is part of the xCalls transactional API, originally 
+    developed at the University of Wisconsin -- Madison.
+
+    xCalls was originally developed primarily by Haris Volos and 
+    Neelam Goyal with contributions from Andres Jaan Tack.
+
+    ----------------------------------------------------------------------
+
+    xCalls is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as 
+    published by the Free Software Foundation, either version 3 of 
+    the License, or (at your option) any later version.
+
+    xCalls is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public 
+    License along with xCalls.  If not, see <http://www.gnu.org/licenses/>.
+
+### END HEADER ###
+*/
+
+/**
+ * \file offset.c
+ *
+ * \brief Shadow file offsets.
+ *
+ * Within a transaction, xcalls operating at the file offset of a file 
+ * descriptor do not move the kernel offset. The transaction instead 
+ * tracks its own offset in a shadow kept in the descriptor's mapping 
+ * and reads and writes at it with pread and pwrite. Commit publishes the 
+ * final offset with a single lseek, and abort simply drops the shadow. 
+ *
+ * Descriptors opened with O_APPEND are not shadowed: the kernel writes 
+ * them at the end of the file whatever the offset, so the xcalls keep 
+ * using the kernel offset.
+ *
+ * Descriptors sharing an open file description, such as duplicates 
+ * made by dup, share the kernel offset too. A descriptor is therefore 
+ * shadowed only while it is the only descriptor mapped to its KOA, and 
+ * x_dup moves the kernel offset to the shadow and stops shadowing before
+ * duplicating a shadowed descriptor.
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <misc/debug.h>
+#include <core/tx.h>
+#include <core/config.h>
+#include <core/koa.h>
+#include <core/buffer.h>
+#include <core/txdesc.h>
+#include <libc/syscalls.h>
+#include <xcalls/offset.h>
+
+
+static
+void
+offset_shadow_undo(void *args, int *result)
+{
+	txc_offset_shadow_t *shadow = (txc_offset_shadow_t *) args;
+	int                 local_result = 0;
+
+	if (txc_koa_get_shadow_offset(shadow->koamgr, shadow->fd) == args) {
+		txc_koa_set_shadow_offset(shadow->koamgr, shadow->fd, NULL);
+	}
+	if (shadow->kernel_moved &&
+	    txc_libc_lseek(shadow->fd, shadow->start, SEEK_SET) < 0) 
+	{
+		local_result = errno;
+	}
+	if (result) {
+		*result = local_result;
+	}
+}
+
+
+static
+void
+offset_shadow_commit(void *args, int *result)
+{
+	txc_offset_shadow_t *shadow = (txc_offset_shadow_t *) args;
+	int                 local_result = 0;
+
+	if (txc_koa_get_shadow_offset(shadow->koamgr, shadow->fd) == args) {
+		txc_koa_set_shadow_offset(shadow->koamgr, shadow->fd, NULL);
+	}
+	if (!shadow->disabled && 
+	    (shadow->offset != shadow->start || shadow->kernel_moved) &&
+	    txc_libc_lseek(shadow->fd, shadow->offset, SEEK_SET) < 0) 
+	{
+		local_result = errno;
+	}
+	if (result) {
+		*result = local_result;
+	}
+}
+
+
+/**
+ * \brief Gets the shadow of the file offset of a descriptor.
+ *
+ * The first time a transaction asks for the shadow of a descriptor, the 
+ * shadow is initialized from the kernel offset and actions publishing 
+ * or dropping it are registered.
+ *
+ * Caller must hold the sentinel of the KOA the descriptor is mapped to.
+ *
+ * \param[in] txd Transaction descriptor.
+ * \param[in] koa The KOA the file descriptor is mapped to.
+ * \param[in] fd File descriptor.
+ * \return The shadow offset, or NULL if the descriptor's offset is not 
+ * shadowed, in which case the caller uses the kernel offset.
+ */
+txc_offset_shadow_t *
+txc_offset_shadow_get(txc_tx_t *txd, txc_koa_t *koa, int fd)
+{
+	txc_koamgr_t        *koamgr = txc_koa_get_koamgr(koa);
+	txc_offset_shadow_t *shadow;
+	int                 flags;
+	off_t               start;
+
+	if (txc_koa_get_type(koa) != TXC_KOA_IS_FILE) {
+		return NULL;
+	}
+	shadow = (txc_offset_shadow_t *) txc_koa_get_shadow_offset(koamgr, fd);
+	if (shadow) {
+		return shadow->disabled ? NULL : shadow;
+	}
+	if (txc_koa_get_num_fdrefs(koa) > 1) {
+		/* The descriptor may share its offset with another descriptor. */
+		return NULL;
+	}
+	if ((flags = txc_libc_fcntl_getfl(fd)) < 0 ||
+	    (start = txc_libc_lseek(fd, 0, SEEK_CUR)) < 0)
+	{
+		return NULL;
+	}
+	if ((shadow = (txc_offset_shadow_t *) 
+	              txc_buffer_linear_malloc(txd->buffer_linear, 
+	                                       sizeof(txc_offset_shadow_t)))
+	    == NULL)
+	{
+		return NULL;
+	}
+	shadow->fd = fd;
+	shadow->koamgr = koamgr;
+	shadow->offset = shadow->start = start;
+	shadow->disabled = (flags & O_APPEND) ? 1 : 0;
+	shadow->kernel_moved = 0;
+	txc_tx_register_keyed_commit_action(txd, offset_shadow_commit, 
+	                                    (void *) shadow, NULL,
+	                                    TXC_TX_REGULAR_COMMIT_ACTION_ORDER, fd);
+	txc_tx_register_undo_action(txd, offset_shadow_undo, 
+	                            (void *) shadow, NULL,
+	                            TXC_TX_REGULAR_UNDO_ACTION_ORDER);
+	txc_koa_set_shadow_offset(koamgr, fd, (void *) shadow);
+	return shadow->disabled ? NULL : shadow;
+}
+
+
+/**
+ * \brief Stops shadowing the file offset of a descriptor.
+ *
+ * Moves the kernel offset to the shadow so that descriptors sharing the
+ * open file description see it. Abort still moves the kernel offset back 
+ * to where the transaction found it.
+ *
+ * Caller must hold the sentinel of the KOA the descriptor is mapped to.
+ *
+ * \param[in] koamgr KOA manager.
+ * \param[in] fd File descriptor.
+ * \return 0 on success, or -1 if a failure occurred (in which case, errno
+ * is set appropriately).
+ */
+int
+txc_offset_shadow_flush(txc_koamgr_t *koamgr, int fd)
+{
+	txc_offset_shadow_t *shadow;
+
+	shadow = (txc_offset_shadow_t *) txc_koa_get_shadow_offset(koamgr, fd);
+	if (shadow == NULL || shadow->disabled) {
+		return 0;
+	}
+	if (txc_libc_lseek(fd, shadow->offset, SEEK_SET) < 0) {
+		return -1;
+	}
+	shadow->kernel_moved = 1;
+	shadow->disabled = 1;
+	return 0;
+}
@@ -0,0 +1,63 @@
+/*
+    Copyright (C) 2008-2009 Computer Sciences Department, 
+    University of Wisconsin -- Madison
+
+    ----------------------------------------------------------------------
+
+    This file is part of the xCalls transactional API, originally 
+    developed at the University of Wisconsin -- Madison.
+
+    xCalls was originally developed primarily by Haris Volos and 
+    Neelam Goyal with contributions from Andres Jaan Tack.
+
+    ----------------------------------------------------------------------
+
+    xCalls is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as 
+    published by the Free Software Foundation, either version 3 of 
+    the License, or (at your option) any later version.
+
+    xCalls is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public 
+    License along with xCalls.  If not, see <http://www.gnu.org/licenses/>.
+
+### END HEADER ###
+*/
+
+/**
+ * \file offset.h
+ *
+ * \brief Shadow file offset interface.
+ */
+
+#ifndef _TXC_OFFSET_H
+#define _TXC_OFFSET_H
+
+#include <sys/types.h>
+#include <core/tx.h>
+#include <core/koa.h>
+
+typedef struct txc_offset_shadow_s txc_offset_shadow_t;
+
+/** 
+ * The file offset of a descriptor as seen by the transaction using it.
+ * Reads and writes go to offset with pread and pwrite; the kernel 
+ * offset is only updated at commit.
+ */
+struct txc_offset_shadow_s {
+	int          fd;
+	txc_koamgr_t *koamgr;
+	off_t        offset;       /**< File offset as seen by the transaction */
+	off_t        start;        /**< Kernel file offset when the transaction first used the descriptor */
+	int          disabled;     /**< Descriptor opened with O_APPEND; the kernel offset is used */
+	int          kernel_moved; /**< The kernel offset was moved and must be restored on abort */
+};
+
+txc_offset_shadow_t *txc_offset_shadow_get(txc_tx_t *txd, txc_koa_t *koa, int fd);
+int txc_offset_shadow_flush(txc_koamgr_t *koamgr, int fd);
+
+#endif /* _TXC_OFFSET_H */
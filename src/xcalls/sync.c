@@ -0,0 +1,176 @@
+/*
+    Copyright (C) 2008-2009 Computer Sciences Department, 
+    University of Wisconsin -- Madison
+
+    ----------------------------------------------------------------------
+
+    This file is part of the xCalls transactional API, originally 
+    developed at the University of Wisconsin -- Madison.
+
+    xCalls was originally developed primarily by Haris Volos and 
+    Neelam Goyal with contributions from Andres Jaan Tack.
+
+    ----------------------------------------------------------------------
+
+    xCalls is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as 
+    published by the Free Software Foundation, either version 3 of 
+    the License, or (at your option) any later version.
+
+    xCalls is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public 
+    License along with xCalls.  If not, see <http://www.gnu.org/licenses/>.
+
+### END HEADER ###
+*/
+
+/**
+ * \file sync.c
+ *
+ * \brief Group commit of x_fsync and x_fdatasync.
+ *
+ * A transaction flushes the files it asked to flush after it has released
+ * its sentinels, so that transactions committing to the same file can 
+ * share a single flush (see txc_koa_file_sync). Writes of the transaction
+ * reach the kernel at the regular commit level, before the flush.
+ *
+ * Since the sentinel is no longer held when the flush is issued, the 
+ * descriptor is duplicated while it still is, and the flush goes through
+ * the duplicate. This also covers a transaction closing the descriptor 
+ * after flushing it.
+ *
+ * Repeated flushes of a descriptor within a transaction are merged into 
+ * one; failures are reported to the result of the first of them. Flushes
+ * of different descriptors run concurrently on the commit helpers.
+ */
+
+#include <unistd.h>
+#include <errno.h>
+#include <misc/debug.h>
+#include <core/tx.h>
+#include <core/config.h>
+#include <core/koa.h>
+#include <core/buffer.h>
+#include <core/txdesc.h>
+#include <libc/syscalls.h>
+#include <xcalls/xcalls.h>
+#include <xcalls/sync.h>
+
+
+typedef struct x_sync_commit_args_s x_sync_commit_args_t;
+
+struct x_sync_commit_args_s {
+	int       fd;
+	txc_koa_t *koa;
+	int       datasync;  /**< Whether fdatasync is enough for all the requests */
+	int       sync_fd;   /**< Duplicate of fd the flush goes through; -1 if flushed already */
+	int       error;     /**< Failure to report if flushed already */
+};
+
+
+static
+int
+sync_fd(int fd, int datasync)
+{
+	int ret;
+
+	ret = datasync ? txc_libc_fdatasync(fd) : txc_libc_fsync(fd);
+	return (ret < 0) ? errno : 0;
+}
+
+
+static
+void
+x_sync_prepare_commit(void *args, int *result)
+{
+	x_sync_commit_args_t *args_commit = (x_sync_commit_args_t *) args;
+
+	if ((args_commit->sync_fd = txc_libc_dup(args_commit->fd)) < 0) {
+		/* Out of descriptors; flush alone while the descriptor is valid. */
+		args_commit->error = sync_fd(args_commit->fd, args_commit->datasync);
+	}
+	if (result) {
+		*result = 0;
+	}
+}
+
+
+static
+void
+x_sync_commit(void *args, int *result)
+{
+	x_sync_commit_args_t *args_commit = (x_sync_commit_args_t *) args;
+	int                  local_result = args_commit->error;
+
+	if (args_commit->sync_fd >= 0) {
+		if (txc_koa_get_type(args_commit->koa) == TXC_KOA_IS_FILE) {
+			local_result = txc_koa_file_sync(args_commit->koa, 
+			                                 args_commit->sync_fd,
+			                                 args_commit->datasync);
+		} else {
+			local_result = sync_fd(args_commit->sync_fd, args_commit->datasync);
+		}
+		txc_libc_close(args_commit->sync_fd);
+	}
+	if (result) {
+		*result = local_result;
+	}
+}
+
+
+/**
+ * \brief Registers the flush of a descriptor at commit.
+ *
+ * Caller must hold the sentinel of the KOA the descriptor is mapped to.
+ *
+ * \param[in] txd Transaction descriptor.
+ * \param[in] koa The KOA the file descriptor is mapped to.
+ * \param[in] fd File descriptor.
+ * \param[in] datasync Whether fdatasync is enough.
+ * \param[out] result Where to report failures of the flush.
+ * \return Code indicating success or failure (reason) of the operation.
+ */
+txc_result_t
+txc_sync_register(txc_tx_t *txd, txc_koa_t *koa, int fd, int datasync, 
+                  int *result)
+{
+	x_sync_commit_args_t *args_commit;
+	txc_result_t         ret;
+
+	if ((args_commit = (x_sync_commit_args_t *) 
+	                   txc_tx_find_mergeable_commit_action(txd, fd, 
+	                                                       TXC_X_COMMIT_SYNC))
+	    != NULL && args_commit->koa == koa)
+	{
+		args_commit->datasync &= datasync;
+		return TXC_R_SUCCESS;
+	}
+	if ((args_commit = (x_sync_commit_args_t *)
+	                   txc_buffer_linear_malloc(txd->buffer_linear, 
+	                                            sizeof(x_sync_commit_args_t)))
+	    == NULL)
+	{
+		return TXC_R_NOMEMORY;
+	}
+	args_commit->fd = fd;
+	args_commit->koa = koa;
+	args_commit->datasync = datasync;
+	args_commit->sync_fd = -1;
+	args_commit->error = 0;
+	if ((ret = txc_tx_register_mergeable_commit_action(txd, x_sync_prepare_commit,
+	                                                   (void *) args_commit, NULL,
+	                                                   TXC_TX_REGULAR_COMMIT_ACTION_ORDER,
+	                                                   fd, TXC_X_COMMIT_SYNC)) 
+	    != TXC_R_SUCCESS)
+	{
+		return ret;
+	}
+	return txc_tx_register_keyed_commit_action(txd, x_sync_commit, 
+	                                           (void *) args_commit, result,
+	                                           TXC_GROUP_SYNC_COMMIT_ACTION_ORDER,
+	                                           fd);
+}
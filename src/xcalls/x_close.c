@@ -71,8 +71,12 @@ x_close_commit(void *args, int *result)
 	koamgr = txc_koa_get_koamgr(myargs->koa);
 	txc_koa_lock_alias_cache(koamgr);
 	txc_koa_lock_fd(koamgr, myargs->fd);
-	xret = txc_koa_detach_fd(myargs->koa, myargs->fd, 0);
-	if (xret == TXC_R_SUCCESS) {
+	if (txc_koa_fdcache_park(myargs->koa, myargs->fd) == TXC_R_SUCCESS) {
+		/* File descriptor kept open for reuse by a later x_open. */
+		xret = TXC_R_SUCCESS;
+	} else if ((xret = txc_koa_detach_fd(myargs->koa, myargs->fd, 0)) 
+	           == TXC_R_SUCCESS) 
+	{
 		if (txc_libc_close(myargs->fd) < 0) {
 			local_errno = errno;
 		}	
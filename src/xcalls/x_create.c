@@ -34,10 +34,16 @@
  * \brief x_create implementation.
  */
 
+/* For O_TMPFILE and renameat2. */
+#define _GNU_SOURCE
+
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
+#include <limits.h>
+#include <stdio.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <stdlib.h>
 #include <misc/debug.h>
 #include <misc/errno.h>
@@ -46,6 +52,7 @@
 #include <core/koa.h>
 #include <core/buffer.h>
 #include <core/stats.h>
+#include <core/journal.h>
 #include <libc/syscalls.h>
 #include <core/txdesc.h>
 #include <xcalls/xcalls.h>
@@ -159,14 +166,338 @@ x_create_case2_undo(void *args, int *result)
 }
 
 
+/*
+ * Case 3: commit and undo actions
+ */
+
+/* 
+ * Template of the names next to pathname through which an unnamed file 
+ * replaces an existing one. The names are linked only if free, so existing
+ * files are never touched; a crash can leave one behind.
+ */
+#define TXC_CREATE_TEMP_SUFFIX ".libtxc.XXXXXX"
+#define TXC_CREATE_TEMP_RETRIES 16
+
+typedef struct x_create_case3_commit_undo_args_s   x_create_case3_commit_undo_args_t;
+
+struct x_create_case3_commit_undo_args_s {
+	int                                      fd;
+	txc_koa_t                                *koa;
+	int                                      published;    /**< If set, then pathname already refers to the file. */
+	dev_t                                    dir_dev;      /**< Device of the directory of pathname. */
+	ino_t                                    dir_ino;      /**< Inode of the directory of pathname. */
+	char                                     pathname[TXC_MAX_LEN_PATHNAME];
+	char                                     old_pathname[TXC_MAX_LEN_PATHNAME + sizeof(TXC_CREATE_TEMP_SUFFIX)];
+	struct x_create_case3_commit_undo_args_s *next;        /**< Next file created unnamed by the transaction. */
+};
+
+/* Whether /proc/self/fd is there to name unnamed files; -1 until checked. */
+static int x_create_case3_proc_available = -1;
+
+
+/** 
+ * Copies the directory part of pathname to dir. 
+ *
+ * \return A pointer to the last component of pathname.
+ */
+static
+const char *
+x_create_case3_dirname(const char *pathname, char *dir)
+{
+	const char *slash;
+
+	if ((slash = strrchr(pathname, '/')) == NULL) {
+		strcpy(dir, ".");
+		return pathname;
+	} 
+	if (slash == pathname) {
+		strcpy(dir, "/");
+	} else {
+		memcpy(dir, pathname, slash - pathname);
+		dir[slash - pathname] = '\0';
+	}
+	return slash + 1;
+}
+
+
+/** 
+ * Opens an unnamed file in the directory of pathname. 
+ *
+ * Called with the alias cache locked, which also serializes the check 
+ * for /proc.
+ *
+ * \return The file descriptor, or -1 if unnamed files cannot be named 
+ * later on.
+ */
+static
+int
+x_create_case3_open(const char *pathname, mode_t mode, struct stat *dir_stat)
+{
+#ifdef O_TMPFILE
+	char dir[TXC_MAX_LEN_PATHNAME];
+
+	if (x_create_case3_proc_available == -1) {
+		x_create_case3_proc_available = (access("/proc/self/fd", X_OK) == 0);
+	}
+	if (!x_create_case3_proc_available) {
+		return -1;
+	}
+	x_create_case3_dirname(pathname, dir);
+	if (stat(dir, dir_stat) < 0) {
+		return -1;
+	}
+	return txc_libc_open(dir, O_TMPFILE | O_NOCTTY | O_RDWR, mode);
+#else
+	return -1;
+#endif
+}
+
+
+/** 
+ * Links from to a free name next to pathname, stored in temp. 
+ *
+ * \return 0 on success, or -1 (in which case, errno is set appropriately).
+ */
+static
+int
+x_create_case3_link_temp(const char *from, int flags, const char *pathname, 
+                         char *temp, size_t size)
+{
+	int i;
+
+	for (i = 0; i < TXC_CREATE_TEMP_RETRIES; i++) {
+		snprintf(temp, size, "%s%s", pathname, TXC_CREATE_TEMP_SUFFIX);
+		mktemp(temp);
+		if (temp[0] == '\0') {
+			break;
+		}
+		if (linkat(AT_FDCWD, from, AT_FDCWD, temp, flags) == 0) {
+			return 0;
+		}
+		if (errno != EEXIST) {
+			return -1;
+		}
+	}
+	errno = EEXIST;
+	return -1;
+}
+
+
+/** 
+ * Gives the unnamed file the name pathname, replacing any existing file.
+ * If old_pathname is not NULL, then the existing file is kept under the
+ * name stored there (empty if there was none).
+ *
+ * \return 0 on success, or an errno value.
+ */
+static
+int
+x_create_case3_link(x_create_case3_commit_undo_args_t *args, char *old_pathname)
+{
+	char proc_path[64];
+	char new_pathname[TXC_MAX_LEN_PATHNAME + sizeof(TXC_CREATE_TEMP_SUFFIX)];
+	int  local_result = 0;
+
+	if (old_pathname) {
+		old_pathname[0] = '\0';
+	}
+	snprintf(proc_path, sizeof(proc_path), "/proc/self/fd/%d", args->fd);
+	if (linkat(AT_FDCWD, proc_path, AT_FDCWD, args->pathname, 
+	           AT_SYMLINK_FOLLOW) == 0) 
+	{
+		return 0;
+	}
+	if (errno != EEXIST) {
+		return errno;
+	}
+	/* 
+	 * Replace the existing file through a name in the same directory,
+	 * so that no one sees the name missing.
+	 */
+	if (x_create_case3_link_temp(proc_path, AT_SYMLINK_FOLLOW, args->pathname,
+	                             new_pathname, sizeof(new_pathname)) < 0) 
+	{
+		return errno;
+	}
+	if (old_pathname) {
+#ifdef RENAME_EXCHANGE
+		/* The existing file takes the temporary name in the same step. */
+		if (renameat2(AT_FDCWD, new_pathname, AT_FDCWD, args->pathname, 
+		              RENAME_EXCHANGE) == 0) 
+		{
+			strcpy(old_pathname, new_pathname);
+			return 0;
+		}
+		if (errno != EINVAL && errno != ENOSYS) {
+			local_result = errno;
+			txc_libc_unlink(new_pathname);
+			return local_result;
+		}
+#endif
+		if (x_create_case3_link_temp(args->pathname, 0, args->pathname,
+		                             old_pathname, sizeof(args->old_pathname)) < 0) 
+		{
+			local_result = errno;
+			old_pathname[0] = '\0';
+			txc_libc_unlink(new_pathname);
+			return local_result;
+		}
+	}
+	if (txc_libc_rename(new_pathname, args->pathname) < 0) {
+		local_result = errno;
+		txc_libc_unlink(new_pathname);
+		if (old_pathname && old_pathname[0] != '\0') {
+			txc_libc_unlink(old_pathname);
+			old_pathname[0] = '\0';
+		}
+	}
+	return local_result;
+}
+
+
+static
+void
+x_create_case3_commit(void *args, int *result)
+{
+	int                                local_result = 0;
+	x_create_case3_commit_undo_args_t *myargs = (x_create_case3_commit_undo_args_t *) args;
+
+	if (myargs->published) {
+		/* The file has its name already; drop the one it replaced. */
+		if (myargs->old_pathname[0] != '\0' &&
+		    txc_libc_unlink(myargs->old_pathname) < 0) 
+		{
+			local_result = errno;
+		}
+	} else {
+		local_result = x_create_case3_link(myargs, NULL);
+	}
+	if (result) {
+		*result = local_result;
+	}
+}
+
+
+static
+void
+x_create_case3_undo(void *args, int *result)
+{
+	int                                local_result = 0; 
+	x_create_case3_commit_undo_args_t *myargs = (x_create_case3_commit_undo_args_t *) args;
+	txc_koamgr_t                       *koamgr;
+
+	koamgr = txc_koa_get_koamgr(myargs->koa);
+	txc_koa_lock_alias_cache(koamgr);
+	if (myargs->published) {
+		/* Give the name back to the file it replaced, if any. */
+		if (myargs->old_pathname[0] != '\0') {
+			if (txc_libc_rename(myargs->old_pathname, myargs->pathname) < 0) {
+				local_result = errno;
+			}
+		} else if (txc_libc_unlink(myargs->pathname) < 0) {
+			local_result = errno;
+		}
+	}
+	/* Once without a name, closing the file removes it. */
+	txc_koa_detach_fd(myargs->koa, myargs->fd, 1);
+	if (txc_libc_close(myargs->fd) < 0 && local_result == 0) {
+		local_result = errno;
+	}	
+	txc_koa_unlock_alias_cache(koamgr);
+	if (result) {
+		*result = local_result;
+	}
+}
+
+
+/**
+ * \brief Names the files the transaction created unnamed as pathname.
+ *
+ * Lets xCalls operating on pathname later in the transaction see the file
+ * x_create returned, as they would if it had been created in place. The 
+ * file replaces any existing file, which is kept aside until the 
+ * transaction finishes as in CASE 2. Called with the alias cache locked; 
+ * aborts the transaction if another one operates on the existing file.
+ *
+ * \param[in] txd The transaction descriptor.
+ * \param[in] pathname The path xCall is about to operate on.
+ * \return 0 on success, or an errno value.
+ */
+int
+txc_x_create_publish(void *txd, const char *pathname)
+{
+	txc_tx_t                          *mytxd = (txc_tx_t *) txd;
+	x_create_case3_commit_undo_args_t *args;
+	txc_koamgr_t                      *koamgr;
+	txc_koa_t                         *koa_old;
+	txc_sentinel_t                    *sentinel;
+	txc_result_t                      xret;
+	char                              dir[TXC_MAX_LEN_PATHNAME];
+	const char                        *name;
+	struct stat                       dir_stat;
+	ino_t                             inode;
+	int                               ret;
+
+	if (mytxd->created_unnamed == NULL) {
+		return 0;
+	}
+	name = x_create_case3_dirname(pathname, dir);
+	if (stat(dir, &dir_stat) < 0) {
+		return 0;
+	}
+	for (args = (x_create_case3_commit_undo_args_t *) mytxd->created_unnamed;
+	     args != NULL;
+	     args = args->next) 
+	{
+		if (args->published ||
+		    args->dir_dev != dir_stat.st_dev ||
+		    args->dir_ino != dir_stat.st_ino ||
+		    strcmp(x_create_case3_dirname(args->pathname, dir), name) != 0)
+		{
+			continue;
+		}
+		koamgr = txc_koa_get_koamgr(args->koa);
+		txc_koa_path2inode(args->pathname, &inode);
+		if (inode != 0 &&
+		    txc_koa_alias_cache_lookup_inode(koamgr, inode, &koa_old) 
+		    == TXC_R_SUCCESS) 
+		{
+			/* Isolate ourself from transactions operating on the existing file. */
+			txc_koa_lock_fds_refby_koa(koa_old);
+			sentinel = txc_koa_get_sentinel(koa_old);
+			xret = txc_sentinel_tryacquire(mytxd, sentinel, 0);
+			txc_koa_unlock_fds_refby_koa(koa_old);
+			if (xret == TXC_R_BUSYSENTINEL) {
+				txc_koa_unlock_alias_cache(koamgr);
+				txc_tx_abort_transaction(mytxd, TXC_ABORTREASON_BUSYSENTINEL);
+				TXC_INTERNALERROR("Never gets here. Transaction abort failed.\n");
+			}
+		}
+		if ((ret = x_create_case3_link(args, args->old_pathname)) != 0) {
+			return ret;
+		}
+		args->published = 1;
+	}
+	return 0;
+}
+
+
 /**
  * \brief Creates a file.
  * 
  * Creates a file using the creation flags: O_CREAT| O_NOCTTY| O_TRUNC| O_RDWR.
- * If a file already exists then it is renamed and removed if transaction finally 
- * commits.
  *
- * <b> Execution </b>: in-place
+ * Where the file system supports unnamed files (O_TMPFILE) and /proc is 
+ * mounted, the file is created without a name in the directory of pathname 
+ * and takes the name when the transaction commits, replacing any existing 
+ * file; until then other threads keep seeing the existing file, if any. 
+ * Aborting just closes the file. If x_open, x_create, x_rename or x_unlink
+ * refers to pathname before the transaction finishes, the file takes the 
+ * name right then, so the transaction sees its own file. Otherwise, or if 
+ * a journal is kept, the file is created in place, and an existing file is
+ * renamed and removed if the transaction finally commits.
+ *
+ * <b> Execution </b>: deferred (unnamed file), in-place
  *
  * <b> Asynchronous failures </b>: commit, abort
  *
@@ -189,6 +520,7 @@ XCALL_DEF(x_create)(const char *pathname, mode_t mode, int *result)
 	int            ret;
 	int            local_result = 0;
 	ino_t          inode;
+	struct stat    dir_stat;
 	char           temp_pathname[128]; 
 	int            creation_flags = O_CREAT| O_NOCTTY| O_TRUNC| O_RDWR;
 
@@ -198,10 +530,93 @@ XCALL_DEF(x_create)(const char *pathname, mode_t mode, int *result)
 		case TXC_XACTSTATE_TRANSACTIONAL_RETRYABLE:
 			/* Serialize open/create/close file operations to detect aliasing */
 			txc_koa_lock_alias_cache(koamgr);
+			if ((local_result = txc_x_create_publish(txd, pathname)) != 0) {
+				txc_koa_unlock_alias_cache(koamgr);
+				ret = -1;
+				goto done;
+			}
 			txc_koa_path2inode(pathname, &inode);
 			TXC_DEBUG_PRINT(TXC_DEBUG_XCALL, "X_CREATE: path = %s, inode= %d\n", 
 			                pathname, inode);
-			if (inode == 0) {
+			if (txc_g_journalmgr == NULL &&
+			    (fildes = x_create_case3_open(pathname, mode, &dir_stat)) >= 0) 
+			{
+				x_create_case3_commit_undo_args_t *args_commit_undo; 
+				struct stat                        stat_buf;
+				/* 
+				 * CASE 3: The file is created unnamed and named at commit, or
+				 * earlier if the transaction refers to pathname again.
+				 * Not with a journal, as a file without a name cannot be 
+				 * recovered.
+				 */
+				if (inode != 0 &&
+				    txc_koa_alias_cache_lookup_inode(koamgr, inode, &koa_old) 
+				    == TXC_R_SUCCESS) 
+				{
+					/* Isolate ourself from transactions operating on the existing file, as in CASE 2a. */
+					txc_koa_lock_fds_refby_koa(koa_old);
+					sentinel = txc_koa_get_sentinel(koa_old);
+					xret = txc_sentinel_tryacquire(txd, sentinel, 0);
+					txc_koa_unlock_fds_refby_koa(koa_old);
+					if (xret == TXC_R_BUSYSENTINEL) {
+						txc_libc_close(fildes);
+						txc_koa_unlock_alias_cache(koamgr);
+						txc_tx_abort_transaction(txd, TXC_ABORTREASON_BUSYSENTINEL);
+						TXC_INTERNALERROR("Never gets here. Transaction abort failed.\n");
+					}
+				}
+				if (txc_libc_fstat(fildes, &stat_buf) < 0) {
+					local_result = errno;
+					txc_libc_close(fildes);
+					txc_koa_unlock_alias_cache(koamgr);
+					ret = -1;
+					goto done;
+				}
+				if (txc_koa_create(koamgr, &koa_new, TXC_KOA_IS_FILE, 
+				                   (void *) stat_buf.st_ino) != TXC_R_SUCCESS)
+				{
+					local_result = ENOMEM;
+					txc_libc_close(fildes);
+					txc_koa_unlock_alias_cache(koamgr);
+					ret = -1;
+					goto done;
+				}
+				txc_koa_lock_fd(koamgr, fildes);
+				txc_koa_attach_fd(koa_new, fildes, 0);
+				sentinel = txc_koa_get_sentinel(koa_new);
+				/* Not reacquired after restart, as in CASE 1. */
+				xret = txc_sentinel_tryacquire(txd, sentinel, 0);
+				if (xret != TXC_R_SUCCESS) {
+					TXC_INTERNALERROR("Cannot acquire the sentinel of the KOA I've just created!\n");
+				}
+				args_commit_undo = (x_create_case3_commit_undo_args_t *)
+				                   txc_buffer_linear_malloc(txd->buffer_linear, 
+				                                            sizeof(x_create_case3_commit_undo_args_t));
+				if (args_commit_undo == NULL) {
+					TXC_INTERNALERROR("Allocation failed. Linear buffer out of space.\n");
+				}
+				strcpy(args_commit_undo->pathname, pathname);
+				args_commit_undo->koa = koa_new;
+				args_commit_undo->fd = fildes;
+				args_commit_undo->published = 0;
+				args_commit_undo->old_pathname[0] = '\0';
+				args_commit_undo->dir_dev = dir_stat.st_dev;
+				args_commit_undo->dir_ino = dir_stat.st_ino;
+				args_commit_undo->next = (x_create_case3_commit_undo_args_t *) 
+				                         txd->created_unnamed;
+				txd->created_unnamed = (void *) args_commit_undo;
+
+				txc_tx_register_commit_action(txd, x_create_case3_commit, 
+				                              (void *) args_commit_undo, result,
+				                              TXC_KOA_CREATE_COMMIT_ACTION_ORDER);
+				txc_tx_register_undo_action  (txd, x_create_case3_undo, 
+				                              (void *) args_commit_undo, result,
+				                              TXC_KOA_CREATE_UNDO_ACTION_ORDER);
+
+				txc_koa_unlock_fd(koamgr, fildes);
+				txc_koa_unlock_alias_cache(koamgr);
+				ret = fildes;
+			} else if (inode == 0) {
 				x_create_case1_commit_undo_args_t *args_commit_undo; 
 				/* 
 				 * CASE 1: File does not exist.  
@@ -224,7 +639,32 @@ XCALL_DEF(x_create)(const char *pathname, mode_t mode, int *result)
 					goto done;
 				}
 				txc_koa_path2inode(pathname, &inode);
-				txc_koa_create(koamgr, &koa_new, TXC_KOA_IS_FILE, (void *) inode);
+				/* 
+				 * Logged once the inode is known; a crash in between 
+				 * leaves an empty file behind.
+				 */
+				if (txc_g_journalmgr &&
+				    ((local_result = txc_journal_log_name(txc_g_journalmgr, txd, 
+				                                          TXC_JOURNAL_UNDO_UNLINK,
+				                                          pathname, NULL, inode)) != 0 ||
+				     (local_result = txc_journal_sync_parent(pathname)) != 0))
+				{
+					txc_libc_unlink(pathname);
+					txc_libc_close(fildes);
+					txc_koa_unlock_alias_cache(koamgr);
+					ret = -1;
+					goto done;
+				}
+				if (txc_koa_create(koamgr, &koa_new, TXC_KOA_IS_FILE, (void *) inode)
+				    != TXC_R_SUCCESS)
+				{
+					local_result = ENOMEM;
+					txc_libc_unlink(pathname);
+					txc_libc_close(fildes);
+					txc_koa_unlock_alias_cache(koamgr);
+					ret = -1;
+					goto done;
+				}
 				txc_koa_lock_fd(koamgr, fildes);
 				txc_koa_attach_fd(koa_new, fildes, 0);
 				sentinel = txc_koa_get_sentinel(koa_new);
@@ -335,6 +775,16 @@ XCALL_DEF(x_create)(const char *pathname, mode_t mode, int *result)
 				x_create_case2_commit_undo_args_t *args_commit_undo; 
 				strcpy(temp_pathname, "/tmp/libtxc.tmp.XXXXXX");
 				mktemp(temp_pathname); 
+				if (txc_g_journalmgr &&
+				    (local_result = txc_journal_log_name(txc_g_journalmgr, txd, 
+				                                         TXC_JOURNAL_UNDO_RENAME,
+				                                         temp_pathname, pathname, 
+				                                         inode)) != 0)
+				{
+					txc_koa_unlock_alias_cache(koamgr);
+					ret = -1;
+					goto done;
+				}
 				txc_libc_rename(pathname, temp_pathname);
 				if ((ret = fildes = txc_libc_open(pathname, 
 				                                  creation_flags, 
@@ -345,8 +795,31 @@ XCALL_DEF(x_create)(const char *pathname, mode_t mode, int *result)
 					local_result = errno;
 					goto done;
 				}
+				if (txc_g_journalmgr &&
+				    ((local_result = txc_journal_sync_parent(temp_pathname)) != 0 ||
+				     (local_result = txc_journal_sync_parent(pathname)) != 0 ||
+				     (local_result = txc_journal_log_name(txc_g_journalmgr, txd, 
+				                                          TXC_JOURNAL_REDO_UNLINK,
+				                                          temp_pathname, NULL, 
+				                                          inode)) != 0))
+				{
+					txc_libc_close(fildes);
+					txc_libc_rename(temp_pathname, pathname);
+					txc_koa_unlock_alias_cache(koamgr);
+					ret = -1;
+					goto done;
+				}
 				txc_koa_path2inode(pathname, &inode);
-				txc_koa_create(koamgr, &koa_new, TXC_KOA_IS_FILE, (void *) inode);
+				if (txc_koa_create(koamgr, &koa_new, TXC_KOA_IS_FILE, (void *) inode)
+				    != TXC_R_SUCCESS)
+				{
+					local_result = ENOMEM;
+					txc_libc_close(fildes);
+					txc_libc_rename(temp_pathname, pathname);
+					txc_koa_unlock_alias_cache(koamgr);
+					ret = -1;
+					goto done;
+				}
 
 				TXC_DEBUG_PRINT(TXC_DEBUG_XCALL, 
 				                "X_CREATE: Case 2B: KOA = %x\n", 
@@ -413,7 +886,15 @@ XCALL_DEF(x_create)(const char *pathname, mode_t mode, int *result)
 				goto done;
 			}
 			txc_koa_path2inode(pathname, &inode);
-			txc_koa_create(koamgr, &koa_new, TXC_KOA_IS_FILE, (void *) inode);
+			if (txc_koa_create(koamgr, &koa_new, TXC_KOA_IS_FILE, (void *) inode)
+			    != TXC_R_SUCCESS)
+			{
+				local_result = ENOMEM;
+				txc_libc_close(fildes);
+				txc_koa_unlock_alias_cache(koamgr);
+				ret = -1;
+				goto done;
+			}
 			txc_koa_lock_fd(koamgr, fildes);
 			txc_koa_attach_fd(koa_new, fildes, 0);
 			sentinel = txc_koa_get_sentinel(koa_new);
@@ -49,6 +49,7 @@
 #include <libc/syscalls.h>
 #include <core/txdesc.h>
 #include <xcalls/xcalls.h>
+#include <xcalls/offset.h>
 
 typedef struct x_dup_undo_args_s x_dup_undo_args_t;
 
@@ -147,6 +148,13 @@ XCALL_DEF(x_dup)(int oldfd, int *result)
 				TXC_INTERNALERROR("Never gets here. Transaction abort failed.\n");
 			}
 
+			/* The duplicate shares the file offset, so stop shadowing it. */
+			if (txc_offset_shadow_flush(koamgr, oldfd) < 0) {
+				txc_koa_unlock_fds_refby_koa(koa);
+				local_result = errno;
+				ret = -1;
+				goto done;
+			}
 			if ((ret = fildes = txc_libc_dup(oldfd)) < 0) { 
 				txc_koa_unlock_fds_refby_koa(koa);
 				local_result = errno;
@@ -49,6 +49,7 @@
 #include <libc/syscalls.h>
 #include <core/txdesc.h>
 #include <xcalls/xcalls.h>
+#include <xcalls/sync.h>
 
 
 #include <fcntl.h>
@@ -68,30 +69,6 @@
 #include <xcalls/xcalls.h>
 
 
-typedef struct x_fsync_commit_args_s x_fsync_commit_args_t;
-
-struct x_fsync_commit_args_s {
-	int       fd;
-};
-
-
-static
-void
-x_fsync_commit(void *args, int *result)
-{
-	x_fsync_commit_args_t *args_commit = (x_fsync_commit_args_t *) args;
-	int                   local_result = 0;
-
-	if (txc_libc_fsync(args_commit->fd) < 0)
-	{
-		local_result = errno;
-	}
-	if (result) {
-		*result = local_result;
-	}	
-}
-
-
 /**
  * \brief Synchronizes a file in-core state with storage device.
  * 
@@ -99,6 +76,9 @@ x_fsync_commit(void *args, int *result)
  *
  * <b> Asynchronous failures </b>: commit
  *
+ * The flush is issued after the transaction releases its sentinels and
+ * is shared with other transactions flushing the same file at commit.
+ *
  * \param[in] fildes The file's file descriptor.
  * \param[out] result Where to store any asynchronous failures.
  * \return 0 on success, or -1 if a synchronous failure occurred 
@@ -113,7 +93,6 @@ XCALL_DEF(x_fsync)(int fildes, int *result)
 	txc_sentinel_t        *sentinel;
 	txc_result_t          xret;
 	int                   ret;
-	x_fsync_commit_args_t *args_commit; 
 	int                   local_result = 0;
 
 	txd = txc_tx_get_txd();
@@ -143,19 +122,10 @@ XCALL_DEF(x_fsync)(int fildes, int *result)
 				txc_koa_unlock_fd(koamgr, fildes);
 			}
 
-			args_commit = (x_fsync_commit_args_t *)
-			              txc_buffer_linear_malloc(txd->buffer_linear, 
-			                                       sizeof(x_fsync_commit_args_t));
-			if (args_commit == NULL) {
+			if (txc_sync_register(txd, koa, fildes, 0, result) != TXC_R_SUCCESS) {
 				TXC_INTERNALERROR("Allocation failed. Linear buffer out of space.\n");
 			}
-			args_commit->fd = fildes;
-
-			txc_tx_register_commit_action(txd, x_fsync_commit, 
-			                              (void *) args_commit, result,
-			                              TXC_TX_REGULAR_COMMIT_ACTION_ORDER);
 
-			txc_koa_unlock_fd(koamgr, fildes);
 			ret = 0;
 			txc_stats_txstat_increment(txd, XCALL, x_fsync, 1);
 			break;
@@ -32,6 +32,8 @@
  * \file x_lseek.c
  *
  * \brief x_lseek implementation.
+ *
+ * Seeking a shadowed file offset (see offset.c) just updates the shadow.
  */
 
 #include <fcntl.h>
@@ -49,6 +51,7 @@
 #include <core/stats.h>
 #include <libc/syscalls.h>
 #include <xcalls/xcalls.h>
+#include <xcalls/offset.h>
 
 
 typedef struct x_lseek_undo_args_s x_lseek_undo_args_t;
@@ -106,9 +109,12 @@ XCALL_DEF(x_lseek)(int fd, off_t offset, int whence, int *result)
 	txc_koa_t           *koa;
 	txc_sentinel_t      *sentinel;
 	txc_result_t        xret;
-	int                 ret;
+	off_t               ret;
 	x_lseek_undo_args_t *args_undo;
 	int                 local_result;
+	txc_offset_shadow_t *shadow;
+	void                *pending;
+	struct stat         stat_buf;
 
 
 	txd = txc_tx_get_txd();
@@ -147,6 +153,70 @@ XCALL_DEF(x_lseek)(int fd, off_t offset, int whence, int *result)
 
 			/* Got sentinel. Continue with the rest of the stuff. */
 
+			if ((shadow = txc_offset_shadow_get(txd, koa, fd)) != NULL) {
+				switch (whence) {
+					case SEEK_SET:
+						ret = offset;
+						break;
+					case SEEK_CUR:
+						ret = shadow->offset + offset;
+						break;
+					case SEEK_END:
+						if (txc_libc_fstat(fd, &stat_buf) < 0) {
+							local_result = errno;
+							ret = -1;
+							goto done;
+						}
+						ret = stat_buf.st_size;
+						/* 
+						 * Deferred writes of this transaction may extend the
+						 * file past the end the kernel knows of.
+						 */
+						if ((pending = txc_koa_get_pending_output(koa)) != NULL &&
+						    txc_x_write_deferred_end(pending) > ret) 
+						{
+							ret = txc_x_write_deferred_end(pending);
+						}
+						ret += offset;
+						break;
+					default:
+						/* Let the kernel look for data or holes. */
+						shadow->kernel_moved = 1;
+						if (txc_libc_lseek(fd, shadow->offset, SEEK_SET) < 0 ||
+						    (ret = txc_libc_lseek(fd, offset, whence)) < 0) 
+						{
+							local_result = errno;
+							ret = -1;
+							goto done;
+						}
+				}
+				if (ret < 0) {
+					local_result = EINVAL;
+					ret = -1;
+					goto done;
+				}
+				shadow->offset = ret;
+				local_result = 0;
+				txc_stats_txstat_increment(txd, XCALL, x_lseek, 1);
+				goto done;
+			}
+
+			/* 
+			 * Consecutive seeks are undone by restoring the position saved
+			 * by the first of them.
+			 */
+			if (txc_tx_find_mergeable_undo_action(txd, fd, TXC_X_UNDO_LSEEK,
+			                                      TXC_TX_MERGE_ADJACENT) != NULL)
+			{
+				if ((ret = txc_libc_lseek(fd, offset, whence)) < 0) {
+					local_result = errno;
+					goto done;
+				}
+				local_result = 0;
+				txc_stats_txstat_increment(txd, XCALL, x_lseek, 1);
+				goto done;
+			}
+
 			if ((args_undo = (x_lseek_undo_args_t *)
 			                 txc_buffer_linear_malloc(txd->buffer_linear, 
 			                                          sizeof(x_lseek_undo_args_t)))
@@ -176,9 +246,10 @@ XCALL_DEF(x_lseek)(int fd, off_t offset, int whence, int *result)
 					goto error_handler_1;
 				}
 			}
-			txc_tx_register_undo_action(txd, x_lseek_undo, 
-			                            (void *) args_undo, result,
-			                            TXC_TX_REGULAR_UNDO_ACTION_ORDER);
+			txc_tx_register_mergeable_undo_action(txd, x_lseek_undo, 
+			                                      (void *) args_undo, result,
+			                                      TXC_TX_REGULAR_UNDO_ACTION_ORDER,
+			                                      fd, TXC_X_UNDO_LSEEK);
 			local_result = 0;
 			/* 
 			 * ret was assigned offset location as measured in bytes from the 
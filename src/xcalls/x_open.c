@@ -108,6 +108,7 @@ XCALL_DEF(x_open)(const char *pathname, int flags, mode_t mode, int *result)
 	ino_t              inode;
 	x_open_undo_args_t *args_undo; 
 	int                open_flags = O_RDWR | flags;
+	int                reused = 0;
 	int                local_result = 0;
 
 	txd = txc_tx_get_txd();
@@ -116,6 +117,11 @@ XCALL_DEF(x_open)(const char *pathname, int flags, mode_t mode, int *result)
 		case TXC_XACTSTATE_TRANSACTIONAL_RETRYABLE:
 			/* Serialize open/create/close file operations to detect aliasing */
 			txc_koa_lock_alias_cache(koamgr);
+			if ((local_result = txc_x_create_publish(txd, pathname)) != 0) {
+				txc_koa_unlock_alias_cache(koamgr);
+				ret = -1;
+				goto done;
+			}
 			txc_koa_path2inode(pathname, &inode);
 			if (inode == 0) {
 				/* File does not exist. */
@@ -124,7 +130,16 @@ XCALL_DEF(x_open)(const char *pathname, int flags, mode_t mode, int *result)
 				ret = -1;
 				goto done;
 			} else {
-				if ((ret = fildes = txc_libc_open(pathname, open_flags, mode)) < 0) { 
+				/* 
+				 * Prefer a descriptor of the file left open by an earlier
+				 * x_close over opening the file again.
+				 */
+				if (txc_koa_fdcache_reuse(koamgr, inode, open_flags, &fildes) 
+				    == TXC_R_SUCCESS) 
+				{
+					ret = fildes;
+					reused = 1;
+				} else if ((ret = fildes = txc_libc_open(pathname, open_flags, mode)) < 0) { 
 					txc_koa_unlock_alias_cache(koamgr);
 					local_result = errno;
 					goto done;
@@ -140,6 +155,10 @@ XCALL_DEF(x_open)(const char *pathname, int flags, mode_t mode, int *result)
 					txc_koa_lock_fds_refby_koa(koa);
 					txc_koa_lock_fd(koamgr, fildes);
 					txc_koa_attach_fd(koa, fildes, 0);
+					if (reused) {
+						/* Drop the reference the descriptor cache held. */
+						txc_koa_detach(koa);
+					}
 					sentinel = txc_koa_get_sentinel(koa);
 					xret = txc_sentinel_tryacquire(txd, sentinel, 0);
 					if (xret == TXC_R_BUSYSENTINEL) {
@@ -185,7 +204,16 @@ XCALL_DEF(x_open)(const char *pathname, int flags, mode_t mode, int *result)
 					 *   way for some other in-flight transaction to have a reference 
 					 *   to the file to operate on it.
 				 	 */
-					txc_koa_create(koamgr, &koa, TXC_KOA_IS_FILE, (void *) inode);
+					TXC_ASSERT(reused == 0);
+					if (txc_koa_create(koamgr, &koa, TXC_KOA_IS_FILE, (void *) inode)
+					    != TXC_R_SUCCESS)
+					{
+						txc_libc_close(fildes);
+						txc_koa_unlock_alias_cache(koamgr);
+						local_result = ENOMEM;
+						ret = -1;
+						goto done;
+					}
 					txc_koa_lock_fd(koamgr, fildes);
 					txc_koa_attach_fd(koa, fildes, 0);
 					sentinel = txc_koa_get_sentinel(koa);
@@ -223,19 +251,36 @@ XCALL_DEF(x_open)(const char *pathname, int flags, mode_t mode, int *result)
 			 * structures.
 			 */
 			txc_koa_lock_alias_cache(koamgr);
-			if ((ret = fildes = txc_libc_open(pathname, open_flags, mode)) < 0) { 
-				txc_koa_unlock_alias_cache(koamgr);
-				local_result = errno;
-				goto done;
-			}
 			txc_koa_path2inode(pathname, &inode);
+			if (inode != 0 && 
+			    txc_koa_fdcache_reuse(koamgr, inode, open_flags, &fildes) 
+			    == TXC_R_SUCCESS) 
+			{
+				reused = 1;
+			} else {
+				if ((ret = fildes = txc_libc_open(pathname, open_flags, mode)) < 0) { 
+					txc_koa_unlock_alias_cache(koamgr);
+					local_result = errno;
+					goto done;
+				}
+				txc_koa_path2inode(pathname, &inode);
+			}
 			if (txc_koa_alias_cache_lookup_inode(koamgr, inode, &koa) 
+			    != TXC_R_SUCCESS &&
+			    txc_koa_create(koamgr, &koa, TXC_KOA_IS_FILE, (void *) inode)
 			    != TXC_R_SUCCESS) 
 			{
-				txc_koa_create(koamgr, &koa, TXC_KOA_IS_FILE, (void *) inode);
+				txc_libc_close(fildes);
+				txc_koa_unlock_alias_cache(koamgr);
+				local_result = ENOMEM;
+				ret = -1;
+				goto done;
 			}	
 			txc_koa_lock_fd(koamgr, fildes);
 			txc_koa_attach_fd(koa, fildes, 0);
+			if (reused) {
+				txc_koa_detach(koa);
+			}
 			sentinel = txc_koa_get_sentinel(koa);
 			txc_koa_unlock_fd(koamgr, fildes);
 			txc_koa_unlock_alias_cache(koamgr);
@@ -91,6 +91,36 @@ x_pipe_undo(void *args, int *result)
 }
 
 
+/** 
+ * Creates the KOAs of both ends of a pipe. If a KOA cannot be created
+ * then the pipe is closed.
+ *
+ * \return 0 on success, or an errno value.
+ */
+static
+int
+x_pipe_create_koas(txc_koamgr_t *koamgr, int fildes[2], 
+                   txc_koa_t **koa0p, txc_koa_t **koa1p)
+{
+	if (txc_koa_create(koamgr, koa0p, TXC_KOA_IS_PIPE_READ_END, NULL) 
+	    != TXC_R_SUCCESS) 
+	{
+		goto err;
+	}
+	if (txc_koa_create(koamgr, koa1p, TXC_KOA_IS_PIPE_WRITE_END, NULL) 
+	    != TXC_R_SUCCESS) 
+	{
+		txc_koa_destroy(koa0p);
+		goto err;
+	}
+	return 0;
+err:
+	txc_libc_close(fildes[0]);
+	txc_libc_close(fildes[1]);
+	return ENOMEM;
+}
+
+
 /**
  * \brief Creates a pipe
  * 
@@ -127,8 +157,12 @@ XCALL_DEF(x_pipe)(int fildes[2], int *result)
 				local_result = errno;
 				goto done;
 			}
-			txc_koa_create(koamgr, &koa0, TXC_KOA_IS_PIPE_READ_END, NULL); 
-			txc_koa_create(koamgr, &koa1, TXC_KOA_IS_PIPE_WRITE_END, NULL);
+			if ((local_result = x_pipe_create_koas(koamgr, fildes, &koa0, &koa1)) 
+			    != 0) 
+			{
+				ret = -1;
+				goto done;
+			}
 			/* Always acquire locks in increasing order to avoid any deadlock */
 			if (fildes[0] < fildes[1]) {
 				txc_koa_lock_fd(koamgr, fildes[0]);
@@ -183,8 +217,12 @@ XCALL_DEF(x_pipe)(int fildes[2], int *result)
 				local_result = errno;
 				goto done;
 			}
-			txc_koa_create(koamgr, &koa0, TXC_KOA_IS_PIPE_READ_END, NULL); 
-			txc_koa_create(koamgr, &koa1, TXC_KOA_IS_PIPE_WRITE_END, NULL);
+			if ((local_result = x_pipe_create_koas(koamgr, fildes, &koa0, &koa1)) 
+			    != 0) 
+			{
+				ret = -1;
+				goto done;
+			}
 			/* Always acquire locks in increasing order to avoid any deadlock */
 			if (fildes[0] < fildes[1]) {
 				txc_koa_lock_fd(koamgr, fildes[0]);
@@ -0,0 +1,222 @@
+/*
+    Copyright (C) 2008-2009 Computer Sciences Department, 
+    University of Wisconsin -- Madison
+
+    ----------------------------------------------------------------------
+
+    This file is part of the xCalls transactional API, originally 
+    developed at the University of Wisconsin -- Madison.
+
+    xCalls was originally developed primarily by Haris Volos and 
+    Neelam Goyal with contributions from Andres Jaan Tack.
+
+    ----------------------------------------------------------------------
+
+    xCalls is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as 
+    published by the Free Software Foundation, either version 3 of 
+    the License, or (at your option) any later version.
+
+    xCalls is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public 
+    License along with xCalls.  If not, see <http://www.gnu.org/licenses/>.
+
+### END HEADER ###
+*/
+
+/**
+ * \file x_pread.c
+ *
+ * \brief x_pread, x_preadv implementation.
+ *
+ * Positional reads leave the file offset alone, so there is nothing to 
+ * undo on abort.
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/uio.h>
+#include <misc/debug.h>
+#include <misc/errno.h>
+#include <core/tx.h>
+#include <core/config.h>
+#include <core/koa.h>
+#include <core/buffer.h>
+#include <core/stats.h>
+#include <libc/syscalls.h>
+#include <core/txdesc.h>
+#include <xcalls/xcalls.h>
+
+
+/** 
+ * Overlays the deferred writes pending on a file onto data read into 
+ * an iovec, and returns the number of bytes the transaction reads.
+ */
+static
+ssize_t
+x_preadv_overlay(void *pending, const struct iovec *iov, int iovcnt, 
+                 off_t offset, ssize_t nread)
+{
+	ssize_t len = nread;
+	ssize_t seg_start = 0;
+	ssize_t seg_nread;
+	ssize_t seg_len;
+	int     i;
+
+	for (i=0; i<iovcnt; i++) {
+		seg_nread = nread - seg_start;
+		if (seg_nread < 0) {
+			seg_nread = 0;
+		} else if (seg_nread > (ssize_t) iov[i].iov_len) {
+			seg_nread = iov[i].iov_len;
+		}
+		seg_len = txc_x_write_deferred_overlay(pending, iov[i].iov_base, 
+		                                       iov[i].iov_len, 
+		                                       offset + seg_start, seg_nread);
+		if (seg_start + seg_len > len) {
+			len = seg_start + seg_len;
+		}
+		seg_start += iov[i].iov_len;
+	}
+	return len;
+}
+
+
+static
+ssize_t 
+x_preadv(int fd, const struct iovec *iov, int iovcnt, off_t offset, 
+         int *result, int vectored)
+{
+	txc_tx_t           *txd;
+	txc_koamgr_t       *koamgr = txc_g_koamgr;
+	txc_koa_t          *koa;
+	txc_sentinel_t     *sentinel;
+	txc_result_t       xret;
+	ssize_t            ret;
+	void               *pending;
+	int                local_result;
+
+
+	txd = txc_tx_get_txd();
+
+	switch(txc_tx_get_xactstate(txd)) {
+		case TXC_XACTSTATE_TRANSACTIONAL_IRREVOCABLE:
+		case TXC_XACTSTATE_NONTRANSACTIONAL:
+			if ((ret = txc_libc_preadv(fd, iov, iovcnt, offset)) < 0) {
+				local_result = errno;
+			} else {
+				local_result = 0;
+			}
+			goto done;
+
+		case TXC_XACTSTATE_TRANSACTIONAL_RETRYABLE:
+			txc_koa_lock_fd(koamgr, fd);
+			xret = txc_koa_lookup_fd2koa(koamgr, fd, &koa);
+			if (xret == TXC_R_FAILURE) {
+				/* 
+				 * The KOA mapped to the file descriptor has gone. Report
+				 * this error as invalid file descriptor.
+				 */
+				txc_koa_unlock_fd(koamgr, fd);
+				local_result = EBADF;
+				ret = -1;
+				goto done;
+			}
+			sentinel = txc_koa_get_sentinel(koa);
+			xret = txc_sentinel_tryacquire(txd, sentinel, 
+			                               TXC_SENTINEL_ACQUIREONRETRY);
+			txc_koa_unlock_fd(koamgr, fd);
+			if (xret == TXC_R_BUSYSENTINEL) {
+				txc_tx_abort_transaction(txd, TXC_ABORTREASON_BUSYSENTINEL);
+				TXC_INTERNALERROR("Never gets here. Transaction abort failed.\n");
+			}
+
+			/* Got sentinel. Continue with the rest of the stuff. */
+
+			if ((ret = txc_libc_preadv(fd, iov, iovcnt, offset)) < 0) {
+				local_result = errno;
+				goto done;
+			}
+			/* Deferred writes of this transaction are read back too. */
+			if (txc_koa_get_type(koa) == TXC_KOA_IS_FILE &&
+			    (pending = txc_koa_get_pending_output(koa)) != NULL) 
+			{
+				ret = x_preadv_overlay(pending, iov, iovcnt, offset, ret);
+			}
+			local_result = 0;
+			if (vectored) {
+				txc_stats_txstat_increment(txd, XCALL, x_preadv, 1);
+			} else {
+				txc_stats_txstat_increment(txd, XCALL, x_pread, 1);
+			}
+			goto done;
+
+		default:
+			TXC_INTERNALERROR("Unknown transaction state\n");
+	}
+
+done:
+	if (result) {
+		*result = local_result;
+	}
+	return ret;
+}
+
+
+/**
+ * \brief Reads from a file at a given offset.
+ * 
+ * <b> Execution </b>: in-place
+ *
+ * <b> Asynchronous failures </b>: none
+ *
+ * The file offset is not changed.
+ *
+ * \param[in] fd The file descriptor of the file to read from.
+ * \param[in] buf The buffer where to store read data.
+ * \param[in] nbyte The number of bytes to read.
+ * \param[in] offset The file offset to read from.
+ * \param[out] result Where to store any asynchronous failures.
+ * \return The number of read bytes on success, or -1 if a synchronous failure occurred 
+ * (in which case, errno is set appropriately).
+ */
+ssize_t 
+XCALL_DEF(x_pread)(int fd, void *buf, size_t nbyte, off_t offset, int *result)
+{
+	struct iovec iov;
+
+	iov.iov_base = buf;
+	iov.iov_len = nbyte;
+	return x_preadv(fd, &iov, 1, offset, result, 0);
+}
+
+
+/**
+ * \brief Reads from a file at a given offset into multiple buffers.
+ * 
+ * <b> Execution </b>: in-place
+ *
+ * <b> Asynchronous failures </b>: none
+ *
+ * The file offset is not changed.
+ *
+ * \param[in] fd The file descriptor of the file to read from.
+ * \param[in] iov The buffers where to store read data.
+ * \param[in] iovcnt The number of buffers.
+ * \param[in] offset The file offset to read from.
+ * \param[out] result Where to store any asynchronous failures.
+ * \return The number of read bytes on success, or -1 if a synchronous failure occurred 
+ * (in which case, errno is set appropriately).
+ */
+ssize_t 
+XCALL_DEF(x_preadv)(int fd, const struct iovec *iov, int iovcnt, off_t offset, int *result)
+{
+	return x_preadv(fd, iov, iovcnt, offset, result, 1);
+}
@@ -141,7 +141,7 @@ XCALL_DEF(x_pthread_create)(pthread_t *thread,
 
 	switch(txc_tx_get_xactstate(txd)) {
 		case TXC_XACTSTATE_TRANSACTIONAL_RETRYABLE:
-			control_block = (x_pthread_create_control_block_t *) MALLOC(sizeof(x_pthread_create_control_block_t));
+			control_block = (x_pthread_create_control_block_t *) MALLOC(TXC_MALLOC_XCALL, sizeof(x_pthread_create_control_block_t));
 
 			control_block->arg = arg;
 			control_block->start = start_routine;
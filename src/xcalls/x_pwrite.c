@@ -0,0 +1,392 @@
+/*
+    Copyright (C) 2008-2009 Computer Sciences Department, 
+    University of Wisconsin -- Madison
+
+    ----------------------------------------------------------------------
+
+    This file is part of the xCalls transactional API, originally 
+    developed at the University of Wisconsin -- Madison.
+
+    xCalls was originally developed primarily by Haris Volos and 
+    Neelam Goyal with contributions from Andres Jaan Tack.
+
+    ----------------------------------------------------------------------
+
+    xCalls is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as 
+    published by the Free Software Foundation, either version 3 of 
+    the License, or (at your option) any later version.
+
+    xCalls is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public 
+    License along with xCalls.  If not, see <http://www.gnu.org/licenses/>.
+
+### END HEADER ###
+*/
+
+/**
+ * \file x_pwrite.c
+ *
+ * \brief x_pwrite, x_pwritev implementation.
+ *
+ * Positional writes leave the file offset alone. The undo action writes
+ * the overwritten data back at the same offset and truncates the file 
+ * back if the write extended it, without seeking.
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <misc/debug.h>
+#include <misc/errno.h>
+#include <core/tx.h>
+#include <core/config.h>
+#include <core/koa.h>
+#include <core/buffer.h>
+#include <core/txdesc.h>
+#include <core/stats.h>
+#include <core/journal.h>
+#include <libc/syscalls.h>
+#include <xcalls/xcalls.h>
+
+
+typedef struct x_pwrite_undo_args_s x_pwrite_undo_args_t;
+
+struct x_pwrite_undo_args_s {
+	int                 fd;
+	off_t               offset;
+	void                *buf;
+	size_t              nbyte_old;
+	off_t               old_size;      /**< File size to truncate back to; -1 if the write did not extend the file */
+	txc_buffer_linear_t *spill_buffer; /**< Buffer keeping the old data in its spill file, if not in buf */
+	off_t               spill_offset;
+	int                 spill_cloned;  /**< Whether the old data are in the clone file of spill_buffer */
+};
+
+
+static
+void
+x_pwrite_undo(void *args, int *result)
+{
+	x_pwrite_undo_args_t *args_undo = (x_pwrite_undo_args_t *) args;
+	int                  local_result = 0;
+
+	if (args_undo->nbyte_old > 0) {
+		if (args_undo->spill_buffer && args_undo->spill_cloned) {
+			if (txc_buffer_linear_unclone(args_undo->spill_buffer, 
+			                              args_undo->spill_offset, 
+			                              args_undo->fd, 
+			                              args_undo->nbyte_old, 
+			                              args_undo->offset) < 0)
+			{
+				local_result = errno;
+				goto done;
+			}
+		} else if (args_undo->spill_buffer) {
+			if (txc_buffer_linear_unspill(args_undo->spill_buffer, 
+			                              args_undo->spill_offset, 
+			                              args_undo->fd, 
+			                              args_undo->nbyte_old, 
+			                              args_undo->offset) < 0)
+			{
+				local_result = errno;
+				goto done;
+			}
+		} else if (txc_libc_pwrite(args_undo->fd, args_undo->buf, 
+		                           args_undo->nbyte_old, 
+		                           args_undo->offset) < 0)
+		{
+			local_result = errno;
+			goto done;
+		}
+	}
+	if (args_undo->old_size >= 0) {
+		if (txc_libc_ftruncate(args_undo->fd, args_undo->old_size) < 0) {
+			local_result = errno;
+		}
+	}
+done:
+	if (result) {
+		*result = local_result;
+	}	
+}
+
+
+static
+ssize_t 
+x_pwritev(int fd, const struct iovec *iov, int iovcnt, off_t offset, 
+          int *result, int vectored)
+{
+	txc_tx_t             *txd;
+	txc_koamgr_t         *koamgr = txc_g_koamgr;
+	txc_koa_t            *koa;
+	txc_sentinel_t       *sentinel;
+	txc_result_t         xret;
+	ssize_t              ret;
+	x_pwrite_undo_args_t *args_undo;
+	void                 *old_data = NULL;
+	void                 *pending;
+	size_t               nbyte;
+	struct stat          stat_buf;
+	int                  local_result;
+	int                  i;
+	int                  flags;
+	size_t               journaled;
+	size_t               len;
+
+
+	txd = txc_tx_get_txd();
+
+	switch(txc_tx_get_xactstate(txd)) {
+		case TXC_XACTSTATE_TRANSACTIONAL_IRREVOCABLE:
+		case TXC_XACTSTATE_NONTRANSACTIONAL:
+			if ((ret = txc_libc_pwritev(fd, iov, iovcnt, offset)) < 0) {
+				local_result = errno;
+			} else {
+				local_result = 0;
+			}
+			goto done;
+
+		case TXC_XACTSTATE_TRANSACTIONAL_RETRYABLE:
+			txc_koa_lock_fd(koamgr, fd);
+			xret = txc_koa_lookup_fd2koa(koamgr, fd, &koa);
+			if (xret == TXC_R_FAILURE) {
+				/* 
+				 * The KOA mapped to the file descriptor has gone. Report
+				 * this error as invalid file descriptor.
+				 */
+				txc_koa_unlock_fd(koamgr, fd);
+				local_result = EBADF;
+				ret = -1;
+				goto done;
+			}
+			sentinel = txc_koa_get_sentinel(koa);
+			xret = txc_sentinel_tryacquire(txd, sentinel, 
+			                               TXC_SENTINEL_ACQUIREONRETRY);
+			txc_koa_unlock_fd(koamgr, fd);
+			if (xret == TXC_R_BUSYSENTINEL) {
+				txc_tx_abort_transaction(txd, TXC_ABORTREASON_BUSYSENTINEL);
+				TXC_INTERNALERROR("Never gets here. Transaction abort failed.\n");
+			}
+
+			/* Got sentinel. Continue with the rest of the stuff. */
+
+			/* 
+			 * The kernel appends to O_APPEND descriptors whatever the 
+			 * offset, so the old data saved at offset would be restored
+			 * over the wrong range on abort.
+			 */
+			if ((flags = txc_libc_fcntl_getfl(fd)) < 0) {
+				local_result = errno;
+				ret = -1;
+				goto error_handler_0;
+			}
+			if (flags & O_APPEND) {
+				local_result = EINVAL;
+				ret = -1;
+				goto error_handler_0;
+			}
+			for (i=0, nbyte=0; i<iovcnt; i++) {
+				nbyte += iov[i].iov_len;
+			}
+			if (txc_koa_get_type(koa) == TXC_KOA_IS_FILE &&
+			    (pending = txc_koa_get_pending_output(koa)) != NULL) 
+			{
+				/* 
+				 * Writing in place over deferred data; drop the deferred 
+				 * data so that the commit does not write them back over.
+				 */
+				if (txc_x_write_deferred_discard(pending, txd->buffer_linear, 
+				                                 offset, nbyte) < 0) 
+				{
+					local_result = ENOMEM;
+					ret = -1;
+					goto error_handler_0;
+				}
+			}
+			if ((args_undo = (x_pwrite_undo_args_t *)
+			                 txc_buffer_linear_malloc(txd->buffer_linear, 
+			                                          sizeof(x_pwrite_undo_args_t)))
+			    == NULL)
+			{	
+				local_result = ENOMEM;
+				ret = -1;
+				goto error_handler_0;
+			}
+			args_undo->fd = fd;
+			args_undo->offset = offset;
+			args_undo->spill_buffer = NULL;
+			args_undo->spill_cloned = 0;
+			if (txc_g_journalmgr &&
+			    (local_result = txc_journal_log_undo_write(txc_g_journalmgr, txd, fd, 
+			                                               offset, nbyte)) != 0)
+			{
+				ret = -1;
+				goto error_handler_1;
+			}
+			if (txc_buffer_linear_clonable(nbyte) &&
+			    (ret = txc_buffer_linear_clone(txd->buffer_linear, fd, 
+			                                   nbyte, offset,
+			                                   &args_undo->spill_offset))
+			    >= 0)
+			{
+				/* Kept next to the file, without going through memory. */
+				args_undo->spill_buffer = txd->buffer_linear;
+				args_undo->spill_cloned = 1;
+			} else if (txc_buffer_linear_spillable(nbyte) || 
+			           txc_buffer_linear_clonable(nbyte)) 
+			{
+				/* 
+				 * Too much data to keep in memory. Keep them in the
+				 * spill file; they are read back only on abort.
+				 */
+				if ((ret = txc_buffer_linear_spill(txd->buffer_linear, fd, 
+				                                   nbyte, offset,
+				                                   &args_undo->spill_offset)) 
+				    < 0)
+				{
+					local_result = errno;
+					goto error_handler_1;
+				}
+				args_undo->spill_buffer = txd->buffer_linear;
+			} else {
+				if ((old_data = (void *) txc_buffer_linear_malloc(txd->buffer_linear, 
+				                                                  nbyte))
+				    == NULL) 
+				{
+					local_result = ENOMEM;
+					ret = -1;
+					goto error_handler_1;
+				}
+				if ((ret = txc_libc_pread(fd, old_data, nbyte, offset)) < 0) {
+					local_result = errno;
+					goto error_handler_2;					   
+				}
+			}
+			args_undo->buf = old_data;
+			args_undo->nbyte_old = ret;
+			args_undo->old_size = -1;
+			if (args_undo->nbyte_old < nbyte) {
+				/* The write runs past the end of the file. */
+				if (txc_libc_fstat(fd, &stat_buf) < 0) {
+					local_result = errno;
+					ret = -1;
+					goto error_handler_2;
+				}
+				args_undo->old_size = stat_buf.st_size;
+			}
+			if ((ret = txc_libc_pwritev(fd, iov, iovcnt, offset)) < 0) {
+				local_result = errno;
+				goto error_handler_2;
+			}
+			txc_tx_register_undo_action(txd, x_pwrite_undo, 
+			                            (void *) args_undo, result,
+			                            TXC_TX_REGULAR_UNDO_ACTION_ORDER);
+			local_result = 0;
+			for (i=0, journaled=0; txc_g_journalmgr && journaled < (size_t) ret; i++) {
+				len = iov[i].iov_len;
+				if (len > ret - journaled) {
+					len = ret - journaled;
+				}
+				if ((local_result = txc_journal_log_write(txc_g_journalmgr, txd, fd, 
+				                                          offset + journaled,
+				                                          iov[i].iov_base, len)) != 0)
+				{
+					ret = -1;
+					break;
+				}
+				journaled += len;
+			}
+			if (vectored) {
+				txc_stats_txstat_increment(txd, XCALL, x_pwritev, 1);
+			} else {
+				txc_stats_txstat_increment(txd, XCALL, x_pwrite, 1);
+			}
+			goto done;
+
+		default:
+			TXC_INTERNALERROR("Unknown transaction state\n");
+	}
+
+error_handler_2:
+	if (old_data) {
+		txc_buffer_linear_free(txd->buffer_linear, nbyte);
+	}
+error_handler_1:
+	txc_buffer_linear_free(txd->buffer_linear,
+		                   sizeof(x_pwrite_undo_args_t));
+error_handler_0:
+done:
+	if (result) {
+		*result = local_result;
+	}
+	return ret;
+}
+
+
+/**
+ * \brief Writes to a file at a given offset, while it saves any 
+ * overwritten data.
+ * 
+ * <b> Execution </b>: in-place
+ *
+ * <b> Asynchronous failures </b>: abort
+ *
+ * The file offset is not changed. Within a transaction, descriptors 
+ * opened with O_APPEND fail with EINVAL, as the kernel appends the data 
+ * whatever the offset.
+ *
+ * \param[in] fd The file descriptor of the file.
+ * \param[in] buf The buffer that has the data to be written.
+ * \param[in] nbyte The number of bytes to write.
+ * \param[in] offset The file offset to write at.
+ * \param[out] result Where to store any asynchronous failures.
+ * \return The number of written bytes on success, or -1 if a synchronous failure occurred 
+ * (in which case, errno is set appropriately).
+ */
+ssize_t 
+XCALL_DEF(x_pwrite)(int fd, const void *buf, size_t nbyte, off_t offset, int *result)
+{
+	struct iovec iov;
+
+	/* The data are only read; drop the qualifier through an integer. */
+	iov.iov_base = (void *) (uintptr_t) buf;
+	iov.iov_len = nbyte;
+	return x_pwritev(fd, &iov, 1, offset, result, 0);
+}
+
+
+/**
+ * \brief Writes multiple buffers to a file at a given offset, while it 
+ * saves any overwritten data.
+ * 
+ * <b> Execution </b>: in-place
+ *
+ * <b> Asynchronous failures </b>: abort
+ *
+ * The file offset is not changed. Within a transaction, descriptors 
+ * opened with O_APPEND fail with EINVAL, as the kernel appends the data 
+ * whatever the offset.
+ *
+ * \param[in] fd The file descriptor of the file.
+ * \param[in] iov The buffers that have the data to be written.
+ * \param[in] iovcnt The number of buffers.
+ * \param[in] offset The file offset to write at.
+ * \param[out] result Where to store any asynchronous failures.
+ * \return The number of written bytes on success, or -1 if a synchronous failure occurred 
+ * (in which case, errno is set appropriately).
+ */
+ssize_t 
+XCALL_DEF(x_pwritev)(int fd, const struct iovec *iov, int iovcnt, off_t offset, int *result)
+{
+	return x_pwritev(fd, iov, iovcnt, offset, result, 1);
+}
@@ -32,6 +32,9 @@
  * \file x_read.c
  *
  * \brief x_read implementation.
+ *
+ * Reads at a shadowed file offset (see offset.c) use pread and need no 
+ * undo action.
  */
 
 #include <fcntl.h>
@@ -49,6 +52,7 @@
 #include <libc/syscalls.h>
 #include <core/txdesc.h>
 #include <xcalls/xcalls.h>
+#include <xcalls/offset.h>
 
 
 typedef struct x_read_undo_args_s x_read_undo_args_t;
@@ -102,6 +106,8 @@ XCALL_DEF(x_read)(int fd, void *buf, size_t nbyte, int *result)
 	int                ret;
 	x_read_undo_args_t *args_undo;
 	int                local_result;
+	txc_offset_shadow_t *shadow;
+	void               *pending;
 
 
 	txd = txc_tx_get_txd();
@@ -140,6 +146,38 @@ XCALL_DEF(x_read)(int fd, void *buf, size_t nbyte, int *result)
 
 			/* Got sentinel. Continue with the rest of the stuff. */
 
+			if ((shadow = txc_offset_shadow_get(txd, koa, fd)) != NULL) {
+				if ((ret = txc_libc_pread(fd, buf, nbyte, shadow->offset)) < 0) {
+					local_result = errno;
+					goto done;
+				}
+				/* Deferred writes of this transaction are read back too. */
+				if ((pending = txc_koa_get_pending_output(koa)) != NULL) {
+					ret = txc_x_write_deferred_overlay(pending, buf, nbyte, 
+					                                   shadow->offset, ret);
+				}
+				shadow->offset += ret;
+				local_result = 0;
+				txc_stats_txstat_increment(txd, XCALL, x_read, 1);
+				goto done;
+			}
+
+			/* Consecutive reads move the offset back in one go on abort. */
+			if ((args_undo = (x_read_undo_args_t *) 
+			                 txc_tx_find_mergeable_undo_action(txd, fd, TXC_X_UNDO_READ,
+			                                                   TXC_TX_MERGE_ADJACENT))
+			    != NULL)
+			{
+				if ((ret = txc_libc_read(fd, buf, nbyte)) < 0) {
+					local_result = errno;
+					goto done;
+				}
+				args_undo->nbyte += ret;
+				local_result = 0;
+				txc_stats_txstat_increment(txd, XCALL, x_read, 1);
+				goto done;
+			}
+
 			if ((args_undo = (x_read_undo_args_t *)
 			                 txc_buffer_linear_malloc(txd->buffer_linear, 
 			                                          sizeof(x_read_undo_args_t)))
@@ -155,9 +193,10 @@ XCALL_DEF(x_read)(int fd, void *buf, size_t nbyte, int *result)
 				goto error_handler_1;
 			}
 			args_undo->nbyte = ret;
-			txc_tx_register_undo_action(txd, x_read_undo, 
-			                            (void *) args_undo, result,
-			                            TXC_TX_REGULAR_UNDO_ACTION_ORDER);
+			txc_tx_register_mergeable_undo_action(txd, x_read_undo, 
+			                                      (void *) args_undo, result,
+			                                      TXC_TX_REGULAR_UNDO_ACTION_ORDER,
+			                                      fd, TXC_X_UNDO_READ);
 			local_result = 0;
 			txc_stats_txstat_increment(txd, XCALL, x_read, 1);
 			goto done;
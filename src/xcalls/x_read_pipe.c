@@ -39,6 +39,7 @@
 #include <errno.h>
 #include <string.h>
 #include <stdlib.h>
+#include <sys/ioctl.h>
 #include <misc/debug.h>
 #include <misc/errno.h>
 #include <misc/generic_types.h>
@@ -55,8 +56,8 @@
 typedef struct x_read_pipe_commit_undo_args_s x_read_pipe_commit_undo_args_t;
 
 struct x_read_pipe_commit_undo_args_s {
-	txc_koa_t             *koa;
-	txc_buffer_circular_t *buffer;
+	txc_koa_t         *koa;
+	txc_buffer_ring_t *buffer;
 };
 
 
@@ -67,7 +68,7 @@ x_read_pipe_undo(void *args, int *result)
 	x_read_pipe_commit_undo_args_t *args_undo = (x_read_pipe_commit_undo_args_t *) args;
 	int                            local_result = 0;
 
-	args_undo->buffer->state = TXC_BUFFER_STATE_NON_SPECULATIVE;
+	txc_buffer_ring_abort(args_undo->buffer);
 	if (result) {
 		*result = local_result;
 	}
@@ -80,28 +81,39 @@ x_read_pipe_commit(void *args, int *result)
 {
 	x_read_pipe_commit_undo_args_t *args_commit = (x_read_pipe_commit_undo_args_t *) args;
 	int                            local_result = 0;
-	txc_buffer_circular_t          *buffer;
 
-	buffer = args_commit->buffer;
-
-	if (buffer->speculative_primary_tail != buffer->speculative_primary_head) {
-		buffer->primary_head = buffer->speculative_primary_head; 
-		buffer->primary_tail = buffer->speculative_primary_tail; 
-	} else if (buffer->speculative_secondary_tail != buffer->speculative_secondary_head) {
-		buffer->primary_head = buffer->speculative_secondary_head; 
-		buffer->primary_tail = buffer->speculative_secondary_tail; 
-		buffer->secondary_head = buffer->secondary_tail = 0;
-	} else {
-		buffer->primary_head = buffer->primary_tail = 0;
-		buffer->secondary_head = buffer->secondary_tail = 0;
-	}
-	buffer->state = TXC_BUFFER_STATE_NON_SPECULATIVE;
+	txc_buffer_ring_commit(args_commit->buffer);
 	if (result) {
 		*result = local_result;
 	}
 }
 
 
+/**
+ * \brief Reads from a pipe without blocking the bytes already in the pipe.
+ *
+ * Used to top up a request partially served from the buffer: blocking 
+ * there would keep the caller waiting for data it did not need to see yet.
+ *
+ * \return The number of bytes read, 0 if the pipe is empty, or -1 on 
+ * failure.
+ */
+static
+ssize_t
+pipe_read_ready(int fd, void *buf, size_t nbyte)
+{
+	int ready;
+
+	if (ioctl(fd, FIONREAD, &ready) < 0) {
+		return -1;
+	}
+	if (ready <= 0) {
+		return 0;
+	}
+	return txc_libc_read(fd, buf, ((size_t) ready < nbyte) ? (size_t) ready : nbyte);
+}
+
+
 static 
 ssize_t 
 __txc_read_pipe(txc_tx_t *txd, txc_bool_t speculative_read,
@@ -111,21 +123,13 @@ __txc_read_pipe(txc_tx_t *txd, txc_bool_t speculative_read,
 	txc_koa_t                      *koa;
 	txc_sentinel_t                 *sentinel;
 	txc_result_t                   xret;
-	int                            ret;
+	ssize_t                        ret;
 	x_read_pipe_commit_undo_args_t *args_commit_undo;
 	int                            local_result = 0;
-	int                            store_in_primary_buffer;
-	int                            store_in_secondary_buffer;
-	int                            hdr_base_index;
-	int                            needed_bytes;
-	txc_buffer_circular_t          *buffer;
-
-	
-	/* 
-	 * FIXME: We don't handle the case where we need to consume more data 
-	 * than available in the buffer. In such a case you need to request
-	 * the additional data.
-	 */
+	ssize_t                        fresh;
+	unsigned int                   available;
+	unsigned int                   space;
+	txc_buffer_ring_t              *buffer;
 
 	txc_koa_lock_fd(koamgr, fd);
 	xret = txc_koa_lookup_fd2koa(koamgr, fd, &koa);
@@ -139,123 +143,105 @@ __txc_read_pipe(txc_tx_t *txd, txc_bool_t speculative_read,
 		ret = -1;
 		goto done;
 	}
-	buffer = (txc_buffer_circular_t *) txc_koa_get_buffer(koa);
+	buffer = (txc_buffer_ring_t *) txc_koa_get_buffer(koa);
 
 	if (!speculative_read) {
 		txc_koa_unlock_fd(koamgr, fd);
-		if ((buffer->primary_tail != buffer->primary_head) ||
-		    (buffer->secondary_tail != buffer->secondary_head)) {
-			/* There are buffered data available */
-			if (buffer->primary_tail != buffer->primary_head) {
-				/* Consume data from the primary buffer */
-				hdr_base_index = buffer->primary_head;
-				buffer->primary_head += nbyte;
-			} else {
-				/* Consume data from the secondary buffer and make the secondary 
-				 * buffer primary 
-				 */
-				hdr_base_index = buffer->secondary_head;
-				buffer->secondary_head += nbyte;
-				buffer->primary_tail = buffer->secondary_tail; 
-				buffer->primary_head = buffer->secondary_head; 
-				buffer->secondary_head = buffer->secondary_tail = 0;
+		if ((available = txc_buffer_ring_used(buffer, 0)) == 0) {
+			if ((ret = txc_libc_read(fd, buf, nbyte)) < 0) {
+				local_result = errno;
 			}
-			/* Now fall through to do the copy */
-		} else { 
-			ret = txc_libc_read(fd, buf, nbyte);
-			local_result = errno;
 			goto done;
 		}
-	} else {
-		/* READ is speculative */		
-		sentinel = txc_koa_get_sentinel(koa);
-		xret = txc_sentinel_tryacquire(txd, sentinel, 
-									   TXC_SENTINEL_ACQUIREONRETRY);
-		txc_koa_unlock_fd(koamgr, fd);
-		if (xret == TXC_R_BUSYSENTINEL) {
-			txc_tx_abort_transaction(txd, TXC_ABORTREASON_BUSYSENTINEL);
-			TXC_INTERNALERROR("Never gets here. Transaction abort failed.\n");
+		/* Consume data left in the buffer by transactions first. */
+		ret = (nbyte < available) ? nbyte : available;
+		memcpy(buf, txc_buffer_ring_head_ptr(buffer, 0), ret); 
+		txc_buffer_ring_consume(buffer, ret, 0);
+		if (ret < nbyte && 
+		    (fresh = pipe_read_ready(fd, (char *) buf + ret, nbyte - ret)) > 0) 
+		{
+			ret += fresh;
 		}
+		goto done;
+	} 
+
+	/* READ is speculative */		
+	sentinel = txc_koa_get_sentinel(koa);
+	xret = txc_sentinel_tryacquire(txd, sentinel, 
+	                               TXC_SENTINEL_ACQUIREONRETRY);
+	txc_koa_unlock_fd(koamgr, fd);
+	if (xret == TXC_R_BUSYSENTINEL) {
+		txc_tx_abort_transaction(txd, TXC_ABORTREASON_BUSYSENTINEL);
+		TXC_INTERNALERROR("Never gets here. Transaction abort failed.\n");
+	}
 
-		/* Got sentinel. Continue with the rest of the stuff. */
-		if (buffer->state == TXC_BUFFER_STATE_NON_SPECULATIVE) {
-			if ((args_commit_undo = (x_read_pipe_commit_undo_args_t *)
-									 txc_buffer_linear_malloc(txd->buffer_linear, 
-															  sizeof(x_read_pipe_commit_undo_args_t)))
-				 == NULL)
-			{
-				local_result = ENOMEM;
-				ret = -1;
-				goto done;
-			}
-			buffer->speculative_primary_head = buffer->primary_head;
-			buffer->speculative_primary_tail = buffer->primary_tail;
-			buffer->speculative_secondary_head = buffer->secondary_head;
-			buffer->speculative_secondary_tail = buffer->secondary_tail;
-			buffer->state = TXC_BUFFER_STATE_SPECULATIVE;
-
-			args_commit_undo->koa = koa;
-			args_commit_undo->buffer = buffer;
-
-			txc_tx_register_commit_action(txd, x_read_pipe_commit, 
-										  (void *) args_commit_undo, result,
-										  TXC_TX_REGULAR_COMMIT_ACTION_ORDER);
-			txc_tx_register_undo_action(txd, x_read_pipe_undo, 
-										(void *) args_commit_undo, result,
-										TXC_TX_REGULAR_UNDO_ACTION_ORDER);
+	/* Got sentinel. Continue with the rest of the stuff. */
+	if (buffer->state == TXC_BUFFER_STATE_NON_SPECULATIVE) {
+		if ((args_commit_undo = (x_read_pipe_commit_undo_args_t *)
+		                        txc_buffer_linear_malloc(txd->buffer_linear, 
+		                                                 sizeof(x_read_pipe_commit_undo_args_t)))
+		    == NULL)
+		{
+			local_result = ENOMEM;
+			ret = -1;
+			goto done;
 		}
+		txc_buffer_ring_speculate(buffer);
 
-		if (buffer->speculative_primary_tail != buffer->speculative_primary_head ||
-				buffer->speculative_secondary_tail != buffer->speculative_secondary_head) {
-			/* There are buffered data available to consume*/
-			if (buffer->speculative_primary_tail != buffer->speculative_primary_head) {
-				/* Consume data from the primary buffer */
-				hdr_base_index = buffer->speculative_primary_head;
-				buffer->speculative_primary_head += nbyte;
-			} else {
-				/* Consume data from the secondary buffer */
-				hdr_base_index = buffer->speculative_secondary_head;
-				buffer->speculative_secondary_head += nbyte;
-			}
-			ret = nbyte;
-		} else { 
-			/* No buffered data available 
-			 * 1) Find space in the buffer
-			 * 3) Issue a read call to the kernel to bring the data in the buffer
-			 * 4) Copy the buffered data back to the application buffer
-			 */
-			needed_bytes = nbyte; 
-			store_in_primary_buffer = store_in_secondary_buffer = 0;
-			if (buffer->primary_tail < (buffer->size_max - needed_bytes)) {
-				/* There is space in the primary part of the buffer */
-				hdr_base_index = buffer->primary_tail;
-				store_in_primary_buffer = 1;
-			}	else if (buffer->secondary_tail < 
-													(buffer->primary_head + 1 - needed_bytes)) {
-				/* There is space in the secondary part of the buffer */
-				hdr_base_index = buffer->secondary_tail;
-				store_in_secondary_buffer = 1;
-			} else {
-				/* There is not space in the buffer */
-				local_result = ENOMEM;
-				ret = -1;
-				goto done;
-			}
-			ret = txc_libc_read(fd, &(buffer->buf[hdr_base_index]), nbyte);
-			if (ret > 0) {
-				if (store_in_primary_buffer) {
-					buffer->primary_tail += ret;
-				} else if (store_in_secondary_buffer) {
-					buffer->secondary_tail += ret;
-				} else {
-					TXC_INTERNALERROR("Sanity check -- shouldn't come here.\n");
-				}
+		args_commit_undo->koa = koa;
+		args_commit_undo->buffer = buffer;
+
+		txc_tx_register_commit_action(txd, x_read_pipe_commit, 
+		                              (void *) args_commit_undo, result,
+		                              TXC_TX_REGULAR_COMMIT_ACTION_ORDER);
+		txc_tx_register_undo_action(txd, x_read_pipe_undo, 
+		                            (void *) args_commit_undo, result,
+		                            TXC_TX_REGULAR_UNDO_ACTION_ORDER);
+	}
+
+	txc_stats_txstat_increment(txd, XCALL, x_read_pipe, 1);
+	/* 
+	 * Data are read straight into the tail of the buffer, where they stay
+	 * if the transaction aborts. Each read brings in as much as the pipe 
+	 * holds and the buffer fits so that following calls, such as those of
+	 * a consumer parsing small records, are served from the buffer.
+	 */
+	space = txc_buffer_ring_space(buffer);
+	if ((available = txc_buffer_ring_used(buffer, 1)) == 0) { 
+		/* No buffered data available. Block until there are some. */
+		if (space == 0) {
+			local_result = ENOMEM;
+			ret = -1;
+			goto done;
+		}
+		ret = txc_libc_read(fd, txc_buffer_ring_tail_ptr(buffer), space);
+		if (ret <= 0) {
+			if (ret < 0) {
+				local_result = errno;
 			}
-			txc_stats_txstat_increment(txd, XCALL, x_read_pipe, 1);
+			goto done;
 		}
-	}	
+		txc_buffer_ring_produce(buffer, ret);
+		available = ret;
+	} else if (available < nbyte) {
+		/* 
+		 * Partial hit. Top up with whatever the pipe already holds, 
+		 * without waiting for more.
+		 */
+		if (space > 0 && 
+		    (fresh = pipe_read_ready(fd, txc_buffer_ring_tail_ptr(buffer), 
+		                             space)) > 0) 
+		{
+			txc_buffer_ring_produce(buffer, fresh);
+			available += fresh;
+		}
+	} else {
+		txc_stats_txstat_increment(txd, XCALL, x_read_pipe_syscalls_saved, 1);
+	}
 	/* Copy data from the buffer back to the application buffer */
-	memcpy(buf, &buffer->buf[hdr_base_index], nbyte); 
+	ret = (nbyte < available) ? nbyte : available;
+	memcpy(buf, txc_buffer_ring_head_ptr(buffer, 1), ret); 
+	txc_buffer_ring_consume(buffer, ret, 1);
 	local_result = 0;
 done:
 	if (result) {
@@ -271,6 +257,8 @@ done:
  * The xCall buffers any read data so that in case of transaction 
  * abort read data are not consumed but stay present for the next 
  * pipe read.
+ * Within a transaction it reads ahead as much as the pipe holds, so 
+ * that following reads are served from the buffer without a system call.
  *
  * <b> Execution </b>: in-place
  *
@@ -287,7 +275,7 @@ ssize_t
 XCALL_DEF(x_read_pipe)(int fd, void *buf, size_t nbyte, int *result)
 {
 	txc_tx_t           *txd;
-	int                ret;
+	ssize_t            ret;
 
 	txd = txc_tx_get_txd();
 
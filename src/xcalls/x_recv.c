@@ -0,0 +1,293 @@
+/*
+    Copyright (C) 2008-2009 Computer Sciences Department, 
+    University of Wisconsin -- Madison
+
+    ----------------------------------------------------------------------
+
+    This file is part of the xCalls transactional API, originally 
+    developed at the University of Wisconsin -- Madison.
+
+    xCalls was originally developed primarily by Haris Volos and 
+    Neelam Goyal with contributions from Andres Jaan Tack.
+
+    ----------------------------------------------------------------------
+
+    xCalls is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as 
+    published by the Free Software Foundation, either version 3 of 
+    the License, or (at your option) any later version.
+
+    xCalls is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public 
+    License along with xCalls.  If not, see <http://www.gnu.org/licenses/>.
+
+### END HEADER ###
+*/
+
+/**
+ * \file x_recv.c
+ *
+ * \brief x_recv implementation.
+ *
+ * Data received from a stream socket are kept in the input ring buffer of
+ * the socket's KOA until the transaction that consumed them commits, so 
+ * that they are returned again to the next receiver if the transaction 
+ * aborts (see <tt>txc_buffer_ring_s</tt>).
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <misc/debug.h>
+#include <misc/errno.h>
+#include <misc/generic_types.h>
+#include <core/tx.h>
+#include <core/config.h>
+#include <core/koa.h>
+#include <core/buffer.h>
+#include <core/stats.h>
+#include <libc/syscalls.h>
+#include <core/txdesc.h>
+#include <xcalls/xcalls.h>
+
+
+typedef struct x_recv_commit_undo_args_s x_recv_commit_undo_args_t;
+
+struct x_recv_commit_undo_args_s {
+	txc_koa_t         *koa;
+	txc_buffer_ring_t *buffer;
+};
+
+
+static
+void 
+x_recv_undo(void *args, int *result) 
+{
+	x_recv_commit_undo_args_t *args_undo = (x_recv_commit_undo_args_t *) args;
+
+	txc_buffer_ring_abort(args_undo->buffer);
+	if (result) {
+		*result = 0;
+	}
+}
+
+
+static 
+void
+x_recv_commit(void *args, int *result)
+{
+	x_recv_commit_undo_args_t *args_commit = (x_recv_commit_undo_args_t *) args;
+
+	txc_buffer_ring_commit(args_commit->buffer);
+	if (result) {
+		*result = 0;
+	}
+}
+
+
+static 
+ssize_t 
+__txc_recv(txc_tx_t *txd, txc_bool_t speculative_read,
+           int fd, void *buf, size_t len, int flags, int *result) 
+{
+	txc_koamgr_t              *koamgr = txc_g_koamgr;
+	txc_koa_t                 *koa;
+	txc_sentinel_t            *sentinel;
+	txc_result_t              xret;
+	ssize_t                   ret;
+	x_recv_commit_undo_args_t *args_commit_undo;
+	int                       local_result = 0;
+	unsigned int              available;
+	unsigned int              space;
+	size_t                    request;
+	size_t                    copied;
+	size_t                    n;
+	ssize_t                   ret2;
+	txc_buffer_ring_t         *buffer;
+
+	txc_koa_lock_fd(koamgr, fd);
+	xret = txc_koa_lookup_fd2koa(koamgr, fd, &koa);
+	if (xret == TXC_R_FAILURE) {
+		/* 
+		 * The KOA mapped to the file descriptor has gone. Report
+		 * this error as invalid file descriptor.
+		 */
+		txc_koa_unlock_fd(koamgr, fd);
+		local_result = EBADF;
+		ret = -1;
+		goto done;
+	}
+	if (txc_koa_get_type(koa) != TXC_KOA_IS_SOCK_STREAM) {
+		/* Datagram sockets are served by x_recvmsg. */
+		txc_koa_unlock_fd(koamgr, fd);
+		local_result = EOPNOTSUPP;
+		ret = -1;
+		goto done;
+	}
+	buffer = (txc_buffer_ring_t *) txc_koa_get_buffer(koa);
+
+	if (!speculative_read) {
+		txc_koa_unlock_fd(koamgr, fd);
+		if ((available = txc_buffer_ring_used(buffer, 0)) == 0) {
+			if ((ret = txc_libc_recv(fd, buf, len, flags)) < 0) {
+				local_result = errno;
+			}
+			goto done;
+		}
+		/* Drain data left behind by transactions first. */
+		ret = (len < available) ? len : available;
+		memcpy(buf, txc_buffer_ring_head_ptr(buffer, 0), ret);
+		if (!(flags & MSG_PEEK)) {
+			txc_buffer_ring_consume(buffer, ret, 0);
+			if ((flags & MSG_WAITALL) && ret < len) {
+				/* Wait for the rest as the socket would. */
+				if ((ret2 = txc_libc_recv(fd, (char *) buf + ret, len - ret, 
+				                          flags)) > 0) 
+				{
+					ret += ret2;
+				}
+			}
+		}
+		goto done;
+	}
+
+	/* Receive is speculative */		
+	sentinel = txc_koa_get_sentinel(koa);
+	xret = txc_sentinel_tryacquire(txd, sentinel, 
+	                               TXC_SENTINEL_ACQUIREONRETRY);
+	txc_koa_unlock_fd(koamgr, fd);
+	if (xret == TXC_R_BUSYSENTINEL) {
+		txc_tx_abort_transaction(txd, TXC_ABORTREASON_BUSYSENTINEL);
+		TXC_INTERNALERROR("Never gets here. Transaction abort failed.\n");
+	}
+
+	/* Got sentinel. Continue with the rest of the stuff. */
+	if (buffer->state == TXC_BUFFER_STATE_NON_SPECULATIVE) {
+		if ((args_commit_undo = (x_recv_commit_undo_args_t *)
+		                        txc_buffer_linear_malloc(txd->buffer_linear, 
+		                                                 sizeof(x_recv_commit_undo_args_t)))
+		    == NULL)
+		{
+			local_result = ENOMEM;
+			ret = -1;
+			goto done;
+		}
+		txc_buffer_ring_speculate(buffer);
+
+		args_commit_undo->koa = koa;
+		args_commit_undo->buffer = buffer;
+
+		txc_tx_register_commit_action(txd, x_recv_commit, 
+		                              (void *) args_commit_undo, result,
+		                              TXC_TX_REGULAR_COMMIT_ACTION_ORDER);
+		txc_tx_register_undo_action(txd, x_recv_undo, 
+		                            (void *) args_commit_undo, result,
+		                            TXC_TX_REGULAR_UNDO_ACTION_ORDER);
+	}
+
+	/* 
+	 * With MSG_WAITALL (and no MSG_PEEK) keep going until len bytes have 
+	 * been received, serving buffered data first.
+	 */
+	copied = 0;
+	do {
+		if ((available = txc_buffer_ring_used(buffer, 1)) == 0) {
+			/* 
+			 * No buffered data available. Bring in as much as fits in the 
+			 * buffer so that following receives are served from the buffer.
+			 * With MSG_WAITALL we must not wait for more than requested.
+			 */
+			if ((space = txc_buffer_ring_space(buffer)) == 0) {
+				if (copied > 0) {
+					break;
+				}
+				local_result = ENOMEM;
+				ret = -1;
+				goto done;
+			}
+			request = space;
+			if ((flags & MSG_WAITALL) && len - copied < space) {
+				request = len - copied;
+			}
+			ret = txc_libc_recv(fd, txc_buffer_ring_tail_ptr(buffer), request, 
+			                    flags & ~MSG_PEEK);
+			txc_stats_txstat_increment(txd, XCALL, x_recv, 1);
+			if (ret <= 0) {
+				if (copied > 0) {
+					/* Short read on shutdown or signal, as recv does. */
+					break;
+				}
+				if (ret < 0) {
+					local_result = errno;
+				}
+				goto done;
+			}
+			txc_buffer_ring_produce(buffer, ret);
+			available = ret;
+		}
+		n = (len - copied < available) ? len - copied : available;
+		memcpy((char *) buf + copied, txc_buffer_ring_head_ptr(buffer, 1), n);
+		if (!(flags & MSG_PEEK)) {
+			txc_buffer_ring_consume(buffer, n, 1);
+		}
+		copied += n;
+	} while ((flags & MSG_WAITALL) && !(flags & MSG_PEEK) && copied < len);
+	ret = copied;
+	local_result = 0;
+done:
+	if (result) {
+		*result = local_result;
+	}
+	return ret;
+}
+
+
+/**
+ * \brief Receives a message from a stream socket.
+ * 
+ * The xCall buffers any received data so that in case of transaction 
+ * abort the data are not consumed but stay present for the next 
+ * receive.
+ *
+ * <b> Execution </b>: in-place
+ *
+ * <b> Asynchronous failures </b>: commit, abort
+ *
+ * \param[in] s The file descriptor of the socket.
+ * \param[in] buf The buffer where to store received data.
+ * \param[in] len The size of the buffer.
+ * \param[in] flags See man recv. MSG_PEEK and MSG_WAITALL are supported.
+ * \param[out] result Where to store asynchronous failures.
+ * \return The number of received bytes on success, 0 if the peer has 
+ * performed an orderly shutdown, or -1 if a synchronous failure occurred 
+ * (in which case, errno is set appropriately).
+ */
+ssize_t 
+XCALL_DEF(x_recv)(int s, void *buf, size_t len, int flags, int *result)
+{
+	txc_tx_t           *txd;
+	ssize_t            ret;
+
+	txd = txc_tx_get_txd();
+
+	switch(txc_tx_get_xactstate(txd)) {
+		case TXC_XACTSTATE_TRANSACTIONAL_IRREVOCABLE:
+		case TXC_XACTSTATE_NONTRANSACTIONAL:
+			ret = __txc_recv(txd, TXC_BOOL_FALSE, s, buf, len, flags, result);
+			break;
+		case TXC_XACTSTATE_TRANSACTIONAL_RETRYABLE:
+			ret = __txc_recv(txd, TXC_BOOL_TRUE, s, buf, len, flags, result);
+			break;
+		default:
+			TXC_INTERNALERROR("Unknown transaction state\n");
+	}
+	return ret;
+}
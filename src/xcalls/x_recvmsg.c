@@ -57,25 +57,53 @@
 #define TXC_DGRAM_MAX_SIZE      1024*64
 #define TXC_CONTROLMSG_MAX_SIZE 1024*2
 
+/** Rounds a record length up so that the next record header is aligned. */
+#define TXC_SOCKET_MSG_ALIGN(len) (((len) + 7) & ~((size_t) 7))
+
 typedef struct txc_socket_msghdr_s txc_socket_msghdr_t;
 
+/** 
+ * Header of a datagram kept in the input ring buffer of a socket. The 
+ * header is followed by msg_datalen bytes of data and msg_controllen 
+ * bytes of control data. It holds no pointers so that the record stays 
+ * valid at whichever of the two views of the ring it is accessed.
+ */
 struct txc_socket_msghdr_s {
 	struct sockaddr_in msg_name;
 	socklen_t          msg_namelen;
-	char               *msg_iov_base;
-	size_t             msg_iov_len;		/* length in bytes */
-	void               *msg_control;
+	size_t             msg_datalen;		/* length in bytes */
 	socklen_t          msg_controllen;
 	int                msg_flags;
 };
 
+static inline
+char *
+txc_socket_msghdr_data(txc_socket_msghdr_t *hdr)
+{
+	return (char *) hdr + sizeof(txc_socket_msghdr_t);
+}
+
+static inline
+char *
+txc_socket_msghdr_control(txc_socket_msghdr_t *hdr)
+{
+	return txc_socket_msghdr_data(hdr) + hdr->msg_datalen;
+}
+
+static inline
+size_t
+txc_socket_msghdr_reclen(txc_socket_msghdr_t *hdr)
+{
+	return TXC_SOCKET_MSG_ALIGN(sizeof(txc_socket_msghdr_t) + 
+	                            hdr->msg_datalen + hdr->msg_controllen);
+}
 
 
 typedef struct x_recvmsg_commit_undo_args_s x_recvmsg_commit_undo_args_t;
 
 struct x_recvmsg_commit_undo_args_s {
-	txc_koa_t             *koa;
-	txc_buffer_circular_t *buffer;
+	txc_koa_t         *koa;
+	txc_buffer_ring_t *buffer;
 };
 
 
@@ -86,7 +114,7 @@ x_recvmsg_undo(void *args, int *result)
 	x_recvmsg_commit_undo_args_t *args_undo = (x_recvmsg_commit_undo_args_t *) args;
 	int                          local_result = 0;
 
-	args_undo->buffer->state = TXC_BUFFER_STATE_NON_SPECULATIVE;
+	txc_buffer_ring_abort(args_undo->buffer);
 	if (result) {
 		*result = local_result;
 	}
@@ -99,28 +127,154 @@ x_recvmsg_commit(void *args, int *result)
 {
 	x_recvmsg_commit_undo_args_t *args_commit = (x_recvmsg_commit_undo_args_t *) args;
 	int                          local_result = 0;
-	txc_buffer_circular_t        *buffer;
 
-	buffer = args_commit->buffer;
-
-	if (buffer->speculative_primary_tail != buffer->speculative_primary_head) {
-		buffer->primary_head = buffer->speculative_primary_head; 
-		buffer->primary_tail = buffer->speculative_primary_tail; 
-	} else if (buffer->speculative_secondary_tail != buffer->speculative_secondary_head) {
-		buffer->primary_head = buffer->speculative_secondary_head; 
-		buffer->primary_tail = buffer->speculative_secondary_tail; 
-		buffer->secondary_head = buffer->secondary_tail = 0;
-	} else {
-		buffer->primary_head = buffer->primary_tail = 0;
-		buffer->secondary_head = buffer->secondary_tail = 0;
-	}
-	buffer->state = TXC_BUFFER_STATE_NON_SPECULATIVE;
+	txc_buffer_ring_commit(args_commit->buffer);
 	if (result) {
 		*result = local_result;
 	}
 }
 
 
+/** Room reserved in the ring for a datagram before it is received. */
+#define TXC_SOCKET_MSG_SLOT_SIZE                                             \
+  TXC_SOCKET_MSG_ALIGN(sizeof(txc_socket_msghdr_t) +                         \
+                       TXC_DGRAM_MAX_SIZE + TXC_CONTROLMSG_MAX_SIZE)
+
+
+/**
+ * \brief Receives pending datagrams from the kernel into the tail of the 
+ * ring.
+ *
+ * Up to sock_recv_batch datagrams, as many as are pending and fit in the 
+ * ring, are received with a single system call, each into a slot large 
+ * enough for any datagram. The records are then packed one after the 
+ * other, with the control data of each right after its data, so that 
+ * they are consumed sequentially from the head of the ring.
+ *
+ * \return The length of the first datagram, or -1 if a failure occurred 
+ * or nothing was received (in which case, errno is set appropriately).
+ */
+static
+ssize_t
+buffer_recvmsg(txc_buffer_ring_t *buffer, int fd, int flags, 
+               txc_socket_msghdr_t **hdrp)
+{
+	txc_libc_mmsghdr_t  msgvec[TXC_SOCK_RECV_BATCH_MAX];
+	struct iovec        iov[TXC_SOCK_RECV_BATCH_MAX];
+	txc_socket_msghdr_t *hdr;
+	char                *tail;
+	char                *dst;
+	char                *control;
+	unsigned int        n;
+	int                 num;
+	int                 i;
+
+	n = txc_buffer_ring_space(buffer) / TXC_SOCKET_MSG_SLOT_SIZE;
+	if (n == 0) {
+		errno = ENOMEM;
+		return -1;
+	}
+	if (n > (unsigned int) txc_runtime_settings.sock_recv_batch) {
+		n = txc_runtime_settings.sock_recv_batch;
+	}
+	tail = txc_buffer_ring_tail_ptr(buffer);
+	for (i=0; i<n; i++) {
+		hdr = (txc_socket_msghdr_t *) (tail + i * TXC_SOCKET_MSG_SLOT_SIZE);
+		iov[i].iov_base = txc_socket_msghdr_data(hdr);
+		iov[i].iov_len = TXC_DGRAM_MAX_SIZE;
+		msgvec[i].msg_hdr.msg_name = (void *) &(hdr->msg_name);
+		msgvec[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+		msgvec[i].msg_hdr.msg_iov = &iov[i];
+		msgvec[i].msg_hdr.msg_iovlen = 1;
+		msgvec[i].msg_hdr.msg_control = txc_socket_msghdr_data(hdr) + 
+		                                TXC_DGRAM_MAX_SIZE;
+		msgvec[i].msg_hdr.msg_controllen = TXC_CONTROLMSG_MAX_SIZE;
+		msgvec[i].msg_hdr.msg_flags = 0;
+		msgvec[i].msg_len = 0;
+	}
+	/* Wait for the first datagram only; take the rest if already pending. */
+	if ((num = txc_libc_recvmmsg(fd, msgvec, n, 
+	                             (n > 1) ? flags | MSG_WAITFORONE : flags)) < 0)
+	{
+		return -1;
+	}
+	if (num == 0) {
+		/* Nothing was received, so there is no record to hand back. */
+		errno = EAGAIN;
+		return -1;
+	}
+
+	for (dst = tail, i=0; i<num; i++) {
+		hdr = (txc_socket_msghdr_t *) (tail + i * TXC_SOCKET_MSG_SLOT_SIZE);
+		control = (char *) msgvec[i].msg_hdr.msg_control;
+		hdr->msg_datalen = msgvec[i].msg_len;
+		hdr->msg_namelen = msgvec[i].msg_hdr.msg_namelen;
+		hdr->msg_controllen = msgvec[i].msg_hdr.msg_controllen;
+		hdr->msg_flags = msgvec[i].msg_hdr.msg_flags;
+		if (dst != (char *) hdr) {
+			memmove(dst, hdr, sizeof(txc_socket_msghdr_t) + hdr->msg_datalen);
+			hdr = (txc_socket_msghdr_t *) dst;
+		}
+		if (hdr->msg_controllen > 0) {
+			memmove(txc_socket_msghdr_control(hdr), control, hdr->msg_controllen);
+		}
+		txc_buffer_ring_produce(buffer, txc_socket_msghdr_reclen(hdr));
+		dst += txc_socket_msghdr_reclen(hdr);
+	}
+	*hdrp = (txc_socket_msghdr_t *) tail;
+	return (*hdrp)->msg_datalen;
+}
+
+
+/**
+ * \brief Copies a buffered datagram out to the application's message.
+ *
+ * As with recvmsg, data that do not fit in the application's buffers are
+ * discarded and reported through MSG_TRUNC (MSG_CTRUNC for control data).
+ */
+static
+ssize_t
+buffer_copyout(txc_socket_msghdr_t *hdr, struct msghdr *msg)
+{
+	char   *data = txc_socket_msghdr_data(hdr);
+	size_t s;
+	size_t n;
+	size_t i;
+	int    flags = hdr->msg_flags;
+
+	if (msg->msg_name) {
+		n = (msg->msg_namelen < hdr->msg_namelen) ? msg->msg_namelen 
+		                                          : hdr->msg_namelen;
+		memcpy(msg->msg_name, (void *) &(hdr->msg_name), n);
+		msg->msg_namelen = hdr->msg_namelen;
+	}
+	for (s=0, i=0; i<msg->msg_iovlen && s<hdr->msg_datalen; i++) {
+		n = hdr->msg_datalen - s;
+		if (n > msg->msg_iov[i].iov_len) {
+			n = msg->msg_iov[i].iov_len;
+		}
+		memcpy(msg->msg_iov[i].iov_base, &data[s], n);
+		s += n;
+	}
+	if (s < hdr->msg_datalen) {
+		flags |= MSG_TRUNC;
+	}
+	if (msg->msg_control) {
+		n = hdr->msg_controllen;
+		if (n > msg->msg_controllen) {
+			n = msg->msg_controllen;
+			flags |= MSG_CTRUNC;
+		}
+		memcpy(msg->msg_control, txc_socket_msghdr_control(hdr), n);
+		msg->msg_controllen = n;
+	} else {
+		msg->msg_controllen = 0;
+	}
+	msg->msg_flags = flags;
+	return s;
+}
+
+
 static 
 ssize_t 
 __txc_recvmsg(txc_tx_t *txd, txc_bool_t speculative_read,
@@ -130,27 +284,11 @@ __txc_recvmsg(txc_tx_t *txd, txc_bool_t speculative_read,
 	txc_koa_t                      *koa;
 	txc_sentinel_t                 *sentinel;
 	txc_result_t                   xret;
-	int                            ret;
+	ssize_t                        ret;
 	x_recvmsg_commit_undo_args_t  *args_commit_undo;
 	int                            local_result = 0;
-	int                            store_in_primary_buffer;
-	int                            store_in_secondary_buffer;
-	int                            hdr_base_index;
-	int                            needed_bytes;
-	txc_buffer_circular_t          *buffer;
-	struct iovec                   temp_iovec;
-	struct msghdr                  temp_msghdr;
-	txc_socket_msghdr_t            *temp_buffer_msghdr;
-	ssize_t                        len;
-	int                            s;
-	int                            i;
-
-	
-	/* 
-	 * FIXME: We don't handle the case where we need to consume more data 
-	 * than available in the buffer. In such a case you need to request
-	 * the additional data.
-	 */
+	txc_buffer_ring_t              *buffer;
+	txc_socket_msghdr_t            *hdr;
 
 	txc_koa_lock_fd(koamgr, fd);
 	xret = txc_koa_lookup_fd2koa(koamgr, fd, &koa);
@@ -164,41 +302,22 @@ __txc_recvmsg(txc_tx_t *txd, txc_bool_t speculative_read,
 		ret = -1;
 		goto done;
 	}
-	buffer = (txc_buffer_circular_t *) txc_koa_get_buffer(koa);
+	buffer = (txc_buffer_ring_t *) txc_koa_get_buffer(koa);
 
 	if (!speculative_read) {
 		txc_koa_unlock_fd(koamgr, fd);
-		if ((buffer->primary_tail != buffer->primary_head) ||
-		    (buffer->secondary_tail != buffer->secondary_head)) {
-			/* There are buffered data available */
-			if (buffer->primary_tail != buffer->primary_head) {
-				/* Consume data from the primary buffer */
-				hdr_base_index = buffer->primary_head;
-				temp_buffer_msghdr = (txc_socket_msghdr_t *) &(buffer->buf[hdr_base_index]);
-				len = sizeof(txc_socket_msghdr_t) +
-				      temp_buffer_msghdr->msg_iov_len + 
-				      temp_buffer_msghdr->msg_controllen;
-				buffer->primary_head += len;
-			} else {
-				/* Consume data from the secondary buffer and make the secondary 
-				 * buffer primary 
-				 */
-				hdr_base_index = buffer->secondary_head;
-				temp_buffer_msghdr = (txc_socket_msghdr_t *) &(buffer->buf[hdr_base_index]);
-				len = sizeof(txc_socket_msghdr_t) +
-				      temp_buffer_msghdr->msg_iov_len + 
-				      temp_buffer_msghdr->msg_controllen;
-				buffer->secondary_head += len;
-				buffer->primary_tail = buffer->secondary_tail; 
-				buffer->primary_head = buffer->secondary_head; 
-				buffer->secondary_head = buffer->secondary_tail = 0;
-			}
-			/* Now fall through to do the copy */
-		} else { 
+		if (txc_buffer_ring_used(buffer, 0) == 0) {
+			/* No buffered data available */
 			ret = txc_libc_recvmsg(fd, msg, flags);
 			local_result = errno;
 			goto done;
 		}
+		/* Consume the oldest buffered datagram */
+		hdr = (txc_socket_msghdr_t *) txc_buffer_ring_head_ptr(buffer, 0);
+		ret = buffer_copyout(hdr, msg);
+		if (!(flags & MSG_PEEK)) {
+			txc_buffer_ring_consume(buffer, txc_socket_msghdr_reclen(hdr), 0);
+		}
 	} else {
 		/* READ is speculative */		
 		sentinel = txc_koa_get_sentinel(koa);
@@ -221,11 +340,7 @@ __txc_recvmsg(txc_tx_t *txd, txc_bool_t speculative_read,
 				ret = -1;
 				goto done;
 			}
-			buffer->speculative_primary_head = buffer->primary_head;
-			buffer->speculative_primary_tail = buffer->primary_tail;
-			buffer->speculative_secondary_head = buffer->secondary_head;
-			buffer->speculative_secondary_tail = buffer->secondary_tail;
-			buffer->state = TXC_BUFFER_STATE_SPECULATIVE;
+			txc_buffer_ring_speculate(buffer);
 
 			args_commit_undo->koa = koa;
 			args_commit_undo->buffer = buffer;
@@ -238,106 +353,28 @@ __txc_recvmsg(txc_tx_t *txd, txc_bool_t speculative_read,
 										TXC_TX_REGULAR_UNDO_ACTION_ORDER);
 		}
 
-		if (buffer->speculative_primary_tail != buffer->speculative_primary_head ||
-				buffer->speculative_secondary_tail != buffer->speculative_secondary_head) {
-			/* There are buffered data available to consume*/
-			if (buffer->speculative_primary_tail != buffer->speculative_primary_head) {
-				/* Consume data from the primary buffer */
-				hdr_base_index = buffer->speculative_primary_head;
-				temp_buffer_msghdr = (txc_socket_msghdr_t *) &(buffer->buf[hdr_base_index]);
-				len = sizeof(txc_socket_msghdr_t) + 
-				      temp_buffer_msghdr->msg_iov_len + 
-				      temp_buffer_msghdr->msg_controllen;
-				buffer->speculative_primary_head += len;
-			} else {
-				/* Consume data from the secondary buffer */
-				hdr_base_index = buffer->speculative_secondary_head;
-				temp_buffer_msghdr = (txc_socket_msghdr_t *) &(buffer->buf[hdr_base_index]);
-				buffer->speculative_secondary_head += len;
-			}
+		if (txc_buffer_ring_used(buffer, 1) > 0) {
+			/* There are buffered data available to consume */
+			hdr = (txc_socket_msghdr_t *) txc_buffer_ring_head_ptr(buffer, 1);
 		} else { 
-			/* No buffered data available 
-			 * 1) Find space in the buffer
-			 * 3) Issue a read call to the kernel to bring the data in the buffer
-			 * 4) Copy the buffered data back to the application buffer
+			/* 
+			 * No buffered data available. Bring the pending datagrams 
+			 * into the buffer so that they are not lost if the transaction
+			 * aborts, and so that following calls are served from it.
+			 * The kernel is never asked to peek since the datagram is
+			 * already kept in the buffer.
 			 */
-			needed_bytes = sizeof(txc_socket_msghdr_t) + 
-			               TXC_DGRAM_MAX_SIZE + TXC_CONTROLMSG_MAX_SIZE;
-			store_in_primary_buffer = store_in_secondary_buffer = 0;
-			if (buffer->primary_tail < (buffer->size_max - needed_bytes)) {
-				/* There is space in the primary part of the buffer */
-				hdr_base_index = buffer->primary_tail;
-				store_in_primary_buffer = 1;
-			} else if (buffer->secondary_tail < 
-			           (buffer->primary_head + 1 - needed_bytes)) 
-			{
-				/* There is space in the secondary part of the buffer */
-				hdr_base_index = buffer->secondary_tail;
-				store_in_secondary_buffer = 1;
-			} else {
-				/* There is not space in the buffer */
-				local_result = ENOMEM;
-				ret = -1;
+			if ((ret = buffer_recvmsg(buffer, fd, flags & ~MSG_PEEK, &hdr)) < 0) {
+				local_result = errno;
 				goto done;
 			}
-			temp_buffer_msghdr = (txc_socket_msghdr_t *) &(buffer->buf[hdr_base_index]);
-			temp_buffer_msghdr->msg_iov_base = 	(void *) (temp_buffer_msghdr + 
-			                                              sizeof(txc_socket_msghdr_t));
-			temp_buffer_msghdr->msg_control = (void *) (temp_buffer_msghdr + 
-			                                            sizeof(txc_socket_msghdr_t) + 
-			                                            TXC_DGRAM_MAX_SIZE);
-			temp_iovec.iov_base = temp_buffer_msghdr->msg_iov_base; 
-			temp_iovec.iov_len = TXC_DGRAM_MAX_SIZE;
-			temp_msghdr.msg_name = (void *) &(temp_buffer_msghdr->msg_name);
-			temp_msghdr.msg_namelen = sizeof(struct sockaddr_in);
-			temp_msghdr.msg_iov = &temp_iovec;
-			temp_msghdr.msg_iovlen = 1;
-			temp_msghdr.msg_control = temp_buffer_msghdr->msg_control;
-			temp_msghdr.msg_controllen = TXC_CONTROLMSG_MAX_SIZE;
-			ret = txc_libc_recvmsg(fd, &temp_msghdr, flags);
-			if (ret > 0) {
-				temp_buffer_msghdr->msg_iov_len = ret;
-				temp_buffer_msghdr->msg_namelen = temp_msghdr.msg_namelen;
-				temp_buffer_msghdr->msg_controllen = temp_msghdr.msg_controllen;
-				temp_buffer_msghdr->msg_flags = temp_msghdr.msg_flags;
-				if (store_in_primary_buffer) {
-					buffer->primary_tail += sizeof(txc_socket_msghdr_t) +
-					                        temp_buffer_msghdr->msg_iov_len +
-					                        temp_buffer_msghdr->msg_controllen;	
-				} else if (store_in_secondary_buffer) {
-					buffer->secondary_tail += sizeof(txc_socket_msghdr_t) +
-					                          temp_buffer_msghdr->msg_iov_len +
-					                          temp_buffer_msghdr->msg_controllen;	
-				} else {
-					TXC_INTERNALERROR("Sanity check -- shouldn't come here.\n");
-				}
-				/* shift control message to the end of the msg_data */
-				if (temp_buffer_msghdr->msg_controllen > 0) {
-					memcpy((char *) temp_buffer_msghdr->msg_iov_base + temp_buffer_msghdr->msg_iov_len, 
-					       temp_buffer_msghdr->msg_control,
-					       temp_buffer_msghdr->msg_controllen);
-				}
-			}
+		}
+		ret = buffer_copyout(hdr, msg);
+		if (!(flags & MSG_PEEK)) {
+			txc_buffer_ring_consume(buffer, txc_socket_msghdr_reclen(hdr), 1);
 		}
 		txc_stats_txstat_increment(txd, XCALL, x_recvmsg, 1);
 	}
-
-	/* Copy data from the buffer back to the application buffer */
-	memcpy(msg->msg_name, 
-	       (void *)&(temp_buffer_msghdr->msg_name), 
-	       sizeof(struct sockaddr_in));
-	msg->msg_namelen = temp_buffer_msghdr->msg_namelen;
-	for (s=0, i=0; i<msg->msg_iovlen; i++) {
-		memcpy(msg->msg_iov[i].iov_base, 
-		       &temp_buffer_msghdr->msg_iov_base[s],
-		       msg->msg_iov[i].iov_len);
-		s += msg->msg_iov[i].iov_len;
-	}
-	msg->msg_flags = temp_buffer_msghdr->msg_flags;
-	msg->msg_controllen = temp_buffer_msghdr->msg_controllen;
-	memcpy(msg->msg_control, temp_buffer_msghdr->msg_control, 
-	       temp_buffer_msghdr->msg_controllen);
-	ret = s;
 	local_result = 0;
 done:
 	if (result) {
@@ -371,7 +408,7 @@ ssize_t
 XCALL_DEF(x_recvmsg)(int s, struct msghdr *msg, int flags, int *result)
 {
 	txc_tx_t *txd;
-	int      ret;
+	ssize_t  ret;
 
 	txd = txc_tx_get_txd();
 
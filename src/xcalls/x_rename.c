@@ -47,6 +47,7 @@
 #include <core/buffer.h>
 #include <core/txdesc.h>
 #include <core/stats.h>
+#include <core/journal.h>
 #include <libc/syscalls.h>
 #include <xcalls/xcalls.h>
 
@@ -70,6 +71,7 @@ x_rename_commit(void *args, int *result)
 	int                         local_errno = 0; 
 	x_rename_commit_undo_args_t *myargs = (x_rename_commit_undo_args_t *) args;
 	txc_koamgr_t                *koamgr;
+	int                         fd;
 
 	koamgr = txc_koa_get_koamgr(myargs->oldpath_koa);
 	txc_koa_lock_alias_cache(koamgr);
@@ -81,6 +83,16 @@ x_rename_commit(void *args, int *result)
 	if (myargs->newpath_koa_is_valid) {
 		txc_koa_detach(myargs->newpath_koa);
 	}
+	if (txc_g_journalmgr) {
+		/* 
+		 * The journal refers to the data written under the old name; 
+		 * make them durable before the name goes away.
+		 */
+		if ((fd = txc_libc_open(myargs->newpath, O_RDONLY, 0)) >= 0) {
+			txc_libc_fsync(fd);
+			txc_libc_close(fd);
+		}
+	}
 	if (txc_libc_unlink(myargs->oldpath) < 0) {
 		local_errno = errno;
 	}	
@@ -172,6 +184,13 @@ XCALL_DEF(x_rename)(const char *oldpath, const char *newpath, int *result)
 	switch(txc_tx_get_xactstate(txd)) {
 		case TXC_XACTSTATE_TRANSACTIONAL_RETRYABLE:
 			txc_koa_lock_alias_cache(koamgr);
+			if ((local_result = txc_x_create_publish(txd, oldpath)) != 0 ||
+			    (local_result = txc_x_create_publish(txd, newpath)) != 0)
+			{
+				txc_koa_unlock_alias_cache(koamgr);
+				ret = -1;
+				goto done;
+			}
 
 			txc_koa_path2inode(oldpath, &oldpath_inode);
 			if (oldpath_inode == 0) {
@@ -200,7 +219,14 @@ XCALL_DEF(x_rename)(const char *oldpath, const char *newpath, int *result)
 				txc_koa_unlock_fds_refby_koa(oldpath_koa);
 			} else {
 				/* No KOA for oldpath; create it */
-				txc_koa_create(koamgr, &oldpath_koa, TXC_KOA_IS_FILE, (void *) oldpath_inode);
+				if (txc_koa_create(koamgr, &oldpath_koa, TXC_KOA_IS_FILE, 
+				                   (void *) oldpath_inode) != TXC_R_SUCCESS)
+				{
+					txc_koa_unlock_alias_cache(koamgr);
+					local_result = ENOMEM;
+					ret = -1;
+					goto done;
+				}
 				txc_koa_attach(oldpath_koa);
 				sentinel = txc_koa_get_sentinel(oldpath_koa);
 				xret = txc_sentinel_tryacquire(txd, sentinel, 0);
@@ -238,7 +264,17 @@ XCALL_DEF(x_rename)(const char *oldpath, const char *newpath, int *result)
 					}
 				} else {
 					/* No KOA for newpath; create it */
-					txc_koa_create(koamgr, &newpath_koa, TXC_KOA_IS_FILE, (void *) newpath_inode);
+					if (txc_koa_create(koamgr, &newpath_koa, TXC_KOA_IS_FILE, 
+					                   (void *) newpath_inode) != TXC_R_SUCCESS)
+					{
+						txc_koa_lock_fds_refby_koa(oldpath_koa);
+						txc_koa_detach(oldpath_koa);
+						txc_koa_unlock_fds_refby_koa(oldpath_koa);
+						txc_koa_unlock_alias_cache(koamgr);
+						local_result = ENOMEM;
+						ret = -1;
+						goto done;
+					}
 					txc_koa_attach(newpath_koa);
 					sentinel = txc_koa_get_sentinel(newpath_koa);
 					xret = txc_sentinel_tryacquire(txd, sentinel, 0);
@@ -252,6 +288,16 @@ XCALL_DEF(x_rename)(const char *oldpath, const char *newpath, int *result)
 				 */
 				strcpy(temppath, "/tmp/libtxc.tmp.XXXXXX");
 				mktemp(temppath); 
+				if (txc_g_journalmgr &&
+				    (local_result = txc_journal_log_name(txc_g_journalmgr, txd, 
+				                                         TXC_JOURNAL_UNDO_RENAME,
+				                                         temppath, newpath, 
+				                                         newpath_inode)) != 0)
+				{
+					txc_koa_unlock_alias_cache(koamgr);
+					ret = -1;
+					goto done;
+				}
 				txc_libc_rename(newpath, temppath);
 				newpath_koa_is_valid = 1;
 			}
@@ -264,7 +310,33 @@ XCALL_DEF(x_rename)(const char *oldpath, const char *newpath, int *result)
 			 * newpath. Later on commit we drop the oldpath link to complete
 			 * the rename.
 			 */
+			if (txc_g_journalmgr && !newpath_koa_is_valid &&
+			    (local_result = txc_journal_log_name(txc_g_journalmgr, txd, 
+			                                         TXC_JOURNAL_UNDO_UNLINK,
+			                                         newpath, NULL, 
+			                                         oldpath_inode)) != 0)
+			{
+				txc_koa_unlock_alias_cache(koamgr);
+				ret = -1;
+				goto done;
+			}
 			txc_libc_link(oldpath, newpath);
+			if (txc_g_journalmgr &&
+			    ((local_result = txc_journal_sync_parent(newpath)) != 0 ||
+			     (local_result = txc_journal_log_name(txc_g_journalmgr, txd, 
+			                                          TXC_JOURNAL_REDO_UNLINK,
+			                                          oldpath, NULL, 
+			                                          oldpath_inode)) != 0))
+			{
+				/* No undo action is registered yet; restore newpath here. */
+				txc_libc_unlink(newpath);
+				if (newpath_koa_is_valid) {
+					txc_libc_rename(temppath, newpath);
+				}
+				txc_koa_unlock_alias_cache(koamgr);
+				ret = -1;
+				goto done;
+			}
 
 			args_commit_undo = (x_rename_commit_undo_args_t *)
 			                   txc_buffer_linear_malloc(txd->buffer_linear, 
@@ -280,8 +352,14 @@ XCALL_DEF(x_rename)(const char *oldpath, const char *newpath, int *result)
 			args_commit_undo->oldpath_koa = oldpath_koa;
 			args_commit_undo->newpath_koa_is_valid = newpath_koa_is_valid;
 
+			/* 
+			 * With a journal, the commit syncs the file, so it waits for
+			 * the deferred writes to it.
+			 */
 			txc_tx_register_commit_action(txd, x_rename_commit, 
 			                              (void *) args_commit_undo, result,
+			                              txc_g_journalmgr ? 
+			                              TXC_KOA_DESTROY_COMMIT_ACTION_ORDER :
 			                              TXC_KOA_CREATE_COMMIT_ACTION_ORDER);
 			txc_tx_register_undo_action  (txd, x_rename_undo, 
 			                              (void *) args_commit_undo, result,
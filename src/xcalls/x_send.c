@@ -0,0 +1,289 @@
+/*
+    Copyright (C) 2008-2009 Computer Sciences Department, 
+    University of Wisconsin -- Madison
+
+    ----------------------------------------------------------------------
+
+    This file is part of the xCalls transactional API, originally 
+    developed at the University of Wisconsin -- Madison.
+
+    xCalls was originally developed primarily by Haris Volos and 
+    Neelam Goyal with contributions from Andres Jaan Tack.
+
+    ----------------------------------------------------------------------
+
+    xCalls is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as 
+    published by the Free Software Foundation, either version 3 of 
+    the License, or (at your option) any later version.
+
+    xCalls is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public 
+    License along with xCalls.  If not, see <http://www.gnu.org/licenses/>.
+
+### END HEADER ###
+*/
+
+/**
+ * \file x_send.c
+ *
+ * \brief x_send implementation.
+ *
+ * Sends are deferred until commit. Consecutive sends of a transaction 
+ * to the same stream socket using the same flags are coalesced into a 
+ * single batch that is handed to the kernel with as few sendmsg calls as 
+ * possible. The batch being built is kept in the socket's KOA, which is 
+ * safe because only the transaction holding the KOA's sentinel may 
+ * touch it.
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <misc/debug.h>
+#include <misc/errno.h>
+#include <core/tx.h>
+#include <core/config.h>
+#include <core/koa.h>
+#include <core/buffer.h>
+#include <core/txdesc.h>
+#include <core/stats.h>
+#include <libc/syscalls.h>
+#include <xcalls/xcalls.h>
+
+#define TXC_SEND_IOV_MAX 64
+
+typedef struct x_send_chunk_s x_send_chunk_t;
+typedef struct x_send_commit_undo_args_s x_send_commit_undo_args_t;
+
+struct x_send_chunk_s {
+	char           *buf;
+	size_t         len;
+	x_send_chunk_t *next;
+};
+
+struct x_send_commit_undo_args_s {
+	int            fd;
+	int            flags;
+	txc_koa_t      *koa;
+	x_send_chunk_t *head;
+	x_send_chunk_t *tail;
+};
+
+
+static
+void
+x_send_undo(void *args, int *result)
+{
+	x_send_commit_undo_args_t *args_undo = (x_send_commit_undo_args_t *) args;
+
+	if (txc_koa_get_pending_output(args_undo->koa) == args) {
+		txc_koa_set_pending_output(args_undo->koa, NULL);
+	}
+	if (result) {
+		*result = 0;
+	}
+}
+
+
+static
+void
+x_send_commit(void *args, int *result)
+{
+	x_send_commit_undo_args_t *args_commit = (x_send_commit_undo_args_t *) args;
+	int                       local_result = 0;
+	struct iovec              iov[TXC_SEND_IOV_MAX];
+	struct msghdr             msg;
+	x_send_chunk_t            *chunk;
+	x_send_chunk_t            *iter;
+	size_t                    offset;
+	ssize_t                   ret;
+	int                       i;
+
+	if (txc_koa_get_pending_output(args_commit->koa) == args) {
+		txc_koa_set_pending_output(args_commit->koa, NULL);
+	}
+
+	memset(&msg, 0, sizeof(struct msghdr));
+	msg.msg_iov = iov;
+	chunk = args_commit->head;
+	offset = 0;
+	while (chunk) {
+		iov[0].iov_base = chunk->buf + offset;
+		iov[0].iov_len = chunk->len - offset;
+		for (i=1, iter = chunk->next; 
+		     i<TXC_SEND_IOV_MAX && iter; 
+		     i++, iter = iter->next) 
+		{
+			iov[i].iov_base = iter->buf;
+			iov[i].iov_len = iter->len;
+		}
+		msg.msg_iovlen = i;
+		if ((ret = txc_libc_sendmsg(args_commit->fd, &msg, 
+		                            args_commit->flags)) < 0) 
+		{
+			if (errno == EINTR) {
+				continue;
+			}
+			local_result = errno;
+			break;
+		}
+		/* Skip what the kernel took; it may have taken only part of it. */
+		while (chunk && ret >= (ssize_t) (chunk->len - offset)) {
+			ret -= chunk->len - offset;
+			chunk = chunk->next;
+			offset = 0;
+		}
+		offset += ret;
+	}
+
+	if (result) {
+		*result = local_result;
+	}	
+}
+
+
+/**
+ * \brief Sends a message to a stream socket.
+ * 
+ * <b> Execution </b>: deferred
+ *
+ * <b> Asynchronous failures </b>: commit
+ *
+ * \param[in] s The file descriptor of the socket.
+ * \param[in] buf The buffer that has the data to send.
+ * \param[in] len The number of bytes to send.
+ * \param[in] flags See man send.
+ * \param[out] result Where to store any asynchronous failures.
+ * \return The number of sent bytes on success, or -1 if a synchronous failure 
+ * occurred (in which case, errno is set appropriately).
+ */
+ssize_t 
+XCALL_DEF(x_send)(int s, const void *buf, size_t len, int flags, int *result)
+{
+	txc_tx_t                  *txd;
+	txc_koamgr_t              *koamgr = txc_g_koamgr;
+	txc_koa_t                 *koa;
+	txc_sentinel_t            *sentinel;
+	txc_result_t              xret;
+	ssize_t                   ret;
+	x_send_commit_undo_args_t *args_commit_undo;
+	x_send_chunk_t            *chunk;
+	int                       local_result;
+
+
+	txd = txc_tx_get_txd();
+
+	switch(txc_tx_get_xactstate(txd)) {
+		case TXC_XACTSTATE_TRANSACTIONAL_IRREVOCABLE:
+		case TXC_XACTSTATE_NONTRANSACTIONAL:
+			if ((ret = txc_libc_send(s, buf, len, flags)) < 0) {
+				local_result = errno;
+			} else {
+				local_result = 0;
+			}
+			goto done;
+
+		case TXC_XACTSTATE_TRANSACTIONAL_RETRYABLE:
+			txc_koa_lock_fd(koamgr, s);
+			xret = txc_koa_lookup_fd2koa(koamgr, s, &koa);
+			if (xret == TXC_R_FAILURE) {
+				/* 
+				 * The KOA mapped to the file descriptor has gone. Report
+				 * this error as invalid file descriptor.
+				 */
+				txc_koa_unlock_fd(koamgr, s);
+				local_result = EBADF;
+				ret = -1;
+				goto done;
+			}
+			sentinel = txc_koa_get_sentinel(koa);
+			xret = txc_sentinel_tryacquire(txd, sentinel, 
+			                               TXC_SENTINEL_ACQUIREONRETRY);
+			txc_koa_unlock_fd(koamgr, s);
+			if (xret == TXC_R_BUSYSENTINEL) {
+				txc_tx_abort_transaction(txd, TXC_ABORTREASON_BUSYSENTINEL);
+				TXC_INTERNALERROR("Never gets here. Transaction abort failed.\n");
+			}
+
+			/* 
+			 * Got sentinel. Continue with the rest of the stuff. Only 
+			 * sends to stream sockets are coalesced since each send to a 
+			 * datagram socket is a message of its own.
+			 */
+			if (txc_koa_get_type(koa) == TXC_KOA_IS_SOCK_STREAM) {
+				args_commit_undo = (x_send_commit_undo_args_t *) 
+				                   txc_koa_get_pending_output(koa);
+			} else {
+				args_commit_undo = NULL;
+			}
+			if (args_commit_undo == NULL || args_commit_undo->flags != flags) {
+				/* Start a new batch. */
+				if ((args_commit_undo = (x_send_commit_undo_args_t *)
+				                        txc_buffer_linear_malloc(txd->buffer_linear, 
+				                                                 sizeof(x_send_commit_undo_args_t)))
+				    == NULL)
+				{	
+					local_result = ENOMEM;
+					ret = -1;
+					goto done;
+				}
+				args_commit_undo->fd = s;
+				args_commit_undo->flags = flags;
+				args_commit_undo->koa = koa;
+				args_commit_undo->head = args_commit_undo->tail = NULL;
+				txc_tx_register_commit_action(txd, x_send_commit, 
+				                              (void *) args_commit_undo, result,
+				                              TXC_TX_REGULAR_COMMIT_ACTION_ORDER);
+				txc_tx_register_undo_action(txd, x_send_undo, 
+				                            (void *) args_commit_undo, result,
+				                            TXC_TX_REGULAR_UNDO_ACTION_ORDER);
+				if (txc_koa_get_type(koa) == TXC_KOA_IS_SOCK_STREAM) {
+					txc_koa_set_pending_output(koa, (void *) args_commit_undo);
+				} else {
+					/* Later x_sendmsg calls must not be batched ahead of it. */
+					txc_koa_set_pending_output(koa, NULL);
+				}
+			}
+			if ((chunk = (x_send_chunk_t *) 
+			             txc_buffer_linear_malloc(txd->buffer_linear, 
+			                                      sizeof(x_send_chunk_t) + len))
+			    == NULL) 
+			{
+				local_result = ENOMEM;
+				ret = -1;
+				goto done;
+			}
+			chunk->buf = (char *) (chunk + 1);
+			chunk->len = len;
+			chunk->next = NULL;
+			memcpy(chunk->buf, buf, len);
+			if (args_commit_undo->tail) {
+				args_commit_undo->tail->next = chunk;
+			} else {
+				args_commit_undo->head = chunk;
+			}
+			args_commit_undo->tail = chunk;
+			local_result = 0;							
+			ret = len;
+			txc_stats_txstat_increment(txd, XCALL, x_send, 1);
+			goto done;
+		default:
+			TXC_INTERNALERROR("Unknown transaction state\n");
+	}
+
+done:
+	if (result) {
+		*result = local_result;
+	}
+	return ret;
+}
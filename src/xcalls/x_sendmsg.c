@@ -32,6 +32,13 @@
  * \file x_sendmsg.c
  *
  * \brief x_sendmsg implementation.
+ *
+ * Messages are deferred until commit. The messages a transaction sends to
+ * a datagram socket with the same flags are gathered into a batch that is
+ * handed to the kernel with as few sendmmsg calls as possible. Each 
+ * message is copied, name, control data and payload, into a single 
+ * contiguous piece of the linear buffer. As with x_send, the batch being
+ * built is kept in the socket's KOA.
  */
 
 #include <fcntl.h>
@@ -52,26 +59,98 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 
-typedef struct x_sendmsg_commit_args_s x_sendmsg_commit_args_t;
+#define TXC_SENDMSG_BATCH_MAX 64
+
+/** Rounds a length up so that what follows it is aligned. */
+#define TXC_SENDMSG_ALIGN(len) (((len) + 7) & ~((size_t) 7))
+
+typedef struct x_sendmsg_entry_s x_sendmsg_entry_t;
+typedef struct x_sendmsg_commit_undo_args_s x_sendmsg_commit_undo_args_t;
+
+struct x_sendmsg_entry_s {
+	struct msghdr     msg;
+	struct iovec      iov;
+	int               *result;  /**< Where to report the failure of this message */
+	x_sendmsg_entry_t *next;
+};
 
-struct x_sendmsg_commit_args_s {
-	int  fd;
-	int  flags;
-	struct msghdr msg;
+struct x_sendmsg_commit_undo_args_s {
+	int               fd;
+	int               flags;
+	txc_koa_t         *koa;
+	x_sendmsg_entry_t *head;
+	x_sendmsg_entry_t *tail;
 };
 
+
+static
+void
+x_sendmsg_undo(void *args, int *result)
+{
+	x_sendmsg_commit_undo_args_t *args_undo = (x_sendmsg_commit_undo_args_t *) args;
+
+	if (txc_koa_get_pending_output(args_undo->koa) == args) {
+		txc_koa_set_pending_output(args_undo->koa, NULL);
+	}
+	if (result) {
+		*result = 0;
+	}
+}
+
+
 static
 void
 x_sendmsg_commit(void *args, int *result)
 {
-	x_sendmsg_commit_args_t *args_commit = (x_sendmsg_commit_args_t *) args;
-	int                     local_result = 0;
+	x_sendmsg_commit_undo_args_t *args_commit = (x_sendmsg_commit_undo_args_t *) args;
+	int                          local_result = 0;
+	txc_libc_mmsghdr_t           msgvec[TXC_SENDMSG_BATCH_MAX];
+	x_sendmsg_entry_t            *entry;
+	x_sendmsg_entry_t            *iter;
+	int                          ret;
+	int                          n;
+	int                          i;
+
+	if (txc_koa_get_pending_output(args_commit->koa) == args) {
+		txc_koa_set_pending_output(args_commit->koa, NULL);
+	}
 
-	if (txc_libc_sendmsg(args_commit->fd, &args_commit->msg, 
-	                     args_commit->flags)  < 0)
-	{
-		local_result = errno;
+	entry = args_commit->head;
+	while (entry) {
+		for (n=0, iter = entry; 
+		     n<TXC_SENDMSG_BATCH_MAX && iter; 
+		     n++, iter = iter->next) 
+		{
+			msgvec[n].msg_hdr = iter->msg;
+			msgvec[n].msg_len = 0;
+		}
+		if ((ret = txc_libc_sendmmsg(args_commit->fd, msgvec, n, 
+		                             args_commit->flags)) < 0) 
+		{
+			if (errno == EINTR) {
+				continue;
+			}
+			/* 
+			 * The first message failed. Report it to its sender and go on
+			 * with the rest, as if each message were sent on its own.
+			 */
+			if (entry->result) {
+				*entry->result = errno;
+			}
+			if (local_result == 0) {
+				local_result = errno;
+			}
+			entry = entry->next;
+			continue;
+		}
+		for (i=0; i<ret; i++) {
+			if (entry->result) {
+				*entry->result = 0;
+			}
+			entry = entry->next;
+		}
 	}
+
 	if (result) {
 		*result = local_result;
 	}	
@@ -97,14 +176,18 @@ x_sendmsg_commit(void *args, int *result)
 ssize_t 
 XCALL_DEF(x_sendmsg)(int fd, const struct msghdr *msg, int flags, int *result)
 {
-	txc_tx_t                *txd;
-	txc_koamgr_t            *koamgr = txc_g_koamgr;
-	txc_koa_t               *koa;
-	txc_sentinel_t          *sentinel;
-	txc_result_t            xret;
-	int                     ret;
-	x_sendmsg_commit_args_t *args_commit;
-	int                     local_result;
+	txc_tx_t                     *txd;
+	txc_koamgr_t                 *koamgr = txc_g_koamgr;
+	txc_koa_t                    *koa;
+	txc_sentinel_t               *sentinel;
+	txc_result_t                 xret;
+	ssize_t                      ret;
+	x_sendmsg_commit_undo_args_t *args_commit_undo;
+	x_sendmsg_entry_t            *entry;
+	char                         *p;
+	size_t                       len;
+	size_t                       i;
+	int                          local_result;
 
 
 	txd = txc_tx_get_txd();
@@ -141,54 +224,100 @@ XCALL_DEF(x_sendmsg)(int fd, const struct msghdr *msg, int flags, int *result)
 				TXC_INTERNALERROR("Never gets here. Transaction abort failed.\n");
 			}
 
-			/* Got sentinel. Continue with the rest of the stuff. */
-			if ((args_commit = (x_sendmsg_commit_args_t *)
-   	                           txc_buffer_linear_malloc(txd->buffer_linear, 
-			                                            sizeof(x_sendmsg_commit_args_t)))
-			    == NULL)
-			{	
-				local_result = ENOMEM;
-				ret = -1;
-				goto done;
+			/* 
+			 * Got sentinel. Continue with the rest of the stuff. On a 
+			 * stream socket the pending output is a batch of x_send, 
+			 * which later x_send calls must not extend past this message.
+			 */
+			if (txc_koa_get_type(koa) == TXC_KOA_IS_SOCK_DGRAM) {
+				args_commit_undo = (x_sendmsg_commit_undo_args_t *) 
+				                   txc_koa_get_pending_output(koa);
+			} else {
+				txc_koa_set_pending_output(koa, NULL);
+				args_commit_undo = NULL;
 			}
-			memcpy(&args_commit->msg, msg, sizeof(struct msghdr));
-			args_commit->fd = fd;
-			args_commit->flags = flags;
-			if ((args_commit->msg.msg_iov = (struct iovec *) txc_buffer_linear_malloc(txd->buffer_linear, 
-			                                                                  msg->msg_iovlen))
-			    == NULL) 
-			{
-				local_result = ENOMEM;
-				ret = -1;
-				goto error_handler;
+			if (args_commit_undo == NULL || args_commit_undo->flags != flags) {
+				/* Start a new batch. */
+				if ((args_commit_undo = (x_sendmsg_commit_undo_args_t *)
+				                        txc_buffer_linear_malloc(txd->buffer_linear, 
+				                                                 sizeof(x_sendmsg_commit_undo_args_t)))
+				    == NULL)
+				{	
+					local_result = ENOMEM;
+					ret = -1;
+					goto done;
+				}
+				args_commit_undo->fd = fd;
+				args_commit_undo->flags = flags;
+				args_commit_undo->koa = koa;
+				args_commit_undo->head = args_commit_undo->tail = NULL;
+				/* Failures are reported to each message's sender. */
+				txc_tx_register_commit_action(txd, x_sendmsg_commit, 
+				                              (void *) args_commit_undo, NULL,
+				                              TXC_TX_REGULAR_COMMIT_ACTION_ORDER);
+				txc_tx_register_undo_action(txd, x_sendmsg_undo, 
+				                            (void *) args_commit_undo, NULL,
+				                            TXC_TX_REGULAR_UNDO_ACTION_ORDER);
+				if (txc_koa_get_type(koa) == TXC_KOA_IS_SOCK_DGRAM) {
+					txc_koa_set_pending_output(koa, (void *) args_commit_undo);
+				}
 			}
-			if ((args_commit->msg.msg_control = (void *) txc_buffer_linear_malloc(txd->buffer_linear, 
-			                                                                      msg->msg_controllen))
+
+			/* Copy the message into a single piece of the linear buffer. */
+			for (len=0, i=0; i<msg->msg_iovlen; i++) {
+				len += msg->msg_iov[i].iov_len;
+			}
+			if ((entry = (x_sendmsg_entry_t *) 
+			             txc_buffer_linear_malloc(txd->buffer_linear, 
+			                                      sizeof(x_sendmsg_entry_t) + 
+			                                      TXC_SENDMSG_ALIGN(msg->msg_namelen) +
+			                                      TXC_SENDMSG_ALIGN(msg->msg_controllen) +
+			                                      len))
 			    == NULL) 
 			{
 				local_result = ENOMEM;
 				ret = -1;
-				goto error_handler2;
+				goto done;
+			}
+			p = (char *) (entry + 1);
+			memset(&entry->msg, 0, sizeof(struct msghdr));
+			if (msg->msg_name && msg->msg_namelen > 0) {
+				entry->msg.msg_name = p;
+				entry->msg.msg_namelen = msg->msg_namelen;
+				memcpy(p, msg->msg_name, msg->msg_namelen);
+				p += TXC_SENDMSG_ALIGN(msg->msg_namelen);
+			}
+			if (msg->msg_control && msg->msg_controllen > 0) {
+				entry->msg.msg_control = p;
+				entry->msg.msg_controllen = msg->msg_controllen;
+				memcpy(p, msg->msg_control, msg->msg_controllen);
+				p += TXC_SENDMSG_ALIGN(msg->msg_controllen);
+			}
+			entry->iov.iov_base = p;
+			entry->iov.iov_len = len;
+			for (i=0; i<msg->msg_iovlen; i++) {
+				memcpy(p, msg->msg_iov[i].iov_base, msg->msg_iov[i].iov_len);
+				p += msg->msg_iov[i].iov_len;
+			}
+			entry->msg.msg_iov = &entry->iov;
+			entry->msg.msg_iovlen = 1;
+			entry->result = result;
+			entry->next = NULL;
+			if (args_commit_undo->tail) {
+				args_commit_undo->tail->next = entry;
+			} else {
+				args_commit_undo->head = entry;
 			}
+			args_commit_undo->tail = entry;
 
-			memcpy (args_commit->msg.msg_iov, msg->msg_iov, msg->msg_iovlen);
-			memcpy (args_commit->msg.msg_control, msg->msg_control, msg->msg_controllen);
-			txc_tx_register_commit_action(txd, x_sendmsg_commit, 
-			                              (void *) args_commit, result,
-			                              TXC_TX_REGULAR_COMMIT_ACTION_ORDER);
 			local_result = 0;							
+			ret = len;
 			txc_stats_txstat_increment(txd, XCALL, x_sendmsg, 1);
 			goto done;
 		default:
 			TXC_INTERNALERROR("Unknown transaction state\n");
 	}
 
-error_handler2:
-	txc_buffer_linear_free(txd->buffer_linear,
-		                   msg->msg_iovlen);
-error_handler:
-	txc_buffer_linear_free(txd->buffer_linear,
-		                   sizeof(x_sendmsg_commit_args_t));
 done:
 	if (result) {
 		*result = local_result;
@@ -94,13 +94,13 @@ x_socket_undo(void *args, int *result)
  * \param[in] type Specifies communication semantics. Currently we support:
  *            \li SOCK_DGRAM: Supports datagrams (connectionless, unreliable 
  *                messages of a fixed maximum length).
+ *            \li SOCK_STREAM: Provides sequenced, reliable, two-way, 
+ *                connection-based byte streams.
  * \param[in] protocol Specifies a particular protocol to be used with the 
  *            socket.
  * \param[out] result Where to store any asynchronous failures.
  * \return A new file descriptor for the new socket, or -1 if a synchronous 
  *         failure occurred (in which case, errno is set appropriately).
- * 
- * \todo Implement SOCK_STREAM.
  */
 int 
 XCALL_DEF(x_socket)(int domain, int type, int protocol, int *result) 
@@ -123,6 +123,9 @@ XCALL_DEF(x_socket)(int domain, int type, int protocol, int *result)
 			koa_type = TXC_KOA_IS_SOCK_DGRAM;
 			break;
 		case SOCK_STREAM:
+			koa_type = TXC_KOA_IS_SOCK_STREAM;
+			break;
+		default:
 			local_result = EINVAL;
 			ret = -1;
 			goto done;
@@ -134,7 +137,12 @@ XCALL_DEF(x_socket)(int domain, int type, int protocol, int *result)
 				local_result = errno;
 				goto done;
 			}
-			txc_koa_create(koamgr, &koa, koa_type, NULL); 
+			if (txc_koa_create(koamgr, &koa, koa_type, NULL) != TXC_R_SUCCESS) {
+				txc_libc_close(fildes);
+				local_result = ENOMEM;
+				ret = -1;
+				goto done;
+			}
 			txc_koa_lock_fd(koamgr, fildes);
 			txc_koa_attach_fd(koa, fildes, 0);
 			sentinel = txc_koa_get_sentinel(koa);
@@ -173,7 +181,12 @@ XCALL_DEF(x_socket)(int domain, int type, int protocol, int *result)
 				local_result = errno;
 				goto done;
 			}
-			txc_koa_create(koamgr, &koa, koa_type, NULL); 
+			if (txc_koa_create(koamgr, &koa, koa_type, NULL) != TXC_R_SUCCESS) {
+				txc_libc_close(fildes);
+				local_result = ENOMEM;
+				ret = -1;
+				goto done;
+			}
 			txc_koa_lock_fd(koamgr, fildes);
 			txc_koa_attach_fd(koa, fildes, 0);
 			txc_koa_unlock_fd(koamgr, fildes);
@@ -47,6 +47,7 @@
 #include <core/buffer.h>
 #include <core/txdesc.h>
 #include <core/stats.h>
+#include <core/journal.h>
 #include <libc/syscalls.h>
 #include <xcalls/xcalls.h>
 
@@ -120,6 +121,11 @@ XCALL_DEF(x_unlink)(const char *pathname, int *result)
 	switch(txc_tx_get_xactstate(txd)) {
 		case TXC_XACTSTATE_TRANSACTIONAL_RETRYABLE:
 			txc_koa_lock_alias_cache(koamgr);
+			if ((local_result = txc_x_create_publish(txd, pathname)) != 0) {
+				txc_koa_unlock_alias_cache(koamgr);
+				ret = -1;
+				goto done;
+			}
 			txc_koa_path2inode(pathname, &inode);
 			if (inode == 0) {
 				/* File does not exist. */
@@ -156,7 +162,14 @@ XCALL_DEF(x_unlink)(const char *pathname, int *result)
 					 *   way for some other in-flight transaction to have a reference 
 					 *   to the file to operate on it.
 				 	 */
-					txc_koa_create(koamgr, &koa, TXC_KOA_IS_FILE, (void *) inode);
+					if (txc_koa_create(koamgr, &koa, TXC_KOA_IS_FILE, (void *) inode)
+					    != TXC_R_SUCCESS)
+					{
+						txc_koa_unlock_alias_cache(koamgr);
+						local_result = ENOMEM;
+						ret = -1;
+						goto done;
+					}
 					txc_koa_attach(koa);
 					sentinel = txc_koa_get_sentinel(koa);
 					xret = txc_sentinel_tryacquire(txd, sentinel, 0);
@@ -174,6 +187,16 @@ XCALL_DEF(x_unlink)(const char *pathname, int *result)
 				args_commit->koa = koa;
 				strcpy(args_commit->pathname, pathname);
 
+				if (txc_g_journalmgr &&
+				    (local_result = txc_journal_log_name(txc_g_journalmgr, txd, 
+				                                         TXC_JOURNAL_REDO_UNLINK,
+				                                         pathname, NULL, inode)) != 0)
+				{
+					txc_koa_unlock_alias_cache(koamgr);
+					ret = -1;
+					goto done;
+				}
+
 				txc_tx_register_commit_action(txd, x_unlink_commit, 
 				                              (void *) args_commit, result,
 				                              TXC_KOA_DESTROY_COMMIT_ACTION_ORDER);
@@ -31,7 +31,18 @@
 /**
  * \file x_write.c
  *
- * \brief x_write_seq, x_write_ignore, x_write_ovr implementation.
+ * \brief x_write_seq, x_write_ignore, x_write_ovr, x_write_deferred 
+ * implementation.
+ *
+ * x_write_deferred keeps the writes of a transaction to a file in a map 
+ * of non-overlapping extents, kept sorted by file offset in the file's 
+ * KOA. The data are written to the file at commit with one pwritev per 
+ * run of contiguous extents, so an abort only has to drop the map. x_read
+ * and x_lseek overlay the map so that a transaction sees its own deferred
+ * writes.
+ *
+ * Writes at a shadowed file offset (see offset.c) go to the file with 
+ * pwrite and their undo actions use absolute offsets, never lseek.
  */
 
 #include <fcntl.h>
@@ -39,6 +50,7 @@
 #include <errno.h>
 #include <string.h>
 #include <stdlib.h>
+#include <sys/uio.h>
 #include <misc/debug.h>
 #include <misc/errno.h>
 #include <core/tx.h>
@@ -47,21 +59,55 @@
 #include <core/buffer.h>
 #include <core/txdesc.h>
 #include <core/stats.h>
+#include <core/uring.h>
+#include <core/journal.h>
 #include <libc/syscalls.h>
 #include <xcalls/xcalls.h>
+#include <xcalls/offset.h>
 
 
 #define TXC_WRITE_SEQ         0x1
 #define TXC_WRITE_OVR_SAVE    0x2
 #define TXC_WRITE_OVR_IGNORE  0x3
+#define TXC_WRITE_DEFERRED    0x4
+
+#define TXC_WRITE_DEFERRED_IOV_MAX 64
 
 typedef struct x_write_undo_args_s x_write_undo_args_t;
+typedef struct x_write_deferred_extent_s x_write_deferred_extent_t;
+typedef struct x_write_deferred_result_s x_write_deferred_result_t;
+typedef struct x_write_deferred_commit_undo_args_s x_write_deferred_commit_undo_args_t;
 
 struct x_write_undo_args_s {
-	int  fd;
-	void *buf;
-	int  nbyte_new;
-	int  nbyte_old;
+	int                 fd;
+	off_t               offset;         /**< File offset written at, or -1 if at the kernel offset */
+	void                *buf;
+	int                 nbyte_new;
+	int                 nbyte_old;
+	txc_buffer_linear_t *spill_buffer;  /**< Buffer keeping the old data in its spill file, if not in buf */
+	off_t               spill_offset;
+	int                 spill_cloned;   /**< Whether the old data are in the clone file of spill_buffer */
+};
+
+struct x_write_deferred_extent_s {
+	off_t                     offset;
+	size_t                    len;
+	char                      *data;
+	x_write_deferred_extent_t *next;
+};
+
+struct x_write_deferred_result_s {
+	int                       *result;  /**< Where to report the failure of the commit */
+	x_write_deferred_result_t *next;
+};
+
+struct x_write_deferred_commit_undo_args_s {
+	int                       fd;
+	txc_koa_t                 *koa;
+	off_t                     end;            /**< End of the furthest deferred write */
+	x_write_deferred_extent_t *head;
+	x_write_deferred_extent_t *tail;
+	x_write_deferred_result_t *results;
 };
 
 
@@ -70,10 +116,11 @@ void
 x_write_seq_undo(void *args, int *result)
 {
 	x_write_undo_args_t *args_undo = (x_write_undo_args_t *) args;
-	off_t               offset;
+	off_t               offset = args_undo->offset;
 	int                 local_result = 0;
 
-	if ((offset = txc_libc_lseek(args_undo->fd, 
+	if (offset < 0 &&
+	    (offset = txc_libc_lseek(args_undo->fd, 
 	                             -(args_undo->nbyte_new), SEEK_CUR)) < 0) 
 	{
 		local_result = errno;
@@ -94,16 +141,17 @@ void
 x_write_ovr_undo(void *args, int *result)
 {
 	x_write_undo_args_t *args_undo = (x_write_undo_args_t *) args;
-	off_t               offset;
+	off_t               offset = args_undo->offset;
 	int                 local_result = 0;
 
-	if ((offset = txc_libc_lseek(args_undo->fd, 
+	if (offset < 0 &&
+	    (offset = txc_libc_lseek(args_undo->fd, 
 	                             -(args_undo->nbyte_new), SEEK_CUR)) < 0) 
 	{
 		local_result = errno;
 		goto done;
 	}
-	if (args_undo->buf) {	
+	if (args_undo->buf || args_undo->spill_buffer) {	
 		if (args_undo->nbyte_old < args_undo->nbyte_new) {
 			/*
 			 * (nbyte_old < nbyte_new) means we wrote more data than we were 
@@ -118,8 +166,24 @@ x_write_ovr_undo(void *args, int *result)
 				goto done;
 			}	
 		}
-		if (txc_libc_pwrite(args_undo->fd, args_undo->buf, 
-		                    args_undo->nbyte_old, offset)  < 0)
+		if (args_undo->spill_buffer && args_undo->spill_cloned) {
+			if (txc_buffer_linear_unclone(args_undo->spill_buffer, 
+			                              args_undo->spill_offset, 
+			                              args_undo->fd, 
+			                              args_undo->nbyte_old, offset) < 0)
+			{
+				local_result = errno;
+			}
+		} else if (args_undo->spill_buffer) {
+			if (txc_buffer_linear_unspill(args_undo->spill_buffer, 
+			                              args_undo->spill_offset, 
+			                              args_undo->fd, 
+			                              args_undo->nbyte_old, offset) < 0)
+			{
+				local_result = errno;
+			}
+		} else if (txc_libc_pwrite(args_undo->fd, args_undo->buf, 
+		                           args_undo->nbyte_old, offset)  < 0)
 		{
 			local_result = errno;
 		}
@@ -131,6 +195,403 @@ done:
 }
 
 
+/**
+ * Removes the range [offset, offset+len) from the extents of the map. 
+ * An extent covering the range on both sides is split in two.
+ */
+static
+int
+x_write_deferred_punch(txc_buffer_linear_t *buffer_linear,
+                       x_write_deferred_commit_undo_args_t *map,
+                       off_t offset, size_t len)
+{
+	x_write_deferred_extent_t **prevp = &map->head;
+	x_write_deferred_extent_t *prev = NULL;
+	x_write_deferred_extent_t *extent;
+	x_write_deferred_extent_t *right;
+	off_t                     end = offset + len;
+	off_t                     extent_end;
+
+	while ((extent = *prevp)) {
+		extent_end = extent->offset + extent->len;
+		if (extent_end <= offset) {
+			prev = extent;
+			prevp = &extent->next;
+			continue;
+		}
+		if (extent->offset >= end) {
+			break;
+		}
+		if (extent->offset < offset && extent_end > end) {
+			if ((right = (x_write_deferred_extent_t *) 
+			             txc_buffer_linear_malloc(buffer_linear, 
+			                                      sizeof(x_write_deferred_extent_t)))
+			    == NULL)
+			{
+				return -1;
+			}
+			right->offset = end;
+			right->len = extent_end - end;
+			right->data = extent->data + (end - extent->offset);
+			right->next = extent->next;
+			extent->len = offset - extent->offset;
+			extent->next = right;
+			if (map->tail == extent) {
+				map->tail = right;
+			}
+			break;
+		}
+		if (extent->offset < offset) {
+			extent->len = offset - extent->offset;
+			prev = extent;
+			prevp = &extent->next;
+			continue;
+		}
+		if (extent_end > end) {
+			extent->data += end - extent->offset;
+			extent->len = extent_end - end;
+			extent->offset = end;
+			break;
+		}
+		/* Completely overwritten. */
+		*prevp = extent->next;
+		if (map->tail == extent) {
+			map->tail = prev;
+		}
+	}
+	return 0;
+}
+
+
+/**
+ * Adds an extent to the map, replacing any data it overwrites.
+ */
+static
+int
+x_write_deferred_insert(txc_buffer_linear_t *buffer_linear,
+                        x_write_deferred_commit_undo_args_t *map,
+                        x_write_deferred_extent_t *new_extent)
+{
+	x_write_deferred_extent_t **prevp;
+
+	/* Sequential writes go past the last extent. */
+	if (map->tail == NULL || 
+	    map->tail->offset + (off_t) map->tail->len <= new_extent->offset) 
+	{
+		new_extent->next = NULL;
+		if (map->tail) {
+			map->tail->next = new_extent;
+		} else {
+			map->head = new_extent;
+		}
+		map->tail = new_extent;
+		return 0;
+	}
+	if (x_write_deferred_punch(buffer_linear, map, 
+	                           new_extent->offset, new_extent->len) < 0) 
+	{
+		return -1;
+	}
+	for (prevp = &map->head; 
+	     *prevp && (*prevp)->offset < new_extent->offset; 
+	     prevp = &(*prevp)->next);
+	new_extent->next = *prevp;
+	*prevp = new_extent;
+	if (new_extent->next == NULL) {
+		map->tail = new_extent;
+	}
+	return 0;
+}
+
+
+static
+void
+x_write_deferred_report_result(x_write_deferred_commit_undo_args_t *map, 
+                               int local_result)
+{
+	x_write_deferred_result_t *iter;
+
+	for (iter = map->results; iter; iter = iter->next) {
+		*iter->result = local_result;
+	}
+}
+
+
+static
+void
+x_write_deferred_undo(void *args, int *result)
+{
+	x_write_deferred_commit_undo_args_t *args_undo = (x_write_deferred_commit_undo_args_t *) args;
+
+	/* Nothing reached the file. */
+	if (txc_koa_get_pending_output(args_undo->koa) == args) {
+		txc_koa_set_pending_output(args_undo->koa, NULL);
+	}
+	if (result) {
+		*result = 0;
+	}
+}
+
+
+/** Drops the first n bytes of an iovec. */
+static
+void
+x_write_deferred_iov_drop(struct iovec *iov, int *iovcnt, size_t n)
+{
+	int j;
+
+	for (j = 0; n >= iov[j].iov_len; j++) {
+		n -= iov[j].iov_len;
+	}
+	iov[j].iov_base = (char *) iov[j].iov_base + n;
+	iov[j].iov_len -= n;
+	memmove(&iov[0], &iov[j], (*iovcnt - j) * sizeof(struct iovec));
+	*iovcnt -= j;
+}
+
+
+/**
+ * Writes runs of contiguous extents, starting at extent, with a single 
+ * io_uring submission. Returns the first extent not completely written, 
+ * with *skipp set to how much of its run was, or NULL if all extents 
+ * were written or a write failed (*errorp is set then). Returns extent 
+ * itself if the ring cannot be used.
+ */
+static
+x_write_deferred_extent_t *
+x_write_deferred_commit_uring(int fd, x_write_deferred_extent_t *extent, 
+                              size_t *skipp, int *errorp)
+{
+	struct iovec              iov[TXC_WRITE_DEFERRED_IOV_MAX];
+	txc_uring_op_t            ops[TXC_URING_BATCH_MAX];
+	x_write_deferred_extent_t *first[TXC_URING_BATCH_MAX];
+	size_t                    run_len[TXC_URING_BATCH_MAX];
+	x_write_deferred_extent_t *iter;
+	x_write_deferred_extent_t *prev;
+	int                       num_iov;
+	int                       num_ops;
+	int                       i;
+
+	*skipp = 0;
+	for (iter = extent, num_iov = 0, num_ops = 0; 
+	     iter && num_ops < TXC_URING_BATCH_MAX && 
+	     num_iov < TXC_WRITE_DEFERRED_IOV_MAX; 
+	     num_ops++) 
+	{
+		first[num_ops] = iter;
+		run_len[num_ops] = 0;
+		ops[num_ops].opcode = TXC_URING_OP_WRITEV;
+		ops[num_ops].fd = fd;
+		ops[num_ops].iov = &iov[num_iov];
+		ops[num_ops].iovcnt = 0;
+		ops[num_ops].offset = iter->offset;
+		do {
+			iov[num_iov].iov_base = iter->data;
+			iov[num_iov].iov_len = iter->len;
+			num_iov++;
+			ops[num_ops].iovcnt++;
+			run_len[num_ops] += iter->len;
+			prev = iter;
+			iter = iter->next;
+		} while (iter && num_iov < TXC_WRITE_DEFERRED_IOV_MAX && 
+		         iter->offset == prev->offset + (off_t) prev->len);
+	}
+	if (txc_uring_submit(ops, num_ops) != TXC_R_SUCCESS) {
+		return extent;
+	}
+	for (i = 0; i < num_ops; i++) {
+		if (ops[i].res == (ssize_t) run_len[i]) {
+			continue;
+		}
+		if (ops[i].res < 0 && ops[i].res != -ECANCELED && 
+		    ops[i].res != -EINTR && ops[i].res != -EAGAIN) 
+		{
+			*errorp = -ops[i].res;
+			return NULL;
+		}
+		/* Short or canceled; the synchronous path completes it. */
+		*skipp = (ops[i].res > 0) ? ops[i].res : 0;
+		return first[i];
+	}
+	return iter;
+}
+
+
+static
+void
+x_write_deferred_commit(void *args, int *result)
+{
+	x_write_deferred_commit_undo_args_t *args_commit = (x_write_deferred_commit_undo_args_t *) args;
+	int                                 local_result = 0;
+	struct iovec                        iov[TXC_WRITE_DEFERRED_IOV_MAX];
+	x_write_deferred_extent_t           *extent;
+	x_write_deferred_extent_t           *iter;
+	off_t                               offset;
+	size_t                              run_len;
+	size_t                              written;
+	size_t                              skip = 0;
+	ssize_t                             ret;
+	int                                 i;
+
+	if (txc_koa_get_pending_output(args_commit->koa) == args) {
+		txc_koa_set_pending_output(args_commit->koa, NULL);
+	}
+
+	extent = args_commit->head;
+	while (extent) {
+		if (txc_runtime_settings.io_uring == TXC_BOOL_TRUE && skip == 0) {
+			extent = x_write_deferred_commit_uring(args_commit->fd, extent, 
+			                                       &skip, &local_result);
+			if (extent == NULL) {
+				goto done;
+			}
+		}
+
+		/* Gather a run of contiguous extents. */
+		offset = extent->offset;
+		iov[0].iov_base = extent->data;
+		iov[0].iov_len = extent->len;
+		run_len = extent->len;
+		for (i=1, iter = extent->next; 
+		     iter && i < TXC_WRITE_DEFERRED_IOV_MAX && 
+		     iter->offset == offset + (off_t) run_len;
+		     i++, iter = iter->next) 
+		{
+			iov[i].iov_base = iter->data;
+			iov[i].iov_len = iter->len;
+			run_len += iter->len;
+		}
+		if ((written = skip) > 0) {
+			x_write_deferred_iov_drop(iov, &i, skip);
+			skip = 0;
+		}
+
+		/* The kernel may take only part of it; write the rest. */
+		for (; written < run_len; written += ret) {
+			if ((ret = txc_libc_pwritev(args_commit->fd, iov, i, 
+			                            offset + written)) < 0) 
+			{
+				if (errno == EINTR) {
+					ret = 0;
+					continue;
+				}
+				local_result = errno;
+				goto done;
+			}
+			if (written + ret < run_len) {
+				/* Drop what was written from the front of the iovec. */
+				x_write_deferred_iov_drop(iov, &i, ret);
+			}
+		}
+		extent = iter;
+	}
+
+done:
+	x_write_deferred_report_result(args_commit, local_result);
+	if (result) {
+		*result = local_result;
+	}	
+}
+
+
+/**
+ * Overlays the deferred writes pending on a file onto data just read 
+ * from it. Bytes past the end of the file that lie before the end of 
+ * a deferred write read back as zeros, as the file would have a hole
+ * there after the commit.
+ *
+ * \param[in] pending The deferred writes pending on the file's KOA.
+ * \param[in,out] buf The buffer holding the data read.
+ * \param[in] nbyte The size of the buffer.
+ * \param[in] offset The file offset the data were read from.
+ * \param[in] nread The number of bytes read from the file.
+ * \return The number of bytes the transaction reads.
+ */
+ssize_t
+txc_x_write_deferred_overlay(void *pending, void *buf, size_t nbyte, 
+                             off_t offset, ssize_t nread)
+{
+	x_write_deferred_commit_undo_args_t *map = (x_write_deferred_commit_undo_args_t *) pending;
+	x_write_deferred_extent_t           *extent;
+	ssize_t                             len = nread;
+	off_t                               from;
+	off_t                               to;
+
+	if (map->end > offset) {
+		if (map->end - offset > (off_t) nbyte) {
+			to = offset + nbyte;
+		} else {
+			to = map->end;
+		}
+		if (to - offset > len) {
+			memset((char *) buf + len, 0, to - offset - len);
+			len = to - offset;
+		}
+	}
+	for (extent = map->head; extent; extent = extent->next) {
+		if (extent->offset >= offset + len) {
+			break;
+		}
+		from = extent->offset > offset ? extent->offset : offset;
+		to = extent->offset + (off_t) extent->len;
+		if (to > offset + len) {
+			to = offset + len;
+		}
+		if (from < to) {
+			memcpy((char *) buf + (from - offset), 
+			       extent->data + (from - extent->offset), to - from);
+		}
+	}
+	return len;
+}
+
+
+/**
+ * Returns the end of the furthest deferred write pending on a file.
+ */
+off_t
+txc_x_write_deferred_end(void *pending)
+{
+	x_write_deferred_commit_undo_args_t *map = (x_write_deferred_commit_undo_args_t *) pending;
+
+	return map->end;
+}
+
+
+/**
+ * Drops the deferred writes pending on a file over the range 
+ * [offset, offset+len), which is about to be written in place.
+ *
+ * \return 0 on success, or -1 if out of memory.
+ */
+int
+txc_x_write_deferred_discard(void *pending, void *buffer_linear, 
+                             off_t offset, size_t len)
+{
+	return x_write_deferred_punch((txc_buffer_linear_t *) buffer_linear, 
+	                              (x_write_deferred_commit_undo_args_t *) pending, 
+	                              offset, len);
+}
+
+
+/**
+ * Journals the data an in-place write has just written. Without an 
+ * offset, the data end at the file offset.
+ */
+static
+int
+x_write_journal(txc_tx_t *txd, int fd, off_t offset, const void *buf, 
+                ssize_t nbyte)
+{
+	if (offset < 0 && 
+	    (offset = txc_libc_lseek(fd, 0, SEEK_CUR) - nbyte) < 0) 
+	{
+		return errno;
+	}
+	return txc_journal_log_write(txc_g_journalmgr, txd, fd, offset, buf, nbyte);
+}
+
+
 static
 ssize_t 
 x_write(int fd, const void *buf, size_t nbyte, int *result, int flags)
@@ -141,9 +602,15 @@ x_write(int fd, const void *buf, size_t nbyte, int *result, int flags)
 	txc_sentinel_t      *sentinel;
 	txc_result_t        xret;
 	int                 ret;
-	void                *old_data;
+	void                *old_data = NULL;
+	off_t               offset;
 	x_write_undo_args_t *args_write_undo;
 	int                 local_result;
+	void                *pending = NULL;
+	txc_offset_shadow_t *shadow;
+	x_write_deferred_commit_undo_args_t *map;
+	x_write_deferred_extent_t           *extent;
+	x_write_deferred_result_t           *result_node;
 
 
 	txd = txc_tx_get_txd();
@@ -181,8 +648,68 @@ x_write(int fd, const void *buf, size_t nbyte, int *result, int flags)
 			}
 
 			/* Got sentinel. Continue with the rest of the stuff. */
+			shadow = txc_offset_shadow_get(txd, koa, fd);
+			if (shadow) {
+				pending = txc_koa_get_pending_output(koa);
+			}
+			if (flags == TXC_WRITE_DEFERRED && shadow == NULL) {
+				/* 
+				 * Appends always go to the end of the file, whatever the 
+				 * offset, so they cannot be placed in the map. They go in 
+				 * place, as do writes to anything but a regular file.
+				 */
+				flags = TXC_WRITE_SEQ;
+			} else if (flags != TXC_WRITE_DEFERRED && pending) {
+				/* 
+				 * Writing in place over deferred data; drop the deferred 
+				 * data so that the commit does not write them back over.
+				 */
+				if (x_write_deferred_punch(txd->buffer_linear, 
+				                           (x_write_deferred_commit_undo_args_t *) pending, 
+				                           shadow->offset, nbyte) < 0) 
+				{
+					local_result = ENOMEM;
+					ret = -1;
+					goto done;
+				}
+			}
 			switch (flags) {
 				case TXC_WRITE_SEQ:
+					/* 
+					 * Undoing the earliest of a run of appends undoes the rest
+					 * too. Without a shadow offset its undo action seeks back
+					 * from the current offset, so only an append right after 
+					 * it can be merged into it.
+					 */
+					args_write_undo = (x_write_undo_args_t *) 
+					                  txc_tx_find_mergeable_undo_action(txd, fd, 
+					                                                    TXC_X_UNDO_WRITE_SEQ,
+					                                                    shadow ? 0 : TXC_TX_MERGE_ADJACENT);
+					if (args_write_undo && 
+					    (shadow == NULL || shadow->offset >= args_write_undo->offset)) 
+					{
+						if (shadow) {
+							if ((ret = txc_libc_pwrite(fd, buf, nbyte, shadow->offset)) < 0) {
+								local_result = errno;
+								goto done;
+							}
+							shadow->offset += ret;
+						} else if ((ret = txc_libc_write(fd, buf, nbyte)) < 0) {
+							local_result = errno;
+							goto done;
+						}
+						args_write_undo->nbyte_new += ret;
+						local_result = 0;
+						if (txc_g_journalmgr &&
+						    (local_result = x_write_journal(txd, fd, 
+						                                    shadow ? shadow->offset - ret : -1,
+						                                    buf, ret)) != 0)
+						{
+							ret = -1;
+						}
+						txc_stats_txstat_increment(txd, XCALL, x_write_seq, 1);
+						goto done;
+					}
 					if ((args_write_undo = (x_write_undo_args_t *)
    			                               txc_buffer_linear_malloc(txd->buffer_linear, 
 					                                                sizeof(x_write_undo_args_t)))
@@ -193,16 +720,42 @@ x_write(int fd, const void *buf, size_t nbyte, int *result, int flags)
 						goto error_handler_write_seq_0;
 					}
 					args_write_undo->fd = fd;
-					if ((ret = txc_libc_write(fd, buf, nbyte)) < 0) {
-						local_result = errno;
+					if (txc_g_journalmgr &&
+					    (local_result = txc_journal_log_undo_truncate(txc_g_journalmgr, txd, fd, 
+					                                                  shadow ? shadow->offset : -1))
+					    != 0)
+					{
+						ret = -1;
 						goto error_handler_write_seq_1;
 					}
+					if (shadow) {
+						args_write_undo->offset = shadow->offset;
+						if ((ret = txc_libc_pwrite(fd, buf, nbyte, shadow->offset)) < 0) {
+							local_result = errno;
+							goto error_handler_write_seq_1;
+						}
+						shadow->offset += ret;
+					} else {
+						args_write_undo->offset = -1;
+						if ((ret = txc_libc_write(fd, buf, nbyte)) < 0) {
+							local_result = errno;
+							goto error_handler_write_seq_1;
+						}
+					}
 					args_write_undo->nbyte_new = ret;
-					txc_tx_register_undo_action(txd, x_write_seq_undo, 
-					                            (void *) args_write_undo, result,
-					                            TXC_TX_REGULAR_UNDO_ACTION_ORDER);
+					txc_tx_register_mergeable_undo_action(txd, x_write_seq_undo, 
+					                                      (void *) args_write_undo, result,
+					                                      TXC_TX_REGULAR_UNDO_ACTION_ORDER,
+					                                      fd, TXC_X_UNDO_WRITE_SEQ);
 					local_result = 0;							
 					ret = args_write_undo->nbyte_new;
+					if (txc_g_journalmgr &&
+					    (local_result = x_write_journal(txd, fd, 
+					                                    shadow ? shadow->offset - ret : -1,
+					                                    buf, ret)) != 0)
+					{
+						ret = -1;
+					}
 					txc_stats_txstat_increment(txd, XCALL, x_write_seq, 1);
 					goto done;
 
@@ -217,7 +770,53 @@ x_write(int fd, const void *buf, size_t nbyte, int *result, int flags)
 						ret = -1;
 						goto error_handler_write_ovr_0;
 					}
-					if (flags == TXC_WRITE_OVR_SAVE) {
+					args_write_undo->spill_buffer = NULL;
+					args_write_undo->spill_cloned = 0;
+					if (txc_g_journalmgr && flags == TXC_WRITE_OVR_SAVE &&
+					    (local_result = txc_journal_log_undo_write(txc_g_journalmgr, txd, fd, 
+					                                               shadow ? shadow->offset : -1,
+					                                               nbyte))
+					    != 0)
+					{
+						ret = -1;
+						goto error_handler_write_ovr_1;
+					}
+					if (flags == TXC_WRITE_OVR_SAVE && 
+					    (txc_buffer_linear_spillable(nbyte) ||
+					     txc_buffer_linear_clonable(nbyte)))
+					{
+						/* 
+						 * Too much data to keep in memory. Clone them next to
+						 * the file, or else keep them in the spill file; they 
+						 * are read back only on abort.
+						 */
+						old_data = NULL;
+						if (shadow) {
+							offset = shadow->offset;
+						} else if ((offset = txc_libc_lseek(fd, 0, SEEK_CUR)) < 0) {
+							local_result = errno;
+							ret = -1;
+							goto error_handler_write_ovr_1;
+						}
+						if (txc_buffer_linear_clonable(nbyte) &&
+						    (ret = txc_buffer_linear_clone(txd->buffer_linear, fd,
+						                                   nbyte, offset, 
+						                                   &args_write_undo->spill_offset))
+						    >= 0)
+						{
+							args_write_undo->spill_cloned = 1;
+						} else if ((ret = txc_buffer_linear_spill(txd->buffer_linear, fd, 
+						                                          nbyte, offset,
+						                                          &args_write_undo->spill_offset)) 
+						           < 0)
+						{
+							local_result = errno;
+							ret = -1;
+							goto error_handler_write_ovr_1;
+						}
+						args_write_undo->nbyte_old = ret;
+						args_write_undo->spill_buffer = txd->buffer_linear;
+					} else if (flags == TXC_WRITE_OVR_SAVE) {
 						if ((old_data = (void *) txc_buffer_linear_malloc(txd->buffer_linear, 
 						                                                  sizeof(char) * nbyte))
 						    == NULL) 
@@ -226,7 +825,12 @@ x_write(int fd, const void *buf, size_t nbyte, int *result, int flags)
 							ret = -1;
 							goto error_handler_write_ovr_1;
 						}
-						if ((ret = txc_libc_read(fd, old_data, nbyte)) < 0) {
+						if (shadow) {
+							ret = txc_libc_pread(fd, old_data, nbyte, shadow->offset);
+						} else {
+							ret = txc_libc_read(fd, old_data, nbyte);
+						}
+						if (ret < 0) {
 							local_result = errno;
 							goto error_handler_write_ovr_2;					   
 						}
@@ -237,12 +841,22 @@ x_write(int fd, const void *buf, size_t nbyte, int *result, int flags)
 					}
 					args_write_undo->buf = old_data;
 					args_write_undo->fd = fd;
-					if (args_write_undo->nbyte_old > 0) {
-						txc_libc_lseek(fd, -args_write_undo->nbyte_old, SEEK_CUR);
-					}	
-					if ((ret = txc_libc_write(fd, buf, nbyte)) < 0) {
-						local_result = errno;
-						goto error_handler_write_ovr_2;
+					if (shadow) {
+						args_write_undo->offset = shadow->offset;
+						if ((ret = txc_libc_pwrite(fd, buf, nbyte, shadow->offset)) < 0) {
+							local_result = errno;
+							goto error_handler_write_ovr_2;
+						}
+						shadow->offset += ret;
+					} else {
+						args_write_undo->offset = -1;
+						if (old_data && args_write_undo->nbyte_old > 0) {
+							txc_libc_lseek(fd, -args_write_undo->nbyte_old, SEEK_CUR);
+						}	
+						if ((ret = txc_libc_write(fd, buf, nbyte)) < 0) {
+							local_result = errno;
+							goto error_handler_write_ovr_2;
+						}
 					}
 					args_write_undo->nbyte_new = ret;
 					txc_tx_register_undo_action(txd, x_write_ovr_undo, 
@@ -250,6 +864,13 @@ x_write(int fd, const void *buf, size_t nbyte, int *result, int flags)
 					                            TXC_TX_REGULAR_UNDO_ACTION_ORDER);
 					local_result = 0;							
 					ret = args_write_undo->nbyte_new;
+					if (txc_g_journalmgr &&
+					    (local_result = x_write_journal(txd, fd, 
+					                                    shadow ? shadow->offset - ret : -1,
+					                                    buf, ret)) != 0)
+					{
+						ret = -1;
+					}
 					if (flags == TXC_WRITE_OVR_SAVE) {
 						txc_stats_txstat_increment(txd, XCALL, x_write_ovr, 1);
 					} else {
@@ -257,6 +878,87 @@ x_write(int fd, const void *buf, size_t nbyte, int *result, int flags)
 					}
 					goto done;
 
+				case TXC_WRITE_DEFERRED:
+					map = (x_write_deferred_commit_undo_args_t *) pending;
+					if (map == NULL) {
+						if ((map = (x_write_deferred_commit_undo_args_t *)
+						           txc_buffer_linear_malloc(txd->buffer_linear, 
+						                                    sizeof(x_write_deferred_commit_undo_args_t)))
+						    == NULL)
+						{	
+							local_result = ENOMEM;
+							ret = -1;
+							goto done;
+						}
+						map->fd = fd;
+						map->koa = koa;
+						map->end = 0;
+						map->head = map->tail = NULL;
+						map->results = NULL;
+						/* Failures are reported to each write's caller. */
+						txc_tx_register_keyed_commit_action(txd, x_write_deferred_commit, 
+						                                    (void *) map, NULL,
+						                                    TXC_TX_REGULAR_COMMIT_ACTION_ORDER,
+						                                    fd);
+						txc_tx_register_undo_action(txd, x_write_deferred_undo, 
+						                            (void *) map, NULL,
+						                            TXC_TX_REGULAR_UNDO_ACTION_ORDER);
+						txc_koa_set_pending_output(koa, (void *) map);
+					}
+					if ((extent = (x_write_deferred_extent_t *) 
+					              txc_buffer_linear_malloc(txd->buffer_linear, 
+					                                       sizeof(x_write_deferred_extent_t) + nbyte))
+					    == NULL) 
+					{
+						local_result = ENOMEM;
+						ret = -1;
+						goto done;
+					}
+					result_node = NULL;
+					if (result && 
+					    (result_node = (x_write_deferred_result_t *) 
+					                   txc_buffer_linear_malloc(txd->buffer_linear, 
+					                                            sizeof(x_write_deferred_result_t)))
+					    == NULL) 
+					{
+						local_result = ENOMEM;
+						ret = -1;
+						goto done;
+					}
+					extent->offset = shadow->offset;
+					extent->len = nbyte;
+					extent->data = (char *) (extent + 1);
+					memcpy(extent->data, buf, nbyte);
+					if (txc_g_journalmgr && nbyte > 0 &&
+					    (local_result = txc_journal_log_write(txc_g_journalmgr, txd, fd, 
+					                                          extent->offset, buf, nbyte))
+					    != 0)
+					{
+						ret = -1;
+						goto done;
+					}
+					if (nbyte > 0 &&
+					    x_write_deferred_insert(txd->buffer_linear, map, extent) < 0) 
+					{
+						local_result = ENOMEM;
+						ret = -1;
+						goto done;
+					}
+					/* Move the file offset past the write, as if it took place. */
+					shadow->offset += nbyte;
+					if (extent->offset + (off_t) nbyte > map->end) {
+						map->end = extent->offset + nbyte;
+					}
+					if (result_node) {
+						result_node->result = result;
+						result_node->next = map->results;
+						map->results = result_node;
+					}
+					local_result = 0;							
+					ret = nbyte;
+					txc_stats_txstat_increment(txd, XCALL, x_write_deferred, 1);
+					goto done;
+
 				default:
 					TXC_INTERNALERROR("Unknown x_write type\n");
 			}
@@ -357,3 +1059,28 @@ XCALL_DEF(x_write_ovr)(int fd, const void *buf, size_t nbyte, int *result)
 {
 	return x_write(fd, buf, nbyte, result, TXC_WRITE_OVR_SAVE);
 }
+
+
+/**
+ * \brief Writes to a file at commit, while the transaction reads back 
+ * its own writes.
+ * 
+ * <b> Execution </b>: deferred
+ *
+ * <b> Asynchronous failures </b>: commit
+ *
+ * Writes to a descriptor opened with O_APPEND, or to anything but a 
+ * regular file, go in place as x_write_seq.
+ *
+ * \param[in] fd The file descriptor of the file.
+ * \param[in] buf The buffer that has the data to be written.
+ * \param[in] nbyte The number of bytes to write.
+ * \param[out] result Where to store any asynchronous failures.
+ * \return The number of written bytes on success, or -1 if a synchronous failure occurred 
+ * (in which case, errno is set appropriately).
+ */
+ssize_t 
+XCALL_DEF(x_write_deferred)(int fd, const void *buf, size_t nbyte, int *result)
+{
+	return x_write(fd, buf, nbyte, result, TXC_WRITE_DEFERRED);
+}
@@ -32,6 +32,13 @@
  * \file x_write_pipe.c
  *
  * \brief x_write_pipe implementation.
+ *
+ * Writes are deferred until commit. The writes of a transaction to the 
+ * same pipe are gathered into a batch, kept in the pipe's KOA, that is 
+ * flushed with as few writev calls as possible. Writes of up to PIPE_BUF
+ * bytes to a pipe are atomic, so consecutive writes are combined into a 
+ * single writev only as long as the total stays within PIPE_BUF; output 
+ * of other writers is then never interleaved within a write.
  */
 
 #include <fcntl.h>
@@ -39,6 +46,8 @@
 #include <errno.h>
 #include <string.h>
 #include <stdlib.h>
+#include <limits.h>
+#include <sys/uio.h>
 #include <misc/debug.h>
 #include <misc/errno.h>
 #include <core/tx.h>
@@ -50,27 +59,137 @@
 #include <libc/syscalls.h>
 #include <xcalls/xcalls.h>
 
+#define TXC_WRITE_PIPE_IOV_MAX 64
+
+typedef struct x_write_pipe_chunk_s x_write_pipe_chunk_t;
+typedef struct x_write_pipe_commit_undo_args_s x_write_pipe_commit_undo_args_t;
 
-typedef struct x_write_commit_args_s x_write_commit_args_t;
+struct x_write_pipe_chunk_s {
+	char                 *buf;
+	size_t               len;
+	int                  *result;  /**< Where to report the failure of this write */
+	x_write_pipe_chunk_t *next;
+};
 
-struct x_write_commit_args_s {
-	int  fd;
-	int  nbyte;
-	void *buf;
+struct x_write_pipe_commit_undo_args_s {
+	int                  fd;
+	txc_koa_t            *koa;
+	x_write_pipe_chunk_t *head;
+	x_write_pipe_chunk_t *tail;
+	size_t               group_len;   /**< Bytes in the last writev of the batch */
+	int                  group_num;   /**< Writes in the last writev of the batch */
 };
 
+
+/** 
+ * Whether a write of len bytes joins the writev of the writes preceding 
+ * it, given that writev already holds num writes of total len group_len.
+ */
+static inline
+int
+group_fits(size_t group_len, int group_num, size_t len)
+{
+	return (group_num > 0 && 
+	        group_num < TXC_WRITE_PIPE_IOV_MAX && 
+	        group_len + len <= PIPE_BUF);
+}
+
+
+static
+void
+report_result(x_write_pipe_chunk_t *chunk, x_write_pipe_chunk_t *last, 
+              int local_result)
+{
+	for (; chunk != last; chunk = chunk->next) {
+		if (chunk->result) {
+			*chunk->result = local_result;
+		}
+	}
+}
+
+
+static
+void
+x_write_pipe_undo(void *args, int *result)
+{
+	x_write_pipe_commit_undo_args_t *args_undo = (x_write_pipe_commit_undo_args_t *) args;
+
+	if (txc_koa_get_pending_output(args_undo->koa) == args) {
+		txc_koa_set_pending_output(args_undo->koa, NULL);
+	}
+	if (result) {
+		*result = 0;
+	}
+}
+
+
 static
 void
 x_write_pipe_commit(void *args, int *result)
 {
-	x_write_commit_args_t *args_commit = (x_write_commit_args_t *) args;
-	int                   local_result = 0;
+	x_write_pipe_commit_undo_args_t *args_commit = (x_write_pipe_commit_undo_args_t *) args;
+	int                             local_result = 0;
+	struct iovec                    iov[TXC_WRITE_PIPE_IOV_MAX];
+	x_write_pipe_chunk_t            *chunk;
+	x_write_pipe_chunk_t            *iter;
+	x_write_pipe_chunk_t            *next;
+	size_t                          group_len;
+	size_t                          offset;
+	ssize_t                         ret;
+	int                             i;
+
+	if (txc_koa_get_pending_output(args_commit->koa) == args) {
+		txc_koa_set_pending_output(args_commit->koa, NULL);
+	}
+
+	chunk = args_commit->head;
+	while (chunk) {
+		/* Gather the writes that go out with this writev. */
+		iov[0].iov_base = chunk->buf;
+		iov[0].iov_len = chunk->len;
+		group_len = chunk->len;
+		for (i=1, iter = chunk->next; 
+		     iter && group_fits(group_len, i, iter->len); 
+		     i++, iter = iter->next) 
+		{
+			iov[i].iov_base = iter->buf;
+			iov[i].iov_len = iter->len;
+			group_len += iter->len;
+		}
+		next = iter;
+
+		/* The kernel may take only part of it; write the rest. */
+		for (offset = 0; offset < group_len; offset += ret) {
+			if ((ret = txc_libc_writev(args_commit->fd, iov, i)) < 0) {
+				if (errno == EINTR) {
+					ret = 0;
+					continue;
+				}
+				local_result = errno;
+				/* This and the following writes never made it. */
+				report_result(chunk, NULL, local_result);
+				goto done;
+			}
+			if (offset + ret < group_len) {
+				/* Drop what was written from the front of the iovec. */
+				size_t skip = ret;
+				int    j = 0;
 
-	if (txc_libc_write(args_commit->fd, args_commit->buf, 
-	                   args_commit->nbyte)  < 0)
-	{
-		local_result = errno;
+				while (skip >= iov[j].iov_len) {
+					skip -= iov[j].iov_len;
+					j++;
+				}
+				iov[j].iov_base = (char *) iov[j].iov_base + skip;
+				iov[j].iov_len -= skip;
+				memmove(&iov[0], &iov[j], (i - j) * sizeof(struct iovec));
+				i -= j;
+			}
+		}
+		report_result(chunk, next, 0);
+		chunk = next;
 	}
+
+done:
 	if (result) {
 		*result = local_result;
 	}	
@@ -94,15 +213,16 @@ x_write_pipe_commit(void *args, int *result)
 ssize_t 
 XCALL_DEF(x_write_pipe)(int fd, const void *buf, size_t nbyte, int *result)
 {
-	txc_tx_t              *txd;
-	txc_koamgr_t          *koamgr = txc_g_koamgr;
-	txc_koa_t             *koa;
-	txc_sentinel_t        *sentinel;
-	txc_result_t          xret;
-	int                   ret;
-	void                  *deferred_data;
-	x_write_commit_args_t *args_write_commit;
-	int                   local_result;
+	txc_tx_t                        *txd;
+	txc_koamgr_t                    *koamgr = txc_g_koamgr;
+	txc_koa_t                       *koa;
+	txc_sentinel_t                  *sentinel;
+	txc_result_t                    xret;
+	ssize_t                         ret;
+	x_write_pipe_commit_undo_args_t *args_commit_undo;
+	x_write_pipe_chunk_t            *chunk;
+	int                             local_result;
+	int                             is_pipe;
 
 
 	txd = txc_tx_get_txd();
@@ -139,42 +259,87 @@ XCALL_DEF(x_write_pipe)(int fd, const void *buf, size_t nbyte, int *result)
 				TXC_INTERNALERROR("Never gets here. Transaction abort failed.\n");
 			}
 
-			/* Got sentinel. Continue with the rest of the stuff. */
-			if ((args_write_commit = (x_write_commit_args_t *)
-   	                                 txc_buffer_linear_malloc(txd->buffer_linear, 
-			                                                  sizeof(x_write_commit_args_t)))
-			    == NULL)
-			{	
-				local_result = ENOMEM;
-				ret = -1;
-				goto done;
+			/* 
+			 * Got sentinel. Continue with the rest of the stuff. Only 
+			 * writes to a pipe are batched in its KOA; writes to anything
+			 * else, such as a redirected standard output, go one by one
+			 * and leave the KOA's pending output (which other xCalls use
+			 * for their own batches) alone.
+			 */
+			is_pipe = (txc_koa_get_type(koa) == TXC_KOA_IS_PIPE_WRITE_END);
+			args_commit_undo = NULL;
+			if (is_pipe) {
+				args_commit_undo = (x_write_pipe_commit_undo_args_t *) 
+				                   txc_koa_get_pending_output(koa);
 			}
-			if ((deferred_data = (void *) txc_buffer_linear_malloc(txd->buffer_linear, 
-			                                                       sizeof(char) * nbyte))
+			if (args_commit_undo == NULL) {
+				/* Start a new batch. */
+				if ((args_commit_undo = (x_write_pipe_commit_undo_args_t *)
+				                        txc_buffer_linear_malloc(txd->buffer_linear, 
+				                                                 sizeof(x_write_pipe_commit_undo_args_t)))
+				    == NULL)
+				{	
+					local_result = ENOMEM;
+					ret = -1;
+					goto done;
+				}
+				args_commit_undo->fd = fd;
+				args_commit_undo->koa = koa;
+				args_commit_undo->head = args_commit_undo->tail = NULL;
+				args_commit_undo->group_len = 0;
+				args_commit_undo->group_num = 0;
+				/* Failures are reported to each write's caller. */
+				txc_tx_register_commit_action(txd, x_write_pipe_commit, 
+				                              (void *) args_commit_undo, NULL,
+				                              TXC_TX_REGULAR_COMMIT_ACTION_ORDER);
+				txc_tx_register_undo_action(txd, x_write_pipe_undo, 
+				                            (void *) args_commit_undo, NULL,
+				                            TXC_TX_REGULAR_UNDO_ACTION_ORDER);
+				if (is_pipe) {
+					txc_koa_set_pending_output(koa, (void *) args_commit_undo);
+				}	
+			}
+			if ((chunk = (x_write_pipe_chunk_t *) 
+			             txc_buffer_linear_malloc(txd->buffer_linear, 
+			                                      sizeof(x_write_pipe_chunk_t) + nbyte))
 			    == NULL) 
 			{
 				local_result = ENOMEM;
 				ret = -1;
-				goto error_handler;
+				goto done;
+			}
+			chunk->buf = (char *) (chunk + 1);
+			chunk->len = nbyte;
+			chunk->result = result;
+			chunk->next = NULL;
+			memcpy(chunk->buf, buf, nbyte);
+			if (args_commit_undo->tail) {
+				args_commit_undo->tail->next = chunk;
+			} else {
+				args_commit_undo->head = chunk;
+			}
+			args_commit_undo->tail = chunk;
+
+			/* Mirror the grouping of the commit to count the writes saved. */
+			if (group_fits(args_commit_undo->group_len, 
+			               args_commit_undo->group_num, nbyte)) 
+			{
+				args_commit_undo->group_len += nbyte;
+				args_commit_undo->group_num++;
+				txc_stats_txstat_increment(txd, XCALL, x_write_pipe_syscalls_saved, 1);
+			} else {
+				args_commit_undo->group_len = nbyte;
+				args_commit_undo->group_num = 1;
 			}
-			memcpy (deferred_data, buf, nbyte);
-			args_write_commit->nbyte = nbyte;
-			args_write_commit->buf = deferred_data;
-			args_write_commit->fd = fd;
-			txc_tx_register_commit_action(txd, x_write_pipe_commit, 
-			                              (void *) args_write_commit, result,
-			                              TXC_TX_REGULAR_COMMIT_ACTION_ORDER);
+
 			local_result = 0;							
-			ret = args_write_commit->nbyte;
+			ret = nbyte;
 			txc_stats_txstat_increment(txd, XCALL, x_write_pipe, 1);
 			goto done;
 		default:
 			TXC_INTERNALERROR("Unknown transaction state\n");
 	}
 
-error_handler:
-	txc_buffer_linear_free(txd->buffer_linear,
-		                   sizeof(x_write_commit_args_t));
 done:
 	if (result) {
 		*result = local_result;
@@ -35,9 +35,6 @@
  *
  * The error codes returned by xCalls are the ones returned by the 
  * corresponding system call.
- *
- * \todo Implement x_send by reusing code of x_sendmsg.
- * \todo Implement x_recv by reusing code of x_recvmsg.
  */
 
 #ifndef _TXC_XCALLS_H
@@ -45,6 +42,7 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <fcntl.h>
 
 #define XCALL_DEF(xcall) _TXC_##xcall 
@@ -63,17 +61,38 @@ int     XCALL_DEF(x_pthread_create)(pthread_t *thread, const pthread_attr_t *att
 int     XCALL_DEF(x_pthread_mutex_init)(pthread_mutex_t *mutex, const pthread_mutexattr_t *attr, int *result);
 int     XCALL_DEF(x_pthread_mutex_lock)(pthread_mutex_t *mutex, int *result);
 int     XCALL_DEF(x_pthread_mutex_unlock)(pthread_mutex_t *mutex, int *result);
+ssize_t XCALL_DEF(x_pread)(int fd, void *buf, size_t nbyte, off_t offset, int *result);
+ssize_t XCALL_DEF(x_preadv)(int fd, const struct iovec *iov, int iovcnt, off_t offset, int *result);
+ssize_t XCALL_DEF(x_pwrite)(int fd, const void *buf, size_t nbyte, off_t offset, int *result);
+ssize_t XCALL_DEF(x_pwritev)(int fd, const struct iovec *iov, int iovcnt, off_t offset, int *result);
 ssize_t XCALL_DEF(x_read)(int fd, void *buf, size_t nbyte, int *result);
 ssize_t XCALL_DEF(x_read_pipe)(int fd, void *buf, size_t nbyte, int *result);
+ssize_t XCALL_DEF(x_recv)(int s, void *buf, size_t len, int flags, int *result);
 ssize_t XCALL_DEF(x_recvmsg)(int s, struct msghdr *msg, int flags, int *result);
 int     XCALL_DEF(x_rename)(const char *oldpath, const char *newpath, int *result);
 int     XCALL_DEF(x_socket)(int domain, int type, int protocol, int *result); 
+ssize_t XCALL_DEF(x_write_deferred)(int fd, const void *buf, size_t nbyte, int *result);
 ssize_t XCALL_DEF(x_write_ovr)(int fd, const void *buf, size_t nbyte, int *result);
 ssize_t XCALL_DEF(x_write_ovr_save)(int fd, const void *buf, size_t nbyte, int *result);
 ssize_t XCALL_DEF(x_write_ovr_ignore)(int fd, const void *buf, size_t nbyte, int *result);
 ssize_t XCALL_DEF(x_write_pipe)(int fd, const void *buf, size_t nbyte, int *result);
+ssize_t XCALL_DEF(x_send)(int s, const void *buf, size_t len, int flags, int *result);
 ssize_t XCALL_DEF(x_sendmsg)(int fd, const struct msghdr *msg, int flags, int *result);
 ssize_t XCALL_DEF(x_write_seq)(int fd, const void *buf, size_t nbyte, int *result);
 int     XCALL_DEF(x_unlink)(const char *pathname, int *result);
 
+/* Kinds of the mergeable undo and commit actions of xcalls. */
+#define TXC_X_UNDO_WRITE_SEQ 1
+#define TXC_X_UNDO_READ      2
+#define TXC_X_UNDO_LSEEK     3
+#define TXC_X_COMMIT_SYNC    4
+
+/* Deferred file writes pending in a transaction (x_write.c). */
+ssize_t txc_x_write_deferred_overlay(void *pending, void *buf, size_t nbyte, off_t offset, ssize_t nread);
+off_t   txc_x_write_deferred_end(void *pending);
+int     txc_x_write_deferred_discard(void *pending, void *buffer_linear, off_t offset, size_t len);
+
+/* Files created unnamed in a transaction (x_create.c). */
+int     txc_x_create_publish(void *txd, const char *pathname);
+
 #endif
@@ -0,0 +1,142 @@
+/*
+    Copyright (C) 2008-2009 Computer Sciences Department, 
+    University of Wisconsin -- Madison
+
+    ----------------------------------------------------------------------
+
+    This file is part of the xCalls transactional API, originally 
+    developed at the University of Wisconsin -- Madison.
+
+    xCalls was originally developed primarily by Haris Volos and 
+    Neelam Goyal with contributions from Andres Jaan Tack.
+
+    ----------------------------------------------------------------------
+
+    xCalls is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as 
+    published by the Free Software Foundation, either version 3 of 
+    the License, or (at your option) any later version.
+
+    xCalls is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public 
+    License along with xCalls.  If not, see <http://www.gnu.org/licenses/>.
+
+### END HEADER ###
+*/
+
+#include <txc/txc.h>
+#include <misc/result.h>
+#include <core/tx.h>
+#include <core/txdesc.h>
+#include <core/journal.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "util/ut.h"
+#include "util/ut_file.h"
+
+char *test_file = "/tmp/libtxc.tmp.test";
+char *test_file2 = "/tmp/libtxc.tmp.test2";
+char *test_file3 = "/tmp/libtxc.tmp.test3";
+char *journal_file = "/tmp/libtxc.tmp.journal";
+
+
+UT_START_TEST(test1)
+{
+	txc_journalmgr_t *journalmgr;
+	struct txc_tx_s  tx_committed;
+	struct txc_tx_s  tx_inflight;
+	struct txc_tx_s  tx_aborted;
+	struct stat      stat_buf;
+	int              fd;
+
+	/* Leave behind the journal of a process crashing in the middle of commits */
+	unlink(journal_file);
+	unlink(test_file3);
+	UT_ASSERT_EQUAL(0, create_file(test_file, "DEADBEEF"));
+	UT_ASSERT_EQUAL(0, create_file(test_file2, "MADCOW"));
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, txc_journalmgr_create(&journalmgr, journal_file));
+	memset(&tx_committed, 0, sizeof(tx_committed));
+	memset(&tx_inflight, 0, sizeof(tx_inflight));
+	memset(&tx_aborted, 0, sizeof(tx_aborted));
+	fd = open(test_file, O_RDWR);
+
+	/* A deferred write and an unlink never applied */
+	UT_ASSERT_EQUAL(0, txc_journal_log_write(journalmgr, &tx_committed, fd, 0, "BEEF", 4));
+	stat(test_file2, &stat_buf);
+	UT_ASSERT_EQUAL(0, txc_journal_log_name(journalmgr, &tx_committed, 
+	                                        TXC_JOURNAL_REDO_UNLINK, 
+	                                        test_file2, NULL, stat_buf.st_ino));
+	UT_ASSERT_EQUAL(0, txc_journal_commit(journalmgr, &tx_committed));
+
+	/* An in-place write extending the file and a create */
+	UT_ASSERT_EQUAL(0, txc_journal_log_undo_write(journalmgr, &tx_inflight, fd, 4, 8));
+	pwrite(fd, "DEADBEEF", 8, 4);
+	UT_ASSERT_EQUAL(0, create_file(test_file3, "DEAD"));
+	stat(test_file3, &stat_buf);
+	UT_ASSERT_EQUAL(0, txc_journal_log_name(journalmgr, &tx_inflight, 
+	                                        TXC_JOURNAL_UNDO_UNLINK, 
+	                                        test_file3, NULL, stat_buf.st_ino));
+
+	/* Rolled back already */
+	UT_ASSERT_EQUAL(0, txc_journal_log_undo_write(journalmgr, &tx_aborted, fd, 0, 4));
+	txc_journal_abort(journalmgr, &tx_aborted);
+	close(fd);
+
+	setenv("TXC_JOURNAL", journal_file, 1);
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_global_init());
+	UT_ASSERT_EQUAL(UT_TRUE, file_equal_str(test_file, "BEEFBEEF"));
+	UT_ASSERT_EQUAL(UT_FALSE, exists_file(test_file2));
+	UT_ASSERT_EQUAL(UT_FALSE, exists_file(test_file3));
+	stat(journal_file, &stat_buf);
+	UT_ASSERT_EQUAL(0, stat_buf.st_size);
+}
+UT_END_TEST
+
+
+UT_START_TEST(test2)
+{
+	int         fd;
+	struct stat stat_buf;
+
+	unlink(journal_file);
+	setenv("TXC_JOURNAL", journal_file, 1);
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_global_init());
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_thread_init());
+
+	UT_ASSERT_EQUAL(0, create_file(test_file, "DEADBEEF"));
+	XACT_BEGIN(xact_1)
+		fd = _XCALL(x_open)(test_file, O_RDWR, S_IRUSR|S_IWUSR, NULL);
+		_XCALL(x_write_deferred)(fd, "BEEF", 4, NULL);
+		_XCALL(x_close)(fd, NULL);
+	XACT_END(xact_1)
+	UT_ASSERT_EQUAL(UT_TRUE, file_equal_str(test_file, "BEEFBEEF"));
+
+	/* Records are kept until a checkpoint, which shutdown takes */
+	stat(journal_file, &stat_buf);
+	UT_ASSERT_NOTEQUAL(0, stat_buf.st_size);
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_global_shutdown());
+	stat(journal_file, &stat_buf);
+	UT_ASSERT_EQUAL(0, stat_buf.st_size);
+}
+UT_END_TEST
+
+
+int
+main(int argc, char *argv[])
+{
+	ut_suite_t *suite;
+
+	ut_suite_create(&suite, "test_journal");
+	ut_suite_add_test(suite, "test1", test1);
+	ut_suite_add_test(suite, "test2", test2);
+
+	ut_suite_run_all(suite);
+}
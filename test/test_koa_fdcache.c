@@ -0,0 +1,143 @@
+/*
+    Copyright (C) 2008-2009 Computer Sciences Department, 
+    University of Wisconsin -- Madison
+
+    ----------------------------------------------------------------------
+
+    This file is part of the xCalls transactional API, originally 
+    developed at the University of Wisconsin -- Madison.
+
+    xCalls was originally developed primarily by Haris Volos and 
+    Neelam Goyal with contributions from Andres Jaan Tack.
+
+    ----------------------------------------------------------------------
+
+    xCalls is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as 
+    published by the Free Software Foundation, either version 3 of 
+    the License, or (at your option) any later version.
+
+    xCalls is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public 
+    License along with xCalls.  If not, see <http://www.gnu.org/licenses/>.
+
+### END HEADER ###
+*/
+
+#include <math.h>
+#include <txc/txc.h>
+#include <misc/result.h>
+#include <core/tx.h>
+#include <core/sentinel.h>
+#include <core/koa.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "util/ut.h"
+#include "util/ut_file.h"
+
+char *test_file = "/tmp/libtxc.tmp.test";
+char *test_file2 = "/tmp/libtxc.tmp.test2";
+
+
+UT_START_TEST(test1)
+{
+	int          fd;
+	int          fd2;
+	char         buf[16];
+
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_global_init());
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_thread_init());
+
+	UT_ASSERT_EQUAL(0, create_file(test_file, "DEADBEEF"));
+	XACT_BEGIN(xact_1)
+		fd = _XCALL(x_open)(test_file, O_RDWR, S_IRUSR|S_IWUSR, NULL);
+		_XCALL(x_read)(fd, buf, 4, NULL);
+		_XCALL(x_close)(fd, NULL);
+	XACT_END(xact_1)
+
+	/* The parked descriptor is reused with its offset rewound */
+	memset(buf, 0, 16);
+	XACT_BEGIN(xact_2)
+		fd2 = _XCALL(x_open)(test_file, O_RDWR, S_IRUSR|S_IWUSR, NULL);
+		_XCALL(x_read)(fd2, buf, 8, NULL);
+		_XCALL(x_close)(fd2, NULL);
+	XACT_END(xact_2)
+	UT_ASSERT_EQUAL(fd, fd2);
+	UT_ASSERT_EQUAL(0, strcmp(buf, "DEADBEEF"));
+}
+UT_END_TEST
+
+
+UT_START_TEST(test2)
+{
+	int          fd;
+	int          fd2;
+
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_global_init());
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_thread_init());
+
+	UT_ASSERT_EQUAL(0, create_file(test_file, "DEADBEEF"));
+	XACT_BEGIN(xact_1)
+		fd = _XCALL(x_open)(test_file, O_RDWR, S_IRUSR|S_IWUSR, NULL);
+		_XCALL(x_close)(fd, NULL);
+	XACT_END(xact_1)
+
+	/* A parked descriptor of a file that has been replaced is not reused */
+	unlink(test_file);
+	UT_ASSERT_EQUAL(0, create_file(test_file, "MADCOW"));
+	XACT_BEGIN(xact_2)
+		fd2 = _XCALL(x_open)(test_file, O_RDWR, S_IRUSR|S_IWUSR, NULL);
+		_XCALL(x_close)(fd2, NULL);
+	XACT_END(xact_2)
+	UT_ASSERT_EQUAL(UT_TRUE, file_equal_str(test_file, "MADCOW"));
+}
+UT_END_TEST
+
+
+UT_START_TEST(test3)
+{
+	int          fd;
+	int          fd2;
+
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_global_init());
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_thread_init());
+
+	UT_ASSERT_EQUAL(0, create_file(test_file, "DEADBEEF"));
+	UT_ASSERT_EQUAL(0, create_file(test_file2, "MADCOW"));
+	XACT_BEGIN(xact_1)
+		fd = _XCALL(x_open)(test_file, O_RDWR, S_IRUSR|S_IWUSR, NULL);
+		_XCALL(x_close)(fd, NULL);
+	XACT_END(xact_1)
+
+	/* Descriptors are only reused with compatible flags */
+	XACT_BEGIN(xact_2)
+		fd2 = _XCALL(x_open)(test_file, O_RDWR|O_APPEND, S_IRUSR|S_IWUSR, NULL);
+		_XCALL(x_close)(fd2, NULL);
+	XACT_END(xact_2)
+	UT_ASSERT_NOTEQUAL(fd, fd2);
+}
+UT_END_TEST
+
+
+int
+main(int argc, char *argv[])
+{
+	ut_suite_t *suite;
+
+	setenv("TXC_KOA_FDCACHE_SIZE", "1", 1);
+
+	ut_suite_create(&suite, "test_koa_fdcache");
+	ut_suite_add_test(suite, "test1", test1);
+	ut_suite_add_test(suite, "test2", test2);
+	ut_suite_add_test(suite, "test3", test3);
+
+	ut_suite_run_all(suite);
+}
@@ -0,0 +1,201 @@
+/*
+    Copyright (C) 2008-2009 Computer Sciences Department, 
+    University of Wisconsin -- Madison
+
+    ----------------------------------------------------------------------
+
+    This file is part of the xCalls transactional API, originally 
+    developed at the University of Wisconsin -- Madison.
+
+    xCalls was originally developed primarily by Haris Volos and 
+    Neelam Goyal with contributions from Andres Jaan Tack.
+
+    ----------------------------------------------------------------------
+
+    xCalls is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as 
+    published by the Free Software Foundation, either version 3 of 
+    the License, or (at your option) any later version.
+
+    xCalls is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public 
+    License along with xCalls.  If not, see <http://www.gnu.org/licenses/>.
+
+### END HEADER ###
+*/
+
+#include <math.h>
+#include <txc/txc.h>
+#include <misc/result.h>
+#include <core/tx.h>
+#include <core/sentinel.h>
+#include <core/koa.h>
+#include <core/config.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include "util/ut.h"
+#include "util/ut_file.h"
+
+char *test_file = "/tmp/libtxc.tmp.test";
+
+
+UT_START_TEST(test1)
+{
+	txc_tx_t     *txd;
+	int          fd;
+	int          result;
+	int          ret;
+
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_global_init());
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_thread_init());
+
+	txd = txc_tx_get_txd();
+
+	UT_ASSERT_EQUAL(0, create_file(test_file, "INITIAL"));
+	/* Descriptor opened outside xCalls */
+	fd = open(test_file, O_RDWR);
+	UT_ASSERT_NOTEQUAL(-1, fd);
+
+	XACT_BEGIN(xact_1)
+		ret = _XCALL(x_write_ovr_save)(fd, "DEADBEEF", 8, &result);
+		XACT_WAIVER {
+			UT_ASSERT_EQUAL(8, ret);
+			UT_ASSERT_EQUAL(txd, txc_sentinel_owner(FD2SENTINEL(fd)));
+		}
+		XACT_ABORT(TXC_ABORTREASON_USERABORT);	
+	XACT_END(xact_1)
+	UT_ASSERT_EQUAL(UT_TRUE, file_equal_str(test_file, "INITIAL"));
+	_XCALL(x_close)(fd, NULL);
+}
+UT_END_TEST
+
+
+UT_START_TEST(test2)
+{
+	txc_tx_t     *txd;
+	int          fd;
+	int          fd2;
+	int          result;
+
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_global_init());
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_thread_init());
+
+	txd = txc_tx_get_txd();
+
+	UT_ASSERT_EQUAL(0, create_file(test_file, "INITIAL"));
+	fd = _XCALL(x_open)(test_file, O_RDWR, S_IRUSR|S_IWUSR, NULL);
+	fd2 = open(test_file, O_RDWR);
+	UT_ASSERT_NOTEQUAL(-1, fd2);
+
+	/* Adopted descriptor of a live file shares the file's sentinel */
+	UT_ASSERT_EQUAL(FD2SENTINEL(fd), FD2SENTINEL(fd2));
+	_XCALL(x_close)(fd2, NULL);
+	_XCALL(x_close)(fd, NULL);
+}
+UT_END_TEST
+
+
+UT_START_TEST(test3)
+{
+	txc_tx_t     *txd;
+	int          pipefd[2];
+	char         buf[512];
+
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_global_init());
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_thread_init());
+
+	txd = txc_tx_get_txd();
+
+	/* Pipe created outside xCalls */
+	UT_ASSERT_EQUAL(0, pipe(pipefd));
+	XACT_BEGIN(xact_1)
+		_XCALL(x_write_pipe)(pipefd[1], "DEADBEEF", 9, NULL);
+	XACT_END(xact_1)
+	XACT_BEGIN(xact_2)
+		_XCALL(x_read_pipe)(pipefd[0], buf, 9, NULL);
+	XACT_END(xact_2)
+	UT_ASSERT_EQUAL(0, strcmp(buf, "DEADBEEF"));
+}
+UT_END_TEST
+
+
+UT_START_TEST(test4)
+{
+	int          result;
+	int          ret;
+	char         buf[16];
+
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_global_init());
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_thread_init());
+
+	/* Descriptors that are not open still report EBADF */
+	XACT_BEGIN(xact_1)
+		ret = _XCALL(x_read)(TXC_KOA_MAP_SIZE - 1, buf, 16, &result);
+	XACT_END(xact_1)
+	UT_ASSERT_EQUAL(-1, ret);
+	UT_ASSERT_EQUAL(EBADF, result);
+}
+UT_END_TEST
+
+
+UT_START_TEST(test5)
+{
+	txc_tx_t     *txd;
+	int          fd;
+	int          fd2;
+	int          result;
+	int          ret;
+
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_global_init());
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_thread_init());
+
+	txd = txc_tx_get_txd();
+
+	UT_ASSERT_EQUAL(0, create_file(test_file, "INITIAL"));
+	fd = _XCALL(x_open)(test_file, O_RDWR, S_IRUSR|S_IWUSR, NULL);
+	fd2 = open(test_file, O_RDWR);
+	UT_ASSERT_NOTEQUAL(-1, fd2);
+
+	/* 
+	 * The first xCall on fd2 adopts it into the KOA of the live file 
+	 * while holding its lock; the second finds the lock released.
+	 */
+	XACT_BEGIN(xact_1)
+		ret = _XCALL(x_write_ovr_save)(fd2, "DEAD", 4, &result);
+		XACT_WAIVER {
+			UT_ASSERT_EQUAL(4, ret);
+			UT_ASSERT_EQUAL(txd, txc_sentinel_owner(FD2SENTINEL(fd2)));
+		}
+		ret = _XCALL(x_write_ovr_save)(fd2, "BEEF", 4, &result);
+		XACT_WAIVER {
+			UT_ASSERT_EQUAL(4, ret);
+		}
+	XACT_END(xact_1)
+	UT_ASSERT_EQUAL(FD2SENTINEL(fd), FD2SENTINEL(fd2));
+	UT_ASSERT_EQUAL(UT_TRUE, file_equal_str(test_file, "DEADBEEF"));
+	_XCALL(x_close)(fd2, NULL);
+	_XCALL(x_close)(fd, NULL);
+}
+UT_END_TEST
+
+
+int
+main(int argc, char *argv[])
+{
+	ut_suite_t *suite;
+	ut_suite_create(&suite, "test_koa_materialize");
+	ut_suite_add_test(suite, "test1", test1);
+	ut_suite_add_test(suite, "test2", test2);
+	ut_suite_add_test(suite, "test3", test3);
+	ut_suite_add_test(suite, "test4", test4);
+	ut_suite_add_test(suite, "test5", test5);
+
+	ut_suite_run_all(suite);
+}
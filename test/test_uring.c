@@ -0,0 +1,135 @@
+/*
+    Copyright (C) 2008-2009 Computer Sciences Department, 
+    University of Wisconsin -- Madison
+
+    ----------------------------------------------------------------------
+
+    This file is part of the xCalls transactional API, originally 
+    developed at the University of Wisconsin -- Madison.
+
+    xCalls was originally developed primarily by Haris Volos and 
+    Neelam Goyal with contributions from Andres Jaan Tack.
+
+    ----------------------------------------------------------------------
+
+    xCalls is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as 
+    published by the Free Software Foundation, either version 3 of 
+    the License, or (at your option) any later version.
+
+    xCalls is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public 
+    License along with xCalls.  If not, see <http://www.gnu.org/licenses/>.
+
+### END HEADER ###
+*/
+
+#include <txc/txc.h>
+#include <misc/result.h>
+#include <core/uring.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include "util/ut.h"
+#include "util/ut_file.h"
+
+char *test_file = "/tmp/libtxc.tmp.test";
+
+
+/* 
+ * A batch of writes runs in one submission, or is refused as a whole 
+ * where io_uring is unavailable so that the caller writes synchronously.
+ */
+UT_START_TEST(test1)
+{
+	int            fd;
+	struct iovec   iov[3];
+	txc_uring_op_t ops[2];
+	txc_result_t   ret;
+
+	UT_ASSERT_EQUAL(0, create_file(test_file, "0123456789"));
+	fd = open(test_file, O_RDWR);
+	UT_ASSERT_NOTEQUAL(-1, fd);
+
+	iov[0].iov_base = "AB";
+	iov[0].iov_len = 2;
+	iov[1].iov_base = "CD";
+	iov[1].iov_len = 2;
+	iov[2].iov_base = "XYZ";
+	iov[2].iov_len = 3;
+	ops[0].opcode = TXC_URING_OP_WRITEV;
+	ops[0].fd = fd;
+	ops[0].iov = &iov[0];
+	ops[0].iovcnt = 2;
+	ops[0].offset = 0;
+	ops[1].opcode = TXC_URING_OP_WRITEV;
+	ops[1].fd = fd;
+	ops[1].iov = &iov[2];
+	ops[1].iovcnt = 1;
+	ops[1].offset = 8;
+	ret = txc_uring_submit(ops, 2);
+	if (ret == TXC_R_SUCCESS) {
+		UT_ASSERT_EQUAL(4, ops[0].res);
+		UT_ASSERT_EQUAL(3, ops[1].res);
+		UT_ASSERT_EQUAL(UT_TRUE, file_equal_str(test_file, "ABCD4567XYZ"));
+	} else {
+		UT_ASSERT_EQUAL(UT_TRUE, file_equal_str(test_file, "0123456789"));
+	}
+	close(fd);
+}
+UT_END_TEST
+
+
+/* 
+ * A failed write cancels the writes linked after it.
+ */
+UT_START_TEST(test2)
+{
+	int            fd;
+	struct iovec   iov;
+	txc_uring_op_t ops[2];
+
+	UT_ASSERT_EQUAL(0, create_file(test_file, "0123456789"));
+	fd = open(test_file, O_RDWR);
+	UT_ASSERT_NOTEQUAL(-1, fd);
+
+	iov.iov_base = "AB";
+	iov.iov_len = 2;
+	ops[0].opcode = TXC_URING_OP_WRITEV;
+	ops[0].fd = -1;
+	ops[0].iov = &iov;
+	ops[0].iovcnt = 1;
+	ops[0].offset = 0;
+	ops[1].opcode = TXC_URING_OP_WRITEV;
+	ops[1].fd = fd;
+	ops[1].iov = &iov;
+	ops[1].iovcnt = 1;
+	ops[1].offset = 0;
+	if (txc_uring_submit(ops, 2) == TXC_R_SUCCESS) {
+		UT_ASSERT_EQUAL(-EBADF, ops[0].res);
+		UT_ASSERT_EQUAL(-ECANCELED, ops[1].res);
+	}
+	UT_ASSERT_EQUAL(UT_TRUE, file_equal_str(test_file, "0123456789"));
+	close(fd);
+}
+UT_END_TEST
+
+
+int
+main(int argc, char *argv[])
+{
+	ut_suite_t *suite;
+	ut_suite_create(&suite, "test_uring");
+	ut_suite_add_test(suite, "test1", test1);
+	ut_suite_add_test(suite, "test2", test2);
+
+	ut_suite_run_all(suite);
+}
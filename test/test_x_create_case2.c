@@ -104,6 +104,77 @@ UT_START_TEST(test2)
 UT_END_TEST
 
 
+UT_START_TEST(test3)
+{
+	txc_tx_t *txd;
+	int      fd;
+	int      visible_before_commit = -1;
+
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_global_init());
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_thread_init());
+
+	txd = txc_tx_get_txd();
+
+	UT_ASSERT_EQUAL(0, create_file2(test_file, test_file_initial_contents));
+	UT_ASSERT_EQUAL(0, compare_file2(test_file, test_file_initial_contents));
+
+	XACT_BEGIN(xact_undo_action1)
+		fd = _XCALL(x_create)(test_file, S_IRUSR|S_IWUSR, NULL);
+			XACT_WAIVER {
+				visible_before_commit = compare_file2(test_file, 
+				                                      test_file_initial_contents);
+			}
+	XACT_END(xact_undo_action1)
+
+	UT_ASSERT(fd >= 0);
+	UT_ASSERT_EQUAL(0, visible_before_commit);
+	UT_ASSERT(file_equal_str(test_file, "") == UT_TRUE);
+	close(fd);
+}
+UT_END_TEST
+
+
+int test4_aborts;
+
+UT_START_TEST(test4)
+{
+	txc_tx_t    *txd;
+	int         fd;
+	int         fd_open;
+	struct stat stat_create;
+	struct stat stat_open;
+	int         same_file = 0;
+
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_global_init());
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_thread_init());
+
+	txd = txc_tx_get_txd();
+
+	UT_ASSERT_EQUAL(0, create_file2(test_file, test_file_initial_contents));
+	UT_ASSERT_EQUAL(0, compare_file2(test_file, test_file_initial_contents));
+
+	/* The transaction opens the file it created, then aborts. */
+	test4_aborts = 0;
+	XACT_BEGIN(xact_undo_action1)
+		fd = _XCALL(x_create)(test_file, S_IRUSR|S_IWUSR, NULL);
+		fd_open = _XCALL(x_open)(test_file, O_RDONLY, 0, NULL);
+			XACT_WAIVER {
+				same_file = (fd_open >= 0 &&
+				             fstat(fd, &stat_create) == 0 &&
+				             fstat(fd_open, &stat_open) == 0 &&
+				             stat_create.st_ino == stat_open.st_ino);
+				if (test4_aborts++ == 0) {
+					XACT_ABORT(TXC_ABORTREASON_USERABORT);	
+				}
+			}
+	XACT_END(xact_undo_action1)
+
+	UT_ASSERT(same_file);
+	UT_ASSERT_EQUAL(0, compare_file2(test_file, test_file_initial_contents));
+}
+UT_END_TEST
+
+
 int
 main(int argc, char *argv[])
 {
@@ -111,5 +182,7 @@ main(int argc, char *argv[])
 	ut_suite_create(&suite, "test_x_create_case2");
 	ut_suite_add_test(suite, "test1", test1);
 	ut_suite_add_test(suite, "test2", test2);
+	ut_suite_add_test(suite, "test3", test3);
+	ut_suite_add_test(suite, "test4", test4);
 	ut_suite_run_all(suite);
 }
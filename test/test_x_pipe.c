@@ -205,6 +205,90 @@ UT_START_TEST(test5)
 UT_END_TEST
 
 
+/* 
+ * Reads ahead and serves later reads from the buffer, topping up a 
+ * partial hit with data written to the pipe in the meantime.
+ */
+UT_START_TEST(test6)
+{
+	txc_tx_t     *txd;
+	int          result;
+	int          ret1;
+	int          ret2;
+	volatile int test_retries;
+	int          pipefd[2];
+	char         buf1[128];
+	char         buf2[128];
+
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_global_init());
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_thread_init());
+
+	txd = txc_tx_get_txd();
+
+	_XCALL(x_pipe)(pipefd, NULL);
+	write(pipefd[1], "AAAABBBB", 8);
+	test_retries = 0;
+	XACT_BEGIN(xact_1)
+		XACT_WAIVER {
+			memset(buf1, 0, 128);
+			memset(buf2, 0, 128);
+		}
+		ret1 = _XCALL(x_read_pipe)(pipefd[0], buf1, 4, &result);
+		XACT_WAIVER {
+			if (test_retries == 0) {
+				write(pipefd[1], "CCCC", 4);
+			}
+		}
+		ret2 = _XCALL(x_read_pipe)(pipefd[0], buf2, 8, &result);
+		XACT_WAIVER {
+			if (test_retries++ <= 8) {
+				XACT_ABORT(TXC_ABORTREASON_USERRETRY);	
+			}
+		}
+	XACT_END(xact_1)
+	UT_ASSERT_EQUAL(4, ret1);
+	UT_ASSERT_EQUAL(0, strcmp(buf1, "AAAA"));
+	UT_ASSERT_EQUAL(8, ret2);
+	UT_ASSERT_EQUAL(0, strcmp(buf2, "BBBBCCCC"));
+}
+UT_END_TEST
+
+
+/* Writes of a transaction to a pipe come out together and in order. */
+UT_START_TEST(test7)
+{
+	txc_tx_t     *txd;
+	int          result;
+	int          ret;
+	int          pipefd[2];
+	char         buf[128];
+	int          f;
+	int          i;
+
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_global_init());
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_thread_init());
+
+	txd = txc_tx_get_txd();
+
+	_XCALL(x_pipe)(pipefd, NULL);
+	XACT_BEGIN(xact_1)
+		for (i=0; i<10; i++) {
+			ret = _XCALL(x_write_pipe)(pipefd[1], "0123456789" + i, 1, &result);
+		}
+	XACT_END(xact_1)
+
+	/* Make pipe non-blocking */
+	f = fcntl(pipefd[0], F_GETFL, 0);
+	f |= O_NONBLOCK;
+	fcntl(pipefd[0], F_SETFL, f);
+	memset(buf, 0, 128);
+	UT_ASSERT_EQUAL(10, read(pipefd[0], buf, 128));
+	UT_ASSERT_EQUAL(0, strcmp(buf, "0123456789"));
+	UT_ASSERT_EQUAL(0, result);
+}
+UT_END_TEST
+
+
 int
 main(int argc, char *argv[])
 {
@@ -215,6 +299,8 @@ main(int argc, char *argv[])
 	ut_suite_add_test(suite, "test3", test3);
 	ut_suite_add_test(suite, "test4", test4);
 	ut_suite_add_test(suite, "test5", test5);
+	ut_suite_add_test(suite, "test6", test6);
+	ut_suite_add_test(suite, "test7", test7);
 
 	ut_suite_run_all(suite);
 }
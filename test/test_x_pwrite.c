@@ -0,0 +1,178 @@
+/*
+    Copyright (C) 2008-2009 Computer Sciences Department, 
+    University of Wisconsin -- Madison
+
+    ----------------------------------------------------------------------
+
+    This file is part of the xCalls transactional API, originally 
+    developed at the University of Wisconsin -- Madison.
+
+    xCalls was originally developed primarily by Haris Volos and 
+    Neelam Goyal with contributions from Andres Jaan Tack.
+
+    ----------------------------------------------------------------------
+
+    xCalls is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as 
+    published by the Free Software Foundation, either version 3 of 
+    the License, or (at your option) any later version.
+
+    xCalls is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public 
+    License along with xCalls.  If not, see <http://www.gnu.org/licenses/>.
+
+### END HEADER ###
+*/
+
+#include <math.h>
+#include <txc/txc.h>
+#include <misc/result.h>
+#include <core/tx.h>
+#include <core/sentinel.h>
+#include <core/koa.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include "util/ut.h"
+#include "util/ut_file.h"
+
+
+char *test_file = "/tmp/libtxc.tmp.test";
+
+
+/* 
+ * Positional writes are undone on abort, including the part that 
+ * extended the file, and never move the file offset.
+ */
+UT_START_TEST(test1)
+{
+	txc_tx_t     *txd;
+	int          fd;
+	int          result;
+	int          ret;
+
+
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_global_init());
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_thread_init());
+
+	txd = txc_tx_get_txd();
+
+	UT_ASSERT_EQUAL(0, create_file(test_file, "0123456789"));
+
+	fd = _XCALL(x_open)(test_file, O_RDWR, S_IRUSR|S_IWUSR, NULL);
+	XACT_BEGIN(xact_1)
+		ret = _XCALL(x_pwrite)(fd, "DEAD", 4, 2, &result);
+		ret = _XCALL(x_pwrite)(fd, "BEEF", 4, 8, &result);
+		XACT_WAIVER {
+			UT_ASSERT_EQUAL(4, ret);
+			UT_ASSERT_EQUAL(UT_TRUE, file_equal_str(test_file, "01DEAD67BEEF"));
+		}
+		XACT_ABORT(TXC_ABORTREASON_USERABORT);	
+	XACT_END(xact_1)
+	UT_ASSERT_EQUAL(TXC_R_FAILURE, SENTINEL_ENLISTED(txd, FD2SENTINEL(fd)));
+	UT_ASSERT_EQUAL(0, lseek(fd, 0, SEEK_CUR));
+	UT_ASSERT_EQUAL(UT_TRUE, file_equal_str(test_file, "0123456789"));
+}
+UT_END_TEST
+
+
+/* 
+ * Vectored positional writes commit, and positional reads see them.
+ */
+UT_START_TEST(test2)
+{
+	txc_tx_t     *txd;
+	int          fd;
+	int          result;
+	int          ret;
+	char         buf1[4];
+	char         buf2[8];
+	struct iovec iov[2];
+
+
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_global_init());
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_thread_init());
+
+	txd = txc_tx_get_txd();
+
+	UT_ASSERT_EQUAL(0, create_file(test_file, "0123456789"));
+
+	fd = _XCALL(x_open)(test_file, O_RDWR, S_IRUSR|S_IWUSR, NULL);
+	XACT_BEGIN(xact_1)
+		iov[0].iov_base = "MAD";
+		iov[0].iov_len = 3;
+		iov[1].iov_base = "COW";
+		iov[1].iov_len = 3;
+		ret = _XCALL(x_pwritev)(fd, iov, 2, 6, &result);
+		iov[0].iov_base = buf1;
+		iov[0].iov_len = sizeof(buf1);
+		iov[1].iov_base = buf2;
+		iov[1].iov_len = sizeof(buf2);
+		ret = _XCALL(x_preadv)(fd, iov, 2, 4, &result);
+		XACT_WAIVER {
+			UT_ASSERT_EQUAL(8, ret);
+			UT_ASSERT_EQUAL(0, memcmp(buf1, "45MA", 4));
+			UT_ASSERT_EQUAL(0, memcmp(buf2, "DCOW", 4));
+		}
+	XACT_END(xact_1)
+	UT_ASSERT_EQUAL(TXC_R_FAILURE, SENTINEL_ENLISTED(txd, FD2SENTINEL(fd)));
+	UT_ASSERT_EQUAL(0, lseek(fd, 0, SEEK_CUR));
+	UT_ASSERT_EQUAL(UT_TRUE, file_equal_str(test_file, "012345MADCOW"));
+}
+UT_END_TEST
+
+
+/* 
+ * Positional reads see the deferred writes of the transaction, and 
+ * positional writes replace them.
+ */
+UT_START_TEST(test3)
+{
+	txc_tx_t     *txd;
+	int          fd;
+	int          result;
+	int          ret;
+	char         buf[16];
+
+
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_global_init());
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_thread_init());
+
+	txd = txc_tx_get_txd();
+
+	UT_ASSERT_EQUAL(0, create_file(test_file, "0123456789"));
+
+	fd = _XCALL(x_open)(test_file, O_RDWR, S_IRUSR|S_IWUSR, NULL);
+	XACT_BEGIN(xact_1)
+		ret = _XCALL(x_write_deferred)(fd, "ZOMBIE", 6, &result);
+		ret = _XCALL(x_pwrite)(fd, "xy", 2, 1, &result);
+		ret = _XCALL(x_pread)(fd, buf, sizeof(buf), 0, &result);
+		XACT_WAIVER {
+			UT_ASSERT_EQUAL(10, ret);
+			UT_ASSERT_EQUAL(0, memcmp(buf, "ZxyBIE6789", 10));
+		}
+	XACT_END(xact_1)
+	UT_ASSERT_EQUAL(TXC_R_FAILURE, SENTINEL_ENLISTED(txd, FD2SENTINEL(fd)));
+	UT_ASSERT_EQUAL(UT_TRUE, file_equal_str(test_file, "ZxyBIE6789"));
+}
+UT_END_TEST
+
+
+int
+main(int argc, char *argv[])
+{
+	ut_suite_t *suite;
+	ut_suite_create(&suite, "test_x_pwrite");
+	ut_suite_add_test(suite, "test1", test1);
+	ut_suite_add_test(suite, "test2", test2);
+	ut_suite_add_test(suite, "test3", test3);
+
+	ut_suite_run_all(suite);
+}
@@ -38,6 +38,7 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <string.h>
+#include <unistd.h>
 #include "util/ut.h"
 #include "util/ut_file.h"
 
@@ -175,6 +176,44 @@ UT_START_TEST(test2)
 UT_END_TEST
 
 
+/* 
+ * The file offset moves only when the transaction commits.
+ */
+UT_START_TEST(test3)
+{
+	txc_tx_t     *txd;
+	int          fd;
+	int          result;
+	int          ret;
+	volatile int test_retries;
+	char         buf[512];
+
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_global_init());
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_thread_init());
+
+	txd = txc_tx_get_txd();
+
+	UT_ASSERT_EQUAL(0, create_file(test_file, test_file_initial_contents));
+
+	test_retries = 0;
+	fd = _XCALL(x_open)(test_file, O_RDWR, S_IRUSR|S_IWUSR, NULL);
+	XACT_BEGIN(xact_1)
+		ret = _XCALL(x_read)(fd, buf, 10, &result);
+		_XCALL(x_lseek)(fd, 40, SEEK_CUR, NULL);
+		ret = _XCALL(x_read)(fd, buf, 16, &result);
+		XACT_WAIVER {
+			UT_ASSERT_EQUAL(0, lseek(fd, 0, SEEK_CUR));
+			UT_ASSERT_EQUAL(66, _XCALL(x_lseek)(fd, 0, SEEK_CUR, NULL));
+			if (test_retries++ < 1) {
+				XACT_ABORT(TXC_ABORTREASON_USERRETRY);	
+			}
+		}
+	XACT_END(xact_1)
+	UT_ASSERT_EQUAL(66, lseek(fd, 0, SEEK_CUR));
+}
+UT_END_TEST
+
+
 int
 main(int argc, char *argv[])
 {
@@ -182,6 +221,7 @@ main(int argc, char *argv[])
 	ut_suite_create(&suite, "test_x_read_lseek");
 	ut_suite_add_test(suite, "test1", test1);
 	ut_suite_add_test(suite, "test2", test2);
+	ut_suite_add_test(suite, "test3", test3);
 
 	test_file_initial_contents = str_create2(test_file_initial_contents_tbl);
 
@@ -0,0 +1,155 @@
+/*
+    Copyright (C) 2008-2009 Computer Sciences Department, 
+    University of Wisconsin -- Madison
+
+    ----------------------------------------------------------------------
+
+    This file is part of the xCalls transactional API, originally 
+    developed at the University of Wisconsin -- Madison.
+
+    xCalls was originally developed primarily by Haris Volos and 
+    Neelam Goyal with contributions from Andres Jaan Tack.
+
+    ----------------------------------------------------------------------
+
+    xCalls is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as 
+    published by the Free Software Foundation, either version 3 of 
+    the License, or (at your option) any later version.
+
+    xCalls is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public 
+    License along with xCalls.  If not, see <http://www.gnu.org/licenses/>.
+
+### END HEADER ###
+*/
+
+#include <math.h>
+#include <txc/txc.h>
+#include <misc/result.h>
+#include <core/tx.h>
+#include <core/sentinel.h>
+#include <core/koa.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include "util/ut.h"
+
+
+UT_START_TEST(test1)
+{
+	int          result;
+	int          sv[2];
+	char         buf[512];
+
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_global_init());
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_thread_init());
+
+	UT_ASSERT_EQUAL(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+	XACT_BEGIN(xact_1)
+		_XCALL(x_send)(sv[0], "DEAD", 4, 0, &result);
+		_XCALL(x_send)(sv[0], "BEEF", 5, 0, &result);
+	XACT_END(xact_1)
+	UT_ASSERT_EQUAL(0, result);
+	UT_ASSERT_EQUAL(9, recv(sv[1], buf, 512, MSG_WAITALL));
+	UT_ASSERT_EQUAL(0, strcmp(buf, "DEADBEEF"));
+}
+UT_END_TEST
+
+
+UT_START_TEST(test2)
+{
+	int          sv[2];
+	char         buf[512];
+
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_global_init());
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_thread_init());
+
+	UT_ASSERT_EQUAL(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+	XACT_BEGIN(xact_1)
+		_XCALL(x_send)(sv[0], "DEADBEEF", 9, 0, NULL);
+		XACT_ABORT(TXC_ABORTREASON_USERABORT);	
+	XACT_END(xact_1)
+	UT_ASSERT_EQUAL(-1, recv(sv[1], buf, 512, MSG_DONTWAIT));
+}
+UT_END_TEST
+
+
+UT_START_TEST(test3)
+{
+	int          sv[2];
+	char         buf[128];
+	volatile int test_retries;
+
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_global_init());
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_thread_init());
+
+	UT_ASSERT_EQUAL(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+	UT_ASSERT_EQUAL(9, send(sv[0], "DEADBEEF", 9, 0));
+	test_retries = 0;
+	XACT_BEGIN(xact_1)
+		XACT_WAIVER {
+			memset(buf, 0, 128);
+		}
+		_XCALL(x_recv)(sv[1], buf, 9, 0, NULL);
+		XACT_WAIVER {
+			/* Aborted transactions must not lose received bytes */
+			UT_ASSERT_EQUAL(0, strcmp(buf, "DEADBEEF"));
+			if (test_retries++ <= 8) {
+				XACT_ABORT(TXC_ABORTREASON_USERRETRY);	
+			}
+		}
+	XACT_END(xact_1)
+	UT_ASSERT_EQUAL(0, strcmp(buf, "DEADBEEF"));
+	UT_ASSERT_EQUAL(-1, _XCALL(x_recv)(sv[1], buf, 128, MSG_DONTWAIT, NULL));
+}
+UT_END_TEST
+
+
+UT_START_TEST(test4)
+{
+	int          sv[2];
+	char         buf[128];
+	int          ret;
+
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_global_init());
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_thread_init());
+
+	UT_ASSERT_EQUAL(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+	UT_ASSERT_EQUAL(9, send(sv[0], "DEADBEEF", 9, 0));
+	memset(buf, 0, 128);
+	XACT_BEGIN(xact_1)
+		ret = _XCALL(x_recv)(sv[1], buf, 4, 0, NULL);
+	XACT_END(xact_1)
+	UT_ASSERT_EQUAL(4, ret);
+	UT_ASSERT_EQUAL(0, strcmp(buf, "DEAD"));
+
+	/* The remaining bytes were buffered by the previous transaction */
+	XACT_BEGIN(xact_2)
+		ret = _XCALL(x_recv)(sv[1], buf, 128, 0, NULL);
+	XACT_END(xact_2)
+	UT_ASSERT_EQUAL(5, ret);
+	UT_ASSERT_EQUAL(0, strcmp(buf, "BEEF"));
+}
+UT_END_TEST
+
+
+int
+main(int argc, char *argv[])
+{
+	ut_suite_t *suite;
+	ut_suite_create(&suite, "test_x_socket_stream");
+	ut_suite_add_test(suite, "test1", test1);
+	ut_suite_add_test(suite, "test2", test2);
+	ut_suite_add_test(suite, "test3", test3);
+	ut_suite_add_test(suite, "test4", test4);
+
+	ut_suite_run_all(suite);
+}
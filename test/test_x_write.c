@@ -32,12 +32,16 @@
 #include <txc/txc.h>
 #include <misc/result.h>
 #include <core/tx.h>
+#include <core/txdesc.h>
 #include <core/sentinel.h>
 #include <core/koa.h>
+#include <core/config.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
 #include "util/ut.h"
 #include "util/ut_file.h"
 
@@ -421,6 +425,306 @@ UT_START_TEST(test7)
 UT_END_TEST
 
 
+/* 
+ * Overwrite more data than fit in the linear buffer, so that the old data
+ * are spilled to a file, and abort.
+ */
+UT_START_TEST(test8)
+{
+	txc_tx_t     *txd;
+	int          fd;
+	int          result;
+	int          ret;
+	char         *initial_contents;
+	char         *new_contents;
+	int          len = 3*1024*1024;
+	int          i;
+
+
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_global_init());
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_thread_init());
+
+	txd = txc_tx_get_txd();
+
+	initial_contents = (char *) malloc(len + 1);
+	new_contents = (char *) malloc(len);
+	for (i=0; i<len; i++) {
+		initial_contents[i] = 'a' + i % 26;
+		new_contents[i] = 'A' + i % 26;
+	}
+	initial_contents[len] = '\0';
+	UT_ASSERT_EQUAL(0, create_file(test_file, initial_contents));
+
+	fd = _XCALL(x_open)(test_file, O_RDWR, S_IRUSR|S_IWUSR, NULL);
+	XACT_BEGIN(xact_1)
+		ret = _XCALL(x_write_ovr_save)(fd, new_contents, 1024, &result);
+		ret = _XCALL(x_write_ovr_save)(fd, new_contents, len - 2048, &result);
+		XACT_WAIVER {
+			UT_ASSERT_EQUAL(len - 2048, ret);
+		}
+		XACT_ABORT(TXC_ABORTREASON_USERABORT);	
+	XACT_END(xact_1)
+	UT_ASSERT_EQUAL(TXC_R_FAILURE, SENTINEL_ENLISTED(txd, FD2SENTINEL(fd)));
+	UT_ASSERT_EQUAL(UT_TRUE, file_equal_str(test_file, initial_contents));
+	free(initial_contents);
+	free(new_contents);
+}
+UT_END_TEST
+
+
+/* 
+ * Deferred writes are read back by the transaction but reach the file 
+ * only on commit.
+ */
+UT_START_TEST(test9)
+{
+	txc_tx_t     *txd;
+	int          fd;
+	int          result;
+	int          ret;
+	char         buf[16];
+
+
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_global_init());
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_thread_init());
+
+	txd = txc_tx_get_txd();
+
+	UT_ASSERT_EQUAL(0, create_file(test_file, "0123456789"));
+
+	fd = _XCALL(x_open)(test_file, O_RDWR, S_IRUSR|S_IWUSR, NULL);
+	XACT_BEGIN(xact_1)
+		ret = _XCALL(x_write_deferred)(fd, "ABC", 3, &result);
+		_XCALL(x_lseek)(fd, 2, SEEK_SET, &result);
+		ret = _XCALL(x_write_deferred)(fd, "XY", 2, &result);
+		_XCALL(x_lseek)(fd, 10, SEEK_SET, &result);
+		ret = _XCALL(x_write_deferred)(fd, "END", 3, &result);
+		_XCALL(x_lseek)(fd, 0, SEEK_SET, &result);
+		ret = _XCALL(x_read)(fd, buf, sizeof(buf), &result);
+		XACT_WAIVER {
+			UT_ASSERT_EQUAL(13, ret);
+			UT_ASSERT_EQUAL(0, memcmp(buf, "ABXY456789END", 13));
+			UT_ASSERT_EQUAL(13, _XCALL(x_lseek)(fd, 0, SEEK_END, &result));
+			UT_ASSERT_EQUAL(UT_TRUE, file_equal_str(test_file, "0123456789"));
+		}
+	XACT_END(xact_1)
+	UT_ASSERT_EQUAL(TXC_R_FAILURE, SENTINEL_ENLISTED(txd, FD2SENTINEL(fd)));
+	UT_ASSERT_EQUAL(UT_TRUE, file_equal_str(test_file, "ABXY456789END"));
+}
+UT_END_TEST
+
+
+/* 
+ * Aborting deferred writes leaves the file and its offset untouched.
+ */
+UT_START_TEST(test10)
+{
+	txc_tx_t     *txd;
+	int          fd;
+	int          result;
+	int          ret;
+
+
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_global_init());
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_thread_init());
+
+	txd = txc_tx_get_txd();
+
+	UT_ASSERT_EQUAL(0, create_file(test_file, "0123456789"));
+
+	fd = _XCALL(x_open)(test_file, O_RDWR, S_IRUSR|S_IWUSR, NULL);
+	XACT_BEGIN(xact_1)
+		ret = _XCALL(x_write_deferred)(fd, "DEADBEEF", 8, &result);
+		ret = _XCALL(x_write_deferred)(fd, "MADCOW", 6, &result);
+		XACT_ABORT(TXC_ABORTREASON_USERABORT);	
+	XACT_END(xact_1)
+	UT_ASSERT_EQUAL(TXC_R_FAILURE, SENTINEL_ENLISTED(txd, FD2SENTINEL(fd)));
+	UT_ASSERT_EQUAL(0, lseek(fd, 0, SEEK_CUR));
+	UT_ASSERT_EQUAL(UT_TRUE, file_equal_str(test_file, "0123456789"));
+}
+UT_END_TEST
+
+
+/* 
+ * A run of appends registers a single undo action and is undone as a
+ * whole.
+ */
+UT_START_TEST(test11)
+{
+	txc_tx_t     *txd;
+	int          fd;
+	int          result;
+	int          ret;
+	int          i;
+	unsigned int num_undo_actions;
+
+
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_global_init());
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_thread_init());
+
+	txd = txc_tx_get_txd();
+
+	UT_ASSERT_EQUAL(0, create_file(test_file, "0123456789"));
+
+	fd = _XCALL(x_open)(test_file, O_RDWR, S_IRUSR|S_IWUSR, NULL);
+	XACT_BEGIN(xact_1)
+		_XCALL(x_lseek)(fd, 0, SEEK_END, &result);
+		ret = _XCALL(x_write_seq)(fd, "DEADBEEF", 8, &result);
+		XACT_WAIVER {
+			num_undo_actions = txd->undo_action_list->num_entries;
+		}
+		for (i=0; i<100; i++) {
+			ret = _XCALL(x_write_seq)(fd, "MADCOW", 6, &result);
+		}
+		XACT_WAIVER {
+			UT_ASSERT_EQUAL(num_undo_actions, txd->undo_action_list->num_entries);
+			UT_ASSERT_EQUAL(10+8+600, _XCALL(x_lseek)(fd, 0, SEEK_END, &result));
+		}
+		XACT_ABORT(TXC_ABORTREASON_USERABORT);	
+	XACT_END(xact_1)
+	UT_ASSERT_EQUAL(TXC_R_FAILURE, SENTINEL_ENLISTED(txd, FD2SENTINEL(fd)));
+	UT_ASSERT_EQUAL(0, lseek(fd, 0, SEEK_CUR));
+	UT_ASSERT_EQUAL(UT_TRUE, file_equal_str(test_file, "0123456789"));
+}
+UT_END_TEST
+
+
+/* 
+ * Overwrite more data than buffer_linear_clone_size, so that the old data 
+ * are cloned next to the file, and abort.
+ */
+UT_START_TEST(test12)
+{
+	txc_tx_t     *txd;
+	int          fd;
+	int          result;
+	int          ret;
+	char         *initial_contents;
+	char         *new_contents;
+	int          len = 6*1024*1024;
+	int          i;
+
+
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_global_init());
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_thread_init());
+
+	txd = txc_tx_get_txd();
+
+	initial_contents = (char *) malloc(len + 1);
+	new_contents = (char *) malloc(len);
+	for (i=0; i<len; i++) {
+		initial_contents[i] = 'a' + i % 26;
+		new_contents[i] = 'A' + i % 26;
+	}
+	initial_contents[len] = '\0';
+	UT_ASSERT_EQUAL(0, create_file(test_file, initial_contents));
+
+	fd = _XCALL(x_open)(test_file, O_RDWR, S_IRUSR|S_IWUSR, NULL);
+	XACT_BEGIN(xact_1)
+		_XCALL(x_lseek)(fd, 4096, SEEK_SET, &result);
+		ret = _XCALL(x_write_ovr_save)(fd, new_contents, len, &result);
+		XACT_WAIVER {
+			UT_ASSERT_EQUAL(len, ret);
+		}
+		XACT_ABORT(TXC_ABORTREASON_USERABORT);	
+	XACT_END(xact_1)
+	UT_ASSERT_EQUAL(TXC_R_FAILURE, SENTINEL_ENLISTED(txd, FD2SENTINEL(fd)));
+	UT_ASSERT_EQUAL(UT_TRUE, file_equal_str(test_file, initial_contents));
+	free(initial_contents);
+	free(new_contents);
+}
+UT_END_TEST
+
+
+/* 
+ * Flushes of a descriptor requested several times by a transaction are 
+ * merged into one, issued at commit.
+ */
+UT_START_TEST(test13)
+{
+	txc_tx_t     *txd;
+	int          fd;
+	int          result;
+	int          sync_result;
+	int          ret;
+	unsigned int num_commit_actions;
+
+
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_global_init());
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_thread_init());
+
+	txd = txc_tx_get_txd();
+
+	UT_ASSERT_EQUAL(0, create_file(test_file, "0123456789"));
+
+	fd = _XCALL(x_open)(test_file, O_RDWR, S_IRUSR|S_IWUSR, NULL);
+	sync_result = -1;
+	XACT_BEGIN(xact_1)
+		_XCALL(x_lseek)(fd, 0, SEEK_END, &result);
+		ret = _XCALL(x_write_seq)(fd, "DEADBEEF", 8, &result);
+		ret = _XCALL(x_fdatasync)(fd, &sync_result);
+		XACT_WAIVER {
+			num_commit_actions = txd->commit_action_list->num_entries;
+		}
+		ret = _XCALL(x_write_seq)(fd, "MADCOW", 6, &result);
+		ret = _XCALL(x_fsync)(fd, &result);
+		ret = _XCALL(x_fdatasync)(fd, &result);
+		XACT_WAIVER {
+			UT_ASSERT_EQUAL(num_commit_actions, txd->commit_action_list->num_entries);
+		}
+	XACT_END(xact_1)
+	UT_ASSERT_EQUAL(0, sync_result);
+	UT_ASSERT_EQUAL(TXC_R_FAILURE, SENTINEL_ENLISTED(txd, FD2SENTINEL(fd)));
+	UT_ASSERT_EQUAL(UT_TRUE, file_equal_str(test_file, "0123456789DEADBEEFMADCOW"));
+}
+UT_END_TEST
+
+
+/* 
+ * Deferred writes of more runs than fit in one io_uring submission reach
+ * the file whether the ring is used, unavailable or disabled.
+ */
+UT_START_TEST(test14)
+{
+	txc_tx_t     *txd;
+	int          fd;
+	int          result;
+	int          ret;
+	int          i;
+	int          use_uring;
+	char         initial_contents[129];
+	char         expected_contents[129];
+
+
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_global_init());
+	UT_ASSERT_EQUAL(TXC_R_SUCCESS, _TXC_thread_init());
+
+	txd = txc_tx_get_txd();
+
+	for (use_uring = 0; use_uring < 2; use_uring++) {
+		txc_runtime_settings.io_uring = use_uring ? TXC_BOOL_TRUE : TXC_BOOL_FALSE;
+		memset(initial_contents, '.', 128);
+		initial_contents[128] = '\0';
+		strcpy(expected_contents, initial_contents);
+		UT_ASSERT_EQUAL(0, create_file(test_file, initial_contents));
+
+		fd = _XCALL(x_open)(test_file, O_RDWR, S_IRUSR|S_IWUSR, NULL);
+		XACT_BEGIN(xact_1)
+			/* Every other byte, so that each write is a run of its own. */
+			for (i=0; i<64; i++) {
+				_XCALL(x_lseek)(fd, 2*i, SEEK_SET, &result);
+				ret = _XCALL(x_write_deferred)(fd, "X", 1, &result);
+			}
+		XACT_END(xact_1)
+		for (i=0; i<64; i++) {
+			expected_contents[2*i] = 'X';
+		}
+		UT_ASSERT_EQUAL(UT_TRUE, file_equal_str(test_file, expected_contents));
+		_XCALL(x_close)(fd, NULL);
+	}
+	txc_runtime_settings.io_uring = TXC_BOOL_FALSE;
+}
+UT_END_TEST
 
 
 int
@@ -435,6 +739,13 @@ main(int argc, char *argv[])
 	ut_suite_add_test(suite, "test5", test5);
 	ut_suite_add_test(suite, "test6", test6);
 	ut_suite_add_test(suite, "test7", test7);
+	ut_suite_add_test(suite, "test8", test8);
+	ut_suite_add_test(suite, "test9", test9);
+	ut_suite_add_test(suite, "test10", test10);
+	ut_suite_add_test(suite, "test11", test11);
+	ut_suite_add_test(suite, "test12", test12);
+	ut_suite_add_test(suite, "test13", test13);
+	ut_suite_add_test(suite, "test14", test14);
 
 	test_file_initial_contents = str_create2(test_file_initial_contents_tbl);
 